@@ -0,0 +1,423 @@
+// ============================================================================
+// adc_bench.c - ADC 擷取效能與雜訊基準測試模組實作
+// 功能：測試任務以最低的非閒置優先順序執行，單次模式每 10 ms 讓出一次 CPU，
+//       連續模式以 soil_sensor_acquire() 短暫獨佔 ADC (其他讀取端只會延遲，不會失敗)
+// ============================================================================
+
+#include "adc_bench.h"
+#include "soil_sensor.h"
+#include "telemetry_transport.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_adc/adc_continuous.h"
+#include "cJSON.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define BENCH_TASK_STACK_SIZE       4096
+#define BENCH_TASK_PRIORITY         (tskIDLE_PRIORITY + 1)  // 低於所有正常工作任務
+#define BENCH_SLICE_US              10000   // 單次模式連續忙碌的最長時間，之後讓出一個 tick
+#define BENCH_FRAME_BYTES           256     // 連續模式每次讀取的 DMA 訊框大小
+#define BENCH_ACQUIRE_TIMEOUT_MS    2000    // 等待 ADC 獨佔權的時間
+#define BENCH_TARGET_NOISE_PERMILLE 1       // 建議採樣次數的目標雜訊 (濕度 0.1%)
+#define BENCH_MAX_SAMPLE_COUNT      64      // 建議採樣次數上限
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "ADC_BENCH";
+
+// ============================================================================
+// 單一模式的統計累加器
+// ============================================================================
+typedef struct {
+    uint32_t count;
+    double mean;                // Welford 線上平均
+    double m2;                  // Welford 平方差累積
+    int min_code;
+    int max_code;
+    int hist_start;             // 直方圖第一格對應的原始碼 (以第一個樣本置中)
+    uint32_t hist[ADC_BENCH_HIST_BINS];
+    uint32_t under;             // 低於直方圖範圍的樣本數
+    uint32_t over;              // 高於直方圖範圍的樣本數
+    int64_t busy_us;            // 實際擷取時間 (不含讓出 CPU 的時間)
+    int64_t wall_us;            // 總經過時間
+    int64_t lat_min_us;         // 單次讀取 (或單一 DMA 訊框) 延遲
+    int64_t lat_max_us;
+    int64_t lat_sum_us;
+    uint32_t lat_count;
+} bench_acc_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static const char *result_topic = NULL;
+static portMUX_TYPE bench_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool running = false;
+static adc_bench_mode_t bench_mode;
+static uint32_t bench_duration_ms;
+static bench_acc_t oneshot_acc;
+static bench_acc_t continuous_acc;
+static uint8_t frame_buffer[BENCH_FRAME_BYTES];
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void adc_bench_task(void *pvParameters);
+static void run_oneshot(bench_acc_t *acc, uint32_t duration_ms);
+static esp_err_t run_continuous(bench_acc_t *acc, uint32_t duration_ms);
+static void acc_reset(bench_acc_t *acc);
+static void acc_add_sample(bench_acc_t *acc, int code);
+static void acc_add_latency(bench_acc_t *acc, int64_t latency_us);
+static cJSON *acc_to_json(const bench_acc_t *acc);
+static void publish_results(esp_err_t continuous_err);
+
+// ============================================================================
+// 初始化與參數解析
+// ============================================================================
+esp_err_t adc_bench_init(const char* topic)
+{
+    if (topic == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    result_topic = topic;
+    return ESP_OK;
+}
+
+esp_err_t adc_bench_parse_args(const char* args, adc_bench_mode_t* mode, uint32_t* duration_ms)
+{
+    *mode = ADC_BENCH_MODE_BOTH;
+    *duration_ms = ADC_BENCH_DEFAULT_DURATION_MS;
+
+    if (args == NULL || args[0] == '\0') {
+        return ESP_OK;
+    }
+
+    const char *duration = strchr(args, ':');
+    size_t mode_len = duration != NULL ? (size_t)(duration - args) : strlen(args);
+
+    if (mode_len == 0 || strncmp(args, "both", mode_len) == 0) {
+        *mode = ADC_BENCH_MODE_BOTH;
+    } else if (strncmp(args, "oneshot", mode_len) == 0) {
+        *mode = ADC_BENCH_MODE_ONESHOT;
+    } else if (strncmp(args, "continuous", mode_len) == 0) {
+        *mode = ADC_BENCH_MODE_CONTINUOUS;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (duration != NULL) {
+        char *end = NULL;
+        unsigned long value = strtoul(duration + 1, &end, 10);
+        if (end == duration + 1 || *end != '\0' || value == 0 || value > ADC_BENCH_MAX_DURATION_MS) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        *duration_ms = value;
+    }
+
+    return ESP_OK;
+}
+
+// ============================================================================
+// 啟動測試
+// ============================================================================
+esp_err_t adc_bench_start(adc_bench_mode_t mode, uint32_t duration_ms)
+{
+    if (result_topic == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&bench_lock);
+    bool busy = running;
+    running = true;
+    portEXIT_CRITICAL(&bench_lock);
+
+    if (busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    bench_mode = mode;
+    bench_duration_ms = duration_ms;
+
+    if (xTaskCreate(adc_bench_task, "adc_bench", BENCH_TASK_STACK_SIZE, NULL,
+                    BENCH_TASK_PRIORITY, NULL) != pdPASS) {
+        portENTER_CRITICAL(&bench_lock);
+        running = false;
+        portEXIT_CRITICAL(&bench_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+bool adc_bench_is_running(void)
+{
+    return running;
+}
+
+// ============================================================================
+// 測試任務 (執行一次後自行刪除)
+// ============================================================================
+static void adc_bench_task(void *pvParameters)
+{
+    esp_err_t continuous_err = ESP_OK;
+
+    acc_reset(&oneshot_acc);
+    acc_reset(&continuous_acc);
+
+    ESP_LOGI(TAG, "📈 ADC 基準測試開始 (每種模式 %lu ms)", bench_duration_ms);
+
+    if (bench_mode != ADC_BENCH_MODE_CONTINUOUS) {
+        run_oneshot(&oneshot_acc, bench_duration_ms);
+    }
+    if (bench_mode != ADC_BENCH_MODE_ONESHOT) {
+        uint32_t duration_ms = bench_duration_ms > ADC_BENCH_MAX_CONTINUOUS_MS ?
+                               ADC_BENCH_MAX_CONTINUOUS_MS : bench_duration_ms;
+        continuous_err = run_continuous(&continuous_acc, duration_ms);
+    }
+
+    publish_results(continuous_err);
+
+    portENTER_CRITICAL(&bench_lock);
+    running = false;
+    portEXIT_CRITICAL(&bench_lock);
+
+    vTaskDelete(NULL);
+}
+
+// ============================================================================
+// 單次模式：與正常讀取共用互斥鎖，逐次量測 adc_oneshot_read 延遲
+// ============================================================================
+static void run_oneshot(bench_acc_t *acc, uint32_t duration_ms)
+{
+    int64_t start_us = esp_timer_get_time();
+    int64_t end_us = start_us + (int64_t)duration_ms * 1000;
+    int64_t slice_start_us = start_us;
+    int64_t now_us = start_us;
+
+    while (now_us < end_us) {
+        int raw = 0;
+        int64_t t0 = esp_timer_get_time();
+        esp_err_t err = soil_sensor_read_raw(1, &raw);
+        now_us = esp_timer_get_time();
+
+        if (err == ESP_OK) {
+            acc_add_sample(acc, raw);
+            acc_add_latency(acc, now_us - t0);
+        }
+
+        if (now_us - slice_start_us >= BENCH_SLICE_US) {
+            acc->busy_us += now_us - slice_start_us;
+            vTaskDelay(1);  // 讓出 CPU 給閒置任務 (避免觸發任務看門狗)
+            slice_start_us = now_us = esp_timer_get_time();
+        }
+    }
+
+    acc->busy_us += now_us - slice_start_us;
+    acc->wall_us = now_us - start_us;
+}
+
+// ============================================================================
+// 連續模式：暫時獨佔 ADC，以 DMA 訊框讀取
+// adc_continuous 執行期間 adc_oneshot_read 會回傳逾時，因此必須先取得獨佔權
+// ============================================================================
+static esp_err_t run_continuous(bench_acc_t *acc, uint32_t duration_ms)
+{
+    soil_sensor_config_t sensor_config;
+    soil_sensor_get_config(&sensor_config);
+
+    esp_err_t err = soil_sensor_acquire(pdMS_TO_TICKS(BENCH_ACQUIRE_TIMEOUT_MS));
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    adc_continuous_handle_t handle = NULL;
+    adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = BENCH_FRAME_BYTES * 4,
+        .conv_frame_size = BENCH_FRAME_BYTES,
+    };
+    err = adc_continuous_new_handle(&handle_config, &handle);
+    if (err != ESP_OK) {
+        soil_sensor_release();
+        return err;
+    }
+
+    adc_digi_pattern_config_t pattern = {
+        .atten = ADC_ATTEN_DB_12,
+        .channel = sensor_config.channel,
+        .unit = ADC_UNIT_1,
+        .bit_width = ADC_BITWIDTH_12,
+    };
+    adc_continuous_config_t dig_config = {
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = ADC_BENCH_CONTINUOUS_FREQ_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,     // ESP32-C3 的 DMA 輸出格式
+    };
+
+    err = adc_continuous_config(handle, &dig_config);
+    if (err == ESP_OK) {
+        err = adc_continuous_start(handle);
+    }
+
+    if (err == ESP_OK) {
+        int64_t start_us = esp_timer_get_time();
+        int64_t end_us = start_us + (int64_t)duration_ms * 1000;
+        int64_t now_us = start_us;
+
+        while (now_us < end_us) {
+            uint32_t out_len = 0;
+            int64_t t0 = esp_timer_get_time();
+            esp_err_t read_err = adc_continuous_read(handle, frame_buffer, sizeof(frame_buffer), &out_len, 100);
+            now_us = esp_timer_get_time();
+            if (read_err != ESP_OK) {
+                continue;
+            }
+
+            acc_add_latency(acc, now_us - t0);
+            for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= out_len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+                adc_digi_output_data_t *p = (adc_digi_output_data_t *)&frame_buffer[i];
+                if (p->type2.channel == sensor_config.channel) {
+                    acc_add_sample(acc, p->type2.data);
+                }
+            }
+        }
+
+        acc->wall_us = now_us - start_us;
+        acc->busy_us = acc->wall_us;
+        adc_continuous_stop(handle);
+    }
+
+    adc_continuous_deinit(handle);
+    soil_sensor_release();
+    return err;
+}
+
+// ============================================================================
+// 統計累加器
+// ============================================================================
+static void acc_reset(bench_acc_t *acc)
+{
+    memset(acc, 0, sizeof(bench_acc_t));
+    acc->lat_min_us = INT64_MAX;
+}
+
+static void acc_add_sample(bench_acc_t *acc, int code)
+{
+    if (acc->count == 0) {
+        acc->min_code = acc->max_code = code;
+        acc->hist_start = code - ADC_BENCH_HIST_BINS / 2;
+    }
+
+    acc->count++;
+    double delta = code - acc->mean;
+    acc->mean += delta / acc->count;
+    acc->m2 += delta * (code - acc->mean);
+
+    if (code < acc->min_code) acc->min_code = code;
+    if (code > acc->max_code) acc->max_code = code;
+
+    int bin = code - acc->hist_start;
+    if (bin < 0) {
+        acc->under++;
+    } else if (bin >= ADC_BENCH_HIST_BINS) {
+        acc->over++;
+    } else {
+        acc->hist[bin]++;
+    }
+}
+
+static void acc_add_latency(bench_acc_t *acc, int64_t latency_us)
+{
+    if (latency_us < acc->lat_min_us) acc->lat_min_us = latency_us;
+    if (latency_us > acc->lat_max_us) acc->lat_max_us = latency_us;
+    acc->lat_sum_us += latency_us;
+    acc->lat_count++;
+}
+
+static double acc_stddev(const bench_acc_t *acc)
+{
+    return acc->count > 1 ? sqrt(acc->m2 / (acc->count - 1)) : 0;
+}
+
+static cJSON *acc_to_json(const bench_acc_t *acc)
+{
+    cJSON *json = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(json, "samples", acc->count);
+    cJSON_AddNumberToObject(json, "rate_sps", acc->busy_us > 0 ? acc->count * 1e6 / acc->busy_us : 0);
+    cJSON_AddNumberToObject(json, "wall_rate_sps", acc->wall_us > 0 ? acc->count * 1e6 / acc->wall_us : 0);
+    cJSON_AddNumberToObject(json, "latency_min_us", acc->lat_count > 0 ? acc->lat_min_us : 0);
+    cJSON_AddNumberToObject(json, "latency_avg_us", acc->lat_count > 0 ? (double)acc->lat_sum_us / acc->lat_count : 0);
+    cJSON_AddNumberToObject(json, "latency_max_us", acc->lat_max_us);
+    cJSON_AddNumberToObject(json, "mean", acc->mean);
+    cJSON_AddNumberToObject(json, "stddev", acc_stddev(acc));
+    cJSON_AddNumberToObject(json, "p2p", acc->max_code - acc->min_code);
+    cJSON_AddNumberToObject(json, "min", acc->min_code);
+    cJSON_AddNumberToObject(json, "max", acc->max_code);
+
+    cJSON *hist = cJSON_AddObjectToObject(json, "histogram");
+    cJSON_AddNumberToObject(hist, "start", acc->hist_start);
+    cJSON_AddNumberToObject(hist, "under", acc->under);
+    cJSON_AddNumberToObject(hist, "over", acc->over);
+    cJSON *bins = cJSON_AddArrayToObject(hist, "bins");
+    for (int i = 0; i < ADC_BENCH_HIST_BINS; i++) {
+        cJSON_AddItemToArray(bins, cJSON_CreateNumber(acc->hist[i]));
+    }
+
+    return json;
+}
+
+// ============================================================================
+// 發布結果
+// ============================================================================
+static void publish_results(esp_err_t continuous_err)
+{
+    soil_sensor_config_t sensor_config;
+    soil_sensor_get_config(&sensor_config);
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "type", "adc_bench");
+    cJSON_AddNumberToObject(json, "duration_ms", bench_duration_ms);
+    cJSON_AddNumberToObject(json, "current_sample_count", sensor_config.sample_count);
+
+    if (oneshot_acc.count > 0) {
+        cJSON_AddItemToObject(json, "oneshot", acc_to_json(&oneshot_acc));
+
+        // 平均 N 次後雜訊降為 σ/√N：求達到目標雜訊 (濕度 0.1%) 所需的 N
+        double target_codes = abs(sensor_config.air_value - sensor_config.water_value) *
+                              BENCH_TARGET_NOISE_PERMILLE / 1000.0;
+        double ratio = acc_stddev(&oneshot_acc) / target_codes;
+        int recommended = (int)ceil(ratio * ratio);
+        if (recommended < 1) recommended = 1;
+        if (recommended > BENCH_MAX_SAMPLE_COUNT) recommended = BENCH_MAX_SAMPLE_COUNT;
+        cJSON_AddNumberToObject(json, "recommended_sample_count", recommended);
+    }
+    if (continuous_acc.count > 0) {
+        cJSON *continuous = acc_to_json(&continuous_acc);
+        cJSON_AddNumberToObject(continuous, "sample_freq_hz", ADC_BENCH_CONTINUOUS_FREQ_HZ);
+        cJSON_AddItemToObject(json, "continuous", continuous);
+    }
+    if (continuous_err != ESP_OK) {
+        cJSON_AddStringToObject(json, "continuous_error", esp_err_to_name(continuous_err));
+    }
+
+    char *json_string = cJSON_PrintUnformatted(json);
+    if (json_string != NULL) {
+        telemetry_publish(result_topic, json_string, 0, 1, 0);
+        free(json_string);
+    }
+    cJSON_Delete(json);
+
+    ESP_LOGI(TAG, "📊 ADC 基準測試完成 - 單次: %lu 筆 σ=%.2f，連續: %lu 筆 σ=%.2f",
+             oneshot_acc.count, acc_stddev(&oneshot_acc),
+             continuous_acc.count, acc_stddev(&continuous_acc));
+}
@@ -0,0 +1,68 @@
+// ============================================================================
+// adc_bench.h - ADC 擷取效能與雜訊基準測試模組標頭檔
+// 功能：以單次 (oneshot) 與連續 (DMA) 模式做定時擷取，量測吞吐量、單次讀取延遲、
+//       雜訊 (標準差、峰對峰值) 與原始碼直方圖，依實測雜訊建議 SAMPLE_COUNT
+// ============================================================================
+
+#ifndef ADC_BENCH_H
+#define ADC_BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define ADC_BENCH_DEFAULT_DURATION_MS   1000    // 預設每種模式的量測時間
+#define ADC_BENCH_MAX_DURATION_MS       10000   // 單次模式量測時間上限
+#define ADC_BENCH_MAX_CONTINUOUS_MS     500     // 連續模式獨佔 ADC 的時間上限
+#define ADC_BENCH_CONTINUOUS_FREQ_HZ    20000   // 連續模式取樣頻率
+#define ADC_BENCH_HIST_BINS             32      // 直方圖格數 (每格 1 個原始碼)
+
+// ============================================================================
+// 量測模式
+// ============================================================================
+typedef enum {
+    ADC_BENCH_MODE_BOTH = 0,        // 先單次、後連續
+    ADC_BENCH_MODE_ONESHOT,         // 僅 adc_oneshot
+    ADC_BENCH_MODE_CONTINUOUS,      // 僅 adc_continuous (DMA)
+} adc_bench_mode_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化基準測試模組
+ *
+ * @param result_topic 結果發布主題
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t adc_bench_init(const char* result_topic);
+
+/**
+ * @brief 解析指令參數，格式為 "[oneshot|continuous|both][:<毫秒>]"，例如 "oneshot:2000"
+ *
+ * @param args 指令參數 (可為 NULL 或空字串，使用預設值)
+ * @param mode 解析出的模式
+ * @param duration_ms 解析出的每種模式量測時間
+ * @return esp_err_t ESP_ERR_INVALID_ARG 表示格式錯誤
+ */
+esp_err_t adc_bench_parse_args(const char* args, adc_bench_mode_t* mode, uint32_t* duration_ms);
+
+/**
+ * @brief 在低優先順序任務中啟動基準測試 (立即返回，結果完成後發布)
+ *
+ * @param mode 量測模式
+ * @param duration_ms 每種模式的量測時間 (連續模式上限 ADC_BENCH_MAX_CONTINUOUS_MS)
+ * @return esp_err_t ESP_ERR_INVALID_STATE 表示已有測試在執行
+ */
+esp_err_t adc_bench_start(adc_bench_mode_t mode, uint32_t duration_ms);
+
+/**
+ * @brief 檢查是否有基準測試正在執行
+ */
+bool adc_bench_is_running(void);
+
+#endif // ADC_BENCH_H
@@ -0,0 +1,569 @@
+// ============================================================================
+// coap_client.c - 精簡 CoAP (RFC 7252) over UDP 客戶端實作
+// 功能：訊息編碼/解碼、Confirmable 重傳與 ACK 等待、Piggybacked 與 Separate 回應、
+//       超過單一區塊的 POST 以 Block1 (RFC 7959) 分塊傳送
+// ============================================================================
+
+#include "coap_client.h"
+#include <string.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+
+// ============================================================================
+// 協定常數定義 (RFC 7252)
+// ============================================================================
+#define COAP_VERSION                1
+#define COAP_TYPE_CON               0       // Confirmable
+#define COAP_TYPE_NON               1       // Non-confirmable
+#define COAP_TYPE_ACK               2       // Acknowledgement
+#define COAP_TYPE_RST               3       // Reset
+#define COAP_METHOD_GET             0x01    // 0.01 GET
+#define COAP_METHOD_POST            0x02    // 0.02 POST
+#define COAP_OPTION_URI_PATH        11
+#define COAP_OPTION_CONTENT_FORMAT  12
+#define COAP_OPTION_BLOCK1          27      // RFC 7959
+#define COAP_CONTENT_FORMAT_JSON    50      // application/json
+#define COAP_PAYLOAD_MARKER         0xFF
+#define COAP_HEADER_SIZE            4
+#define COAP_TOKEN_LEN              4
+
+// ============================================================================
+// 傳輸參數 (比 RFC 預設略短，避免阻塞感測器任務太久)
+// ============================================================================
+#define COAP_ACK_TIMEOUT_MS         2000    // 第一次等待 ACK 的時間
+#define COAP_MAX_RETRANSMIT         3       // 最大重傳次數
+#define COAP_SEPARATE_TIMEOUT_MS    5000    // 等待 Separate 回應的時間
+#define COAP_MAX_MESSAGE_SIZE       1152    // 收發緩衝區大小
+#define COAP_BLOCK_SZX              5       // Block1 區塊大小指數：16 << 5 = COAP_CLIENT_BLOCK_SIZE
+#define COAP_BLOCK_SIZE             COAP_CLIENT_BLOCK_SIZE
+#define COAP_NO_BLOCK               (-1)    // 不附加 Block1 選項
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "COAP_CLIENT";
+
+// ============================================================================
+// 內部結構定義
+// ============================================================================
+typedef struct {
+    uint8_t type;
+    uint8_t code;
+    uint16_t message_id;
+    uint8_t token_len;
+    uint32_t token;
+    const uint8_t *payload;
+    size_t payload_len;
+} coap_message_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static char server_host[64];
+static uint16_t server_port = 5683;
+static struct sockaddr_in server_addr;
+static bool server_resolved = false;
+static int coap_sock = -1;
+static uint16_t next_message_id = 0;
+static SemaphoreHandle_t coap_mutex = NULL;
+static coap_client_stats_t coap_stats = {0};
+static uint8_t tx_buffer[COAP_MAX_MESSAGE_SIZE];
+static uint8_t rx_buffer[COAP_MAX_MESSAGE_SIZE];
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static esp_err_t coap_ensure_socket(void);
+static int coap_write_option(uint8_t *out, size_t out_size, uint16_t delta, const uint8_t *value, size_t len);
+static int coap_build_message(uint8_t type, uint8_t code, uint16_t message_id, uint32_t token,
+                              const char *path, bool json, int32_t block1,
+                              const uint8_t *payload, size_t payload_len);
+static bool coap_parse_message(const uint8_t *buf, size_t len, coap_message_t *msg);
+static void coap_send_empty_ack(uint16_t message_id);
+static esp_err_t coap_transaction(uint8_t type, uint8_t method, const char *path, bool json, int32_t block1,
+                                  const uint8_t *payload, size_t payload_len,
+                                  uint8_t *resp_buf, size_t resp_size, size_t *resp_len, uint8_t *resp_code);
+static esp_err_t coap_post_blockwise(const char *path, const uint8_t *payload, size_t len);
+
+// ============================================================================
+// 初始化 CoAP 客戶端
+// ============================================================================
+esp_err_t coap_client_init(const char* host, uint16_t port)
+{
+    if (host == NULL || strlen(host) == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (coap_mutex == NULL) {
+        coap_mutex = xSemaphoreCreateRecursiveMutex();
+        if (coap_mutex == NULL) {
+            ESP_LOGE(TAG, "無法建立 CoAP 互斥鎖");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    strncpy(server_host, host, sizeof(server_host) - 1);
+    server_host[sizeof(server_host) - 1] = '\0';
+    server_port = port;
+    server_resolved = false;
+    next_message_id = (uint16_t)esp_random();
+
+    ESP_LOGI(TAG, "✅ CoAP 客戶端初始化完成 - 伺服器 %s:%u", server_host, server_port);
+    return ESP_OK;
+}
+
+// ============================================================================
+// POST 資料 (CON 或 NON)
+// ============================================================================
+esp_err_t coap_client_post(const char* path, const uint8_t* payload, size_t len, bool confirmable)
+{
+    if (len > COAP_CLIENT_MAX_PAYLOAD) {
+        ESP_LOGE(TAG, "❌ POST %s 資料 %u bytes 超過上限 %d bytes", path, (unsigned)len, COAP_CLIENT_MAX_PAYLOAD);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (len > COAP_BLOCK_SIZE) {
+        // 分塊需要伺服器逐塊回覆 2.31 Continue，NON 訊息也改以 CON 傳送
+        return coap_post_blockwise(path, payload, len);
+    }
+
+    uint8_t code = 0;
+    esp_err_t err = coap_transaction(confirmable ? COAP_TYPE_CON : COAP_TYPE_NON, COAP_METHOD_POST,
+                                     path, true, COAP_NO_BLOCK, payload, len, NULL, 0, NULL, &code);
+    if (err == ESP_OK && confirmable && (code >> 5) != 2) {
+        ESP_LOGW(TAG, "⚠️ POST %s 回應碼 %d.%02d", path, code >> 5, code & 0x1F);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return err;
+}
+
+// ============================================================================
+// GET 資源 (CON)
+// ============================================================================
+esp_err_t coap_client_get(const char* path, uint8_t* buf, size_t buf_size, size_t* out_len, uint8_t* out_code)
+{
+    uint8_t code = 0;
+    esp_err_t err = coap_transaction(COAP_TYPE_CON, COAP_METHOD_GET, path, false, COAP_NO_BLOCK, NULL, 0,
+                                     buf, buf_size, out_len, &code);
+    if (out_code != NULL) {
+        *out_code = code;
+    }
+    if (err == ESP_OK && (code >> 5) != 2) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return err;
+}
+
+// ============================================================================
+// 分塊 POST (內部函數) - RFC 7959 Block1
+// 每塊以 CON 送出並等待 2.31 Continue，最後一塊 (M=0) 等待 2.01 / 2.04；
+// 區塊大小固定為 COAP_BLOCK_SIZE，伺服器要求更小的區塊時視為失敗；
+// 整個分塊傳送期間持有 (遞迴) 互斥鎖，避免其他任務的請求插入兩塊之間
+// ============================================================================
+static esp_err_t coap_post_blockwise(const char *path, const uint8_t *payload, size_t len)
+{
+    if (coap_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t blocks = (len + COAP_BLOCK_SIZE - 1) / COAP_BLOCK_SIZE;
+    esp_err_t err = ESP_OK;
+    xSemaphoreTakeRecursive(coap_mutex, portMAX_DELAY);
+
+    for (uint32_t num = 0; num < blocks; num++) {
+        size_t offset = (size_t)num * COAP_BLOCK_SIZE;
+        size_t block_len = len - offset < COAP_BLOCK_SIZE ? len - offset : COAP_BLOCK_SIZE;
+        bool more = num + 1 < blocks;
+        int32_t block1 = (int32_t)((num << 4) | (more ? 0x08 : 0) | COAP_BLOCK_SZX);
+
+        uint8_t code = 0;
+        err = coap_transaction(COAP_TYPE_CON, COAP_METHOD_POST, path, true, block1,
+                               payload + offset, block_len, NULL, 0, NULL, &code);
+        if (err != ESP_OK) {
+            break;
+        }
+
+        bool ok = more ? code == COAP_CODE_CONTINUE : (code >> 5) == 2;
+        if (!ok) {
+            ESP_LOGW(TAG, "⚠️ POST %s 區塊 %lu/%lu 回應碼 %d.%02d", path, num + 1, blocks, code >> 5, code & 0x1F);
+            err = code == COAP_CODE_TOO_LARGE ? ESP_ERR_INVALID_SIZE : ESP_ERR_INVALID_RESPONSE;
+            break;
+        }
+    }
+
+    if (err == ESP_OK) {
+        coap_stats.blockwise_posts++;
+        ESP_LOGD(TAG, "POST %s 分 %lu 塊完成 (%u bytes)", path, blocks, (unsigned)len);
+    }
+    xSemaphoreGiveRecursive(coap_mutex);
+    return err;
+}
+
+// ============================================================================
+// 取得統計資訊
+// ============================================================================
+void coap_client_get_stats(coap_client_stats_t* stats)
+{
+    if (stats != NULL) {
+        memcpy(stats, &coap_stats, sizeof(coap_client_stats_t));
+    }
+}
+
+// ============================================================================
+// 建立 UDP socket 並解析伺服器位址 (內部函數)
+// ============================================================================
+static esp_err_t coap_ensure_socket(void)
+{
+    if (!server_resolved) {
+        struct addrinfo hints = {
+            .ai_family = AF_INET,
+            .ai_socktype = SOCK_DGRAM,
+        };
+        struct addrinfo *res = NULL;
+        char port_str[8];
+        snprintf(port_str, sizeof(port_str), "%u", server_port);
+
+        if (getaddrinfo(server_host, port_str, &hints, &res) != 0 || res == NULL) {
+            ESP_LOGW(TAG, "⚠️ DNS 解析失敗: %s", server_host);
+            return ESP_ERR_NOT_FOUND;
+        }
+        memcpy(&server_addr, res->ai_addr, sizeof(server_addr));
+        freeaddrinfo(res);
+        server_resolved = true;
+    }
+
+    if (coap_sock < 0) {
+        coap_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (coap_sock < 0) {
+            ESP_LOGE(TAG, "❌ UDP socket 建立失敗 (errno: %d)", errno);
+            return ESP_FAIL;
+        }
+    }
+
+    return ESP_OK;
+}
+
+// ============================================================================
+// 寫入單一選項 (內部函數) - 處理 delta/length 的 13/269 延伸編碼
+// ============================================================================
+static int coap_write_option(uint8_t *out, size_t out_size, uint16_t delta, const uint8_t *value, size_t len)
+{
+    uint8_t ext[4];
+    int ext_len = 0;
+    uint8_t delta_nibble;
+    uint8_t len_nibble;
+
+    if (delta < 13) {
+        delta_nibble = delta;
+    } else if (delta < 269) {
+        delta_nibble = 13;
+        ext[ext_len++] = delta - 13;
+    } else {
+        delta_nibble = 14;
+        ext[ext_len++] = (delta - 269) >> 8;
+        ext[ext_len++] = (delta - 269) & 0xFF;
+    }
+
+    if (len < 13) {
+        len_nibble = len;
+    } else if (len < 269) {
+        len_nibble = 13;
+        ext[ext_len++] = len - 13;
+    } else {
+        len_nibble = 14;
+        ext[ext_len++] = (len - 269) >> 8;
+        ext[ext_len++] = (len - 269) & 0xFF;
+    }
+
+    size_t total = 1 + ext_len + len;
+    if (total > out_size) {
+        return -1;
+    }
+
+    out[0] = (delta_nibble << 4) | len_nibble;
+    memcpy(&out[1], ext, ext_len);
+    if (len > 0) {
+        memcpy(&out[1 + ext_len], value, len);
+    }
+    return (int)total;
+}
+
+// ============================================================================
+// 編碼 CoAP 訊息到 tx_buffer (內部函數)
+// 路徑以 '/' 切割為多個 Uri-Path 選項
+// ============================================================================
+static int coap_build_message(uint8_t type, uint8_t code, uint16_t message_id, uint32_t token,
+                              const char *path, bool json, int32_t block1,
+                              const uint8_t *payload, size_t payload_len)
+{
+    uint8_t *p = tx_buffer;
+    const uint8_t *end = tx_buffer + sizeof(tx_buffer);
+    uint16_t last_option = 0;
+
+    p[0] = (COAP_VERSION << 6) | (type << 4) | COAP_TOKEN_LEN;
+    p[1] = code;
+    p[2] = message_id >> 8;
+    p[3] = message_id & 0xFF;
+    memcpy(&p[4], &token, COAP_TOKEN_LEN);
+    p += COAP_HEADER_SIZE + COAP_TOKEN_LEN;
+
+    // Uri-Path 選項
+    const char *segment = path;
+    while (segment != NULL && *segment != '\0') {
+        const char *slash = strchr(segment, '/');
+        size_t seg_len = slash ? (size_t)(slash - segment) : strlen(segment);
+        if (seg_len > 0) {
+            int written = coap_write_option(p, end - p, COAP_OPTION_URI_PATH - last_option,
+                                            (const uint8_t *)segment, seg_len);
+            if (written < 0) {
+                return -1;
+            }
+            p += written;
+            last_option = COAP_OPTION_URI_PATH;
+        }
+        segment = slash ? slash + 1 : NULL;
+    }
+
+    // Content-Format 選項
+    if (json) {
+        uint8_t format = COAP_CONTENT_FORMAT_JSON;
+        int written = coap_write_option(p, end - p, COAP_OPTION_CONTENT_FORMAT - last_option, &format, 1);
+        if (written < 0) {
+            return -1;
+        }
+        p += written;
+        last_option = COAP_OPTION_CONTENT_FORMAT;
+    }
+
+    // Block1 選項 (NUM << 4 | M << 3 | SZX，以最短的大端序整數編碼)
+    if (block1 >= 0) {
+        uint8_t value[3];
+        size_t value_len = block1 > 0xFFFF ? 3 : block1 > 0xFF ? 2 : block1 > 0 ? 1 : 0;
+        for (size_t i = 0; i < value_len; i++) {
+            value[i] = (block1 >> (8 * (value_len - 1 - i))) & 0xFF;
+        }
+        int written = coap_write_option(p, end - p, COAP_OPTION_BLOCK1 - last_option, value, value_len);
+        if (written < 0) {
+            return -1;
+        }
+        p += written;
+        last_option = COAP_OPTION_BLOCK1;
+    }
+
+    // 資料內容
+    if (payload != NULL && payload_len > 0) {
+        if ((size_t)(end - p) < payload_len + 1) {
+            return -1;
+        }
+        *p++ = COAP_PAYLOAD_MARKER;
+        memcpy(p, payload, payload_len);
+        p += payload_len;
+    }
+
+    return (int)(p - tx_buffer);
+}
+
+// ============================================================================
+// 解碼 CoAP 訊息 (內部函數) - 略過所有選項，只取出標頭、token 與資料
+// ============================================================================
+static bool coap_parse_message(const uint8_t *buf, size_t len, coap_message_t *msg)
+{
+    if (len < COAP_HEADER_SIZE || (buf[0] >> 6) != COAP_VERSION) {
+        return false;
+    }
+
+    memset(msg, 0, sizeof(coap_message_t));
+    msg->type = (buf[0] >> 4) & 0x03;
+    msg->token_len = buf[0] & 0x0F;
+    msg->code = buf[1];
+    msg->message_id = (buf[2] << 8) | buf[3];
+
+    if (msg->token_len > 8 || len < COAP_HEADER_SIZE + msg->token_len) {
+        return false;
+    }
+    if (msg->token_len == COAP_TOKEN_LEN) {
+        memcpy(&msg->token, &buf[COAP_HEADER_SIZE], COAP_TOKEN_LEN);
+    }
+
+    size_t pos = COAP_HEADER_SIZE + msg->token_len;
+    while (pos < len) {
+        if (buf[pos] == COAP_PAYLOAD_MARKER) {
+            msg->payload = &buf[pos + 1];
+            msg->payload_len = len - pos - 1;
+            return true;
+        }
+
+        uint8_t delta_nibble = buf[pos] >> 4;
+        uint8_t len_nibble = buf[pos] & 0x0F;
+        pos++;
+        if (delta_nibble == 15 || len_nibble == 15) {
+            return false;
+        }
+        pos += (delta_nibble == 13) ? 1 : (delta_nibble == 14) ? 2 : 0;
+
+        size_t opt_len = len_nibble;
+        if (len_nibble == 13) {
+            if (pos >= len) return false;
+            opt_len = buf[pos] + 13;
+            pos += 1;
+        } else if (len_nibble == 14) {
+            if (pos + 1 >= len) return false;
+            opt_len = ((buf[pos] << 8) | buf[pos + 1]) + 269;
+            pos += 2;
+        }
+        pos += opt_len;
+    }
+
+    return pos == len;
+}
+
+// ============================================================================
+// 回覆空 ACK (內部函數) - 用於 Separate 回應
+// ============================================================================
+static void coap_send_empty_ack(uint16_t message_id)
+{
+    uint8_t ack[COAP_HEADER_SIZE] = {
+        (COAP_VERSION << 6) | (COAP_TYPE_ACK << 4),
+        COAP_CODE_EMPTY,
+        message_id >> 8,
+        message_id & 0xFF,
+    };
+    sendto(coap_sock, ack, sizeof(ack), 0, (struct sockaddr *)&server_addr, sizeof(server_addr));
+}
+
+// ============================================================================
+// 執行一次 CoAP 交易 (內部函數)
+// CON：指數退避重傳直到收到 ACK；若為空 ACK 則繼續等待 Separate 回應
+// NON：送出即返回
+// ============================================================================
+static esp_err_t coap_transaction(uint8_t type, uint8_t method, const char *path, bool json, int32_t block1,
+                                  const uint8_t *payload, size_t payload_len,
+                                  uint8_t *resp_buf, size_t resp_size, size_t *resp_len, uint8_t *resp_code)
+{
+    if (coap_mutex == NULL || path == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (resp_len != NULL) {
+        *resp_len = 0;
+    }
+
+    xSemaphoreTakeRecursive(coap_mutex, portMAX_DELAY);
+
+    esp_err_t err = coap_ensure_socket();
+    if (err != ESP_OK) {
+        xSemaphoreGiveRecursive(coap_mutex);
+        return err;
+    }
+
+    uint16_t message_id = next_message_id++;
+    uint32_t token = esp_random();
+    int msg_len = coap_build_message(type, method, message_id, token, path, json, block1, payload, payload_len);
+    if (msg_len < 0) {
+        ESP_LOGE(TAG, "❌ CoAP 訊息超過緩衝區大小 (%d bytes)", COAP_MAX_MESSAGE_SIZE);
+        xSemaphoreGiveRecursive(coap_mutex);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (type == COAP_TYPE_NON) {
+        int sent = sendto(coap_sock, tx_buffer, msg_len, 0, (struct sockaddr *)&server_addr, sizeof(server_addr));
+        coap_stats.non_sent++;
+        xSemaphoreGiveRecursive(coap_mutex);
+        return sent == msg_len ? ESP_OK : ESP_FAIL;
+    }
+
+    // 初始逾時：ACK_TIMEOUT × [1.0, 1.5) 的隨機值
+    uint32_t timeout_ms = COAP_ACK_TIMEOUT_MS + (esp_random() % (COAP_ACK_TIMEOUT_MS / 2));
+    int64_t start_us = esp_timer_get_time();
+    bool acked = false;
+    err = ESP_ERR_TIMEOUT;
+    coap_stats.con_sent++;
+
+    for (int attempt = 0; attempt <= COAP_MAX_RETRANSMIT && err == ESP_ERR_TIMEOUT; attempt++) {
+        if (attempt > 0) {
+            coap_stats.retransmissions++;
+            ESP_LOGD(TAG, "CoAP 重傳 #%d (mid=%u)", attempt, message_id);
+        }
+        sendto(coap_sock, tx_buffer, msg_len, 0, (struct sockaddr *)&server_addr, sizeof(server_addr));
+
+        int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+        while (esp_timer_get_time() < deadline_us) {
+            int64_t remaining_us = deadline_us - esp_timer_get_time();
+            struct timeval tv = {
+                .tv_sec = remaining_us / 1000000,
+                .tv_usec = remaining_us % 1000000,
+            };
+            setsockopt(coap_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+            int n = recvfrom(coap_sock, rx_buffer, sizeof(rx_buffer), 0, NULL, NULL);
+            if (n <= 0) {
+                break;  // 逾時
+            }
+
+            coap_message_t msg;
+            if (!coap_parse_message(rx_buffer, n, &msg)) {
+                continue;
+            }
+
+            if (msg.type == COAP_TYPE_RST && msg.message_id == message_id) {
+                coap_stats.resets++;
+                err = ESP_FAIL;
+                break;
+            }
+
+            bool is_ack = (msg.type == COAP_TYPE_ACK && msg.message_id == message_id);
+            bool is_separate = (acked && msg.type != COAP_TYPE_ACK && msg.token == token);
+            if (!is_ack && !is_separate) {
+                continue;  // 與本次交易無關的訊息
+            }
+
+            if (is_ack && !acked) {
+                acked = true;
+                coap_stats.acks_received++;
+                coap_stats.last_rtt_ms = (esp_timer_get_time() - start_us) / 1000;
+            }
+
+            if (is_ack && msg.code == COAP_CODE_EMPTY) {
+                // 空 ACK：伺服器稍後以 Separate 回應送出結果
+                deadline_us = esp_timer_get_time() + (int64_t)COAP_SEPARATE_TIMEOUT_MS * 1000;
+                continue;
+            }
+
+            if (is_separate && msg.type == COAP_TYPE_CON) {
+                coap_send_empty_ack(msg.message_id);
+            }
+
+            if (resp_code != NULL) {
+                *resp_code = msg.code;
+            }
+            err = ESP_OK;
+            if (resp_buf != NULL && resp_len != NULL && msg.payload_len > 0) {
+                *resp_len = msg.payload_len;
+                if (msg.payload_len > resp_size) {
+                    err = ESP_ERR_INVALID_SIZE;  // 不截斷，由呼叫者整則拒收
+                } else {
+                    memcpy(resp_buf, msg.payload, msg.payload_len);
+                }
+            }
+            break;
+        }
+
+        if (acked && err == ESP_ERR_TIMEOUT) {
+            break;  // 已收到 ACK 但 Separate 回應逾時，不再重傳
+        }
+        timeout_ms *= 2;
+    }
+
+    if (err == ESP_ERR_TIMEOUT) {
+        coap_stats.timeouts++;
+        ESP_LOGW(TAG, "⚠️ CoAP %s 逾時 (mid=%u)", path, message_id);
+    }
+
+    xSemaphoreGiveRecursive(coap_mutex);
+    return err;
+}
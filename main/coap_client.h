@@ -0,0 +1,93 @@
+// ============================================================================
+// coap_client.h - 精簡 CoAP (RFC 7252) over UDP 客戶端標頭檔
+// 功能：提供 Confirmable / Non-confirmable 的 POST 與 GET，作為 MQTT 的輕量替代傳輸
+// ============================================================================
+
+#ifndef COAP_CLIENT_H
+#define COAP_CLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// ============================================================================
+// CoAP 回應碼 (class.detail 編碼為 class << 5 | detail)
+// ============================================================================
+#define COAP_CODE_EMPTY         0x00    // 0.00 空訊息
+#define COAP_CODE_CREATED       0x41    // 2.01 Created
+#define COAP_CODE_CHANGED       0x44    // 2.04 Changed
+#define COAP_CODE_CONTENT       0x45    // 2.05 Content
+#define COAP_CODE_CONTINUE      0x5F    // 2.31 Continue (RFC 7959，分塊傳送中)
+#define COAP_CODE_NOT_FOUND     0x84    // 4.04 Not Found
+#define COAP_CODE_TOO_LARGE     0x8D    // 4.13 Request Entity Too Large
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define COAP_CLIENT_BLOCK_SIZE  512     // Block1 區塊大小 (超過此大小的 POST 分塊傳送)
+#define COAP_CLIENT_MAX_PAYLOAD 16384   // 單次 POST 上限
+
+// ============================================================================
+// CoAP 客戶端統計資訊
+// ============================================================================
+typedef struct {
+    uint32_t con_sent;          // 已送出 Confirmable 訊息數
+    uint32_t non_sent;          // 已送出 Non-confirmable 訊息數
+    uint32_t retransmissions;   // 重傳次數
+    uint32_t acks_received;     // 收到的 ACK 數
+    uint32_t timeouts;          // 重傳耗盡仍無 ACK 的次數
+    uint32_t resets;            // 收到 RST 的次數
+    uint32_t last_rtt_ms;       // 最近一次 Confirmable 往返時間 (毫秒)
+    uint32_t blockwise_posts;   // 以 Block1 分塊完成的 POST 數
+} coap_client_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化 CoAP 客戶端
+ *
+ * 只記錄伺服器位址並建立互斥鎖，DNS 解析與 socket 建立延後到第一次傳輸時
+ * (WiFi 可能尚未連線)
+ *
+ * @param host CoAP 伺服器主機名稱或 IP
+ * @param port CoAP 伺服器埠號 (預設 5683)
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t coap_client_init(const char* host, uint16_t port);
+
+/**
+ * @brief 以 POST 發送資料到指定資源路徑
+ *
+ * @param path 資源路徑，以 '/' 分隔 (例如 "soilsensorcapture/esp/data")
+ * @param payload 資料內容 (JSON)
+ * @param len 資料長度
+ * @param confirmable true 使用 CON (等待 ACK 並重傳)，false 使用 NON；
+ *                    超過一個區塊的資料一律逐塊以 CON 傳送
+ * @return esp_err_t ESP_OK 表示已送出 (NON) 或已確認 (CON)；
+ *                   ESP_ERR_INVALID_SIZE 表示超過 COAP_CLIENT_MAX_PAYLOAD 或伺服器拒收
+ */
+esp_err_t coap_client_post(const char* path, const uint8_t* payload, size_t len, bool confirmable);
+
+/**
+ * @brief 以 Confirmable GET 讀取指定資源
+ *
+ * @param path 資源路徑
+ * @param buf 回應內容緩衝區
+ * @param buf_size 緩衝區大小
+ * @param out_len 實際回應內容長度 (超過緩衝區時為完整長度，內容不複製)
+ * @param out_code 回應碼 (可為 NULL)
+ * @return esp_err_t ESP_OK 表示收到 2.xx 回應；ESP_ERR_INVALID_SIZE 表示回應內容超過緩衝區
+ */
+esp_err_t coap_client_get(const char* path, uint8_t* buf, size_t buf_size, size_t* out_len, uint8_t* out_code);
+
+/**
+ * @brief 取得 CoAP 客戶端統計資訊
+ *
+ * @param stats 統計資訊結構指標
+ */
+void coap_client_get_stats(coap_client_stats_t* stats);
+
+#endif // COAP_CLIENT_H
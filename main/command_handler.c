@@ -5,16 +5,32 @@
 
 #include "command_handler.h"
 #include "ota_update.h"
+#include "ota_range.h"
+#include "ota_recorder.h"
+#include "telemetry_transport.h"
+#include "watering_monitor.h"
+#include "drying_forecast.h"
+#include "adc_bench.h"
+#include "mem_pressure.h"
+#include "power_mgmt.h"
+#include "flow_meter.h"
+#include "raw_capture.h"
+#include "live_stream.h"
+#include "pump_control.h"
+#include "time_sync.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "freertos/event_groups.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "mqtt_client.h"
+#include "cJSON.h"
 
 // ============================================================================
 // 外部變數引用 (來自 main.c)
@@ -25,7 +41,6 @@ extern esp_mqtt_client_handle_t get_mqtt_client(void);
 // ============================================================================
 // 硬體定義 (與 main.c 保持一致)
 // ============================================================================
-#define PUMP_GPIO GPIO_NUM_6
 #define LED_GPIO GPIO_NUM_8
 #define TOPIC_RESPONSE "soilsensorcapture/response"
 
@@ -33,8 +48,19 @@ extern esp_mqtt_client_handle_t get_mqtt_client(void);
 // 模組內部常數定義
 // ============================================================================
 #define COMMAND_QUEUE_SIZE 10           // 指令佇列大小
-#define COMMAND_TASK_STACK_SIZE 3072    // 指令處理任務堆疊大小
+// 指令處理任務堆疊：尚未在硬體上量測，估計值 (gcc -fcallgraph-info，主機 x86-64、-Og) 為本專案程式碼
+// 最深 1.8 KB (WATER 指令 → send_mqtt_response → CoAP 發布) + ESP-IDF 函式庫約 1.5 KB ≈ 3.3 KB，
+// 原本的 3072 不足；實際剩餘量見系統狀態 stack_free.cmd_handler
+#define COMMAND_TASK_STACK_SIZE 6144    // 指令處理任務堆疊大小
 #define COMMAND_TASK_PRIORITY 4         // 指令處理任務優先順序
+#define DEFERRED_QUEUE_SIZE 4           // 記憶體壓力下延後執行的指令數上限
+#define WATER_PULSE_MS 1500             // 未指定水量時的出水時間
+#define WATER_VOLUME_MAX_MS 60000       // 定量澆水的最長出水時間
+#define WATER_NO_FLOW_MS 3000           // 定量澆水時連續無水流即停止
+#define WATER_OFF_WAIT_MARGIN_MS 500    // 等待計時器關閉泵浦的額外時間
+#define OTA_DEFAULT_CONNECTIONS 1       // OTA 預設連線數 ("OTA_UPDATE:<URL> 3" 指定 2-4 條 Range 連線)
+#define COMMAND_DEFAULT_TTL_MS 300000   // 未附期限的指令 (純文字格式) 從收到起算的有效時間，不防延遲送達
+#define COMMAND_NO_DEADLINE INT64_MAX
 
 // ============================================================================
 // 日誌標籤
@@ -44,22 +70,46 @@ static const char *TAG = "CMD_HANDLER";
 // ============================================================================
 // 全域變數定義
 // ============================================================================
-QueueHandle_t command_queue = NULL;        // 指令佇列句柄
 EventGroupHandle_t cmd_event_group = NULL; // 指令事件群組句柄
 
 // ============================================================================
 // 模組內部狀態變數
 // ============================================================================
-static bool pump_enabled = false;          // 泵浦狀態 (澆水時暫時為 true)
 static uint32_t processed_count = 0;       // 已處理指令計數
 static uint32_t error_count = 0;           // 錯誤指令計數
 static uint32_t water_count = 0;           // 澆水次數統計
+static uint32_t expired_count = 0;         // 超過期限而未執行的指令數
+static uint32_t late_count = 0;            // 期限內開始、但執行完成時已超過期限的指令數
+
+// 待執行指令：依優先等級、再依期限排序取出 (同期限依收到順序)
+static mqtt_command_t pending_cmds[COMMAND_QUEUE_SIZE];
+static size_t pending_count = 0;
+static uint32_t enqueue_seq = 0;
+static portMUX_TYPE pending_lock = portMUX_INITIALIZER_UNLOCKED;
+// 新指令以計數信號量喚醒處理任務 (任務通知保留給流量計與泵浦關閉等待)
+static SemaphoreHandle_t pending_sem = NULL;
+static TaskHandle_t command_task_handle = NULL;
+
+// 記憶體壓力達 CRITICAL 時延後的指令 (靜態配置，不在壓力下配置記憶體)
+static mqtt_command_t deferred_cmds[DEFERRED_QUEUE_SIZE];
+static size_t deferred_head = 0;
+static size_t deferred_count = 0;
 
 // ============================================================================
 // 內部函數宣告
 // ============================================================================
 static void command_handler_task(void *pvParameters);
 static esp_err_t send_mqtt_response(const char* message);
+static esp_err_t execute_command(const mqtt_command_t* command);
+static bool is_critical_command(command_type_t type);
+static bool defer_command(const mqtt_command_t* command);
+static void run_deferred_commands(void);
+static esp_err_t enqueue_with_deadline(command_type_t cmd_type, const char* data, int64_t deadline_us);
+static bool pop_next_command(mqtt_command_t* command);
+static bool drop_if_expired(const mqtt_command_t* command);
+static int command_priority(command_type_t type);
+static const char* command_type_name(command_type_t type);
+static esp_err_t dispatch_json_command(const char* payload, int len);
 
 // ============================================================================
 // 初始化指令處理模組
@@ -68,18 +118,17 @@ esp_err_t command_handler_init(void)
 {
     ESP_LOGI(TAG, "初始化指令處理模組...");
     
-    // 建立指令佇列
-    command_queue = xQueueCreate(COMMAND_QUEUE_SIZE, sizeof(mqtt_command_t));
-    if (command_queue == NULL) {
-        ESP_LOGE(TAG, "無法建立指令佇列");
-        return ESP_ERR_NO_MEM;
-    }
-    
     // 建立事件群組
     cmd_event_group = xEventGroupCreate();
     if (cmd_event_group == NULL) {
         ESP_LOGE(TAG, "無法建立事件群組");
-        vQueueDelete(command_queue);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    pending_sem = xSemaphoreCreateCounting(COMMAND_QUEUE_SIZE, 0);
+    if (pending_sem == NULL) {
+        ESP_LOGE(TAG, "無法建立指令信號量");
+        vEventGroupDelete(cmd_event_group);
         return ESP_ERR_NO_MEM;
     }
     
@@ -90,12 +139,11 @@ esp_err_t command_handler_init(void)
         COMMAND_TASK_STACK_SIZE,    // 堆疊大小
         NULL,                       // 任務參數
         COMMAND_TASK_PRIORITY,      // 優先順序
-        NULL                        // 任務句柄
+        &command_task_handle        // 任務句柄 (查詢堆疊剩餘量)
     );
     
     if (task_result != pdPASS) {
         ESP_LOGE(TAG, "無法建立指令處理任務");
-        vQueueDelete(command_queue);
         vEventGroupDelete(cmd_event_group);
         return ESP_ERR_NO_MEM;
     }
@@ -127,6 +175,16 @@ command_type_t parse_command(const char* command_str, int cmd_len)
         return CMD_OTA_STATUS;
     } else if (strncmp(command_str, "OTA_CANCEL", cmd_len) == 0) {
         return CMD_OTA_CANCEL;
+    } else if (strncmp(command_str, "ADC_BENCH", cmd_len) == 0) {
+        return CMD_ADC_BENCH;
+    } else if (strncmp(command_str, "CAPTURE", cmd_len) == 0) {
+        return CMD_CAPTURE;
+    } else if (strncmp(command_str, "OTA_HISTORY", cmd_len) == 0) {
+        return CMD_OTA_HISTORY;
+    } else if (strncmp(command_str, "LIVE_STREAM", cmd_len) == 0) {
+        return CMD_LIVE_STREAM;
+    } else if (strncmp(command_str, "CLEAR_LOCKOUT", cmd_len) == 0) {
+        return CMD_CLEAR_LOCKOUT;
     }
     
     return CMD_UNKNOWN;
@@ -137,16 +195,28 @@ command_type_t parse_command(const char* command_str, int cmd_len)
 // ============================================================================
 esp_err_t enqueue_command(command_type_t cmd_type, const char* data)
 {
-    if (command_queue == NULL) {
+    return enqueue_with_deadline(cmd_type, data, esp_timer_get_time() + COMMAND_DEFAULT_TTL_MS * 1000LL);
+}
+
+static esp_err_t enqueue_with_deadline(command_type_t cmd_type, const char* data, int64_t deadline_us)
+{
+    if (pending_sem == NULL) {
         ESP_LOGE(TAG, "指令佇列未初始化");
         return ESP_ERR_INVALID_STATE;
     }
     
     mqtt_command_t command = {
         .type = cmd_type,
-        .timestamp = esp_timer_get_time() / 1000000  // 轉換為秒
+        .timestamp = esp_timer_get_time() / 1000000,  // 轉換為秒
+        .enqueue_us = esp_timer_get_time(),
+        .deadline_us = deadline_us,
     };
     
+    // 已過期的指令不進入佇列
+    if (drop_if_expired(&command)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
     // 複製資料 (如果有提供)
     if (data != NULL) {
         strncpy(command.data, data, sizeof(command.data) - 1);
@@ -155,10 +225,17 @@ esp_err_t enqueue_command(command_type_t cmd_type, const char* data)
         command.data[0] = '\0';
     }
     
-    // 嘗試將指令加入佇列 (非阻塞)
-    BaseType_t result = xQueueSend(command_queue, &command, 0);
+    // 加入待執行清單 (非阻塞)；取出順序由 pop_next_command() 決定
+    portENTER_CRITICAL(&pending_lock);
+    bool queued = pending_count < COMMAND_QUEUE_SIZE;
+    if (queued) {
+        command.seq = enqueue_seq++;
+        pending_cmds[pending_count++] = command;
+    }
+    portEXIT_CRITICAL(&pending_lock);
     
-    if (result == pdPASS) {
+    if (queued) {
+        xSemaphoreGive(pending_sem);
         ESP_LOGI(TAG, "指令已加入佇列: 類型=%d", cmd_type);
         return ESP_OK;
     } else {
@@ -168,15 +245,221 @@ esp_err_t enqueue_command(command_type_t cmd_type, const char* data)
 }
 
 // ============================================================================
-// 執行澆水指令 - 自動開啟幫浦1.5秒後關閉
+// 取出下一個要執行的指令：優先等級高者先，同等級期限早者先，再依收到順序
+// ============================================================================
+static bool pop_next_command(mqtt_command_t* command)
+{
+    portENTER_CRITICAL(&pending_lock);
+    int best = -1;
+    for (int i = 0; i < (int)pending_count; i++) {
+        if (best < 0) {
+            best = i;
+            continue;
+        }
+        const mqtt_command_t *a = &pending_cmds[i];
+        const mqtt_command_t *b = &pending_cmds[best];
+        int pa = command_priority(a->type);
+        int pb = command_priority(b->type);
+        if (pa < pb || (pa == pb && (a->deadline_us < b->deadline_us ||
+                                     (a->deadline_us == b->deadline_us && a->seq < b->seq)))) {
+            best = i;
+        }
+    }
+    if (best >= 0) {
+        *command = pending_cmds[best];
+        pending_cmds[best] = pending_cmds[--pending_count];
+    }
+    portEXIT_CRITICAL(&pending_lock);
+    return best >= 0;
+}
+
+// ============================================================================
+// 期限檢查：過期即捨棄並回應 (收到時、取出時與延後執行前各檢查一次)
+// ============================================================================
+static bool drop_if_expired(const mqtt_command_t* command)
+{
+    int64_t overdue_us = esp_timer_get_time() - command->deadline_us;
+    if (command->deadline_us == COMMAND_NO_DEADLINE || overdue_us < 0) {
+        return false;
+    }
+    
+    expired_count++;
+    char msg[96];
+    snprintf(msg, sizeof(msg), "⌛ 指令已過期，未執行: %s (逾期 %lld ms)",
+             command_type_name(command->type), overdue_us / 1000);
+    ESP_LOGW(TAG, "%s", msg);
+    send_mqtt_response(msg);
+    return true;
+}
+
+// ============================================================================
+// 解析並派送收到的指令訊息
+// ============================================================================
+esp_err_t dispatch_command_payload(const char* payload, int len)
+{
+    // 附期限的 JSON 格式
+    if (len > 0 && payload[0] == '{') {
+        return dispatch_json_command(payload, len);
+    }
+    
+    // 分離 "指令:參數"
+    const char *colon = memchr(payload, ':', len);
+    int name_len = colon != NULL ? (int)(colon - payload) : len;
+    
+    command_type_t cmd_type = parse_command(payload, name_len);
+    
+    if (cmd_type == CMD_UNKNOWN) {
+        ESP_LOGW(TAG, "⚠️ 未知的指令: %.*s", len, payload);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    
+    if (colon == NULL) {
+        return enqueue_command(cmd_type, NULL);
+    }
+    
+    char args[sizeof(((mqtt_command_t *)0)->data)];
+    int args_len = len - name_len - 1;
+    if (args_len >= (int)sizeof(args)) {
+        ESP_LOGW(TAG, "⚠️ 指令參數過長 (%d bytes)", args_len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(args, colon + 1, args_len);
+    args[args_len] = '\0';
+    
+    return enqueue_command(cmd_type, args);
+}
+
+// ============================================================================
+// 拒收過長的指令訊息 (傳輸層無法完整接收時呼叫，不截斷執行)
+// ============================================================================
+void command_handler_reject_oversize(const char* source, size_t len)
+{
+    ESP_LOGW(TAG, "⚠️ %s 指令訊息 %u bytes 超過上限 %d bytes，拒收", source, (unsigned)len, COMMAND_MAX_PAYLOAD);
+
+    char message[128];
+    snprintf(message, sizeof(message), "❌ 4.13 指令訊息 %u bytes 超過上限 %d bytes，未執行",
+             (unsigned)len, COMMAND_MAX_PAYLOAD);
+    send_mqtt_response(message);
+}
+
+// ============================================================================
+// JSON 指令：{"cmd":"WATER:200","issued_ms":<epoch>,"ttl_ms":30000} 或
+//           {"cmd":"WATER:200","deadline_ms":<epoch>}
+// 期限換算為本機單調時鐘；時間未同步時 epoch 無法比較，只能以收到時間加 ttl_ms 計算
+// ============================================================================
+static esp_err_t dispatch_json_command(const char* payload, int len)
+{
+    cJSON *json = cJSON_ParseWithLength(payload, len);
+    if (json == NULL) {
+        ESP_LOGW(TAG, "⚠️ 無法解析 JSON 指令");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    
+    const cJSON *cmd = cJSON_GetObjectItem(json, "cmd");
+    const cJSON *issued = cJSON_GetObjectItem(json, "issued_ms");
+    const cJSON *ttl = cJSON_GetObjectItem(json, "ttl_ms");
+    const cJSON *deadline = cJSON_GetObjectItem(json, "deadline_ms");
+    if (!cJSON_IsString(cmd) || (ttl != NULL && (!cJSON_IsNumber(ttl) || ttl->valuedouble <= 0))) {
+        cJSON_Delete(json);
+        ESP_LOGW(TAG, "⚠️ JSON 指令缺少 cmd 或 ttl_ms 無效");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    
+    int64_t now_us = esp_timer_get_time();
+    int64_t now_ms = time_sync_now_ms();
+    int64_t deadline_us = now_us + COMMAND_DEFAULT_TTL_MS * 1000LL;
+    if (cJSON_IsNumber(deadline) && now_ms >= 0) {
+        deadline_us = now_us + ((int64_t)deadline->valuedouble - now_ms) * 1000;
+    } else if (cJSON_IsNumber(ttl) && cJSON_IsNumber(issued) && now_ms >= 0) {
+        deadline_us = now_us + ((int64_t)issued->valuedouble + (int64_t)ttl->valuedouble - now_ms) * 1000;
+    } else if (cJSON_IsNumber(ttl)) {
+        deadline_us = now_us + (int64_t)ttl->valuedouble * 1000;
+    }
+    if (now_ms < 0 && (deadline != NULL || issued != NULL)) {
+        ESP_LOGW(TAG, "⚠️ 時間尚未同步，無法檢查指令的絕對期限 (改以收到時間計算)");
+    }
+    
+    // 重用文字格式的解析 (指令名稱與參數)
+    const char *text = cmd->valuestring;
+    const char *colon = strchr(text, ':');
+    int name_len = colon != NULL ? (int)(colon - text) : (int)strlen(text);
+    command_type_t cmd_type = parse_command(text, name_len);
+    
+    esp_err_t err;
+    if (cmd_type == CMD_UNKNOWN) {
+        ESP_LOGW(TAG, "⚠️ 未知的指令: %s", text);
+        err = ESP_ERR_NOT_SUPPORTED;
+    } else if (colon != NULL && strlen(colon + 1) >= sizeof(((mqtt_command_t *)0)->data)) {
+        ESP_LOGW(TAG, "⚠️ 指令參數過長 (%d bytes)", (int)strlen(colon + 1));
+        err = ESP_ERR_INVALID_SIZE;
+    } else {
+        err = enqueue_with_deadline(cmd_type, colon != NULL ? colon + 1 : NULL, deadline_us);
+    }
+    
+    cJSON_Delete(json);
+    return err;
+}
+
+// ============================================================================
+// 執行澆水指令 - 自動開啟幫浦1.5秒後關閉，或依流量計定量出水
 // ============================================================================
-esp_err_t execute_water_command(void)
+esp_err_t execute_water_command(const char* args)
 {
-    ESP_LOGI(TAG, "🚿 執行澆水指令 - 開啟幫浦1.5秒");
+    // 解析目標水量 ("200" 或 "200ml")，0 表示定時出水
+    uint32_t target_ml = 0;
+    if (args != NULL && args[0] != '\0') {
+        char *end = NULL;
+        unsigned long value = strtoul(args, &end, 10);
+        if (end == args || (*end != '\0' && strcmp(end, "ml") != 0) ||
+            value == 0 || value > FLOW_METER_MAX_TARGET_ML) {
+            char error_msg[96];
+            snprintf(error_msg, sizeof(error_msg), "❌ 無效的澆水水量: %s (1-%d ml)",
+                     args, FLOW_METER_MAX_TARGET_ML);
+            send_mqtt_response(error_msg);
+            return ESP_ERR_INVALID_ARG;
+        }
+        target_ml = (uint32_t)value;
+    }
+    if (target_ml > 0 && !flow_meter_is_available()) {
+        send_mqtt_response("⚠️ 未安裝流量計，無法定量澆水");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    
+    // 連續乾抽後暫停澆水，避免空轉泵浦
+    uint32_t lockout_s = 0;
+    if (!watering_monitor_pump_allowed(&lockout_s)) {
+        char lockout_msg[128];
+        snprintf(lockout_msg, sizeof(lockout_msg),
+                 "⚠️ 疑似水箱乾涸或管路堵塞 - 暫停澆水 (剩餘 %lu 分鐘，補水後可用 CLEAR_LOCKOUT 解除)",
+                 lockout_s / 60);
+        send_mqtt_response(lockout_msg);
+        ESP_LOGW(TAG, "%s", lockout_msg);
+        return ESP_ERR_INVALID_STATE;
+    }
     
-    // 開啟幫浦
-    gpio_set_level(PUMP_GPIO, 1);
-    pump_enabled = true;
+    if (target_ml > 0) {
+        ESP_LOGI(TAG, "🚿 執行定量澆水指令 - 目標 %lu ml", target_ml);
+    } else {
+        ESP_LOGI(TAG, "🚿 執行澆水指令 - 開啟幫浦1.5秒");
+    }
+    
+    // 擷取澆水前濕度並開始監測回應
+    watering_monitor_begin();
+    drying_forecast_note_watering();
+    flow_meter_start();
+    
+    // 已預備泵浦觸發擷取時，先開始原始 ADC 擷取再開啟幫浦 (包含啟動瞬間的干擾)
+    raw_capture_pump_starting();
+    
+    // 🔄 新增：開啟幫浦並由計時器負責關閉 (定量澆水以最長出水時間為保底)
+    esp_err_t pump_result = pump_control_start(target_ml > 0 ? WATER_VOLUME_MAX_MS : WATER_PULSE_MS);
+    if (pump_result != ESP_OK) {
+        raw_capture_pump_stopped();
+        watering_monitor_pump_stopped();
+        flow_meter_stop();
+        send_mqtt_response("❌ 無法啟動幫浦 (幫浦已在運轉或計時器失敗)");
+        return pump_result;
+    }
     
     // 開啟指示 LED (ESP32-C3 內建 LED 為反向邏輯)
     gpio_set_level(LED_GPIO, 0);
@@ -184,12 +467,19 @@ esp_err_t execute_water_command(void)
     // 發送開始澆水的 MQTT 回應
     esp_err_t result = send_mqtt_response("🚿 開始澆水 - 幫浦已啟動");
     
-    // 延遲1.5秒 (1500毫秒)
-    vTaskDelay(pdMS_TO_TICKS(1500));
+    // 定量：達到目標水量即提前停止；定時：等計時器在1.5秒 (1500毫秒) 後關閉
+    esp_err_t volume_result = ESP_OK;
+    if (target_ml > 0) {
+        volume_result = flow_meter_wait_volume(target_ml, WATER_VOLUME_MAX_MS, WATER_NO_FLOW_MS);
+    } else if (pump_control_wait_off(WATER_PULSE_MS + WATER_OFF_WAIT_MARGIN_MS) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 等待計時器關閉幫浦逾時，改由任務關閉");
+    }
     
-    // 關閉幫浦
-    gpio_set_level(PUMP_GPIO, 0);
-    pump_enabled = false;
+    // 關閉幫浦 (已由計時器關閉時不做任何事)
+    pump_control_stop();
+    raw_capture_pump_stopped();
+    watering_monitor_pump_stopped();
+    uint32_t delivered_ml = flow_meter_stop();
     
     // 關閉指示 LED
     gpio_set_level(LED_GPIO, 1);
@@ -197,19 +487,43 @@ esp_err_t execute_water_command(void)
     // 增加澆水次數統計
     water_count++;
     
-    // 發送完成澆水的 MQTT 回應
-    char completion_msg[128];
-    snprintf(completion_msg, sizeof(completion_msg), 
-             "✅ 澆水完成 - 幫浦已關閉 (總澆水次數: %lu)", water_count);
+    pump_control_stats_t pump_stats;
+    pump_control_get_stats(&pump_stats);
+    char timing_str[48];
+    if (pump_stats.last.timer_off) {
+        snprintf(timing_str, sizeof(timing_str), "，開啟 %lu ms (誤差 %ld us)",
+                 pump_stats.last.actual_us / 1000, pump_stats.last.jitter_us);
+    } else {
+        snprintf(timing_str, sizeof(timing_str), "，開啟 %lu ms", pump_stats.last.actual_us / 1000);
+    }
+    
+    // 發送完成澆水的 MQTT 回應 (有流量計時附上本次與累計出水量)
+    char completion_msg[256];
+    if (flow_meter_is_available()) {
+        flow_meter_stats_t flow_stats;
+        flow_meter_get_stats(&flow_stats);
+        const char *outcome = volume_result == ESP_ERR_NOT_FOUND ? "⚠️ 無水流，提前停止" :
+                              volume_result == ESP_ERR_TIMEOUT ? "⚠️ 逾時未達目標水量" : "✅ 澆水完成";
+        char target_str[32] = "";
+        if (target_ml > 0) {
+            snprintf(target_str, sizeof(target_str), " / 目標 %lu ml", target_ml);
+        }
+        snprintf(completion_msg, sizeof(completion_msg),
+                 "%s - 出水 %lu ml%s%s (累計 %llu ml，總澆水次數: %lu)",
+                 outcome, delivered_ml, target_str, timing_str, flow_stats.total_ml, water_count);
+    } else {
+        snprintf(completion_msg, sizeof(completion_msg), 
+                 "✅ 澆水完成 - 幫浦已關閉%s (總澆水次數: %lu)", timing_str, water_count);
+    }
     result = send_mqtt_response(completion_msg);
     
     if (result == ESP_OK) {
-        ESP_LOGI(TAG, "✅ 澆水指令執行完成 - 幫浦運行1.5秒後已關閉 (總次數: %lu)", water_count);
+        ESP_LOGI(TAG, "✅ 澆水指令執行完成 - %s (總次數: %lu)", completion_msg, water_count);
     } else {
         ESP_LOGW(TAG, "澆水指令執行完成但回應發送失敗");
     }
     
-    return ESP_OK;
+    return volume_result;
 }
 
 // ============================================================================
@@ -230,7 +544,7 @@ esp_err_t execute_status_command(void)
              water_count,
              processed_count,
              error_count,
-             pump_enabled ? "運行中" : "待機中");
+             pump_control_is_on() ? "運行中" : "待機中");
     
     esp_err_t result = send_mqtt_response(status_msg);
     
@@ -269,7 +583,7 @@ esp_err_t execute_reading_command(void)
 // ============================================================================
 bool get_pump_status(void)
 {
-    return pump_enabled;
+    return pump_control_is_on();
 }
 
 // ============================================================================
@@ -277,7 +591,12 @@ bool get_pump_status(void)
 // ============================================================================
 void set_pump_status(bool enabled)
 {
-    pump_enabled = enabled;
+    // 開啟時同樣受計時器保護，最多運轉 WATER_VOLUME_MAX_MS
+    if (enabled) {
+        pump_control_start(WATER_VOLUME_MAX_MS);
+    } else {
+        pump_control_stop();
+    }
 }
 
 // ============================================================================
@@ -293,6 +612,19 @@ void get_command_stats(uint32_t* processed_count_ptr, uint32_t* error_count_ptr)
     }
 }
 
+// ============================================================================
+// 取得指令期限統計
+// ============================================================================
+void get_command_deadline_stats(uint32_t* expired_count_ptr, uint32_t* late_count_ptr)
+{
+    if (expired_count_ptr != NULL) {
+        *expired_count_ptr = expired_count;
+    }
+    if (late_count_ptr != NULL) {
+        *late_count_ptr = late_count;
+    }
+}
+
 // ============================================================================
 // 取得澆水次數統計
 // ============================================================================
@@ -301,6 +633,14 @@ uint32_t get_water_count(void)
     return water_count;
 }
 
+// ============================================================================
+// 取得指令處理任務堆疊剩餘量
+// ============================================================================
+uint32_t get_command_task_stack_free(void)
+{
+    return command_task_handle != NULL ? uxTaskGetStackHighWaterMark(command_task_handle) : 0;
+}
+
 // ============================================================================
 // 執行 OTA 更新指令
 // ============================================================================
@@ -324,6 +664,7 @@ esp_err_t execute_ota_update_command(const char* firmware_url)
     ota_config_t ota_config = {
         .auto_reboot = true,
         .timeout_ms = 30000,  // 30 秒超時
+        .connections = OTA_DEFAULT_CONNECTIONS,
         .callback = NULL
     };
     
@@ -331,6 +672,21 @@ esp_err_t execute_ota_update_command(const char* firmware_url)
     strncpy(ota_config.firmware_url, firmware_url, sizeof(ota_config.firmware_url) - 1);
     ota_config.firmware_url[sizeof(ota_config.firmware_url) - 1] = '\0';
     
+    // 🔄 新增：URL 後以空白分隔的連線數 (URL 本身不含空白)
+    char *space = strchr(ota_config.firmware_url, ' ');
+    if (space != NULL) {
+        char *end = NULL;
+        unsigned long connections = strtoul(space + 1, &end, 10);
+        if (end == space + 1 || *end != '\0' || connections < 1 || connections > OTA_RANGE_MAX_CONNECTIONS) {
+            char error_msg[96];
+            snprintf(error_msg, sizeof(error_msg), "❌ 無效的 OTA 連線數: %s (1-%d)", space + 1, OTA_RANGE_MAX_CONNECTIONS);
+            send_mqtt_response(error_msg);
+            return ESP_ERR_INVALID_ARG;
+        }
+        *space = '\0';
+        ota_config.connections = (uint8_t)connections;
+    }
+    
     // 取得目前版本作為參考
     ota_get_current_version(ota_config.version, sizeof(ota_config.version));
     
@@ -340,7 +696,7 @@ esp_err_t execute_ota_update_command(const char* firmware_url)
         ESP_LOGI(TAG, "✅ OTA 更新已啟動");
         char response_msg[200];
         snprintf(response_msg, sizeof(response_msg), 
-                 "🚀 OTA 更新已啟動\nURL: %s", firmware_url);
+                 "🚀 OTA 更新已啟動\nURL: %s\n連線數: %u", ota_config.firmware_url, ota_config.connections);
         send_mqtt_response(response_msg);
     } else {
         ESP_LOGE(TAG, "❌ OTA 更新啟動失敗: %s", esp_err_to_name(result));
@@ -369,7 +725,7 @@ esp_err_t execute_ota_status_command(void)
         "待機中", "下載中", "驗證中", "安裝中", "更新完成", "更新錯誤"
     };
     
-    char status_msg[300];
+    char status_msg[400];
     snprintf(status_msg, sizeof(status_msg),
              "🔄 OTA 更新狀態報告\n"
              "📦 目前版本: %s\n"
@@ -377,13 +733,17 @@ esp_err_t execute_ota_status_command(void)
              "⏳ 進度: %d%%\n"
              "✅ 總更新次數: %lu\n"
              "🎯 成功次數: %lu\n"
-             "❌ 失敗次數: %lu",
+             "❌ 失敗次數: %lu\n"
+             "📶 上次下載: %lu ms, %lu KB/s (%u 條連線)",
              current_version,
              state < sizeof(state_names)/sizeof(state_names[0]) ? state_names[state] : "未知",
              progress,
              stats.total_updates,
              stats.successful_updates,
-             stats.failed_updates);
+             stats.failed_updates,
+             stats.last_download_ms,
+             stats.last_download_bytes_per_s / 1024,
+             stats.last_connections);
     
     esp_err_t result = send_mqtt_response(status_msg);
     
@@ -422,6 +782,24 @@ esp_err_t execute_ota_cancel_command(void)
     return result;
 }
 
+// ============================================================================
+// 執行 OTA 紀錄重新上傳指令
+// ============================================================================
+esp_err_t execute_ota_history_command(void)
+{
+    ESP_LOGI(TAG, "📼 執行 OTA 紀錄重新上傳指令");
+    
+    uint32_t count = ota_recorder_reupload();
+    char msg[96];
+    if (count == 0) {
+        snprintf(msg, sizeof(msg), "📼 沒有保留的 OTA 嘗試紀錄");
+    } else {
+        snprintf(msg, sizeof(msg), "📼 已排入 %lu 筆 OTA 嘗試紀錄重新上傳", count);
+    }
+    send_mqtt_response(msg);
+    return ESP_OK;
+}
+
 // ============================================================================
 // 指令處理任務 (FreeRTOS 任務)
 // ============================================================================
@@ -432,60 +810,32 @@ static void command_handler_task(void *pvParameters)
     ESP_LOGI(TAG, "🚀 指令處理任務已啟動");
     
     while (1) {
-        // 等待佇列中的指令 (最多等待 1 秒)
-        BaseType_t result = xQueueReceive(command_queue, &command, pdMS_TO_TICKS(1000));
+        // 等待新指令 (最多等待 1 秒)
+        xSemaphoreTake(pending_sem, pdMS_TO_TICKS(1000));
         
-        if (result == pdPASS) {
+        // 記憶體壓力解除後，先依序執行先前延後的指令
+        run_deferred_commands();
+        
+        // 取到清單為空為止 (多出的信號量計數之後只會造成一次空轉)
+        while (pop_next_command(&command)) {
+            if (drop_if_expired(&command)) {
+                continue;
+            }
+            
             ESP_LOGI(TAG, "🔄 處理指令: 類型=%d, 時間戳=%lu", 
                      command.type, command.timestamp);
             
-            esp_err_t exec_result = ESP_OK;
-            
-            // 根據指令類型執行對應動作
-            switch (command.type) {
-                case CMD_WATER:
-                    exec_result = execute_water_command();
-                    break;
-                    
-                case CMD_GET_STATUS:
-                    exec_result = execute_status_command();
-                    break;
-                    
-                case CMD_GET_READING:
-                    exec_result = execute_reading_command();
-                    break;
-                    
-                case CMD_OTA_UPDATE:
-                    exec_result = execute_ota_update_command(command.data);
-                    break;
-                    
-                case CMD_OTA_STATUS:
-                    exec_result = execute_ota_status_command();
-                    break;
-                    
-                case CMD_OTA_CANCEL:
-                    exec_result = execute_ota_cancel_command();
-                    break;
-                    
-                case CMD_UNKNOWN:
-                default:
-                    ESP_LOGW(TAG, "⚠️ 未知指令類型: %d", command.type);
-                    exec_result = ESP_ERR_INVALID_ARG;
-                    break;
-            }
-            
-            // 更新統計計數
-            if (exec_result == ESP_OK) {
-                processed_count++;
-                xEventGroupSetBits(cmd_event_group, CMD_PROCESSED_BIT);
+            // 🔄 新增：記憶體壓力達 CRITICAL 時只執行必要指令，其餘延後
+            if (mem_pressure_get_tier() >= MEM_PRESSURE_CRITICAL && !is_critical_command(command.type)) {
+                if (!defer_command(&command)) {
+                    error_count++;
+                    xEventGroupSetBits(cmd_event_group, CMD_ERROR_BIT);
+                }
             } else {
-                error_count++;
-                xEventGroupSetBits(cmd_event_group, CMD_ERROR_BIT);
+                // 派送延遲包含降頻 / 淺眠後的喚醒時間，用於評估電源管理設定的代價
+                power_mgmt_record_command_latency((uint32_t)(esp_timer_get_time() - command.enqueue_us));
+                execute_command(&command);
             }
-            
-        } else {
-            // 沒有收到指令，繼續等待
-            // 這裡可以執行一些定期維護工作
         }
         
         // 清除事件位元 (為下次設定做準備)
@@ -493,6 +843,149 @@ static void command_handler_task(void *pvParameters)
     }
 }
 
+// ============================================================================
+// 執行單一指令並更新統計 (內部函數)
+// ============================================================================
+static esp_err_t execute_command(const mqtt_command_t* command)
+{
+    esp_err_t exec_result = ESP_OK;
+    
+    // 根據指令類型執行對應動作
+    switch (command->type) {
+        case CMD_WATER:
+            exec_result = execute_water_command(command->data);
+            break;
+            
+        case CMD_GET_STATUS:
+            exec_result = execute_status_command();
+            break;
+            
+        case CMD_GET_READING:
+            exec_result = execute_reading_command();
+            break;
+            
+        case CMD_OTA_UPDATE:
+            exec_result = execute_ota_update_command(command->data);
+            break;
+            
+        case CMD_OTA_STATUS:
+            exec_result = execute_ota_status_command();
+            break;
+            
+        case CMD_OTA_CANCEL:
+            exec_result = execute_ota_cancel_command();
+            break;
+            
+        case CMD_ADC_BENCH:
+            exec_result = execute_adc_bench_command(command->data);
+            break;
+            
+        case CMD_CAPTURE:
+            exec_result = execute_capture_command(command->data);
+            break;
+            
+        case CMD_OTA_HISTORY:
+            exec_result = execute_ota_history_command();
+            break;
+            
+        case CMD_LIVE_STREAM:
+            exec_result = execute_live_stream_command(command->data);
+            break;
+            
+        case CMD_CLEAR_LOCKOUT:
+            exec_result = execute_clear_lockout_command();
+            break;
+            
+        case CMD_UNKNOWN:
+        default:
+            ESP_LOGW(TAG, "⚠️ 未知指令類型: %d", command->type);
+            exec_result = ESP_ERR_INVALID_ARG;
+            break;
+    }
+    
+    // 期限內開始、但執行完成時已超過期限 (例如長時間定量澆水)
+    if (command->deadline_us != COMMAND_NO_DEADLINE && esp_timer_get_time() > command->deadline_us) {
+        late_count++;
+        ESP_LOGW(TAG, "⏰ 指令 %s 完成時已超過期限 %lld ms", command_type_name(command->type),
+                 (esp_timer_get_time() - command->deadline_us) / 1000);
+    }
+    
+    // 更新統計計數
+    if (exec_result == ESP_OK) {
+        processed_count++;
+        xEventGroupSetBits(cmd_event_group, CMD_PROCESSED_BIT);
+    } else {
+        error_count++;
+        xEventGroupSetBits(cmd_event_group, CMD_ERROR_BIT);
+    }
+    
+    return exec_result;
+}
+
+// ============================================================================
+// 記憶體壓力下的指令延後 (內部函數)
+// ============================================================================
+static bool is_critical_command(command_type_t type)
+{
+    // 澆水影響植物；取消 OTA 可釋放下載緩衝區與 TLS 連線
+    return type == CMD_WATER || type == CMD_OTA_CANCEL;
+}
+
+// 數值越小越優先：必要指令一個等級，其餘一個等級
+static int command_priority(command_type_t type)
+{
+    return is_critical_command(type) ? 0 : 1;
+}
+
+static const char* command_type_name(command_type_t type)
+{
+    switch (type) {
+        case CMD_WATER:       return "WATER";
+        case CMD_GET_STATUS:  return "GET_STATUS";
+        case CMD_GET_READING: return "GET_READING";
+        case CMD_OTA_UPDATE:  return "OTA_UPDATE";
+        case CMD_OTA_STATUS:  return "OTA_STATUS";
+        case CMD_OTA_CANCEL:  return "OTA_CANCEL";
+        case CMD_ADC_BENCH:   return "ADC_BENCH";
+        case CMD_CAPTURE:     return "CAPTURE";
+        case CMD_OTA_HISTORY: return "OTA_HISTORY";
+        case CMD_LIVE_STREAM: return "LIVE_STREAM";
+        case CMD_CLEAR_LOCKOUT: return "CLEAR_LOCKOUT";
+        default:              return "UNKNOWN";
+    }
+}
+
+static bool defer_command(const mqtt_command_t* command)
+{
+    if (deferred_count >= DEFERRED_QUEUE_SIZE) {
+        ESP_LOGW(TAG, "⚠️ 記憶體不足且延後佇列已滿，捨棄指令: 類型=%d", command->type);
+        send_mqtt_response("❌ 記憶體不足，指令已捨棄，請稍後再試");
+        return false;
+    }
+    
+    deferred_cmds[(deferred_head + deferred_count) % DEFERRED_QUEUE_SIZE] = *command;
+    deferred_count++;
+    ESP_LOGW(TAG, "⏸️ 記憶體壓力過高，延後執行指令: 類型=%d (佇列 %d/%d)",
+             command->type, (int)deferred_count, DEFERRED_QUEUE_SIZE);
+    send_mqtt_response("⏸️ 記憶體不足，指令將在壓力解除後執行");
+    return true;
+}
+
+static void run_deferred_commands(void)
+{
+    while (deferred_count > 0 && mem_pressure_get_tier() < MEM_PRESSURE_CRITICAL) {
+        mqtt_command_t command = deferred_cmds[deferred_head];
+        deferred_head = (deferred_head + 1) % DEFERRED_QUEUE_SIZE;
+        deferred_count--;
+        
+        if (drop_if_expired(&command)) {
+            continue;
+        }
+        ESP_LOGI(TAG, "▶️ 記憶體壓力解除，執行延後的指令: 類型=%d", command.type);
+        execute_command(&command);
+    }
+}
+
 // ============================================================================
 // 發送 MQTT 回應 (內部函數)
 // ============================================================================
@@ -502,18 +995,129 @@ static esp_err_t send_mqtt_response(const char* message)
         return ESP_ERR_INVALID_ARG;
     }
     
-    esp_mqtt_client_handle_t client = get_mqtt_client();
-    if (client == NULL) {
-        return ESP_ERR_INVALID_ARG;
-    }
+    esp_err_t err = telemetry_publish(TOPIC_RESPONSE, message, 0, 0, 0);
     
-    int msg_id = esp_mqtt_client_publish(client, TOPIC_RESPONSE, message, 0, 0, 0);
-    
-    if (msg_id >= 0) {
-        ESP_LOGD(TAG, "MQTT 回應已發送: %s (msg_id=%d)", message, msg_id);
+    if (err == ESP_OK) {
+        ESP_LOGD(TAG, "MQTT 回應已發送: %s", message);
         return ESP_OK;
     } else {
         ESP_LOGW(TAG, "MQTT 回應發送失敗: %s", message);
         return ESP_ERR_INVALID_RESPONSE;
     }
-}
\ No newline at end of file
+}
+
+// ============================================================================
+// 執行 ADC 基準測試指令
+// ============================================================================
+esp_err_t execute_adc_bench_command(const char* args)
+{
+    ESP_LOGI(TAG, "📈 執行 ADC 基準測試指令");
+    
+    adc_bench_mode_t mode;
+    uint32_t duration_ms;
+    if (adc_bench_parse_args(args, &mode, &duration_ms) != ESP_OK) {
+        send_mqtt_response("❌ 參數格式錯誤，用法: ADC_BENCH[:oneshot|continuous|both][:毫秒]");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    esp_err_t err = adc_bench_start(mode, duration_ms);
+    if (err == ESP_ERR_INVALID_STATE) {
+        send_mqtt_response("⚠️ ADC 基準測試已在執行中");
+        return err;
+    } else if (err != ESP_OK) {
+        send_mqtt_response("❌ 無法啟動 ADC 基準測試");
+        return err;
+    }
+    
+    char msg[128];
+    snprintf(msg, sizeof(msg), "📈 ADC 基準測試已啟動 (每種模式 %lu ms)，完成後發布結果", duration_ms);
+    return send_mqtt_response(msg);
+}
+
+// ============================================================================
+// 執行原始 ADC 擷取指令
+// ============================================================================
+esp_err_t execute_capture_command(const char* args)
+{
+    ESP_LOGI(TAG, "📈 執行原始 ADC 擷取指令");
+    
+    raw_capture_request_t request;
+    if (raw_capture_parse_args(args, &request) != ESP_OK) {
+        char usage[160];
+        snprintf(usage, sizeof(usage), "❌ 參數格式錯誤，用法: CAPTURE[:毫秒 (≤%d)][:Hz (%d-%d)][:pump][:raw]",
+                 RAW_CAPTURE_MAX_DURATION_MS, RAW_CAPTURE_MIN_RATE_HZ, RAW_CAPTURE_MAX_RATE_HZ);
+        send_mqtt_response(usage);
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    uint32_t samples = 0;
+    esp_err_t err = raw_capture_start(&request, &samples);
+    if (err == ESP_ERR_INVALID_STATE) {
+        char busy_msg[96];
+        snprintf(busy_msg, sizeof(busy_msg), "⚠️ 原始擷取忙碌中 (%s)，請稍後再試",
+                 raw_capture_state_name(raw_capture_get_state()));
+        send_mqtt_response(busy_msg);
+        return err;
+    } else if (err != ESP_OK) {
+        send_mqtt_response("❌ 無法啟動原始擷取");
+        return err;
+    }
+    
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%s - %lu 樣本 @ %lu Hz (%s)，完成後分段上傳",
+             request.on_pump ? "🎯 原始擷取已預備，下次泵浦啟動時開始" : "📈 原始擷取已啟動",
+             samples, request.rate_hz, request.compress ? "delta8" : "raw16");
+    return send_mqtt_response(msg);
+}
+
+// ============================================================================
+// 執行即時串流指令
+// ============================================================================
+esp_err_t execute_live_stream_command(const char* args)
+{
+    ESP_LOGI(TAG, "📡 執行即時串流指令");
+    
+    live_stream_request_t request;
+    if (live_stream_parse_args(args, &request) != ESP_OK) {
+        char usage[160];
+        snprintf(usage, sizeof(usage), "❌ 參數格式錯誤，用法: LIVE_STREAM[:秒 (≤%d)][:Hz (%d-%d)] 或 LIVE_STREAM:stop",
+                 LIVE_STREAM_MAX_DURATION_S, LIVE_STREAM_MIN_HZ, LIVE_STREAM_MAX_HZ);
+        send_mqtt_response(usage);
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (request.stop) {
+        live_stream_stop();
+        return send_mqtt_response("📡 即時串流已結束，恢復一般採樣");
+    }
+    
+    esp_err_t err = live_stream_start(&request);
+    if (err != ESP_OK) {
+        send_mqtt_response("⚠️ 無法開始即時串流 (未連線或記憶體壓力偏高)");
+        return err;
+    }
+    
+    char msg[128];
+    snprintf(msg, sizeof(msg), "📡 即時串流 %lu Hz，%lu 秒後自動結束 (斷線時立即結束)",
+             request.rate_hz, request.duration_s);
+    return send_mqtt_response(msg);
+}
+
+// ============================================================================
+// 執行解除暫停澆水指令
+// ============================================================================
+esp_err_t execute_clear_lockout_command(void)
+{
+    ESP_LOGI(TAG, "🔓 執行解除暫停澆水指令");
+    
+    uint32_t lockout_s = 0;
+    bool was_locked = !watering_monitor_pump_allowed(&lockout_s);
+    watering_monitor_clear_lockout();
+    
+    if (!was_locked) {
+        return send_mqtt_response("🔓 目前未暫停澆水，已將連續無回應次數歸零");
+    }
+    char msg[128];
+    snprintf(msg, sizeof(msg), "🔓 已解除暫停澆水 (原剩餘 %lu 分鐘)，下次澆水將重新監測回應", lockout_s / 60);
+    return send_mqtt_response(msg);
+}
@@ -17,22 +17,35 @@
 // 指令類型定義
 // ============================================================================
 typedef enum {
-    CMD_WATER,          // 澆水指令 (自動開啟幫浦1.5秒)
+    CMD_WATER,          // 澆水指令 (自動開啟幫浦1.5秒；"WATER:200" 定量出水 200 ml)
     CMD_GET_STATUS,     // 取得系統狀態
     CMD_GET_READING,    // 取得即時讀數
     CMD_OTA_UPDATE,     // OTA 韌體更新指令
     CMD_OTA_STATUS,     // 取得 OTA 狀態
     CMD_OTA_CANCEL,     // 取消 OTA 更新
+    CMD_ADC_BENCH,      // ADC 擷取效能與雜訊基準測試
+    CMD_CAPTURE,        // 高取樣率原始 ADC 擷取 (可於泵浦啟動時觸發)
+    CMD_OTA_HISTORY,    // 重新上傳 NVS 中保留的 OTA 嘗試紀錄
+    CMD_LIVE_STREAM,    // 即時高頻讀數串流 ("LIVE_STREAM:300:10"，"LIVE_STREAM:stop" 結束)
+    CMD_CLEAR_LOCKOUT,  // 解除乾抽後的暫停澆水 (補水或排除堵塞後使用)
     CMD_UNKNOWN         // 未知指令
 } command_type_t;
 
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define COMMAND_MAX_PAYLOAD     320     // 單則指令訊息上限 (參數 data[160] + 指令名稱與 JSON 期限欄位)
+
 // ============================================================================
 // 指令結構體定義
 // ============================================================================
 typedef struct {
     command_type_t type;        // 指令類型
-    char data[64];              // 指令資料 (如有需要)
+    char data[160];             // 指令參數 ("指令:參數" 中冒號之後的部分，例如 OTA 韌體 URL)
     uint32_t timestamp;         // 接收時間戳
+    int64_t enqueue_us;         // 加入佇列時間 (us，用於量測派送延遲)
+    int64_t deadline_us;        // 執行期限 (esp_timer 時間，超過即捨棄；INT64_MAX 表示無期限)
+    uint32_t seq;               // 加入順序 (同優先等級、同期限時先進先出)
 } mqtt_command_t;
 
 // ============================================================================
@@ -44,7 +57,6 @@ typedef struct {
 // ============================================================================
 // 全域變數宣告 (在 command_handler.c 中定義)
 // ============================================================================
-extern QueueHandle_t command_queue;        // 指令佇列句柄
 extern EventGroupHandle_t cmd_event_group; // 指令事件群組句柄
 
 // ============================================================================
@@ -72,20 +84,54 @@ command_type_t parse_command(const char* command_str, int cmd_len);
 /**
  * @brief 將指令加入處理佇列
  * 
+ * 佇列依優先等級 (澆水、取消 OTA 為必要指令) 取出，同等級依期限先後；
+ * 未附期限的指令以收到時間加 COMMAND_DEFAULT_TTL_MS (5 分鐘) 為期限
+ * 
+ * 注意：純文字指令沒有發出時間，期限從「節點收到」起算，Broker 保留或網路延遲後
+ * 才送達的舊指令 (例如斷線一小時後才收到的 WATER) 仍會執行；需要防止延遲送達時請改用 JSON 格式
+ * 
  * @param cmd_type 指令類型
  * @param data 指令資料 (可為 NULL)
  * @return esp_err_t ESP_OK 表示成功加入佇列
  */
 esp_err_t enqueue_command(command_type_t cmd_type, const char* data);
 
+/**
+ * @brief 解析並派送一則收到的指令訊息
+ * 
+ * 供各傳輸層 (MQTT 訂閱、CoAP 輪詢) 共用：解析指令後加入處理佇列
+ * 格式為 "指令" 或 "指令:參數"，例如 "OTA_UPDATE:http://host/fw.bin"、"ADC_BENCH:oneshot:2000"；
+ * 純文字指令的期限為收到後 5 分鐘，無法排除延遲送達的舊指令；
+ * 需要期限時改用 JSON：{"cmd":"WATER:200","issued_ms":<epoch ms>,"ttl_ms":30000}
+ * 或 {"cmd":"WATER:200","deadline_ms":<epoch ms>}，已過期的指令不會進入佇列
+ * (以發出時間計算需節點已完成 SNTP 校時，否則退回以收到時間加 ttl_ms)
+ * 
+ * @param payload 指令訊息內容 (不需以 '\0' 結尾)
+ * @param len 訊息長度
+ * @return esp_err_t ESP_OK 表示已加入佇列，ESP_ERR_NOT_SUPPORTED 表示未知指令，
+ *         ESP_ERR_TIMEOUT 表示佇列已滿，ESP_ERR_INVALID_STATE 表示已過期 (已回應，不需再回覆)
+ */
+esp_err_t dispatch_command_payload(const char* payload, int len);
+
+/**
+ * @brief 拒收超過 COMMAND_MAX_PAYLOAD 的指令訊息：記錄日誌並回覆 4.13 錯誤訊息
+ *
+ * @param source 指令來源 (日誌與回應用，例如 "CoAP")
+ * @param len 訊息長度
+ */
+void command_handler_reject_oversize(const char* source, size_t len);
+
 /**
  * @brief 執行澆水指令
  * 
- * 開啟幫浦1.5秒後自動關閉
+ * 無參數時開啟幫浦1.5秒後自動關閉；參數為水量 (例如 "200" 或 "200ml") 時
+ * 依流量計出水，達到目標水量即停止，無水流或逾時則提前停止
  * 
- * @return esp_err_t ESP_OK 表示執行成功
+ * @param args 指令參數，可為 NULL 或空字串
+ * @return esp_err_t ESP_OK 表示執行成功，ESP_ERR_NOT_SUPPORTED 表示未安裝流量計無法定量，
+ *                   ESP_ERR_NOT_FOUND 表示無水流提前停止，ESP_ERR_TIMEOUT 表示逾時仍未達目標水量
  */
-esp_err_t execute_water_command(void);
+esp_err_t execute_water_command(const char* args);
 
 /**
  * @brief 執行狀態查詢指令
@@ -109,7 +155,7 @@ esp_err_t execute_reading_command(void);
 bool get_pump_status(void);
 
 /**
- * @brief 設定泵浦狀態
+ * @brief 設定泵浦狀態 (開啟時由計時器保護，超過定量澆水上限自動關閉)
  * 
  * @param enabled 泵浦狀態
  */
@@ -123,6 +169,14 @@ void set_pump_status(bool enabled);
  */
 void get_command_stats(uint32_t* processed_count, uint32_t* error_count);
 
+/**
+ * @brief 取得指令期限統計
+ * 
+ * @param expired_count 超過期限而未執行的指令數指標
+ * @param late_count 期限內開始、但完成時已超過期限的指令數指標
+ */
+void get_command_deadline_stats(uint32_t* expired_count, uint32_t* late_count);
+
 /**
  * @brief 取得澆水次數統計
  * 
@@ -130,6 +184,13 @@ void get_command_stats(uint32_t* processed_count, uint32_t* error_count);
  */
 uint32_t get_water_count(void);
 
+/**
+ * @brief 取得指令處理任務堆疊的歷史最低剩餘量
+ * 
+ * @return uint32_t 剩餘 bytes (任務尚未建立時為 0)
+ */
+uint32_t get_command_task_stack_free(void);
+
 /**
  * @brief 執行 OTA 更新指令
  * 
@@ -152,6 +213,44 @@ esp_err_t execute_ota_status_command(void);
  */
 esp_err_t execute_ota_cancel_command(void);
 
+/**
+ * @brief 執行 OTA 紀錄重新上傳指令 (紀錄由感測器任務逐筆發布)
+ * 
+ * @return esp_err_t ESP_OK 表示執行成功
+ */
+esp_err_t execute_ota_history_command(void);
+
+/**
+ * @brief 執行 ADC 基準測試指令 (在低優先順序任務中執行，結果另行發布)
+ * 
+ * @param args 測試參數，格式見 adc_bench_parse_args()
+ * @return esp_err_t ESP_OK 表示已啟動
+ */
+esp_err_t execute_adc_bench_command(const char* args);
+
+/**
+ * @brief 執行原始 ADC 擷取指令 (擷取與上傳在背景任務進行)
+ * 
+ * @param args 擷取參數，格式見 raw_capture_parse_args()
+ * @return esp_err_t ESP_OK 表示已啟動或已預備
+ */
+esp_err_t execute_capture_command(const char* args);
+
+/**
+ * @brief 執行即時串流指令 (串流在低優先順序任務中進行，到期或斷線自動結束)
+ * 
+ * @param args 串流參數，格式見 live_stream_parse_args()
+ * @return esp_err_t ESP_OK 表示已開始、已更新或已結束
+ */
+esp_err_t execute_live_stream_command(const char* args);
+
+/**
+ * @brief 執行解除暫停澆水指令
+ * 
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t execute_clear_lockout_command(void);
+
 
 esp_mqtt_client_handle_t get_mqtt_client(void);
 
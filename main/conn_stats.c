@@ -0,0 +1,357 @@
+// ============================================================================
+// conn_stats.c - 連線品質統計模組實作
+// 功能：事件處理函數只更新計數 (portMUX 保護)；統計日以開機時間切分，
+//       日結時把完整報告格式化到靜態緩衝區，由週期任務在連線時發布
+// ============================================================================
+
+#include "conn_stats.h"
+#include "telemetry_transport.h"
+#include "time_sync.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define REPORT_JSON_SIZE    768     // 精簡報告最大長度
+
+// 斷線時長直方圖上界 (秒)，最後一格為 ≥ 7200 秒
+static const uint32_t outage_bin_limits_s[CONN_STATS_OUTAGE_BINS - 1] = { 10, 30, 60, 300, 1800, 7200 };
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "CONN_STATS";
+
+// ============================================================================
+// 內部資料結構
+// ============================================================================
+typedef struct {
+    bool up;
+    bool ever_up;
+    int64_t since_us;           // 目前狀態開始時間
+    int reason;                 // 最近一次斷線原因
+    int64_t connected_us;       // 當日已結束的連線區段累計
+    uint32_t outages;
+    uint32_t longest_outage_s;
+    uint16_t outage_hist[CONN_STATS_OUTAGE_BINS];
+} link_state_t;
+
+typedef struct {
+    uint8_t link;
+    int16_t reason;
+    uint16_t count;
+    uint32_t total_ms;          // 重連耗時累計
+    uint32_t max_ms;            // 最長重連耗時
+} cause_stats_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static const char *report_topic = NULL;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static link_state_t links[CONN_LINK_COUNT];
+static cause_stats_t causes[CONN_STATS_MAX_CAUSES];
+static size_t cause_count = 0;
+static uint32_t bytes_sent = 0;
+static uint32_t bytes_received = 0;
+static uint32_t first_connect_ms = 0;   // 開機到第一次 MQTT 連線的時間
+
+static int64_t day_start_us = 0;
+static uint32_t day_index = 0;
+static int64_t last_report_us = 0;
+
+static char final_report[REPORT_JSON_SIZE];     // 已結束統計日的報告 (待發布)
+static bool final_pending = false;
+static uint32_t final_dropped = 0;              // 未能發布即被覆蓋的日報數
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void roll_day_locked(int64_t now_us);
+static void reset_day_locked(int64_t now_us);
+static void record_cause_locked(conn_link_t link, int reason, uint32_t latency_ms);
+static int format_report_locked(char* buf, size_t size, int64_t now_us, bool final);
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t conn_stats_init(const char* topic)
+{
+    if (topic == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&stats_lock);
+    report_topic = topic;
+    memset(links, 0, sizeof(links));
+    for (int i = 0; i < CONN_LINK_COUNT; i++) {
+        links[i].since_us = now_us;
+    }
+    reset_day_locked(now_us);
+    last_report_us = now_us;
+    portEXIT_CRITICAL(&stats_lock);
+
+    ESP_LOGI(TAG, "✅ 連線品質統計初始化完成 (每 %d 秒發布，%d 秒為一統計日)",
+             CONN_STATS_REPORT_S, CONN_STATS_DAY_S);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 事件回報
+// ============================================================================
+void conn_stats_link_up(conn_link_t link)
+{
+    if (link >= CONN_LINK_COUNT) {
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    uint32_t outage_ms = 0;
+    bool reconnect = false;
+
+    portENTER_CRITICAL(&stats_lock);
+    roll_day_locked(now_us);
+    link_state_t *l = &links[link];
+    if (!l->up) {
+        outage_ms = (uint32_t)((now_us - l->since_us) / 1000);
+        if (l->ever_up) {
+            // 重連：斷線時長同時是重連耗時
+            reconnect = true;
+            uint32_t outage_s = outage_ms / 1000;
+            int bin = 0;
+            while (bin < CONN_STATS_OUTAGE_BINS - 1 && outage_s >= outage_bin_limits_s[bin]) {
+                bin++;
+            }
+            if (l->outage_hist[bin] < UINT16_MAX) {
+                l->outage_hist[bin]++;
+            }
+            if (outage_s > l->longest_outage_s) {
+                l->longest_outage_s = outage_s;
+            }
+            record_cause_locked(link, l->reason, outage_ms);
+        } else if (link == CONN_LINK_MQTT) {
+            first_connect_ms = (uint32_t)(now_us / 1000);
+        }
+        l->up = true;
+        l->ever_up = true;
+        l->since_us = now_us;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (reconnect) {
+        ESP_LOGI(TAG, "📶 %s 重連完成，斷線 %lu ms",
+                 link == CONN_LINK_WIFI ? "WiFi" : "MQTT", outage_ms);
+    }
+}
+
+void conn_stats_link_down(conn_link_t link, int reason)
+{
+    if (link >= CONN_LINK_COUNT) {
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&stats_lock);
+    roll_day_locked(now_us);
+    link_state_t *l = &links[link];
+    if (l->up) {
+        int64_t start_us = l->since_us > day_start_us ? l->since_us : day_start_us;
+        l->connected_us += now_us - start_us;
+        l->outages++;
+        l->up = false;
+        l->since_us = now_us;
+        l->reason = reason;
+    } else if (!l->ever_up) {
+        l->reason = reason;  // 尚未連上過：保留最近一次失敗原因
+    }
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void conn_stats_add_bytes(uint32_t sent, uint32_t received)
+{
+    portENTER_CRITICAL(&stats_lock);
+    bytes_sent += sent;
+    bytes_received += received;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+// ============================================================================
+// 週期發布
+// ============================================================================
+void conn_stats_report(void)
+{
+    if (report_topic == NULL) {
+        return;
+    }
+
+    static char msg[REPORT_JSON_SIZE];
+    int64_t now_us = esp_timer_get_time();
+    int len = 0;
+    bool final = false;
+
+    portENTER_CRITICAL(&stats_lock);
+    roll_day_locked(now_us);
+    if (final_pending) {
+        len = strlen(final_report);
+        memcpy(msg, final_report, len + 1);
+        final = true;
+    } else if (now_us - last_report_us >= CONN_STATS_REPORT_S * 1000000LL) {
+        // 當日累計值每次都包含先前內容，送不出去時等下一個間隔即可
+        len = format_report_locked(msg, sizeof(msg), now_us, false);
+        last_report_us = now_us;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (len <= 0 || !telemetry_is_connected()) {
+        return;
+    }
+
+    if (telemetry_publish(report_topic, msg, len, 1, 0) == ESP_OK) {
+        if (final) {
+            portENTER_CRITICAL(&stats_lock);
+            final_pending = false;
+            portEXIT_CRITICAL(&stats_lock);
+        }
+        ESP_LOGI(TAG, "📶 連線品質%s已發布 (%d bytes)", final ? "日報" : "統計", len);
+    }
+}
+
+void conn_stats_get(conn_link_t link, conn_link_stats_t* stats)
+{
+    if (link >= CONN_LINK_COUNT || stats == NULL) {
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&stats_lock);
+    const link_state_t *l = &links[link];
+    int64_t connected_us = l->connected_us;
+    if (l->up) {
+        connected_us += now_us - (l->since_us > day_start_us ? l->since_us : day_start_us);
+    }
+    stats->up = l->up;
+    stats->connected_s = (uint32_t)(connected_us / 1000000);
+    stats->elapsed_s = (uint32_t)((now_us - day_start_us) / 1000000);
+    stats->outages = l->outages;
+    stats->longest_outage_s = l->longest_outage_s;
+    memcpy(stats->outage_hist, l->outage_hist, sizeof(stats->outage_hist));
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+// ============================================================================
+// 統計日切換 (內部函數，需持有 stats_lock)
+// ============================================================================
+static void roll_day_locked(int64_t now_us)
+{
+    while (now_us - day_start_us >= CONN_STATS_DAY_S * 1000000LL) {
+        int64_t day_end_us = day_start_us + CONN_STATS_DAY_S * 1000000LL;
+        if (final_pending) {
+            final_dropped++;  // 前一天的日報仍未送出 (長時間離線)
+        }
+        final_pending = format_report_locked(final_report, sizeof(final_report), day_end_us, true) > 0;
+        reset_day_locked(day_end_us);
+        day_index++;
+    }
+}
+
+static void reset_day_locked(int64_t now_us)
+{
+    day_start_us = now_us;
+    for (int i = 0; i < CONN_LINK_COUNT; i++) {
+        links[i].connected_us = 0;
+        links[i].outages = 0;
+        links[i].longest_outage_s = 0;
+        memset(links[i].outage_hist, 0, sizeof(links[i].outage_hist));
+    }
+    cause_count = 0;
+    bytes_sent = 0;
+    bytes_received = 0;
+}
+
+// ============================================================================
+// 斷線原因分類 (內部函數，需持有 stats_lock)
+// ============================================================================
+static void record_cause_locked(conn_link_t link, int reason, uint32_t latency_ms)
+{
+    cause_stats_t *cause = NULL;
+    for (size_t i = 0; i < cause_count; i++) {
+        if (causes[i].link == link && causes[i].reason == reason) {
+            cause = &causes[i];
+            break;
+        }
+    }
+    if (cause == NULL) {
+        if (cause_count < CONN_STATS_MAX_CAUSES) {
+            cause = &causes[cause_count++];
+            cause->link = link;
+            cause->reason = reason;
+        } else {
+            cause = &causes[CONN_STATS_MAX_CAUSES - 1];
+            cause->reason = -1;  // 種類過多時併入「其他」
+        }
+    }
+
+    cause->count++;
+    cause->total_ms += latency_ms;
+    if (latency_ms > cause->max_ms) {
+        cause->max_ms = latency_ms;
+    }
+}
+
+// ============================================================================
+// 格式化精簡報告 (內部函數，需持有 stats_lock)
+// 格式：{"type":"conn","day":N,"final":b,"span":秒,"boot_ms":ms,
+//        "w":{"up":千分比,"n":斷線次數,"max":最長秒數,"h":[直方圖]},"m":{...},
+//        "rc":[[層級,原因碼,次數,平均ms,最長ms],...],"tx":位元組,"rx":位元組}
+// ============================================================================
+static int format_report_locked(char* buf, size_t size, int64_t now_us, bool final)
+{
+    static const char *link_keys[CONN_LINK_COUNT] = { "w", "m" };
+    int64_t span_us = now_us - day_start_us;
+    int len = snprintf(buf, size, "{\"type\":\"conn\",\"day\":%lu,\"final\":%s,\"span\":%lld,\"boot_ms\":%lu",
+                       day_index, final ? "true" : "false", span_us / 1000000, first_connect_ms);
+
+    int64_t epoch_ms = time_sync_uptime_to_epoch_ms(day_start_us);
+    if (epoch_ms >= 0 && len < (int)size) {
+        len += snprintf(buf + len, size - len, ",\"start_ms\":%lld", epoch_ms);
+    }
+
+    for (int i = 0; i < CONN_LINK_COUNT && len < (int)size; i++) {
+        const link_state_t *l = &links[i];
+        int64_t connected_us = l->connected_us;
+        if (l->up) {
+            connected_us += now_us - (l->since_us > day_start_us ? l->since_us : day_start_us);
+        }
+        uint32_t up_permille = span_us > 0 ? (uint32_t)(connected_us * 1000 / span_us) : 0;
+        len += snprintf(buf + len, size - len, ",\"%s\":{\"up\":%lu,\"n\":%lu,\"max\":%lu,\"h\":[",
+                        link_keys[i], up_permille, l->outages, l->longest_outage_s);
+        for (int b = 0; b < CONN_STATS_OUTAGE_BINS && len < (int)size; b++) {
+            len += snprintf(buf + len, size - len, b == 0 ? "%u" : ",%u", l->outage_hist[b]);
+        }
+        if (len < (int)size) {
+            len += snprintf(buf + len, size - len, "]}");
+        }
+    }
+
+    if (len < (int)size) {
+        len += snprintf(buf + len, size - len, ",\"rc\":[");
+    }
+    for (size_t i = 0; i < cause_count && len < (int)size; i++) {
+        const cause_stats_t *c = &causes[i];
+        len += snprintf(buf + len, size - len, "%s[%u,%d,%u,%lu,%lu]", i == 0 ? "" : ",",
+                        c->link, c->reason, c->count, c->total_ms / c->count, c->max_ms);
+    }
+    if (len < (int)size) {
+        len += snprintf(buf + len, size - len, "],\"tx\":%lu,\"rx\":%lu,\"lost\":%lu}",
+                        bytes_sent, bytes_received, final_dropped);
+    }
+
+    return len < (int)size ? len : 0;  // 截斷的 JSON 不發布 (持有 spinlock，不可寫日誌)
+}
@@ -0,0 +1,93 @@
+// ============================================================================
+// conn_stats.h - 連線品質統計模組標頭檔
+// 功能：由 WiFi / MQTT 事件處理函數回報連線上下線，按日累計連線時間比例、
+//       斷線時長直方圖、依斷線原因分類的重連耗時與收發位元組數，
+//       以精簡格式定期發布，用於找出值得調整網路的站點
+// ============================================================================
+
+#ifndef CONN_STATS_H
+#define CONN_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define CONN_STATS_DAY_S            86400   // 統計日長度 (秒)
+#define CONN_STATS_REPORT_S         3600    // 當日累計值的發布間隔 (秒)
+#define CONN_STATS_OUTAGE_BINS      7       // 斷線時長直方圖格數
+#define CONN_STATS_MAX_CAUSES       8       // 每日追蹤的斷線原因種類上限 (超過者併入最後一格)
+#define CONN_STATS_REASON_WIFI_DOWN 255     // MQTT 斷線原因：WiFi 先斷線
+
+// ============================================================================
+// 連線層級
+// ============================================================================
+typedef enum {
+    CONN_LINK_WIFI = 0,     // WiFi (原因碼為 wifi_err_reason_t)
+    CONN_LINK_MQTT,         // MQTT (原因碼為 esp_mqtt_error_type_t 或 CONN_STATS_REASON_WIFI_DOWN)
+    CONN_LINK_COUNT,
+} conn_link_t;
+
+// ============================================================================
+// 單一連線層級的當日統計
+// ============================================================================
+typedef struct {
+    bool up;                                        // 目前是否連線
+    uint32_t connected_s;                           // 當日已連線秒數
+    uint32_t elapsed_s;                             // 當日已經過秒數
+    uint32_t outages;                               // 當日斷線次數
+    uint32_t longest_outage_s;                      // 當日最長斷線 (秒)
+    uint16_t outage_hist[CONN_STATS_OUTAGE_BINS];   // 斷線時長直方圖：<10s <30s <1m <5m <30m <2h ≥2h
+} conn_link_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化連線統計
+ *
+ * @param report_topic 統計發布主題
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t conn_stats_init(const char* report_topic);
+
+/**
+ * @brief 連線建立 (WiFi 取得 IP、MQTT 收到 CONNACK 時呼叫)
+ *
+ * @param link 連線層級
+ */
+void conn_stats_link_up(conn_link_t link);
+
+/**
+ * @brief 連線中斷 (WiFi 斷線、MQTT 斷線時呼叫，重複呼叫只記錄第一次)
+ *
+ * @param link 連線層級
+ * @param reason 斷線原因碼，用於分類重連耗時
+ */
+void conn_stats_link_down(conn_link_t link, int reason);
+
+/**
+ * @brief 累計 MQTT 收發位元組數
+ *
+ * @param sent 發送位元組數
+ * @param received 接收位元組數
+ */
+void conn_stats_add_bytes(uint32_t sent, uint32_t received);
+
+/**
+ * @brief 週期呼叫：到達發布間隔或統計日結束時以精簡 JSON 發布 (不使用 cJSON)
+ */
+void conn_stats_report(void);
+
+/**
+ * @brief 取得單一連線層級的當日統計
+ *
+ * @param link 連線層級
+ * @param stats 統計資訊結構指標
+ */
+void conn_stats_get(conn_link_t link, conn_link_stats_t* stats);
+
+#endif // CONN_STATS_H
@@ -0,0 +1,419 @@
+// ============================================================================
+// drying_forecast.c - 乾燥速率預測模組實作
+// 功能：溫度補償後的濕度先做 DRYING_FORECAST_BLOCK_S 區段平均，每個區段以 φ = [1, t, t²]
+//       (t 為擬合開始後的小時數) 做一次帶遺忘因子的 RLS 更新；二次項描述乾燥逐漸趨緩，
+//       直線擬合在指數型乾燥曲線上會系統性低估剩餘時間。
+//       剩餘時間為擬合曲線與門檻的交點，變異數以 delta 法由 σ²·P 傳遞，
+//       再依相鄰區段殘差的自相關 ρ 乘上 (1 + ρ) / (1 - ρ) 放寬 (日夜殘餘漂移使殘差不獨立)。
+//       EMA 濾波值只用來判斷是否已低於門檻與偵測降雨等突升。
+//       每個區段只更新一次且使用 double，對 CPU 負擔可忽略
+// ============================================================================
+
+#include "drying_forecast.h"
+#include "telemetry_transport.h"
+#include "time_sync.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define FILTER_ALPHA            0.25f       // 濾波濕度的 EMA 係數
+#define RLS_PARAMS              3           // [a, b, c]
+#define RLS_INIT_P              100.0       // 參數初始變異數
+#define AUTOCORR_MAX            0.95        // 自相關上限 (放寬倍數最多 39 倍)
+#define Z_95                    1.96
+#define FORECAST_JSON_SIZE      512
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "DRYING_FORECAST";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static drying_forecast_config_t fc_config;
+static const char *forecast_topic = NULL;
+static portMUX_TYPE forecast_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool watering_pending = false;  // 由指令任務設定，下一筆讀數時處理
+
+// 濾波與擬合狀態 (僅感測器任務存取)
+static bool have_filtered = false;
+static float filtered_pct = 0.0f;
+static bool fitting = false;
+static int64_t fit_start_us = 0;
+static int64_t settle_until_us = 0;
+static float fit_min_pct = 0.0f;        // 擬合期間的最低濾波濕度
+
+static int64_t block_start_us = 0;      // 目前區段的第一筆讀數時間
+static double block_sum = 0.0;
+static uint32_t block_count = 0;
+
+static double theta[RLS_PARAMS];        // [a (%), b (%/h), c (%/h²)]
+static double P[RLS_PARAMS][RLS_PARAMS];
+static double err_sum = 0.0;            // 遺忘加權的殘差平方和
+static double weight_sum = 0.0;         // 遺忘加權的區段數
+static double lag_cross = 0.0;          // 遺忘加權的 Σ e_k·e_{k-1}
+static double lag_norm = 0.0;           // 遺忘加權的 Σ e_{k-1}²
+static double prev_residual = 0.0;
+static uint32_t fit_blocks = 0;
+
+// 預測與發布狀態
+static drying_forecast_t forecast = { .state = DRYING_STATE_LEARNING };
+static bool forecast_updated = false;
+static int64_t last_publish_us = 0;
+static bool published_once = false;
+static drying_state_t published_state = DRYING_STATE_LEARNING;
+static float published_hours = 0.0f;
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void start_fit(int64_t sample_us);
+static void rls_step(double t_h, double y);
+static void compute_forecast(drying_forecast_t* out, double now_h);
+static void publish_forecast(const drying_forecast_t* f);
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t drying_forecast_init(const drying_forecast_config_t* config, const char* topic)
+{
+    if (config == NULL || topic == NULL || config->forget_factor <= 0.5f || config->forget_factor > 1.0f) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&fc_config, config, sizeof(drying_forecast_config_t));
+    forecast_topic = topic;
+
+    ESP_LOGI(TAG, "✅ 乾燥速率預測初始化完成 (門檻 %.1f%%，區段 %d 秒，遺忘因子 %.3f，澆水後等待 %lu 秒)",
+             config->threshold_pct, DRYING_FORECAST_BLOCK_S, config->forget_factor, config->settle_s);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 模型更新 (感測器任務中呼叫)
+// ============================================================================
+void drying_forecast_update(int moisture_x10, int64_t sample_us)
+{
+    if (forecast_topic == NULL) {
+        return;
+    }
+
+    float moisture_pct = moisture_x10 / 10.0f;
+    filtered_pct = have_filtered ? filtered_pct + FILTER_ALPHA * (moisture_pct - filtered_pct) : moisture_pct;
+    have_filtered = true;
+
+    drying_forecast_t next = forecast;
+    next.filtered_pct = filtered_pct;
+
+    // 澆水：丟棄目前擬合，滲透期間的上升與回落不納入乾燥模型
+    if (watering_pending) {
+        watering_pending = false;
+        fitting = false;
+        settle_until_us = sample_us + (int64_t)fc_config.settle_s * 1000000LL;
+        next.resets++;
+    }
+
+    if (fitting && (filtered_pct - fit_min_pct) * 10.0f > DRYING_FORECAST_RISE_RESET_X10) {
+        // 沒有經過澆水指令的突升 (降雨、人工澆水)：同樣等待滲透後重新擬合
+        ESP_LOGI(TAG, "🌧️ 濕度上升 %.1f%% (非澆水指令)，重新開始乾燥擬合", filtered_pct - fit_min_pct);
+        fitting = false;
+        settle_until_us = sample_us + (int64_t)fc_config.settle_s * 1000000LL;
+        next.resets++;
+    }
+
+    if (sample_us < settle_until_us) {
+        next.state = DRYING_STATE_LEARNING;
+        next.blocks = 0;
+        next.fit_age_s = 0;
+    } else {
+        if (!fitting) {
+            start_fit(sample_us);
+        }
+        if (filtered_pct < fit_min_pct) {
+            fit_min_pct = filtered_pct;
+        }
+
+        // 區段結束：以區段中點時間與平均值更新一次 RLS
+        block_sum += moisture_pct;
+        block_count++;
+        if (sample_us - block_start_us >= (int64_t)DRYING_FORECAST_BLOCK_S * 1000000LL) {
+            int64_t mid_us = block_start_us + (sample_us - block_start_us) / 2;
+            rls_step((double)(mid_us - fit_start_us) / 3.6e9, block_sum / block_count);
+            block_sum = 0.0;
+            block_count = 0;
+            block_start_us = sample_us;
+        }
+
+        next.blocks = fit_blocks;
+        next.fit_age_s = (uint32_t)((sample_us - fit_start_us) / 1000000LL);
+        compute_forecast(&next, (double)(sample_us - fit_start_us) / 3.6e9);
+    }
+
+    portENTER_CRITICAL(&forecast_lock);
+    forecast = next;
+    forecast_updated = true;
+    portEXIT_CRITICAL(&forecast_lock);
+}
+
+void drying_forecast_note_watering(void)
+{
+    watering_pending = true;
+}
+
+// ============================================================================
+// 發布 (感測器任務中呼叫)
+// ============================================================================
+void drying_forecast_poll(void)
+{
+    if (forecast_topic == NULL || !forecast_updated || !telemetry_is_connected()) {
+        return;
+    }
+
+    drying_forecast_t f;
+    portENTER_CRITICAL(&forecast_lock);
+    f = forecast;
+    forecast_updated = false;
+    portEXIT_CRITICAL(&forecast_lock);
+
+    // 狀態改變、預測乾燥時刻明顯移動或到達發布間隔時才發布
+    // (剩餘時間本來就隨時間遞減，與上次預測扣除經過時間後比較)
+    int64_t now_us = esp_timer_get_time();
+    bool due = !published_once || f.state != published_state ||
+               now_us - last_publish_us >= (int64_t)fc_config.publish_interval_s * 1000000LL;
+    if (!due && f.state == DRYING_STATE_DRYING) {
+        float expected_hours = published_hours - (float)(now_us - last_publish_us) / 3.6e9f;
+        due = fabsf(f.hours_to_threshold - expected_hours) * 100.0f > published_hours * DRYING_FORECAST_CHANGE_PCT;
+    }
+    if (!due) {
+        return;
+    }
+
+    publish_forecast(&f);
+}
+
+void drying_forecast_get(drying_forecast_t* out)
+{
+    if (out == NULL) {
+        return;
+    }
+    portENTER_CRITICAL(&forecast_lock);
+    *out = forecast;
+    portEXIT_CRITICAL(&forecast_lock);
+}
+
+const char* drying_state_name(drying_state_t state)
+{
+    switch (state) {
+        case DRYING_STATE_LEARNING: return "learning";
+        case DRYING_STATE_DRYING:   return "drying";
+        case DRYING_STATE_STABLE:   return "stable";
+        case DRYING_STATE_BELOW:    return "below_threshold";
+        default:                    return "unknown";
+    }
+}
+
+// ============================================================================
+// RLS (內部函數)
+// ============================================================================
+static void start_fit(int64_t sample_us)
+{
+    fitting = true;
+    fit_start_us = sample_us;
+    fit_min_pct = filtered_pct;
+    block_start_us = sample_us;
+    block_sum = 0.0;
+    block_count = 0;
+
+    memset(theta, 0, sizeof(theta));
+    memset(P, 0, sizeof(P));
+    theta[0] = filtered_pct;
+    for (int i = 0; i < RLS_PARAMS; i++) {
+        P[i][i] = RLS_INIT_P;
+    }
+    err_sum = 0.0;
+    weight_sum = 0.0;
+    lag_cross = 0.0;
+    lag_norm = 0.0;
+    prev_residual = 0.0;
+    fit_blocks = 0;
+}
+
+static void rls_step(double t_h, double y)
+{
+    double lambda = fc_config.forget_factor;
+    double phi[RLS_PARAMS] = { 1.0, t_h, t_h * t_h };
+
+    // Pφ 與 φᵀPφ
+    double p_phi[RLS_PARAMS];
+    double denom = lambda;
+    for (int i = 0; i < RLS_PARAMS; i++) {
+        p_phi[i] = 0.0;
+        for (int j = 0; j < RLS_PARAMS; j++) {
+            p_phi[i] += P[i][j] * phi[j];
+        }
+        denom += phi[i] * p_phi[i];
+    }
+
+    double err = y;
+    for (int i = 0; i < RLS_PARAMS; i++) {
+        err -= theta[i] * phi[i];
+    }
+    for (int i = 0; i < RLS_PARAMS; i++) {
+        theta[i] += p_phi[i] / denom * err;
+    }
+
+    // P = (P - Pφφᵀ P / (λ + φᵀPφ)) / λ，只算上三角並鏡射，維持對稱
+    for (int i = 0; i < RLS_PARAMS; i++) {
+        for (int j = i; j < RLS_PARAMS; j++) {
+            P[i][j] = (P[i][j] - p_phi[i] * p_phi[j] / denom) / lambda;
+            P[j][i] = P[i][j];
+        }
+    }
+
+    double post = y;
+    for (int i = 0; i < RLS_PARAMS; i++) {
+        post -= theta[i] * phi[i];
+    }
+    err_sum = lambda * err_sum + post * post;
+    weight_sum = lambda * weight_sum + 1.0;
+    if (fit_blocks > 0) {
+        lag_cross = lambda * lag_cross + post * prev_residual;
+        lag_norm = lambda * lag_norm + prev_residual * prev_residual;
+    }
+    prev_residual = post;
+    fit_blocks++;
+}
+
+// gᵀ·P·g
+static double quad_form(const double g[RLS_PARAMS])
+{
+    double sum = 0.0;
+    for (int i = 0; i < RLS_PARAMS; i++) {
+        for (int j = 0; j < RLS_PARAMS; j++) {
+            sum += g[i] * P[i][j] * g[j];
+        }
+    }
+    return sum > 0.0 ? sum : 0.0;
+}
+
+static void compute_forecast(drying_forecast_t* out, double now_h)
+{
+    double sigma2 = err_sum / (weight_sum > RLS_PARAMS + 1 ? weight_sum - RLS_PARAMS : 1.0);
+    double rho = lag_norm > 0.0 ? lag_cross / lag_norm : 0.0;
+    rho = rho < 0.0 ? 0.0 : (rho > AUTOCORR_MAX ? AUTOCORR_MAX : rho);
+    double var_scale = sigma2 * (1.0 + rho) / (1.0 - rho);
+
+    double a = theta[0], b = theta[1], c = theta[2];
+    double slope_now = b + 2.0 * c * now_h;
+    double g_rate[RLS_PARAMS] = { 0.0, 1.0, 2.0 * now_h };
+
+    out->rate_pct_per_h = (float)-slope_now;
+    out->rate_sd = (float)sqrt(var_scale * quad_form(g_rate));
+    out->rmse_pct = (float)sqrt(sigma2);
+    out->autocorr = (float)rho;
+    out->hours_to_threshold = 0.0f;
+    out->hours_low = 0.0f;
+    out->hours_high = 0.0f;
+
+    if (filtered_pct <= fc_config.threshold_pct) {
+        out->state = DRYING_STATE_BELOW;
+        return;
+    }
+    if (fit_blocks < DRYING_FORECAST_MIN_BLOCKS || now_h * 3600.0 < DRYING_FORECAST_MIN_SPAN_S) {
+        out->state = DRYING_STATE_LEARNING;
+        return;
+    }
+
+    // 解 c·t² + b·t + (a - 門檻) = 0，取目前之後第一個交點
+    double k = a - fc_config.threshold_pct;
+    double cross_h = -1.0;
+    if (fabs(c) < 1e-9) {
+        if (b < 0.0) {
+            cross_h = -k / b;
+        }
+    } else {
+        double disc = b * b - 4.0 * c * k;
+        if (disc >= 0.0) {
+            double q = -0.5 * (b + (b >= 0.0 ? sqrt(disc) : -sqrt(disc)));
+            double r1 = q / c;
+            double r2 = q != 0.0 ? k / q : r1;
+            double lo = r1 < r2 ? r1 : r2;
+            double hi = r1 < r2 ? r2 : r1;
+            cross_h = lo > now_h ? lo : hi;
+        }
+    }
+    double slope_cross = b + 2.0 * c * cross_h;
+    if (cross_h <= now_h || slope_cross >= 0.0 || -slope_now < DRYING_FORECAST_MIN_RATE) {
+        // 不再下降，或擬合曲線在門檻之上趨於平緩
+        out->state = DRYING_STATE_STABLE;
+        return;
+    }
+
+    // 隱函數 F(θ, t) = a + b·t + c·t² - 門檻 = 0：∂t/∂θ = -[1, t, t²] / F'(t)
+    double g_cross[RLS_PARAMS] = { -1.0 / slope_cross, -cross_h / slope_cross, -cross_h * cross_h / slope_cross };
+    double sd = sqrt(var_scale * quad_form(g_cross));
+    double hours = cross_h - now_h;
+
+    out->state = DRYING_STATE_DRYING;
+    out->hours_to_threshold = (float)fmin(hours, DRYING_FORECAST_MAX_HOURS);
+    out->hours_low = (float)fmax(hours - Z_95 * sd, 0.0);
+    out->hours_high = (float)fmin(hours + Z_95 * sd, DRYING_FORECAST_MAX_HOURS);
+}
+
+// ============================================================================
+// 發布預測 (snprintf，不建立 cJSON 樹；保留訊息讓後端訂閱時即取得最新預測)
+// ============================================================================
+static void publish_forecast(const drying_forecast_t* f)
+{
+    char json[FORECAST_JSON_SIZE];
+    int len = snprintf(json, sizeof(json),
+                       "{\"type\":\"drying_forecast\",\"state\":\"%s\",\"moisture\":%.1f,\"threshold\":%.1f,"
+                       "\"rate_pct_per_h\":%.3f,\"rate_sd\":%.3f,\"rmse\":%.2f,\"autocorr\":%.2f,"
+                       "\"blocks\":%lu,\"fit_age_s\":%lu,\"resets\":%lu,\"uptime\":%lld",
+                       drying_state_name(f->state), f->filtered_pct, fc_config.threshold_pct,
+                       f->rate_pct_per_h, f->rate_sd, f->rmse_pct, f->autocorr,
+                       f->blocks, f->fit_age_s, f->resets, esp_timer_get_time() / 1000000);
+
+    int64_t now_ms = time_sync_now_ms();
+    if (len > 0 && len < (int)sizeof(json) && now_ms >= 0) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"ts_ms\":%lld", now_ms);
+    }
+    if (len > 0 && len < (int)sizeof(json) && f->state == DRYING_STATE_DRYING) {
+        len += snprintf(json + len, sizeof(json) - len,
+                        ",\"hours_to_threshold\":%.2f,\"hours_low\":%.2f,\"hours_high\":%.2f",
+                        f->hours_to_threshold, f->hours_low, f->hours_high);
+        if (len > 0 && len < (int)sizeof(json) && now_ms >= 0) {
+            len += snprintf(json + len, sizeof(json) - len, ",\"dry_at_ms\":%lld",
+                            now_ms + (int64_t)(f->hours_to_threshold * 3600000.0f));
+        }
+    }
+    if (len <= 0 || len + 1 >= (int)sizeof(json)) {
+        return;
+    }
+    json[len++] = '}';
+    json[len] = '\0';
+
+    if (telemetry_publish(forecast_topic, json, len, 1, 1) != ESP_OK) {
+        portENTER_CRITICAL(&forecast_lock);
+        forecast_updated = true;  // 下次輪詢再試
+        portEXIT_CRITICAL(&forecast_lock);
+        return;
+    }
+
+    published_once = true;
+    published_state = f->state;
+    published_hours = f->hours_to_threshold;
+    last_publish_us = esp_timer_get_time();
+    if (f->state == DRYING_STATE_DRYING) {
+        ESP_LOGI(TAG, "🌱 乾燥預測：%.2f%%/h，%.1f 小時後低於 %.1f%% (95%% 區間 %.1f ~ %.1f)",
+                 f->rate_pct_per_h, f->hours_to_threshold, fc_config.threshold_pct, f->hours_low, f->hours_high);
+    } else {
+        ESP_LOGI(TAG, "🌱 乾燥預測狀態：%s (濕度 %.1f%%)", drying_state_name(f->state), f->filtered_pct);
+    }
+}
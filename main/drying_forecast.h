@@ -0,0 +1,107 @@
+// ============================================================================
+// drying_forecast.h - 乾燥速率預測模組標頭檔
+// 功能：以上次澆水後溫度補償濕度的區段平均做帶遺忘因子的遞迴最小平方 (RLS) 二次擬合
+//       m(t) = a + b·t + c·t²，估計目前乾燥速率並預測濕度降到門檻的剩餘時間與 95% 信賴區間；
+//       預測有明顯變化或到達發布間隔時才發布一則預測，取代後端逐點迴歸
+// ============================================================================
+
+#ifndef DRYING_FORECAST_H
+#define DRYING_FORECAST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define DRYING_FORECAST_BLOCK_S         3600    // 每個區段平均後才做一次 RLS 更新 (降低雜訊與殘差自相關)
+#define DRYING_FORECAST_MIN_BLOCKS      6       // 擬合開始後至少需要的區段數
+#define DRYING_FORECAST_MIN_SPAN_S      10800   // 擬合開始後至少經過的時間
+#define DRYING_FORECAST_MIN_RATE        0.01f   // 乾燥速率低於此值 (%/h) 視為穩定，不預測
+#define DRYING_FORECAST_MAX_HOURS       720.0f  // 預測上限 (30 天)
+#define DRYING_FORECAST_RISE_RESET_X10  30      // 濾波濕度比擬合期間最低值高出 3% 時重新開始 (降雨、人工澆水)
+#define DRYING_FORECAST_CHANGE_PCT      10      // 預測剩餘時間變化超過此比例時提前發布
+
+// ============================================================================
+// 預測狀態
+// ============================================================================
+typedef enum {
+    DRYING_STATE_LEARNING = 0,      // 澆水後等待滲透穩定或讀數不足
+    DRYING_STATE_DRYING,            // 正在乾燥，已有剩餘時間預測
+    DRYING_STATE_STABLE,            // 濕度未下降，或擬合曲線在門檻之上趨於平緩
+    DRYING_STATE_BELOW,             // 已低於門檻
+} drying_state_t;
+
+// ============================================================================
+// 預測設定
+// ============================================================================
+typedef struct {
+    float threshold_pct;            // 需要澆水的濕度門檻 (%)
+    float forget_factor;            // RLS 遺忘因子 (每個區段)
+    uint32_t settle_s;              // 澆水後等待滲透穩定的時間 (秒)
+    uint32_t publish_interval_s;    // 預測未明顯變化時的最長發布間隔 (秒)
+} drying_forecast_config_t;
+
+// ============================================================================
+// 預測結果
+// ============================================================================
+typedef struct {
+    drying_state_t state;
+    float filtered_pct;             // 目前濾波濕度 (%)
+    float rate_pct_per_h;           // 目前乾燥速率 (%/h，正值表示變乾)
+    float rate_sd;                  // 速率標準差 (%/h)
+    float hours_to_threshold;       // 預測剩餘時間 (小時，僅 DRYING 有效)
+    float hours_low;                // 95% 信賴區間下限
+    float hours_high;               // 95% 信賴區間上限
+    float rmse_pct;                 // 區段平均的擬合殘差 (%)
+    float autocorr;                 // 相鄰區段殘差的自相關 (信賴區間依此放寬)
+    uint32_t blocks;                // 本次擬合納入的區段數
+    uint32_t fit_age_s;             // 擬合開始 (澆水後穩定) 至今的時間
+    uint32_t resets;                // 開機以來重新開始擬合的次數
+} drying_forecast_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化乾燥速率預測 (模型只保存在 RAM，重啟後重新學習)
+ *
+ * @param config 預測設定
+ * @param topic 預測發布主題
+ * @return esp_err_t ESP_ERR_INVALID_ARG 表示設定無效
+ */
+esp_err_t drying_forecast_init(const drying_forecast_config_t* config, const char* topic);
+
+/**
+ * @brief 以一筆讀數更新模型 (每次採樣呼叫，離線時也要呼叫)
+ *
+ * @param moisture_x10 溫度補償後的濕度 (0.1%)
+ * @param sample_us 採樣當下的 esp_timer_get_time()
+ */
+void drying_forecast_update(int moisture_x10, int64_t sample_us);
+
+/**
+ * @brief 澆水開始時呼叫：丟棄目前擬合，等待滲透穩定後重新開始
+ */
+void drying_forecast_note_watering(void);
+
+/**
+ * @brief 週期呼叫 (感測器任務)：連線且預測到期時發布
+ */
+void drying_forecast_poll(void);
+
+/**
+ * @brief 取得目前的預測
+ *
+ * @param forecast 預測結果指標
+ */
+void drying_forecast_get(drying_forecast_t* forecast);
+
+/**
+ * @brief 取得狀態名稱字串
+ */
+const char* drying_state_name(drying_state_t state);
+
+#endif // DRYING_FORECAST_H
@@ -0,0 +1,354 @@
+// ============================================================================
+// flow_meter.c - 水流量計模組實作
+// 功能：ESP32-C3 沒有 PCNT 週邊，以 GPIO 上升緣中斷計數脈衝；
+//       定量澆水時中斷在達到目標脈衝數的當下喚醒等待的任務。
+//       模擬來源依泵浦實際開啟的時間與設定流量推算脈衝，行為與硬體來源一致
+// ============================================================================
+
+#include "flow_meter.h"
+#include "power_mgmt.h"
+#include "pump_control.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "driver/gpio.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define FLOW_MIN_PULSE_INTERVAL_US  500     // 短於此間隔的邊緣視為雜訊 (感測器最高約 300 Hz)
+#define NVS_NAMESPACE               "flow"
+#define NVS_KEY_TOTAL               "total_ml"
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "FLOW_METER";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static flow_meter_config_t meter_config;
+static bool meter_ready = false;
+static portMUX_TYPE flow_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// 由中斷 (或模擬來源) 更新，以 flow_lock 保護
+static uint32_t pulse_count = 0;
+static int64_t last_pulse_us = 0;
+static uint32_t target_pulses = 0;
+static TaskHandle_t target_waiter = NULL;
+
+// 本次出水計量 (只由澆水指令的任務存取)
+static bool active = false;
+static uint32_t start_pulses = 0;
+static int64_t start_us = 0;
+
+// 模擬來源
+static uint32_t mock_rate_ml_per_min = 0;
+static int64_t mock_synced_us = 0;
+static uint64_t mock_residual = 0;          // 未滿一個脈衝的累積量 (脈衝 × 60e9)
+
+static flow_meter_stats_t meter_stats;
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void mock_sync(void);
+static uint32_t pulses_to_ml(uint32_t pulses);
+static void load_total(void);
+static void save_total(uint64_t total_ml);
+
+// ============================================================================
+// 脈衝中斷 (硬體來源)
+// ============================================================================
+static void IRAM_ATTR flow_pulse_isr(void *arg)
+{
+    int64_t now_us = esp_timer_get_time();
+    TaskHandle_t waiter = NULL;
+
+    portENTER_CRITICAL_ISR(&flow_lock);
+    if (now_us - last_pulse_us >= FLOW_MIN_PULSE_INTERVAL_US) {
+        pulse_count++;
+        last_pulse_us = now_us;
+        if (target_waiter != NULL && pulse_count == target_pulses) {
+            waiter = target_waiter;
+        }
+    }
+    portEXIT_CRITICAL_ISR(&flow_lock);
+
+    if (waiter != NULL) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(waiter, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t flow_meter_init(const flow_meter_config_t* config)
+{
+    if (config == NULL || config->pulses_per_liter == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&meter_config, config, sizeof(flow_meter_config_t));
+
+    if (!meter_config.mock) {
+        if (meter_config.gpio < 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        gpio_config_t io_conf = {
+            .intr_type = GPIO_INTR_POSEDGE,
+            .mode = GPIO_MODE_INPUT,
+            .pin_bit_mask = 1ULL << meter_config.gpio,
+            .pull_up_en = GPIO_PULLUP_ENABLE,        // 感測器為開集極輸出
+            .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        };
+        esp_err_t err = gpio_config(&io_conf);
+        if (err == ESP_OK) {
+            err = gpio_install_isr_service(0);
+            if (err == ESP_ERR_INVALID_STATE) {
+                err = ESP_OK;  // 其他模組已安裝中斷服務
+            }
+        }
+        if (err == ESP_OK) {
+            err = gpio_isr_handler_add(meter_config.gpio, flow_pulse_isr, NULL);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "❌ 流量計中斷安裝失敗: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    mock_rate_ml_per_min = meter_config.mock_ml_per_min;
+    load_total();
+    meter_ready = true;
+
+    portENTER_CRITICAL(&flow_lock);
+    meter_stats.available = true;
+    meter_stats.mock = meter_config.mock;
+    portEXIT_CRITICAL(&flow_lock);
+
+    if (meter_config.mock) {
+        ESP_LOGI(TAG, "✅ 流量計初始化完成 (模擬來源 %lu ml/min，K=%lu)",
+                 mock_rate_ml_per_min, meter_config.pulses_per_liter);
+    } else {
+        ESP_LOGI(TAG, "✅ 流量計初始化完成 (GPIO%d，K=%lu 脈衝/公升)",
+                 meter_config.gpio, meter_config.pulses_per_liter);
+    }
+    return ESP_OK;
+}
+
+bool flow_meter_is_available(void)
+{
+    return meter_ready;
+}
+
+// ============================================================================
+// 出水計量
+// ============================================================================
+void flow_meter_start(void)
+{
+    if (!meter_ready || active) {
+        return;
+    }
+    if (!meter_config.mock) {
+        power_mgmt_acquire(PM_SUBSYS_FLOW);
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&flow_lock);
+    start_pulses = pulse_count;
+    mock_synced_us = now_us;
+    mock_residual = 0;
+    portEXIT_CRITICAL(&flow_lock);
+    start_us = now_us;
+    active = true;
+}
+
+uint32_t flow_meter_activation_ml(void)
+{
+    if (!active) {
+        return 0;
+    }
+    mock_sync();
+    portENTER_CRITICAL(&flow_lock);
+    uint32_t pulses = pulse_count - start_pulses;
+    portEXIT_CRITICAL(&flow_lock);
+    return pulses_to_ml(pulses);
+}
+
+esp_err_t flow_meter_wait_volume(uint32_t target_ml, uint32_t timeout_ms, uint32_t no_flow_ms)
+{
+    if (!active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // 目標脈衝數無條件進位，寧可多出一個脈衝的水量也不短少
+    uint32_t needed = (uint32_t)(((uint64_t)target_ml * meter_config.pulses_per_liter + 999) / 1000);
+    ulTaskNotifyTake(pdTRUE, 0);  // 清除先前殘留的通知
+
+    portENTER_CRITICAL(&flow_lock);
+    target_pulses = start_pulses + needed;
+    target_waiter = xTaskGetCurrentTaskHandle();
+    portEXIT_CRITICAL(&flow_lock);
+
+    esp_err_t result;
+    while (1) {
+        mock_sync();
+
+        int64_t now_us = esp_timer_get_time();
+        portENTER_CRITICAL(&flow_lock);
+        uint32_t delivered = pulse_count - start_pulses;
+        int64_t last_flow_us = last_pulse_us > start_us ? last_pulse_us : start_us;
+        portEXIT_CRITICAL(&flow_lock);
+
+        if (delivered >= needed) {
+            result = ESP_OK;
+            break;
+        }
+        if (now_us - start_us >= (int64_t)timeout_ms * 1000) {
+            result = ESP_ERR_TIMEOUT;
+            break;
+        }
+        if (now_us - last_flow_us >= (int64_t)no_flow_ms * 1000) {
+            result = ESP_ERR_NOT_FOUND;
+            break;
+        }
+
+        // 硬體來源在達到目標時由中斷提前喚醒
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FLOW_METER_POLL_MS));
+    }
+
+    portENTER_CRITICAL(&flow_lock);
+    target_waiter = NULL;
+    target_pulses = 0;
+    portEXIT_CRITICAL(&flow_lock);
+    return result;
+}
+
+uint32_t flow_meter_stop(void)
+{
+    if (!active) {
+        return 0;
+    }
+    mock_sync();
+    active = false;
+
+    int64_t now_us = esp_timer_get_time();
+    uint32_t duration_ms = (uint32_t)((now_us - start_us) / 1000);
+
+    portENTER_CRITICAL(&flow_lock);
+    uint32_t pulses = pulse_count - start_pulses;
+    uint32_t ml = pulses_to_ml(pulses);
+    meter_stats.activations++;
+    meter_stats.total_ml += ml;
+    meter_stats.last_ml = ml;
+    meter_stats.last_duration_ms = duration_ms;
+    meter_stats.last_flow_ml_per_min = duration_ms > 0 ? (uint32_t)((uint64_t)ml * 60000 / duration_ms) : 0;
+    meter_stats.pulses_total = pulse_count;
+    uint64_t total_ml = meter_stats.total_ml;
+    portEXIT_CRITICAL(&flow_lock);
+
+    if (!meter_config.mock) {
+        power_mgmt_release(PM_SUBSYS_FLOW);
+    }
+    if (ml > 0) {
+        save_total(total_ml);
+    }
+
+    ESP_LOGI(TAG, "💧 本次出水 %lu ml (%lu 脈衝，%lu ms)，累計 %llu ml",
+             ml, pulses, duration_ms, total_ml);
+    return ml;
+}
+
+// ============================================================================
+// 模擬來源
+// ============================================================================
+// 依出水時間推算脈衝：脈衝 = 流量 (ml/min) × K (脈衝/L) × 經過時間 / (60 s × 1000 ml)
+// 只計入上次結算之後、泵浦實際開啟的區間：計量在泵浦開啟前開始，
+// 泵浦由計時器關閉後也可能稍晚才結算
+static void mock_sync(void)
+{
+    if (!meter_config.mock || !active) {
+        return;
+    }
+
+    // 先讀開關狀態再讀紀錄：兩者之間剛好關閉時多計的時間只有微秒等級
+    bool pump_on = pump_control_is_on();
+    pump_control_stats_t pump;
+    pump_control_get_stats(&pump);
+
+    int64_t now_us = esp_timer_get_time();
+    int64_t flow_from_us = pump.last.started_us > mock_synced_us ? pump.last.started_us : mock_synced_us;
+    int64_t flow_to_us = pump_on ? now_us : pump.last.started_us + pump.last.actual_us;
+    if (pump.activations == 0 || flow_to_us < flow_from_us) {
+        flow_to_us = flow_from_us;  // 這段期間泵浦沒有開啟
+    }
+
+    portENTER_CRITICAL(&flow_lock);
+    mock_residual += (uint64_t)mock_rate_ml_per_min * meter_config.pulses_per_liter *
+                     (uint64_t)(flow_to_us - flow_from_us);
+    mock_synced_us = now_us;
+    uint32_t pulses = (uint32_t)(mock_residual / 60000000000ULL);
+    if (pulses > 0) {
+        mock_residual -= (uint64_t)pulses * 60000000000ULL;
+        pulse_count += pulses;
+        last_pulse_us = flow_to_us;
+    }
+    portEXIT_CRITICAL(&flow_lock);
+}
+
+// ============================================================================
+// 查詢介面
+// ============================================================================
+void flow_meter_get_stats(flow_meter_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+    portENTER_CRITICAL(&flow_lock);
+    memcpy(stats, &meter_stats, sizeof(flow_meter_stats_t));
+    stats->pulses_total = pulse_count;
+    portEXIT_CRITICAL(&flow_lock);
+}
+
+// ============================================================================
+// 內部函數
+// ============================================================================
+static uint32_t pulses_to_ml(uint32_t pulses)
+{
+    return (uint32_t)((uint64_t)pulses * 1000 / meter_config.pulses_per_liter);
+}
+
+static void load_total(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;  // 首次啟動
+    }
+    uint64_t total_ml = 0;
+    if (nvs_get_u64(handle, NVS_KEY_TOTAL, &total_ml) == ESP_OK) {
+        meter_stats.total_ml = total_ml;
+    }
+    nvs_close(handle);
+}
+
+static void save_total(uint64_t total_ml)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_u64(handle, NVS_KEY_TOTAL, total_ml);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 無法儲存累計出水量: %s", esp_err_to_name(err));
+    }
+}
@@ -0,0 +1,100 @@
+// ============================================================================
+// flow_meter.h - 水流量計模組標頭檔
+// 功能：計數霍爾式流量感測器的脈衝，換算每次出水與累計出水量 (ml)，
+//       支援定量澆水 (達到目標水量即停止) 與無水流提前停止；
+//       無硬體時可改用模擬脈衝來源 (FLOW_METER_MOCK)
+// ============================================================================
+
+#ifndef FLOW_METER_H
+#define FLOW_METER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define FLOW_METER_MAX_TARGET_ML    5000    // 單次定量澆水上限 (ml)
+#define FLOW_METER_POLL_MS          20      // 等待目標水量時的檢查間隔
+
+// ============================================================================
+// 流量計設定
+// ============================================================================
+typedef struct {
+    int gpio;                       // 脈衝輸入腳位 (-1 表示未安裝)
+    uint32_t pulses_per_liter;      // 感測器 K 值 (每公升脈衝數)
+    bool mock;                      // true = 使用模擬脈衝來源 (不安裝 GPIO 中斷)
+    uint32_t mock_ml_per_min;       // 模擬來源在出水期間的流量 (ml/min)
+} flow_meter_config_t;
+
+// ============================================================================
+// 流量計統計資訊
+// ============================================================================
+typedef struct {
+    bool available;                 // 流量計已初始化
+    bool mock;                      // 使用模擬脈衝來源
+    uint32_t activations;           // 已計量的出水次數 (開機以來)
+    uint64_t total_ml;              // 累計出水量 (ml，保存在 NVS)
+    uint32_t last_ml;               // 最近一次出水量 (ml)
+    uint32_t last_duration_ms;      // 最近一次出水時間 (ms)
+    uint32_t last_flow_ml_per_min;  // 最近一次平均流量 (ml/min)
+    uint32_t pulses_total;          // 開機以來脈衝總數
+} flow_meter_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化流量計 (安裝 GPIO 中斷或啟用模擬來源) 並從 NVS 載入累計水量
+ *
+ * @param config 流量計設定
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t flow_meter_init(const flow_meter_config_t* config);
+
+/**
+ * @brief 流量計是否可用 (定量澆水的前提)
+ */
+bool flow_meter_is_available(void);
+
+/**
+ * @brief 開始一次出水計量 (開啟泵浦前呼叫)
+ */
+void flow_meter_start(void);
+
+/**
+ * @brief 目前這次出水已累計的水量
+ *
+ * @return uint32_t 水量 (ml)
+ */
+uint32_t flow_meter_activation_ml(void);
+
+/**
+ * @brief 等待本次出水達到目標水量
+ *
+ * 硬體來源由中斷在達到目標脈衝數時喚醒呼叫者，可在目標水量處即時停止
+ *
+ * @param target_ml 目標水量 (ml)
+ * @param timeout_ms 最長出水時間
+ * @param no_flow_ms 連續此時間沒有脈衝即提前返回 (水箱乾涸或管路堵塞)
+ * @return esp_err_t ESP_OK 達到目標，ESP_ERR_TIMEOUT 逾時，ESP_ERR_NOT_FOUND 無水流
+ */
+esp_err_t flow_meter_wait_volume(uint32_t target_ml, uint32_t timeout_ms, uint32_t no_flow_ms);
+
+/**
+ * @brief 結束本次出水計量 (關閉泵浦後呼叫)，更新統計並保存累計水量
+ *
+ * @return uint32_t 本次出水量 (ml)
+ */
+uint32_t flow_meter_stop(void);
+
+/**
+ * @brief 取得流量計統計資訊
+ *
+ * @param stats 統計資訊結構指標
+ */
+void flow_meter_get_stats(flow_meter_stats_t* stats);
+
+#endif // FLOW_METER_H
@@ -0,0 +1,771 @@
+// ============================================================================
+// gateway.c - 站點閘道器聚合模組實作
+// 功能：葉節點 UDP 傳送/重傳、閘道器去重與批次轉送、指令反向路由
+//       訊框標頭帶發送端的開機識別碼，任一端重新開機後序號從 0 開始也不會被誤判為重複
+// ============================================================================
+
+#include "gateway.h"
+#include "command_handler.h"
+#include "telemetry_transport.h"
+#include "mem_pressure.h"
+#include "time_sync.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "cJSON.h"
+#include "lwip/sockets.h"
+#include "lwip/inet.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define GATEWAY_TASK_STACK_SIZE     4096    // 接收任務堆疊大小
+#define GATEWAY_TASK_PRIORITY       4       // 接收任務優先順序
+#define GATEWAY_ACK_TIMEOUT_MS      300     // 葉節點等待 ACK 的時間
+#define GATEWAY_LEAF_MAX_RETRIES    2       // 葉節點最大重傳次數
+#define GATEWAY_MAX_LEAVES          64      // 閘道器最多追蹤的葉節點數
+#define GATEWAY_BATCH_MAX           32      // 每批最多讀數數量
+#define GATEWAY_BATCH_INTERVAL_MS   5000    // 批次最長等待時間
+#define GATEWAY_MAX_PENDING_CMDS    8       // 等待確認的指令數上限
+#define GATEWAY_CMD_RETRY_MS        1000    // 指令重傳間隔
+#define GATEWAY_CMD_MAX_RETRIES     3       // 指令最大重傳次數
+#define GATEWAY_DEDUP_WINDOW        32      // 去重視窗 (序號數)
+#define GATEWAY_LEAVES_FULL_LOG_MS  60000   // 葉節點表已滿的警告間隔
+#define GATEWAY_COMMAND_FRAME_SIZE  (sizeof(gateway_frame_header_t) + GATEWAY_COMMAND_LEN_SIZE + COMMAND_MAX_PAYLOAD)
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "GATEWAY";
+
+// ============================================================================
+// 內部結構定義
+// ============================================================================
+typedef struct {
+    uint32_t node_id;
+    struct sockaddr_in addr;    // 最後一次收到訊框的來源位址 (指令下行使用)
+    uint16_t boot_id;           // 葉節點目前的開機識別碼
+    uint16_t last_seq;          // 最新序號
+    uint32_t seen_mask;         // 最近 32 個序號的接收位元圖 (bit0 = last_seq)
+    bool in_use;
+} gateway_leaf_t;
+
+typedef struct {
+    uint32_t node_id;
+    uint16_t seq;
+    uint8_t retries;
+    int64_t next_retry_us;
+    uint16_t frame_len;
+    uint8_t frame[GATEWAY_COMMAND_FRAME_SIZE];
+    bool in_use;
+} gateway_pending_cmd_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static int gateway_sock = -1;
+static uint32_t local_node_id = 0;
+static uint16_t local_boot_id = 0;
+static uint16_t next_seq = 0;
+static SemaphoreHandle_t gateway_mutex = NULL;
+static gateway_stats_t gateway_stats = {0};
+
+// 葉節點模式
+static struct sockaddr_in gateway_addr;
+static SemaphoreHandle_t ack_semaphore = NULL;
+static volatile uint16_t awaiting_ack_seq = 0;
+static uint16_t last_command_seq = 0;
+static uint16_t last_command_boot_id = 0;
+static bool command_seq_valid = false;
+
+// 閘道器模式
+static bool service_enabled = false;
+static const char *batch_topic = NULL;
+static gateway_leaf_t leaves[GATEWAY_MAX_LEAVES];
+static gateway_reading_frame_t batch[GATEWAY_BATCH_MAX];  // 發布成功前保留，上游斷線時捨棄最舊的讀數
+static int batch_count = 0;
+static int64_t batch_started_us = 0;
+static gateway_pending_cmd_t pending_cmds[GATEWAY_MAX_PENDING_CMDS];
+static int64_t leaves_full_logged_us = 0;    // 上次記錄葉節點表已滿的時間 (限制警告頻率)
+
+// 訊框緩衝區：葉節點轉送訊息與閘道器接收共用 (一個節點只會是其中一種角色)，
+// 多 1 byte 用來偵測超過訊框大小而被截斷的資料包
+static uint8_t frame_buffer[GATEWAY_MAX_FRAME_SIZE + 1];
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static esp_err_t gateway_open_socket(uint16_t bind_port);
+static void gateway_fill_header(gateway_frame_header_t *header, uint8_t type, uint32_t node_id, uint16_t seq,
+                                uint8_t flags);
+static esp_err_t gateway_leaf_send_reliable(const uint8_t *frame, size_t len, uint16_t seq);
+static void gateway_send_ack(const struct sockaddr_in *addr, uint32_t node_id, uint16_t seq);
+static void gateway_leaf_task(void *pvParameters);
+static void gateway_service_task(void *pvParameters);
+static gateway_leaf_t *gateway_find_leaf(uint32_t node_id, bool create);
+static bool gateway_is_duplicate(gateway_leaf_t *leaf, uint16_t boot_id, uint16_t seq);
+static void gateway_accept_frame(const gateway_frame_header_t *header, const uint8_t *buf, int len, bool duplicate);
+static void gateway_handle_message(const gateway_frame_header_t *header, const uint8_t *buf, int len);
+static void gateway_flush_batch(void);
+static void gateway_retry_commands(void);
+
+// ============================================================================
+// 初始化葉節點模式
+// ============================================================================
+esp_err_t gateway_leaf_init(const char* gateway_host, uint16_t gateway_port)
+{
+    if (gateway_host == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    gateway_mutex = xSemaphoreCreateMutex();
+    ack_semaphore = xSemaphoreCreateBinary();
+    if (gateway_mutex == NULL || ack_semaphore == NULL) {
+        ESP_LOGE(TAG, "無法建立閘道器同步物件");
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(&gateway_addr, 0, sizeof(gateway_addr));
+    gateway_addr.sin_family = AF_INET;
+    gateway_addr.sin_port = htons(gateway_port);
+    if (inet_pton(AF_INET, gateway_host, &gateway_addr.sin_addr) != 1) {
+        ESP_LOGE(TAG, "❌ 閘道器位址格式錯誤: %s", gateway_host);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // 葉節點使用臨時埠，只有閘道器需要固定埠
+    esp_err_t err = gateway_open_socket(0);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (xTaskCreate(gateway_leaf_task, "gw_leaf", GATEWAY_TASK_STACK_SIZE, NULL,
+                    GATEWAY_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "❌ 無法建立葉節點接收任務");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "✅ 葉節點模式啟動 - 節點 %08lx → 閘道器 %s:%u",
+             local_node_id, gateway_host, gateway_port);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 葉節點：送出讀數
+// ============================================================================
+esp_err_t gateway_leaf_send_reading(const sensor_reading_t* reading)
+{
+    if (gateway_sock < 0 || service_enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (reading == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(gateway_mutex, portMAX_DELAY);
+
+    gateway_reading_frame_t frame;
+    uint16_t seq = next_seq++;
+    gateway_fill_header(&frame.header, GATEWAY_FRAME_READING, local_node_id, seq, 0);
+    // 記錄時尚未同步、之後才同步的讀數，以目前的時間對應補上牆鐘時間 (與補送路徑相同)
+    frame.epoch_ms = reading->epoch_ms >= 0 ? reading->epoch_ms : time_sync_uptime_to_epoch_ms(reading->uptime_ms * 1000);
+    frame.uptime_s = reading->uptime_ms / 1000;
+    frame.raw_adc = reading->raw_adc;
+    frame.voltage_mv = reading->voltage_mv;
+    frame.moisture_x10 = reading->moisture_x10;
+    frame.flags = reading->pump_on ? GATEWAY_READING_FLAG_PUMP : 0;
+
+    esp_err_t err = gateway_leaf_send_reliable((const uint8_t *)&frame, sizeof(frame), seq);
+
+    xSemaphoreGive(gateway_mutex);
+    return err;
+}
+
+// ============================================================================
+// 葉節點：轉送訊息
+// 訊框：標頭 (含 QoS / retain) + topic_len(1) + data_len(2) + topic + data
+// ============================================================================
+esp_err_t gateway_leaf_relay(const char* topic, const char* data, int len, int qos, int retain)
+{
+    if (gateway_sock < 0 || service_enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t topic_len = strlen(topic);
+    size_t total = sizeof(gateway_frame_header_t) + 3 + topic_len + len;
+    if (topic_len > GATEWAY_MAX_TOPIC_LEN || total > GATEWAY_MAX_FRAME_SIZE) {
+        gateway_stats.oversize_dropped++;
+        ESP_LOGW(TAG, "⚠️ 轉送訊息 %s 超過訊框大小 (%u bytes)", topic, (unsigned)total);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(gateway_mutex, portMAX_DELAY);
+
+    uint8_t *frame = frame_buffer;
+    uint16_t seq = next_seq++;
+    uint8_t flags = (qos & GATEWAY_FLAG_QOS_MASK) | (retain ? GATEWAY_FLAG_RETAIN : 0);
+    gateway_fill_header((gateway_frame_header_t *)frame, GATEWAY_FRAME_MESSAGE, local_node_id, seq, flags);
+    uint8_t *p = frame + sizeof(gateway_frame_header_t);
+    *p++ = topic_len;
+    *p++ = len & 0xFF;
+    *p++ = len >> 8;
+    memcpy(p, topic, topic_len);
+    memcpy(p + topic_len, data, len);
+
+    esp_err_t err = gateway_leaf_send_reliable(frame, total, seq);
+
+    xSemaphoreGive(gateway_mutex);
+    return err;
+}
+
+// ============================================================================
+// 初始化閘道器服務
+// ============================================================================
+esp_err_t gateway_service_init(uint16_t port, const char* topic)
+{
+    gateway_mutex = xSemaphoreCreateMutex();
+    if (gateway_mutex == NULL) {
+        ESP_LOGE(TAG, "無法建立閘道器互斥鎖");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = gateway_open_socket(port);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    batch_topic = topic;
+    memset(leaves, 0, sizeof(leaves));
+    memset(pending_cmds, 0, sizeof(pending_cmds));
+    service_enabled = true;
+
+    if (xTaskCreate(gateway_service_task, "gw_service", GATEWAY_TASK_STACK_SIZE, NULL,
+                    GATEWAY_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "❌ 無法建立閘道器服務任務");
+        service_enabled = false;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "✅ 閘道器服務啟動 - 節點 %08lx 監聽 UDP %u，批次主題 %s",
+             local_node_id, port, batch_topic);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 閘道器：指令下行路由
+// ============================================================================
+esp_err_t gateway_route_command(const char* node_hex, const char* payload, int len)
+{
+    if (!service_enabled || node_hex == NULL || payload == NULL || len <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t node_id = strtoul(node_hex, NULL, 16);
+    if (len > COMMAND_MAX_PAYLOAD) {
+        gateway_stats.commands_failed++;
+        ESP_LOGW(TAG, "⚠️ 指令 %d bytes 超過上限 %d bytes，未路由到節點 %08lx", len, COMMAND_MAX_PAYLOAD, node_id);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(gateway_mutex, portMAX_DELAY);
+
+    gateway_leaf_t *leaf = gateway_find_leaf(node_id, false);
+    gateway_pending_cmd_t *slot = NULL;
+    for (int i = 0; i < GATEWAY_MAX_PENDING_CMDS; i++) {
+        if (!pending_cmds[i].in_use) {
+            slot = &pending_cmds[i];
+            break;
+        }
+    }
+
+    if (leaf == NULL || slot == NULL) {
+        gateway_stats.commands_failed++;
+        xSemaphoreGive(gateway_mutex);
+        ESP_LOGW(TAG, "⚠️ 無法路由指令到節點 %08lx (%s)", node_id,
+                 leaf == NULL ? "未知節點" : "待確認指令已滿");
+        return leaf == NULL ? ESP_ERR_NOT_FOUND : ESP_ERR_NO_MEM;
+    }
+
+    slot->in_use = true;
+    slot->node_id = node_id;
+    slot->seq = next_seq++;
+    slot->retries = 0;
+    slot->next_retry_us = esp_timer_get_time() + GATEWAY_CMD_RETRY_MS * 1000LL;
+    gateway_fill_header((gateway_frame_header_t *)slot->frame, GATEWAY_FRAME_COMMAND, node_id, slot->seq, 0);
+    uint8_t *p = &slot->frame[sizeof(gateway_frame_header_t)];
+    *p++ = len & 0xFF;
+    *p++ = len >> 8;
+    memcpy(p, payload, len);
+    slot->frame_len = sizeof(gateway_frame_header_t) + GATEWAY_COMMAND_LEN_SIZE + len;
+
+    sendto(gateway_sock, slot->frame, slot->frame_len, 0, (struct sockaddr *)&leaf->addr, sizeof(leaf->addr));
+
+    xSemaphoreGive(gateway_mutex);
+    ESP_LOGI(TAG, "📨 指令已路由到節點 %08lx: %.*s", node_id, len, payload);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 狀態查詢
+// ============================================================================
+bool gateway_service_is_enabled(void)
+{
+    return service_enabled;
+}
+
+uint32_t gateway_get_node_id(void)
+{
+    if (local_node_id == 0) {
+        uint8_t mac[6] = {0};
+        esp_read_mac(mac, ESP_MAC_WIFI_STA);
+        local_node_id = ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) |
+                        ((uint32_t)mac[4] << 8) | mac[5];
+    }
+    return local_node_id;
+}
+
+void gateway_set_node_id(uint32_t node_id)
+{
+    if (node_id != 0) {
+        local_node_id = node_id;
+    }
+}
+
+void gateway_get_stats(gateway_stats_t* stats)
+{
+    if (stats != NULL) {
+        memcpy(stats, &gateway_stats, sizeof(gateway_stats_t));
+    }
+}
+
+// ============================================================================
+// 建立 UDP socket (內部函數)
+// ============================================================================
+static esp_err_t gateway_open_socket(uint16_t bind_port)
+{
+    gateway_get_node_id();
+    while (local_boot_id == 0) {
+        local_boot_id = (uint16_t)esp_random();  // 0 保留給「尚未收過」
+    }
+
+    gateway_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (gateway_sock < 0) {
+        ESP_LOGE(TAG, "❌ UDP socket 建立失敗 (errno: %d)", errno);
+        return ESP_FAIL;
+    }
+
+    struct sockaddr_in local_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(bind_port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(gateway_sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) != 0) {
+        ESP_LOGE(TAG, "❌ UDP 埠 %u 綁定失敗 (errno: %d)", bind_port, errno);
+        close(gateway_sock);
+        gateway_sock = -1;
+        return ESP_FAIL;
+    }
+
+    // 接收逾時讓任務能定期處理批次與重傳
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 250000 };
+    setsockopt(gateway_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return ESP_OK;
+}
+
+static void gateway_fill_header(gateway_frame_header_t *header, uint8_t type, uint32_t node_id, uint16_t seq,
+                                uint8_t flags)
+{
+    header->magic = GATEWAY_FRAME_MAGIC;
+    header->type = type;
+    header->flags = flags;
+    header->node_id = node_id;
+    header->boot_id = local_boot_id;
+    header->seq = seq;
+}
+
+// ============================================================================
+// 葉節點：送出並等待 ACK (內部函數，呼叫者持有 gateway_mutex)
+// ============================================================================
+static esp_err_t gateway_leaf_send_reliable(const uint8_t *frame, size_t len, uint16_t seq)
+{
+    awaiting_ack_seq = seq;
+    xSemaphoreTake(ack_semaphore, 0);  // 清除先前殘留的確認
+
+    for (int attempt = 0; attempt <= GATEWAY_LEAF_MAX_RETRIES; attempt++) {
+        if (attempt > 0) {
+            gateway_stats.retransmissions++;
+        }
+        sendto(gateway_sock, frame, len, 0, (struct sockaddr *)&gateway_addr, sizeof(gateway_addr));
+        gateway_stats.frames_sent++;
+
+        if (xSemaphoreTake(ack_semaphore, pdMS_TO_TICKS(GATEWAY_ACK_TIMEOUT_MS)) == pdTRUE) {
+            return ESP_OK;
+        }
+    }
+
+    gateway_stats.send_failures++;
+    ESP_LOGW(TAG, "⚠️ 閘道器未確認訊框 seq=%u", seq);
+    return ESP_ERR_TIMEOUT;
+}
+
+static void gateway_send_ack(const struct sockaddr_in *addr, uint32_t node_id, uint16_t seq)
+{
+    gateway_frame_header_t ack;
+    gateway_fill_header(&ack, GATEWAY_FRAME_ACK, node_id, seq, 0);
+    sendto(gateway_sock, &ack, sizeof(ack), 0, (const struct sockaddr *)addr, sizeof(*addr));
+}
+
+// ============================================================================
+// 葉節點接收任務 (FreeRTOS 任務) - 處理 ACK 與下行指令
+// ============================================================================
+static void gateway_leaf_task(void *pvParameters)
+{
+    uint8_t buf[GATEWAY_COMMAND_FRAME_SIZE + 1];  // 多 1 byte 偵測過長而被截斷的指令
+
+    while (1) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int n = recvfrom(gateway_sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (n < (int)sizeof(gateway_frame_header_t)) {
+            continue;
+        }
+
+        gateway_frame_header_t header;
+        memcpy(&header, buf, sizeof(header));
+        if (header.magic != GATEWAY_FRAME_MAGIC || header.node_id != local_node_id) {
+            continue;
+        }
+
+        if (header.type == GATEWAY_FRAME_ACK) {
+            if (header.seq == awaiting_ack_seq) {
+                xSemaphoreGive(ack_semaphore);
+            }
+        } else if (header.type == GATEWAY_FRAME_COMMAND && n > (int)sizeof(header) + GATEWAY_COMMAND_LEN_SIZE) {
+            const uint8_t *p = &buf[sizeof(header)];
+            int cmd_len = p[0] | (p[1] << 8);
+            if (n > (int)GATEWAY_COMMAND_FRAME_SIZE || cmd_len > COMMAND_MAX_PAYLOAD ||
+                cmd_len != n - (int)sizeof(header) - GATEWAY_COMMAND_LEN_SIZE) {
+                // 截斷的指令不執行，回覆 NACK 讓閘道器停止重傳並記錄失敗
+                gateway_stats.commands_rejected++;
+                ESP_LOGW(TAG, "⚠️ 閘道器指令長度 %d bytes 超過上限 %d bytes 或不完整，拒收", cmd_len, COMMAND_MAX_PAYLOAD);
+                gateway_frame_header_t nack;
+                gateway_fill_header(&nack, GATEWAY_FRAME_NACK, local_node_id, header.seq, 0);
+                sendto(gateway_sock, &nack, sizeof(nack), 0, (const struct sockaddr *)&from, sizeof(from));
+                continue;
+            }
+            gateway_send_ack(&from, local_node_id, header.seq);
+
+            // 閘道器重傳時 ACK 可能遺失，重複的指令只確認不執行 (閘道器重新開機後序號重來，以開機識別碼區分)
+            if (command_seq_valid && header.seq == last_command_seq && header.boot_id == last_command_boot_id) {
+                continue;
+            }
+            last_command_seq = header.seq;
+            last_command_boot_id = header.boot_id;
+            command_seq_valid = true;
+
+            const char *cmd = (const char *)(p + GATEWAY_COMMAND_LEN_SIZE);
+            ESP_LOGI(TAG, "收到閘道器指令: %.*s", cmd_len, cmd);
+            dispatch_command_payload(cmd, cmd_len);
+        }
+    }
+}
+
+// ============================================================================
+// 閘道器服務任務 (FreeRTOS 任務) - 接收、去重、批次、指令重傳
+// ============================================================================
+static void gateway_service_task(void *pvParameters)
+{
+    uint8_t *buf = frame_buffer;
+
+    ESP_LOGI(TAG, "🚀 閘道器服務任務已啟動");
+
+    while (1) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int n = recvfrom(gateway_sock, buf, sizeof(frame_buffer), 0, (struct sockaddr *)&from, &from_len);
+
+        if (n > GATEWAY_MAX_FRAME_SIZE) {
+            // 被截斷的資料包不回覆 ACK，葉節點重傳耗盡後計入 send_failures
+            gateway_stats.oversize_dropped++;
+            ESP_LOGW(TAG, "⚠️ 丟棄超過訊框大小的資料包");
+        } else if (n >= (int)sizeof(gateway_frame_header_t)) {
+            gateway_frame_header_t header;
+            memcpy(&header, buf, sizeof(header));
+
+            if (header.magic == GATEWAY_FRAME_MAGIC) {
+                xSemaphoreTake(gateway_mutex, portMAX_DELAY);
+
+                if (header.type == GATEWAY_FRAME_ACK || header.type == GATEWAY_FRAME_NACK) {
+                    bool rejected = false;
+                    for (int i = 0; i < GATEWAY_MAX_PENDING_CMDS; i++) {
+                        if (pending_cmds[i].in_use && pending_cmds[i].node_id == header.node_id &&
+                            pending_cmds[i].seq == header.seq) {
+                            pending_cmds[i].in_use = false;
+                            if (header.type == GATEWAY_FRAME_ACK) {
+                                gateway_stats.commands_routed++;
+                            } else {
+                                gateway_stats.commands_failed++;
+                                rejected = true;
+                            }
+                        }
+                    }
+                    xSemaphoreGive(gateway_mutex);
+                    if (rejected) {
+                        ESP_LOGW(TAG, "⚠️ 節點 %08lx 拒收指令 (seq=%u，過長或不完整)", header.node_id, header.seq);
+                    }
+                } else {
+                    gateway_leaf_t *leaf = gateway_find_leaf(header.node_id, true);
+                    if (leaf == NULL) {
+                        // 葉節點表已滿：不回覆 ACK，葉節點保留讀數稍後重送，而非誤以為已送達
+                        gateway_stats.leaves_full++;
+                        int64_t now_us = esp_timer_get_time();
+                        bool log_full = leaves_full_logged_us == 0 ||
+                                        now_us - leaves_full_logged_us >= GATEWAY_LEAVES_FULL_LOG_MS * 1000LL;
+                        if (log_full) {
+                            leaves_full_logged_us = now_us;
+                        }
+                        xSemaphoreGive(gateway_mutex);
+                        if (log_full) {
+                            ESP_LOGW(TAG, "⚠️ 葉節點表已滿 (%d 個)，節點 %08lx 的訊框未確認 (累計 %lu 個)",
+                                     GATEWAY_MAX_LEAVES, header.node_id, gateway_stats.leaves_full);
+                        }
+                    } else {
+                        memcpy(&leaf->addr, &from, sizeof(from));
+                        // 不論是否重複都回覆 ACK，避免葉節點持續重傳
+                        gateway_send_ack(&from, header.node_id, header.seq);
+                        bool duplicate = gateway_is_duplicate(leaf, header.boot_id, header.seq);
+                        xSemaphoreGive(gateway_mutex);
+                        gateway_accept_frame(&header, buf, n, duplicate);
+                    }
+                }
+            }
+        }
+
+        if (batch_count > 0 &&
+            esp_timer_get_time() - batch_started_us >= GATEWAY_BATCH_INTERVAL_MS * 1000LL) {
+            gateway_flush_batch();
+        }
+        gateway_retry_commands();
+    }
+}
+
+// ============================================================================
+// 處理已確認的葉節點訊框 (內部函數) - 讀數加入批次，訊息轉送
+// ============================================================================
+static void gateway_accept_frame(const gateway_frame_header_t *header, const uint8_t *buf, int len, bool duplicate)
+{
+    if (duplicate) {
+        gateway_stats.duplicates_dropped++;
+    } else if (header->type == GATEWAY_FRAME_READING && len == sizeof(gateway_reading_frame_t)) {
+        if (batch_count == 0) {
+            batch_started_us = esp_timer_get_time();
+        } else if (batch_count >= GATEWAY_BATCH_MAX) {
+            // 上游長時間無法發布：捨棄最舊的讀數，保留最新的狀態
+            memmove(&batch[0], &batch[1], (GATEWAY_BATCH_MAX - 1) * sizeof(gateway_reading_frame_t));
+            batch_count--;
+            gateway_stats.batch_dropped++;
+        }
+        memcpy(&batch[batch_count++], buf, sizeof(gateway_reading_frame_t));
+        gateway_stats.readings_received++;
+        // 記憶體壓力下提早送出較小的批次，降低單次 JSON 編碼的配置量
+        if (batch_count >= mem_pressure_batch_limit(GATEWAY_BATCH_MAX)) {
+            gateway_flush_batch();
+        }
+    } else if (header->type == GATEWAY_FRAME_MESSAGE) {
+        gateway_handle_message(header, buf, len);
+    }
+}
+
+// ============================================================================
+// 尋找或建立葉節點紀錄 (內部函數，呼叫者持有 gateway_mutex)
+// ============================================================================
+static gateway_leaf_t *gateway_find_leaf(uint32_t node_id, bool create)
+{
+    gateway_leaf_t *free_slot = NULL;
+
+    for (int i = 0; i < GATEWAY_MAX_LEAVES; i++) {
+        if (leaves[i].in_use && leaves[i].node_id == node_id) {
+            return &leaves[i];
+        }
+        if (!leaves[i].in_use && free_slot == NULL) {
+            free_slot = &leaves[i];
+        }
+    }
+
+    if (!create || free_slot == NULL) {
+        return NULL;
+    }
+
+    memset(free_slot, 0, sizeof(gateway_leaf_t));
+    free_slot->in_use = true;
+    free_slot->node_id = node_id;
+    free_slot->boot_id = 0;        // 第一個訊框一定視為新的開機
+    gateway_stats.leaves_known++;
+    ESP_LOGI(TAG, "🌱 新葉節點加入: %08lx (共 %lu 個)", node_id, gateway_stats.leaves_known);
+    return free_slot;
+}
+
+// ============================================================================
+// 序號去重 (內部函數) - 以 32 個序號的滑動位元圖判斷
+// 開機識別碼改變表示葉節點重新開機 (序號從 0 開始)，以此訊框重設視窗
+// ============================================================================
+static bool gateway_is_duplicate(gateway_leaf_t *leaf, uint16_t boot_id, uint16_t seq)
+{
+    if (boot_id != leaf->boot_id) {
+        if (leaf->boot_id != 0) {
+            gateway_stats.leaf_reboots++;
+            ESP_LOGI(TAG, "🔄 葉節點 %08lx 重新開機，重設去重視窗", leaf->node_id);
+        }
+        leaf->boot_id = boot_id;
+        leaf->last_seq = seq;
+        leaf->seen_mask = 1;
+        return false;
+    }
+
+    uint16_t ahead = seq - leaf->last_seq;
+
+    if (ahead == 0) {
+        return true;
+    }
+
+    if (ahead < 0x8000) {
+        // 較新的序號：滑動視窗
+        leaf->seen_mask = (ahead >= GATEWAY_DEDUP_WINDOW) ? 0 : (leaf->seen_mask << ahead);
+        leaf->seen_mask |= 1;
+        leaf->last_seq = seq;
+        return false;
+    }
+
+    uint16_t behind = leaf->last_seq - seq;
+    if (behind >= GATEWAY_DEDUP_WINDOW) {
+        // 超出視窗 (長時間斷線後的舊訊框)，重新以此序號為基準
+        leaf->seen_mask = 1;
+        leaf->last_seq = seq;
+        return false;
+    }
+
+    if (leaf->seen_mask & (1UL << behind)) {
+        return true;
+    }
+    leaf->seen_mask |= (1UL << behind);
+    return false;
+}
+
+// ============================================================================
+// 轉送葉節點訊息 (內部函數) - 主題附加節點 ID 以保留來源，沿用葉節點指定的 QoS / retain
+// ============================================================================
+static void gateway_handle_message(const gateway_frame_header_t *header, const uint8_t *buf, int len)
+{
+    const uint8_t *p = buf + sizeof(gateway_frame_header_t);
+    if (len < (int)sizeof(gateway_frame_header_t) + 3) {
+        return;
+    }
+
+    int topic_len = p[0];
+    int data_len = p[1] | (p[2] << 8);
+    if ((int)sizeof(gateway_frame_header_t) + 3 + topic_len + data_len != len) {
+        return;
+    }
+
+    char topic[288];
+    snprintf(topic, sizeof(topic), "%.*s/%08lx", topic_len, (const char *)(p + 3), header->node_id);
+    telemetry_publish(topic, (const char *)(p + 3 + topic_len), data_len,
+                      header->flags & GATEWAY_FLAG_QOS_MASK, (header->flags & GATEWAY_FLAG_RETAIN) != 0);
+}
+
+// ============================================================================
+// 發布批次讀數 (內部函數)
+// 發布失敗時保留批次，下一個批次週期連同新讀數一起重送
+// ============================================================================
+static void gateway_flush_batch(void)
+{
+    if (!telemetry_is_connected()) {
+        batch_started_us = esp_timer_get_time();  // 未連線時不編碼，等下一個週期再試
+        return;
+    }
+
+    cJSON *json = cJSON_CreateObject();
+    char node_hex[12];
+
+    snprintf(node_hex, sizeof(node_hex), "%08lx", local_node_id);
+    cJSON_AddStringToObject(json, "type", "gateway_batch");
+    cJSON_AddStringToObject(json, "gateway", node_hex);
+    cJSON_AddNumberToObject(json, "timestamp", esp_timer_get_time() / 1000000);
+    int64_t now_ms = time_sync_now_ms();
+    if (now_ms >= 0) {
+        cJSON_AddNumberToObject(json, "ts_ms", (double)now_ms);  // 閘道器發布批次的牆鐘時間
+    }
+    cJSON *readings = cJSON_AddArrayToObject(json, "readings");
+
+    for (int i = 0; i < batch_count; i++) {
+        const gateway_reading_frame_t *r = &batch[i];
+        cJSON *item = cJSON_CreateObject();
+        snprintf(node_hex, sizeof(node_hex), "%08lx", r->header.node_id);
+        cJSON_AddStringToObject(item, "node", node_hex);
+        cJSON_AddNumberToObject(item, "seq", r->header.seq);
+        cJSON_AddNumberToObject(item, "uptime", r->uptime_s);
+        if (r->epoch_ms >= 0) {
+            cJSON_AddNumberToObject(item, "ts_ms", (double)r->epoch_ms);  // 葉節點的採樣時間
+        }
+        cJSON_AddNumberToObject(item, "raw_adc", r->raw_adc);
+        cJSON_AddNumberToObject(item, "voltage", r->voltage_mv / 1000.0);
+        cJSON_AddNumberToObject(item, "moisture", r->moisture_x10 / 10.0);
+        cJSON_AddBoolToObject(item, "gpio_status", (r->flags & GATEWAY_READING_FLAG_PUMP) != 0);
+        cJSON_AddItemToArray(readings, item);
+    }
+
+    // 批次資料量大，使用不含空白的格式
+    char *json_string = cJSON_PrintUnformatted(json);
+    esp_err_t err = ESP_ERR_NO_MEM;
+    if (json_string) {
+        err = telemetry_publish(batch_topic, json_string, 0, 0, 0);
+        free(json_string);
+    }
+    cJSON_Delete(json);
+
+    if (err == ESP_OK) {
+        gateway_stats.batches_published++;
+        ESP_LOGI(TAG, "📦 已轉送批次: %d 筆讀數", batch_count);
+        batch_count = 0;
+    } else {
+        gateway_stats.batch_retries++;
+        batch_started_us = esp_timer_get_time();
+        ESP_LOGW(TAG, "⚠️ 批次發布失敗 (%s)，保留 %d 筆讀數待重送", esp_err_to_name(err), batch_count);
+    }
+}
+
+// ============================================================================
+// 指令重傳 (內部函數)
+// ============================================================================
+static void gateway_retry_commands(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(gateway_mutex, portMAX_DELAY);
+    for (int i = 0; i < GATEWAY_MAX_PENDING_CMDS; i++) {
+        gateway_pending_cmd_t *cmd = &pending_cmds[i];
+        if (!cmd->in_use || now < cmd->next_retry_us) {
+            continue;
+        }
+
+        gateway_leaf_t *leaf = gateway_find_leaf(cmd->node_id, false);
+        if (leaf == NULL || cmd->retries >= GATEWAY_CMD_MAX_RETRIES) {
+            cmd->in_use = false;
+            gateway_stats.commands_failed++;
+            ESP_LOGW(TAG, "⚠️ 指令未送達節點 %08lx (seq=%u)", cmd->node_id, cmd->seq);
+            continue;
+        }
+
+        cmd->retries++;
+        cmd->next_retry_us = now + GATEWAY_CMD_RETRY_MS * 1000LL;
+        sendto(gateway_sock, cmd->frame, cmd->frame_len, 0, (struct sockaddr *)&leaf->addr, sizeof(leaf->addr));
+    }
+    xSemaphoreGive(gateway_mutex);
+}
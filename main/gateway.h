@@ -0,0 +1,169 @@
+// ============================================================================
+// gateway.h - 站點閘道器聚合模組標頭檔
+// 功能：葉節點透過區域 UDP 傳送精簡二進位讀數給閘道器，
+//       閘道器去重、批次後以單一 MQTT 連線轉送，並將指令反向路由給葉節點
+// ============================================================================
+
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sensor_history.h"
+
+// ============================================================================
+// 區域 UDP 訊框格式 (小端序，ESP32 與 Linux 主機皆為小端)
+// ============================================================================
+#define GATEWAY_FRAME_MAGIC     0x5D    // 協定第 4 版：讀數帶 epoch 採樣時間 (0x5A - 0x5C 為舊格式，直接忽略)
+#define GATEWAY_MAX_FRAME_SIZE  4096    // 最大訊框大小 (超過 MTU 需 IP 分段重組，見 sdkconfig.defaults)
+#define GATEWAY_MAX_TOPIC_LEN   64      // 轉送訊息的主題長度上限
+
+typedef enum {
+    GATEWAY_FRAME_READING = 1,  // 葉節點 → 閘道器：感測器讀數
+    GATEWAY_FRAME_MESSAGE,      // 葉節點 → 閘道器：轉送任意主題訊息 (狀態、回應)
+    GATEWAY_FRAME_COMMAND,      // 閘道器 → 葉節點：指令
+    GATEWAY_FRAME_ACK,          // 雙向：確認收到 (seq 為被確認的訊框序號)
+    GATEWAY_FRAME_NACK,         // 葉節點 → 閘道器：指令過長而拒收 (seq 為被拒收的指令序號，閘道器不再重傳)
+} gateway_frame_type_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;              // GATEWAY_FRAME_MAGIC
+    uint8_t type;               // gateway_frame_type_t
+    uint8_t flags;              // 轉送訊息的 QoS 與 retain (GATEWAY_FLAG_*)
+    uint32_t node_id;           // 來源/目的節點 ID (MAC 後 4 bytes)
+    uint16_t boot_id;           // 發送端每次開機的隨機識別碼，改變時接收端重置去重視窗
+    uint16_t seq;               // 訊框序號 (每個節點各自遞增，開機後從 0 開始)
+} gateway_frame_header_t;
+
+#define GATEWAY_FLAG_QOS_MASK   0x03
+#define GATEWAY_FLAG_RETAIN     0x04
+
+typedef struct __attribute__((packed)) {
+    gateway_frame_header_t header;
+    int64_t epoch_ms;           // 採樣時的 epoch 毫秒 (-1 = 葉節點尚未時間同步)
+    uint32_t uptime_s;          // 採樣時的開機秒數
+    uint16_t raw_adc;           // 原始 ADC 值
+    uint16_t voltage_mv;        // 電壓 (毫伏)
+    uint16_t moisture_x10;      // 濕度 (0.1%)
+    uint8_t flags;              // bit0: 泵浦狀態
+} gateway_reading_frame_t;
+
+#define GATEWAY_READING_FLAG_PUMP   0x01
+
+// 指令訊框：標頭 + cmd_len(2) + cmd，cmd 最長為指令處理模組的上限 (COMMAND_MAX_PAYLOAD)
+#define GATEWAY_COMMAND_LEN_SIZE    2
+
+// 轉送訊息訊框：標頭 + topic_len(1) + data_len(2) + topic + data
+#define GATEWAY_MAX_RELAY_PAYLOAD   (GATEWAY_MAX_FRAME_SIZE - sizeof(gateway_frame_header_t) - 3 - GATEWAY_MAX_TOPIC_LEN)
+
+// ============================================================================
+// 閘道器統計資訊
+// ============================================================================
+typedef struct {
+    uint32_t frames_sent;           // 葉節點：已送出訊框數
+    uint32_t retransmissions;       // 葉節點：重傳次數
+    uint32_t send_failures;         // 葉節點：重傳耗盡仍未確認的次數
+    uint32_t readings_received;     // 閘道器：收到的讀數數量
+    uint32_t duplicates_dropped;    // 閘道器：去重丟棄的訊框數
+    uint32_t oversize_dropped;      // 超過 GATEWAY_MAX_FRAME_SIZE 而丟棄的訊框數
+    uint32_t leaf_reboots;          // 閘道器：偵測到葉節點重新開機的次數
+    uint32_t batches_published;     // 閘道器：已發布的批次數
+    uint32_t batch_retries;         // 閘道器：發布失敗後保留待重送的次數
+    uint32_t batch_dropped;         // 閘道器：上游長時間斷線、批次已滿而捨棄的最舊讀數
+    uint32_t leaves_known;          // 閘道器：已知葉節點數
+    uint32_t leaves_full;           // 閘道器：葉節點表已滿而未確認 (由葉節點保留重送) 的訊框數
+    uint32_t commands_routed;       // 閘道器：已確認送達的指令數
+    uint32_t commands_failed;       // 閘道器：無法送達的指令數 (含過長與葉節點拒收)
+    uint32_t commands_rejected;     // 葉節點：因過長而拒收 (回覆 NACK) 的指令數
+} gateway_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化葉節點模式
+ *
+ * 建立 UDP socket 與接收任務 (接收 ACK 與閘道器下發的指令)
+ *
+ * @param gateway_host 閘道器 IP 位址
+ * @param gateway_port 閘道器 UDP 埠號
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t gateway_leaf_init(const char* gateway_host, uint16_t gateway_port);
+
+/**
+ * @brief 葉節點：以精簡二進位格式送出一筆讀數 (等待 ACK，必要時重傳)
+ *
+ * 未確認時讀數仍在 sensor_history 中，由呼叫者之後從歷史緩衝區重送
+ *
+ * @param reading 歷史緩衝區中的讀數
+ * @return esp_err_t ESP_OK 表示閘道器已確認
+ */
+esp_err_t gateway_leaf_send_reading(const sensor_reading_t* reading);
+
+/**
+ * @brief 葉節點：請閘道器以指定主題轉送訊息
+ *
+ * @param topic 原始主題 (閘道器發布時會附加節點 ID)
+ * @param data 訊息內容
+ * @param len 訊息長度
+ * @param qos 閘道器發布時使用的 QoS
+ * @param retain 閘道器發布時是否保留
+ * @return esp_err_t ESP_OK 表示閘道器已確認；ESP_ERR_INVALID_SIZE 表示超過訊框大小
+ */
+esp_err_t gateway_leaf_relay(const char* topic, const char* data, int len, int qos, int retain);
+
+/**
+ * @brief 初始化閘道器服務
+ *
+ * 在本節點的 MQTT 連線上聚合整個站點的葉節點讀數
+ *
+ * @param port 監聽的 UDP 埠號
+ * @param batch_topic 批次讀數發布主題
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t gateway_service_init(uint16_t port, const char* batch_topic);
+
+/**
+ * @brief 閘道器：將指令路由到指定葉節點
+ *
+ * @param node_hex 目的節點 ID (8 位十六進位字串)
+ * @param payload 指令內容
+ * @param len 指令長度
+ * @return esp_err_t ESP_OK 表示已送出 (送達與否由重傳機制追蹤)；ESP_ERR_INVALID_SIZE 表示超過 COMMAND_MAX_PAYLOAD
+ */
+esp_err_t gateway_route_command(const char* node_hex, const char* payload, int len);
+
+/**
+ * @brief 檢查閘道器服務是否啟用
+ *
+ * @return bool true 表示本節點為閘道器
+ */
+bool gateway_service_is_enabled(void);
+
+/**
+ * @brief 取得本節點 ID
+ *
+ * 依序為 gateway_set_node_id() 設定值、MAC 後 4 bytes
+ *
+ * @return uint32_t 節點 ID
+ */
+uint32_t gateway_get_node_id(void);
+
+/**
+ * @brief 覆寫本節點 ID (須在初始化葉節點或閘道器前呼叫，0 表示沿用預設)
+ *
+ * @param node_id 節點 ID
+ */
+void gateway_set_node_id(uint32_t node_id);
+
+/**
+ * @brief 取得閘道器統計資訊
+ *
+ * @param stats 統計資訊結構指標
+ */
+void gateway_get_stats(gateway_stats_t* stats);
+
+#endif // GATEWAY_H
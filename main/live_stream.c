@@ -0,0 +1,387 @@
+// ============================================================================
+// live_stream.c - 即時高頻讀數串流模組實作
+// 功能：串流任務優先順序低於感測器 / 指令 / SSE 任務，每筆讀數只短暫持有 ADC 互斥鎖，
+//       一般讀數與原始擷取照常進行 (期間錯過的排程計入 late_samples，不補讀)；
+//       讀數每 LIVE_STREAM_FRAME_MS 合併為一則 QoS 0 訊框，不進 MQTT outbox。
+//       串流期間持有 ADC 電源管理鎖，避免淺眠喚醒延遲造成讀數間隔抖動
+// ============================================================================
+
+#include "live_stream.h"
+#include "soil_sensor.h"
+#include "telemetry_transport.h"
+#include "mem_pressure.h"
+#include "power_mgmt.h"
+#include "time_sync.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define STREAM_TASK_STACK_SIZE      3072
+#define STREAM_TASK_PRIORITY        2       // 低於感測器 (5)、指令 (4) 與 SSE / 澆水監測 (3)
+#define FRAME_MAX_SAMPLES           (LIVE_STREAM_MAX_HZ * LIVE_STREAM_FRAME_MS / 1000 + 1)
+#define FRAME_JSON_SIZE             (128 + FRAME_MAX_SAMPLES * 24)
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "LIVE_STREAM";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static const char *stream_topic = NULL;
+static TaskHandle_t stream_task_handle = NULL;
+static portMUX_TYPE stream_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// 由指令任務設定、串流任務讀取 (stream_lock 保護)
+static bool active = false;
+static bool stop_requested = false;
+static uint32_t rate_hz = LIVE_STREAM_DEFAULT_HZ;
+static int64_t expire_us = 0;
+static uint32_t request_gen = 0;        // 每次 live_stream_start() 遞增
+static uint32_t seen_gen = 0;           // 串流任務最後一次套用的請求
+static live_stream_stats_t stats;
+
+// 目前訊框 (僅串流任務存取)
+typedef struct {
+    uint32_t offset_ms;             // 相對訊框開始時間
+    uint16_t raw_adc;
+    uint16_t moisture_x10;
+} stream_sample_t;
+
+static stream_sample_t frame_samples[FRAME_MAX_SAMPLES];
+static uint32_t frame_count = 0;
+static uint32_t frame_seq = 0;
+static int64_t frame_start_us = 0;
+static char frame_json[FRAME_JSON_SIZE];
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void live_stream_task(void *pvParameters);
+static live_stream_end_t run_stream(void);
+static live_stream_end_t check_end(int64_t now_us, uint32_t* current_rate);
+static void publish_frame(uint32_t hz, live_stream_end_t end);
+
+// ============================================================================
+// 初始化與參數解析
+// ============================================================================
+esp_err_t live_stream_init(const char* topic)
+{
+    if (topic == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stream_topic = topic;
+
+    if (xTaskCreate(live_stream_task, "live_stream", STREAM_TASK_STACK_SIZE, NULL,
+                    STREAM_TASK_PRIORITY, &stream_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "✅ 即時串流模組初始化完成 (%d-%d Hz，最長 %d 秒)",
+             LIVE_STREAM_MIN_HZ, LIVE_STREAM_MAX_HZ, LIVE_STREAM_MAX_DURATION_S);
+    return ESP_OK;
+}
+
+esp_err_t live_stream_parse_args(const char* args, live_stream_request_t* req)
+{
+    req->rate_hz = LIVE_STREAM_DEFAULT_HZ;
+    req->duration_s = LIVE_STREAM_DEFAULT_DURATION_S;
+    req->stop = false;
+
+    if (args == NULL || args[0] == '\0') {
+        return ESP_OK;
+    }
+    if (strcmp(args, "stop") == 0) {
+        req->stop = true;
+        return ESP_OK;
+    }
+
+    // 數字依序為秒數、頻率
+    int numbers = 0;
+    const char *token = args;
+    while (token != NULL && *token != '\0') {
+        const char *sep = strchr(token, ':');
+        size_t len = sep != NULL ? (size_t)(sep - token) : strlen(token);
+
+        if (len > 0) {
+            char *end = NULL;
+            unsigned long value = strtoul(token, &end, 10);
+            if (end != token + len) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (numbers == 0) {
+                if (value == 0 || value > LIVE_STREAM_MAX_DURATION_S) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                req->duration_s = value;
+            } else if (numbers == 1) {
+                if (value < LIVE_STREAM_MIN_HZ || value > LIVE_STREAM_MAX_HZ) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                req->rate_hz = value;
+            } else {
+                return ESP_ERR_INVALID_ARG;
+            }
+            numbers++;
+        }
+
+        token = sep != NULL ? sep + 1 : NULL;
+    }
+
+    return ESP_OK;
+}
+
+// ============================================================================
+// 開始與結束
+// ============================================================================
+esp_err_t live_stream_start(const live_stream_request_t* req)
+{
+    if (stream_task_handle == NULL || req == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (req->stop) {
+        live_stream_stop();
+        return ESP_OK;
+    }
+    if (!telemetry_is_connected() || mem_pressure_get_tier() >= MEM_PRESSURE_HIGH) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&stream_lock);
+    bool was_active = active;
+    rate_hz = req->rate_hz;
+    expire_us = esp_timer_get_time() + (int64_t)req->duration_s * 1000000LL;
+    stop_requested = false;
+    request_gen++;
+    if (!was_active) {
+        active = true;
+        stats.sessions++;
+    }
+    portEXIT_CRITICAL(&stream_lock);
+
+    // 串流中也通知，讓任務立即套用新的頻率
+    xTaskNotifyGive(stream_task_handle);
+    ESP_LOGI(TAG, "📡 即時串流%s - %lu Hz，%lu 秒後自動結束", was_active ? "已更新" : "開始",
+             req->rate_hz, req->duration_s);
+    return ESP_OK;
+}
+
+void live_stream_stop(void)
+{
+    portENTER_CRITICAL(&stream_lock);
+    bool was_active = active;
+    if (was_active) {
+        stop_requested = true;
+    }
+    portEXIT_CRITICAL(&stream_lock);
+
+    if (was_active && stream_task_handle != NULL) {
+        xTaskNotifyGive(stream_task_handle);
+    }
+}
+
+void live_stream_get_stats(live_stream_stats_t* out)
+{
+    if (out == NULL) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&stream_lock);
+    *out = stats;
+    out->active = active;
+    out->rate_hz = rate_hz;
+    out->remaining_s = active && expire_us > now_us ? (uint32_t)((expire_us - now_us) / 1000000LL) : 0;
+    portEXIT_CRITICAL(&stream_lock);
+}
+
+const char* live_stream_end_name(live_stream_end_t reason)
+{
+    switch (reason) {
+        case LIVE_STREAM_END_NONE:          return "none";
+        case LIVE_STREAM_END_EXPIRED:       return "expired";
+        case LIVE_STREAM_END_STOPPED:       return "stopped";
+        case LIVE_STREAM_END_DISCONNECTED:  return "disconnected";
+        case LIVE_STREAM_END_MEM_PRESSURE:  return "mem_pressure";
+        default:                            return "unknown";
+    }
+}
+
+// ============================================================================
+// 串流任務 (常駐，閒置時阻塞在任務通知)
+// ============================================================================
+static void live_stream_task(void *pvParameters)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        portENTER_CRITICAL(&stream_lock);
+        bool start = active;
+        portEXIT_CRITICAL(&stream_lock);
+        if (!start) {
+            continue;
+        }
+
+        // 結束的同時收到新的請求 (指令已回覆為「已更新」) 時繼續串流
+        live_stream_end_t reason;
+        bool again;
+        power_mgmt_acquire(PM_SUBSYS_ADC);
+        do {
+            reason = run_stream();
+            portENTER_CRITICAL(&stream_lock);
+            again = request_gen != seen_gen && !stop_requested;
+            if (!again) {
+                active = false;
+                stop_requested = false;
+                stats.last_end = reason;
+            }
+            portEXIT_CRITICAL(&stream_lock);
+        } while (again);
+        power_mgmt_release(PM_SUBSYS_ADC);
+
+        ESP_LOGI(TAG, "📡 即時串流結束 (%s)，恢復一般採樣", live_stream_end_name(reason));
+    }
+}
+
+static live_stream_end_t run_stream(void)
+{
+    frame_count = 0;
+    frame_start_us = esp_timer_get_time();
+    int64_t next_sample_us = frame_start_us;
+    uint32_t current_rate = 0;
+
+    while (true) {
+        // 等到下一個讀數時間；指令 (結束或改頻率) 會以任務通知提早喚醒
+        int64_t now_us = esp_timer_get_time();
+        while (now_us < next_sample_us) {
+            int64_t tick_us = (int64_t)portTICK_PERIOD_MS * 1000;
+            TickType_t ticks = (TickType_t)((next_sample_us - now_us + tick_us - 1) / tick_us);
+            if (ulTaskNotifyTake(pdTRUE, ticks) > 0) {
+                next_sample_us = esp_timer_get_time();  // 套用新設定，立即讀取
+            }
+            now_us = esp_timer_get_time();
+        }
+
+        uint32_t previous_rate = current_rate;
+        live_stream_end_t end = check_end(now_us, &current_rate);
+        if (end != LIVE_STREAM_END_NONE) {
+            // 斷線時不再嘗試發布，其餘情況送出最後一則訊框並附上結束原因
+            if (end != LIVE_STREAM_END_DISCONNECTED) {
+                publish_frame(current_rate, end);
+            }
+            return end;
+        }
+        if (previous_rate != 0 && previous_rate != current_rate && frame_count > 0) {
+            publish_frame(previous_rate, LIVE_STREAM_END_NONE);  // 一則訊框內只有一種頻率
+        }
+
+        int raw_adc = 0;
+        if (soil_sensor_read_raw(LIVE_STREAM_OVERSAMPLE, &raw_adc) == ESP_OK && frame_count < FRAME_MAX_SAMPLES) {
+            int64_t sample_us = esp_timer_get_time();
+            if (frame_count == 0) {
+                frame_start_us = sample_us;
+            }
+            stream_sample_t *s = &frame_samples[frame_count++];
+            s->offset_ms = (uint32_t)((sample_us - frame_start_us) / 1000);
+            s->raw_adc = (uint16_t)raw_adc;
+            s->moisture_x10 = (uint16_t)(soil_sensor_raw_to_moisture(raw_adc) * 10.0f + 0.5f);
+            portENTER_CRITICAL(&stream_lock);
+            stats.samples++;
+            portEXIT_CRITICAL(&stream_lock);
+        }
+
+        if (frame_count > 0 && esp_timer_get_time() - frame_start_us >= LIVE_STREAM_FRAME_MS * 1000LL) {
+            publish_frame(current_rate, LIVE_STREAM_END_NONE);
+        }
+
+        // 依固定間隔排程；被搶占或 ADC 忙碌而錯過的讀數不補讀，只計數
+        int64_t period_us = 1000000LL / current_rate;
+        next_sample_us += period_us;
+        now_us = esp_timer_get_time();
+        uint32_t late = 0;
+        while (next_sample_us <= now_us) {
+            next_sample_us += period_us;
+            late++;
+        }
+        if (late > 0) {
+            portENTER_CRITICAL(&stream_lock);
+            stats.late_samples += late;
+            portEXIT_CRITICAL(&stream_lock);
+        }
+    }
+}
+
+static live_stream_end_t check_end(int64_t now_us, uint32_t* current_rate)
+{
+    portENTER_CRITICAL(&stream_lock);
+    bool stop = stop_requested;
+    int64_t expire = expire_us;
+    *current_rate = rate_hz;
+    seen_gen = request_gen;
+    portEXIT_CRITICAL(&stream_lock);
+
+    if (stop) {
+        return LIVE_STREAM_END_STOPPED;
+    }
+    if (now_us >= expire) {
+        return LIVE_STREAM_END_EXPIRED;
+    }
+    if (!telemetry_is_connected()) {
+        return LIVE_STREAM_END_DISCONNECTED;
+    }
+    if (mem_pressure_get_tier() >= MEM_PRESSURE_HIGH) {
+        return LIVE_STREAM_END_MEM_PRESSURE;
+    }
+    return LIVE_STREAM_END_NONE;
+}
+
+// ============================================================================
+// 發布訊框：讀數為 [相對毫秒, ADC 原始值, 濕度 x10]，snprintf 直接編碼
+// ============================================================================
+static void publish_frame(uint32_t hz, live_stream_end_t end)
+{
+    int len = snprintf(frame_json, sizeof(frame_json), "{\"seq\":%lu,\"t0\":%lld,\"hz\":%lu",
+                       frame_seq, frame_start_us / 1000, hz);
+    int64_t epoch_ms = time_sync_uptime_to_epoch_ms(frame_start_us);
+    if (epoch_ms >= 0) {
+        len += snprintf(frame_json + len, sizeof(frame_json) - len, ",\"ts_ms\":%lld", epoch_ms);
+    }
+    len += snprintf(frame_json + len, sizeof(frame_json) - len, ",\"s\":[");
+    for (uint32_t i = 0; i < frame_count && len < (int)sizeof(frame_json); i++) {
+        const stream_sample_t *s = &frame_samples[i];
+        len += snprintf(frame_json + len, sizeof(frame_json) - len, "%s[%lu,%u,%u]",
+                        i > 0 ? "," : "", s->offset_ms, s->raw_adc, s->moisture_x10);
+    }
+    if (len < (int)sizeof(frame_json)) {
+        len += snprintf(frame_json + len, sizeof(frame_json) - len, "]");
+    }
+    if (end != LIVE_STREAM_END_NONE && len < (int)sizeof(frame_json)) {
+        len += snprintf(frame_json + len, sizeof(frame_json) - len, ",\"end\":\"%s\"", live_stream_end_name(end));
+    }
+    if (len < (int)sizeof(frame_json)) {
+        len += snprintf(frame_json + len, sizeof(frame_json) - len, "}");
+    }
+
+    frame_count = 0;
+    frame_seq++;
+    frame_start_us = esp_timer_get_time();
+    if (len >= (int)sizeof(frame_json)) {
+        return;
+    }
+
+    esp_err_t err = telemetry_publish(stream_topic, frame_json, len, 0, 0);
+    portENTER_CRITICAL(&stream_lock);
+    if (err == ESP_OK) {
+        stats.frames++;
+    } else {
+        stats.publish_failed++;
+    }
+    portEXIT_CRITICAL(&stream_lock);
+}
@@ -0,0 +1,107 @@
+// ============================================================================
+// live_stream.h - 即時高頻讀數串流模組標頭檔
+// 功能：安裝與故障排除時由 LIVE_STREAM 指令將節點切換為 1-10 Hz 的精簡讀數串流，
+//       每秒合併為一則訊框發布到專用主題；到期、斷線或記憶體壓力偏高時自動恢復，
+//       串流任務優先順序低於感測器與指令任務，不影響一般遙測與指令延遲
+// ============================================================================
+
+#ifndef LIVE_STREAM_H
+#define LIVE_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define LIVE_STREAM_DEFAULT_HZ          5       // 預設讀數頻率
+#define LIVE_STREAM_MIN_HZ              1
+#define LIVE_STREAM_MAX_HZ              10
+#define LIVE_STREAM_DEFAULT_DURATION_S  120     // 預設串流時間
+#define LIVE_STREAM_MAX_DURATION_S      600     // 串流時間上限 (重新下指令可延長，但每次最多到此值)
+#define LIVE_STREAM_FRAME_MS            1000    // 每則訊框涵蓋的時間
+#define LIVE_STREAM_OVERSAMPLE          4       // 每筆讀數的 ADC 連續採樣平均次數
+
+// ============================================================================
+// 結束原因
+// ============================================================================
+typedef enum {
+    LIVE_STREAM_END_NONE = 0,       // 尚未結束過
+    LIVE_STREAM_END_EXPIRED,        // 到期
+    LIVE_STREAM_END_STOPPED,        // LIVE_STREAM:stop 指令
+    LIVE_STREAM_END_DISCONNECTED,   // 傳輸層斷線
+    LIVE_STREAM_END_MEM_PRESSURE,   // 記憶體壓力達 HIGH 以上
+} live_stream_end_t;
+
+// ============================================================================
+// 串流請求
+// ============================================================================
+typedef struct {
+    uint32_t rate_hz;               // 讀數頻率
+    uint32_t duration_s;            // 串流時間
+    bool stop;                      // true = 立即結束目前的串流
+} live_stream_request_t;
+
+// ============================================================================
+// 串流統計
+// ============================================================================
+typedef struct {
+    bool active;
+    uint32_t rate_hz;
+    uint32_t remaining_s;           // 距離到期的秒數
+    uint32_t sessions;              // 開機以來的串流次數
+    uint32_t samples;               // 開機以來的讀數
+    uint32_t frames;                // 已發布的訊框
+    uint32_t late_samples;          // 因 ADC 忙碌或任務被搶占而錯過排程的讀數
+    uint32_t publish_failed;        // 發布失敗的訊框
+    live_stream_end_t last_end;     // 上次結束原因
+} live_stream_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化串流模組並建立 (閒置時阻塞的) 串流任務
+ *
+ * @param topic 串流訊框發布主題
+ * @return esp_err_t ESP_ERR_NO_MEM 表示任務建立失敗
+ */
+esp_err_t live_stream_init(const char* topic);
+
+/**
+ * @brief 解析指令參數，格式為 "[<秒>][:<Hz>]" 或 "stop"，例如 "300:10"
+ *
+ * @param args 指令參數 (可為 NULL 或空字串，使用預設值)
+ * @param request 解析出的串流請求
+ * @return esp_err_t ESP_ERR_INVALID_ARG 表示格式錯誤或超出範圍
+ */
+esp_err_t live_stream_parse_args(const char* args, live_stream_request_t* request);
+
+/**
+ * @brief 開始串流；串流進行中時改用新的頻率並從現在重新計算到期時間
+ *
+ * @param request 串流請求
+ * @return esp_err_t ESP_ERR_INVALID_STATE 表示未連線或記憶體壓力偏高
+ */
+esp_err_t live_stream_start(const live_stream_request_t* request);
+
+/**
+ * @brief 結束串流 (未在串流時無作用)
+ */
+void live_stream_stop(void);
+
+/**
+ * @brief 取得串流統計
+ *
+ * @param stats 統計結構指標
+ */
+void live_stream_get_stats(live_stream_stats_t* stats);
+
+/**
+ * @brief 取得結束原因字串
+ */
+const char* live_stream_end_name(live_stream_end_t reason);
+
+#endif // LIVE_STREAM_H
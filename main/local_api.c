@@ -0,0 +1,602 @@
+// ============================================================================
+// local_api.c - 本地 HTTP API 模組實作
+// 功能：所有端點共用 sensor_history 的快照與環形緩衝區，
+//       逐筆格式化到堆疊緩衝區後以 chunked 傳送，不組整份文件
+// ============================================================================
+
+#include "local_api.h"
+#include "sensor_history.h"
+#include "command_handler.h"
+#include "ota_update.h"
+#include "telemetry_transport.h"
+#include "time_sync.h"
+#include "watering_monitor.h"
+#include "moisture_comp.h"
+#include "mem_pressure.h"
+#include "conn_stats.h"
+#include "power_mgmt.h"
+#include "flow_meter.h"
+#include "ota_selftest.h"
+#include "pump_control.h"
+#include "sample_slot.h"
+#include "drying_forecast.h"
+#include "live_stream.h"
+#include "ota_range.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define LOCAL_API_SERVER_STACK_SIZE 6144    // HTTP 伺服器任務堆疊大小
+#define LOCAL_API_MAX_SOCKETS       (LOCAL_API_MAX_SSE_CLIENTS + 4) // SSE 長連線 + 一般請求
+#define HTTPD_INTERNAL_SOCKETS      3       // httpd 監聽 socket 與內部控制 socket
+// 其他模組同時可能開啟的 socket：MQTT 1、閘道器 UDP 1、CoAP 1、OTA 探測 / 單連線 1、OTA 並行下載
+#define OTHER_MODULE_SOCKETS        (4 + OTA_RANGE_MAX_CONNECTIONS)
+
+#if defined(CONFIG_LWIP_MAX_SOCKETS) && \
+    (LOCAL_API_MAX_SOCKETS + HTTPD_INTERNAL_SOCKETS + OTHER_MODULE_SOCKETS > CONFIG_LWIP_MAX_SOCKETS)
+#error "CONFIG_LWIP_MAX_SOCKETS 不足以同時容納 HTTP API 與其他連線，請調高 sdkconfig.defaults 的設定"
+#endif
+#define SSE_TASK_STACK_SIZE         3072    // 每個 SSE 客戶端任務的堆疊大小
+#define SSE_TASK_PRIORITY           3       // SSE 任務優先順序 (低於感測器任務)
+#define HISTORY_BATCH_SIZE          16      // 每次從環形緩衝區複製的筆數
+#define RECORD_JSON_SIZE            224     // 單筆讀數 JSON 的最大長度
+#define QUERY_BUFFER_SIZE           128     // URL 查詢字串緩衝區大小
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "LOCAL_API";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static httpd_handle_t server = NULL;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static local_api_stats_t api_stats = {0};
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static esp_err_t latest_handler(httpd_req_t *req);
+static esp_err_t history_handler(httpd_req_t *req);
+static esp_err_t stream_handler(httpd_req_t *req);
+static esp_err_t metrics_handler(httpd_req_t *req);
+static void sse_client_task(void *pvParameters);
+static int format_reading_json(const sensor_reading_t *r, char *buf, size_t size);
+static bool query_get_int64(const char *query, const char *key, int64_t *out);
+static void count_request(void);
+static void close_after_response(httpd_req_t *req);
+static bool reject_under_pressure(httpd_req_t *req);
+
+// ============================================================================
+// 啟動 HTTP 伺服器
+// ============================================================================
+esp_err_t local_api_init(uint16_t port)
+{
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = port;
+    config.stack_size = LOCAL_API_SERVER_STACK_SIZE;
+    config.max_open_sockets = LOCAL_API_MAX_SOCKETS;
+    // 不啟用 LRU 淘汰：一次大量 GET 會把閒置最久的 SSE 長連線關掉；
+    // 改由一般請求回應後主動關閉連線 (close_after_response)，SSE 另有 LOCAL_API_MAX_SSE_CLIENTS 上限
+    config.lru_purge_enable = false;
+
+    esp_err_t err = httpd_start(&server, &config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 無法啟動 HTTP 伺服器: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    const httpd_uri_t uris[] = {
+        { .uri = "/api/latest",  .method = HTTP_GET, .handler = latest_handler },
+        { .uri = "/api/history", .method = HTTP_GET, .handler = history_handler },
+        { .uri = "/api/stream",  .method = HTTP_GET, .handler = stream_handler },
+        { .uri = "/metrics",     .method = HTTP_GET, .handler = metrics_handler },
+    };
+    for (size_t i = 0; i < sizeof(uris) / sizeof(uris[0]); i++) {
+        httpd_register_uri_handler(server, &uris[i]);
+    }
+
+    ESP_LOGI(TAG, "✅ 本地 HTTP API 已啟動 - 埠號: %u", port);
+    return ESP_OK;
+}
+
+void local_api_get_stats(local_api_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&stats_lock);
+    memcpy(stats, &api_stats, sizeof(local_api_stats_t));
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+// ============================================================================
+// GET /api/latest - 最新讀數
+// ============================================================================
+static esp_err_t latest_handler(httpd_req_t *req)
+{
+    count_request();
+    close_after_response(req);
+
+    sensor_reading_t reading;
+    if (!sensor_history_latest(&reading)) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no reading yet");
+        return ESP_OK;
+    }
+
+    char buf[RECORD_JSON_SIZE];
+    int len = format_reading_json(&reading, buf, sizeof(buf));
+
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, buf, len);
+}
+
+// ============================================================================
+// GET /api/history - 歷史讀數 (JSON 陣列，逐批 chunked 傳送)
+// ============================================================================
+static esp_err_t history_handler(httpd_req_t *req)
+{
+    count_request();
+    close_after_response(req);
+
+    int64_t since = 0;
+    int64_t from_ms = -1;
+    int64_t to_ms = -1;
+    int64_t limit = SENSOR_HISTORY_CAPACITY;
+
+    char query[QUERY_BUFFER_SIZE];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        query_get_int64(query, "since", &since);
+        query_get_int64(query, "from", &from_ms);
+        query_get_int64(query, "to", &to_ms);
+        query_get_int64(query, "limit", &limit);
+    }
+    if (since < 0 || limit <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "invalid since/limit");
+        return ESP_OK;
+    }
+    if (reject_under_pressure(req)) {
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, HTTPD_TYPE_JSON);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    httpd_resp_send_chunk(req, "[", 1);
+
+    sensor_reading_t batch[HISTORY_BATCH_SIZE];
+    char buf[RECORD_JSON_SIZE + 1];
+    uint32_t cursor = (uint32_t)since;
+    int64_t sent = 0;
+    size_t count;
+
+    while (sent < limit && (count = sensor_history_read(cursor, batch, HISTORY_BATCH_SIZE)) > 0) {
+        for (size_t i = 0; i < count && sent < limit; i++) {
+            const sensor_reading_t *r = &batch[i];
+            cursor = r->seq;
+
+            // 時間區間只適用於已同步的讀數
+            if ((from_ms >= 0 || to_ms >= 0) && r->epoch_ms < 0) continue;
+            if (from_ms >= 0 && r->epoch_ms < from_ms) continue;
+            if (to_ms >= 0 && r->epoch_ms > to_ms) continue;
+
+            int len = 0;
+            if (sent > 0) {
+                buf[len++] = ',';
+            }
+            len += format_reading_json(r, buf + len, sizeof(buf) - len);
+            if (httpd_resp_send_chunk(req, buf, len) != ESP_OK) {
+                return ESP_FAIL;  // 客戶端已斷線
+            }
+            sent++;
+        }
+    }
+
+    httpd_resp_send_chunk(req, "]", 1);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// ============================================================================
+// GET /api/stream - Server-Sent Events
+// 以非同步請求交給獨立任務，HTTP 伺服器任務可繼續處理其他請求
+// ============================================================================
+static esp_err_t stream_handler(httpd_req_t *req)
+{
+    count_request();
+
+    // 每個串流客戶端需要獨立任務堆疊，記憶體壓力下不接受新連線
+    if (reject_under_pressure(req)) {
+        close_after_response(req);
+        return ESP_OK;
+    }
+
+    bool accepted = false;
+    portENTER_CRITICAL(&stats_lock);
+    if (api_stats.sse_clients < LOCAL_API_MAX_SSE_CLIENTS) {
+        api_stats.sse_clients++;
+        accepted = true;
+    } else {
+        api_stats.sse_rejected++;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (!accepted) {
+        close_after_response(req);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "10");
+        httpd_resp_sendstr(req, "too many stream clients");
+        return ESP_OK;
+    }
+
+    httpd_req_t *async_req = NULL;
+    esp_err_t err = httpd_req_async_handler_begin(req, &async_req);
+    if (err == ESP_OK) {
+        if (xTaskCreate(sse_client_task, "sse_client", SSE_TASK_STACK_SIZE,
+                        async_req, SSE_TASK_PRIORITY, NULL) != pdPASS) {
+            httpd_req_async_handler_complete(async_req);
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (err != ESP_OK) {
+        portENTER_CRITICAL(&stats_lock);
+        api_stats.sse_clients--;
+        portEXIT_CRITICAL(&stats_lock);
+        ESP_LOGE(TAG, "❌ 無法建立 SSE 串流: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+// ============================================================================
+// SSE 客戶端任務 (每個連線一個，新讀數以 task notification 喚醒)
+// ============================================================================
+static void sse_client_task(void *pvParameters)
+{
+    httpd_req_t *req = (httpd_req_t *)pvParameters;
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    char buf[RECORD_JSON_SIZE + 32];
+    sensor_reading_t batch[HISTORY_BATCH_SIZE];
+    uint32_t cursor = 0;
+
+    // 從最新一筆開始推送，不重送整段歷史 (需要歷史請用 /api/history)
+    sensor_reading_t latest;
+    if (sensor_history_latest(&latest)) {
+        cursor = latest.seq - 1;
+    }
+
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    esp_err_t err = sensor_history_watch(self);
+    if (err == ESP_OK) {
+        err = httpd_resp_send_chunk(req, "retry: 3000\n\n", strlen("retry: 3000\n\n"));
+    }
+    ESP_LOGI(TAG, "📡 SSE 客戶端已連線");
+
+    while (err == ESP_OK) {
+        size_t count;
+        while (err == ESP_OK && (count = sensor_history_read(cursor, batch, HISTORY_BATCH_SIZE)) > 0) {
+            for (size_t i = 0; i < count && err == ESP_OK; i++) {
+                int len = snprintf(buf, sizeof(buf), "id: %lu\ndata: ", batch[i].seq);
+                len += format_reading_json(&batch[i], buf + len, sizeof(buf) - len - 2);
+                buf[len++] = '\n';
+                buf[len++] = '\n';
+                err = httpd_resp_send_chunk(req, buf, len);
+                cursor = batch[i].seq;
+
+                portENTER_CRITICAL(&stats_lock);
+                api_stats.sse_events_sent++;
+                portEXIT_CRITICAL(&stats_lock);
+            }
+        }
+
+        if (err == ESP_OK && ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOCAL_API_SSE_KEEPALIVE_MS)) == 0) {
+            // 註解行讓代理與客戶端知道連線仍存活，同時偵測已斷線的客戶端
+            err = httpd_resp_send_chunk(req, ": keepalive\n\n", strlen(": keepalive\n\n"));
+        }
+    }
+
+    sensor_history_unwatch(self);
+    httpd_resp_send_chunk(req, NULL, 0);
+    httpd_req_async_handler_complete(req);
+
+    portENTER_CRITICAL(&stats_lock);
+    api_stats.sse_clients--;
+    portEXIT_CRITICAL(&stats_lock);
+
+    ESP_LOGI(TAG, "📡 SSE 客戶端已斷線");
+    vTaskDelete(NULL);
+}
+
+// ============================================================================
+// GET /metrics - Prometheus 文字格式指標
+// ============================================================================
+static esp_err_t send_metric(httpd_req_t *req, const char *name, const char *type, double value)
+{
+    char line[128];
+    int len = snprintf(line, sizeof(line), "# TYPE %s %s\n%s %.6g\n", name, type, name, value);
+    return httpd_resp_send_chunk(req, line, len);
+}
+
+// 直方圖：counts 為各格 (非累積) 次數，上界以 scale 換算成秒，最後一格為 +Inf
+static esp_err_t send_histogram(httpd_req_t *req, const char *name, const uint32_t *le,
+                                const uint32_t *counts, int buckets, double scale, double sum)
+{
+    char line[128];
+    int len = snprintf(line, sizeof(line), "# TYPE %s histogram\n", name);
+    httpd_resp_send_chunk(req, line, len);
+
+    uint32_t cumulative = 0;
+    for (int b = 0; b < buckets; b++) {
+        cumulative += counts[b];
+        if (b == buckets - 1) {
+            len = snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %lu\n", name, cumulative);
+        } else {
+            len = snprintf(line, sizeof(line), "%s_bucket{le=\"%.6g\"} %lu\n", name, le[b] * scale, cumulative);
+        }
+        httpd_resp_send_chunk(req, line, len);
+    }
+    len = snprintf(line, sizeof(line), "%s_sum %.6g\n%s_count %lu\n", name, sum, name, cumulative);
+    return httpd_resp_send_chunk(req, line, len);
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    count_request();
+    close_after_response(req);
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    // 系統
+    send_metric(req, "soil_uptime_seconds", "gauge", esp_timer_get_time() / 1000000);
+    send_metric(req, "soil_free_heap_bytes", "gauge", esp_get_free_heap_size());
+    send_metric(req, "soil_min_free_heap_bytes", "gauge", esp_get_minimum_free_heap_size());
+
+    // 感測器
+    sensor_reading_t reading;
+    if (sensor_history_latest(&reading)) {
+        send_metric(req, "soil_readings_total", "counter", reading.seq);
+        send_metric(req, "soil_moisture_percent", "gauge", reading.moisture_x10 / 10.0);
+        send_metric(req, "soil_voltage_volts", "gauge", reading.voltage_mv / 1000.0);
+        send_metric(req, "soil_raw_adc", "gauge", reading.raw_adc);
+        if (reading.temp_x100 != SENSOR_HISTORY_NO_TEMP) {
+            send_metric(req, "soil_temperature_celsius", "gauge", reading.temp_x100 / 100.0);
+            send_metric(req, "soil_moisture_compensated_percent", "gauge", reading.moisture_comp_x10 / 10.0);
+        }
+    }
+    send_metric(req, "soil_pump_on", "gauge", get_pump_status() ? 1 : 0);
+
+    // 泵浦計時關閉 (誤差只統計計時器關閉，開啟時間包含提前停止)
+    static const uint32_t jitter_le_us[PUMP_JITTER_BUCKETS] = PUMP_JITTER_BUCKET_LE_US;
+    static const uint32_t on_time_le_ms[PUMP_ON_TIME_BUCKETS] = PUMP_ON_TIME_BUCKET_LE_MS;
+    pump_control_stats_t pump_stats;
+    pump_control_get_stats(&pump_stats);
+    send_histogram(req, "soil_pump_off_jitter_seconds", jitter_le_us, pump_stats.jitter_hist,
+                   PUMP_JITTER_BUCKETS, 1e-6, pump_stats.jitter_abs_sum_us / 1e6);
+    send_histogram(req, "soil_pump_on_time_seconds", on_time_le_ms, pump_stats.on_time_hist,
+                   PUMP_ON_TIME_BUCKETS, 1e-3, pump_stats.on_time_sum_ms / 1e3);
+    send_metric(req, "soil_pump_early_stops_total", "counter", pump_stats.early_stops);
+    send_metric(req, "soil_pump_jitter_bound_violations_total", "counter", pump_stats.bound_violations);
+
+    // 指令與 OTA
+    uint32_t processed = 0, errors = 0;
+    get_command_stats(&processed, &errors);
+    send_metric(req, "soil_commands_processed_total", "counter", processed);
+    send_metric(req, "soil_command_errors_total", "counter", errors);
+    uint32_t expired = 0, late = 0;
+    get_command_deadline_stats(&expired, &late);
+    send_metric(req, "soil_commands_expired_total", "counter", expired);
+    send_metric(req, "soil_commands_late_total", "counter", late);
+    send_metric(req, "soil_water_commands_total", "counter", get_water_count());
+
+    // 流量計
+    flow_meter_stats_t flow_stats;
+    flow_meter_get_stats(&flow_stats);
+    if (flow_stats.available) {
+        send_metric(req, "soil_water_delivered_ml_total", "counter", (double)flow_stats.total_ml);
+        send_metric(req, "soil_water_last_ml", "gauge", flow_stats.last_ml);
+        send_metric(req, "soil_water_last_flow_ml_per_min", "gauge", flow_stats.last_flow_ml_per_min);
+        send_metric(req, "soil_flow_pulses_total", "counter", flow_stats.pulses_total);
+    }
+
+    moisture_comp_stats_t comp_stats;
+    moisture_comp_get_stats(&comp_stats);
+    send_metric(req, "soil_temp_comp_coeff_percent_per_celsius", "gauge", comp_stats.coeff_x1000 / 1000.0);
+    send_metric(req, "soil_temp_comp_learn_samples", "gauge", comp_stats.learn_samples);
+
+    // 澆水回應驗證
+    watering_monitor_stats_t water_stats;
+    watering_monitor_get_stats(&water_stats);
+    send_metric(req, "soil_watering_monitored_total", "counter", water_stats.monitored);
+    send_metric(req, "soil_watering_weak_total", "counter", water_stats.weak_count);
+    send_metric(req, "soil_watering_no_response_total", "counter", water_stats.no_response_count);
+    send_metric(req, "soil_watering_last_rise_percent", "gauge", water_stats.last_rise);
+    send_metric(req, "soil_watering_baseline_rise_percent", "gauge", water_stats.baseline_rise);
+    send_metric(req, "soil_watering_lockout_seconds", "gauge", water_stats.lockout_remaining_s);
+
+    ota_statistics_t ota_stats;
+    if (ota_get_statistics(&ota_stats) == ESP_OK) {
+        send_metric(req, "soil_ota_updates_total", "counter", ota_stats.total_updates);
+        send_metric(req, "soil_ota_failed_total", "counter", ota_stats.failed_updates);
+    }
+
+    // 遙測傳輸
+    telemetry_stats_t tx_stats;
+    telemetry_get_stats(&tx_stats);
+    send_metric(req, "soil_publish_ok_total", "counter", tx_stats.publish_ok);
+    send_metric(req, "soil_publish_failed_total", "counter", tx_stats.publish_failed);
+    send_metric(req, "soil_publish_skipped_total", "counter", tx_stats.publish_skipped);
+    send_metric(req, "soil_publish_bytes_total", "counter", tx_stats.bytes_sent);
+
+    // 連線品質 (當日)
+    conn_link_stats_t wifi_stats, mqtt_stats;
+    conn_stats_get(CONN_LINK_WIFI, &wifi_stats);
+    conn_stats_get(CONN_LINK_MQTT, &mqtt_stats);
+    send_metric(req, "soil_wifi_connected_ratio", "gauge",
+                wifi_stats.elapsed_s > 0 ? (double)wifi_stats.connected_s / wifi_stats.elapsed_s : 0);
+    send_metric(req, "soil_mqtt_connected_ratio", "gauge",
+                mqtt_stats.elapsed_s > 0 ? (double)mqtt_stats.connected_s / mqtt_stats.elapsed_s : 0);
+    send_metric(req, "soil_wifi_outages_today", "gauge", wifi_stats.outages);
+    send_metric(req, "soil_mqtt_outages_today", "gauge", mqtt_stats.outages);
+    send_metric(req, "soil_mqtt_longest_outage_seconds", "gauge", mqtt_stats.longest_outage_s);
+
+    // 電源管理 (清醒比例、各子系統持鎖時間、指令派送延遲)
+    power_mgmt_stats_t pm_stats;
+    power_mgmt_get_stats(&pm_stats);
+    send_metric(req, "soil_pm_enabled", "gauge", pm_stats.enabled ? 1 : 0);
+    if (pm_stats.awake_permille >= 0) {
+        send_metric(req, "soil_pm_awake_ratio", "gauge", pm_stats.awake_permille / 1000.0);
+    }
+    for (int s = 0; s < PM_SUBSYS_COUNT; s++) {
+        char name[48];
+        snprintf(name, sizeof(name), "soil_pm_%s_lock_seconds_total", power_mgmt_subsys_name(s));
+        send_metric(req, name, "counter", pm_stats.locks[s].hold_us / 1e6);
+    }
+    send_metric(req, "soil_command_latency_avg_seconds", "gauge", pm_stats.cmd_latency_avg_us / 1e6);
+    send_metric(req, "soil_command_latency_max_seconds", "gauge", pm_stats.cmd_latency_max_us / 1e6);
+    send_metric(req, "soil_command_latency_p99_seconds", "gauge", pm_stats.cmd_latency_p99_us / 1e6);
+
+    // OTA 自我測試 (0=none 1=running 2=passed 3=failed)
+    uint32_t selftest_remaining_s = 0;
+    send_metric(req, "soil_ota_selftest_state", "gauge", ota_selftest_get_state(&selftest_remaining_s));
+    send_metric(req, "soil_ota_selftest_remaining_seconds", "gauge", selftest_remaining_s);
+
+    // 時間同步
+    time_sync_stats_t ts_stats;
+    time_sync_get_stats(&ts_stats);
+    send_metric(req, "soil_time_synced", "gauge", ts_stats.synced ? 1 : 0);
+    send_metric(req, "soil_clock_drift_ppm", "gauge", ts_stats.drift_ppm);
+    send_metric(req, "soil_sntp_syncs_total", "counter", ts_stats.sync_count);
+
+    // 全場同步採樣
+    sample_slot_stats_t slot_stats;
+    sample_slot_get_stats(&slot_stats);
+    send_metric(req, "soil_sample_aligned", "gauge", slot_stats.aligned ? 1 : 0);
+    send_metric(req, "soil_sample_skew_seconds", "gauge", slot_stats.last_skew_ms / 1000.0);
+    send_metric(req, "soil_sample_skew_max_seconds", "gauge", slot_stats.max_skew_ms / 1000.0);
+    send_metric(req, "soil_sample_missed_slots_total", "counter", slot_stats.missed_slots);
+    send_metric(req, "soil_sample_clock_steps_back_total", "counter", slot_stats.clock_steps_back);
+
+    // 乾燥預測 (未處於乾燥狀態時剩餘時間為 -1)
+    drying_forecast_t forecast;
+    drying_forecast_get(&forecast);
+    send_metric(req, "soil_drying_rate_pct_per_hour", "gauge", forecast.rate_pct_per_h);
+    send_metric(req, "soil_time_to_threshold_seconds", "gauge",
+                forecast.state == DRYING_STATE_DRYING ? forecast.hours_to_threshold * 3600.0 : -1.0);
+    send_metric(req, "soil_time_to_threshold_low_seconds", "gauge",
+                forecast.state == DRYING_STATE_DRYING ? forecast.hours_low * 3600.0 : -1.0);
+    send_metric(req, "soil_time_to_threshold_high_seconds", "gauge",
+                forecast.state == DRYING_STATE_DRYING ? forecast.hours_high * 3600.0 : -1.0);
+    send_metric(req, "soil_drying_fit_resets_total", "counter", forecast.resets);
+
+    // 即時串流
+    live_stream_stats_t live_stats;
+    live_stream_get_stats(&live_stats);
+    send_metric(req, "soil_live_stream_active", "gauge", live_stats.active ? 1 : 0);
+    send_metric(req, "soil_live_stream_samples_total", "counter", live_stats.samples);
+    send_metric(req, "soil_live_stream_late_samples_total", "counter", live_stats.late_samples);
+    send_metric(req, "soil_live_stream_frames_total", "counter", live_stats.frames);
+    send_metric(req, "soil_live_stream_publish_failed_total", "counter", live_stats.publish_failed);
+
+    // 本地 API
+    local_api_stats_t stats;
+    local_api_get_stats(&stats);
+    send_metric(req, "soil_http_requests_total", "counter", stats.requests);
+    send_metric(req, "soil_sse_clients", "gauge", stats.sse_clients);
+    send_metric(req, "soil_sse_rejected_total", "counter", stats.sse_rejected);
+    send_metric(req, "soil_sse_events_total", "counter", stats.sse_events_sent);
+
+    // 記憶體壓力
+    mem_pressure_stats_t mem_stats;
+    mem_pressure_get_stats(&mem_stats);
+    send_metric(req, "soil_mem_pressure_tier", "gauge", mem_stats.tier);
+    send_metric(req, "soil_heap_largest_block_bytes", "gauge", mem_stats.largest_block);
+    send_metric(req, "soil_mem_pressure_transitions_total", "counter", mem_stats.transitions);
+    send_metric(req, "soil_heap_alloc_failures_total", "counter", mem_stats.alloc_failures);
+
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// ============================================================================
+// 工具函數
+// ============================================================================
+
+// 記憶體壓力達 HIGH 時暫停歷史查詢與新的串流，回覆 503 讓客戶端稍後重試
+static bool reject_under_pressure(httpd_req_t *req)
+{
+    if (mem_pressure_get_tier() < MEM_PRESSURE_HIGH) {
+        return false;
+    }
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "30");
+    httpd_resp_sendstr(req, "low memory");
+    return true;
+}
+
+// 讀數格式化為 JSON (欄位名稱與 MQTT payload 一致)，回傳長度
+static int format_reading_json(const sensor_reading_t *r, char *buf, size_t size)
+{
+    int len = snprintf(buf, size,
+                       "{\"seq\":%lu,\"uptime_ms\":%lld,\"voltage\":%u.%03u,\"moisture\":%u.%u,"
+                       "\"raw_adc\":%u,\"gpio_status\":%s",
+                       r->seq, r->uptime_ms,
+                       r->voltage_mv / 1000, r->voltage_mv % 1000,
+                       r->moisture_x10 / 10, r->moisture_x10 % 10,
+                       r->raw_adc, r->pump_on ? "true" : "false");
+    if (r->temp_x100 != SENSOR_HISTORY_NO_TEMP) {
+        int temp = r->temp_x100;
+        len += snprintf(buf + len, size - len, ",\"temperature\":%s%d.%02d,\"moisture_compensated\":%u.%u",
+                        temp < 0 ? "-" : "", abs(temp) / 100, abs(temp) % 100,
+                        r->moisture_comp_x10 / 10, r->moisture_comp_x10 % 10);
+    }
+    if (r->epoch_ms >= 0) {
+        len += snprintf(buf + len, size - len, ",\"ts_ms\":%lld", r->epoch_ms);
+    }
+    len += snprintf(buf + len, size - len, "}");
+    return len;
+}
+
+static bool query_get_int64(const char *query, const char *key, int64_t *out)
+{
+    char value[24];
+    if (httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+
+    char *end = NULL;
+    long long parsed = strtoll(value, &end, 10);
+    if (end == value || *end != '\0') {
+        return false;
+    }
+
+    *out = parsed;
+    return true;
+}
+
+static void count_request(void)
+{
+    portENTER_CRITICAL(&stats_lock);
+    api_stats.requests++;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+// 一般請求回應後關閉連線，閒置的 keep-alive 連線不會佔住 SSE 需要的插槽
+// (關閉排入伺服器任務的工作佇列，在處理函數返回、回應送完後才執行)
+static void close_after_response(httpd_req_t *req)
+{
+    httpd_resp_set_hdr(req, "Connection", "close");
+    httpd_sess_trigger_close(server, httpd_req_to_sockfd(req));
+}
@@ -0,0 +1,54 @@
+// ============================================================================
+// local_api.h - 本地 HTTP API 模組標頭檔
+// 功能：在節點上直接提供最新讀數、歷史區間、Prometheus 格式指標與 SSE 即時串流，
+//       現場平板不必繞經雲端 Broker
+// ============================================================================
+
+#ifndef LOCAL_API_H
+#define LOCAL_API_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define LOCAL_API_MAX_SSE_CLIENTS   3       // 同時連線的 SSE 客戶端上限
+#define LOCAL_API_SSE_KEEPALIVE_MS  15000   // 無新讀數時送出註解行的間隔
+
+// ============================================================================
+// 本地 API 統計資訊
+// ============================================================================
+typedef struct {
+    uint32_t requests;          // 已處理的 HTTP 請求數
+    uint32_t sse_clients;       // 目前連線中的 SSE 客戶端數
+    uint32_t sse_rejected;      // 因連線數已滿而拒絕的 SSE 請求數
+    uint32_t sse_events_sent;   // 已送出的 SSE 事件數
+} local_api_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 啟動本地 HTTP 伺服器並註冊所有端點
+ *
+ * 端點：
+ *   GET /api/latest   最新讀數 (JSON)
+ *   GET /api/history  歷史讀數 (JSON 陣列，chunked)，參數 since=<seq>、from/to=<epoch ms>、limit
+ *   GET /api/stream   Server-Sent Events 即時讀數串流
+ *   GET /metrics      Prometheus 文字格式指標
+ *
+ * @param port HTTP 埠號
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t local_api_init(uint16_t port);
+
+/**
+ * @brief 取得本地 API 統計資訊
+ *
+ * @param stats 統計資訊結構指標
+ */
+void local_api_get_stats(local_api_stats_t* stats);
+
+#endif // LOCAL_API_H
@@ -33,8 +33,6 @@
 // ============================================================================
 #include "driver/gpio.h"           // GPIO 驅動函式庫，提供數位輸入輸出控制
 #include "esp_adc/adc_oneshot.h"   // ADC 單次採樣函式庫 (ESP-IDF v5.0+ 新API)
-#include "esp_adc/adc_cali.h"      // ADC 校準函式庫，用於電壓轉換的精度校正
-#include "esp_adc/adc_cali_scheme.h" // ADC 校準方案函式庫，提供不同的校準演算法
 
 // ============================================================================
 // 網路通訊相關函式庫
@@ -52,6 +50,29 @@
 // ============================================================================
 #include "command_handler.h"  // 指令處理模組
 #include "ota_update.h"       // OTA 韌體更新模組
+#include "telemetry_transport.h" // 遙測傳輸抽象層 (MQTT / CoAP)
+#include "gateway.h"            // 站點閘道器聚合模組
+#include "time_sync.h"          // SNTP 時間同步模組
+#include "sample_slot.h"        // 全場同步採樣時槽
+#include "sensor_history.h"     // 讀數快照與歷史緩衝區
+#include "local_api.h"          // 本地 HTTP API (最新讀數、歷史、指標、SSE)
+#include "soil_sensor.h"        // 土壤濕度感測器 (ADC) 模組
+#include "watering_monitor.h"   // 澆水回應驗證模組
+#include "temp_sensor.h"        // 溫度感測器 HAL
+#include "moisture_comp.h"      // 濕度溫度補償模組
+#include "drying_forecast.h"    // 乾燥速率與剩餘時間預測
+#include "adc_bench.h"          // ADC 擷取基準測試模組
+#include "mem_pressure.h"       // 記憶體壓力分級降級模組
+#include "sensor_registry.h"    // 感測器驅動註冊表
+#include "sensor_drivers.h"     // 內建感測器驅動 (I2C / 模擬)
+#include "conn_stats.h"         // 連線品質統計 (SLA)
+#include "power_mgmt.h"         // 動態調頻 / 淺眠與電源管理鎖
+#include "flow_meter.h"         // 水流量計 (定量澆水)
+#include "ota_selftest.h"       // OTA 效能自我測試與自動回滾
+#include "ota_recorder.h"       // OTA 飛行紀錄器 (NVS 保存，重啟後上傳)
+#include "raw_capture.h"        // 高取樣率原始 ADC 擷取 (雜訊診斷)
+#include "live_stream.h"        // 即時高頻讀數串流 (安裝與故障排除)
+#include "pump_control.h"       // 泵浦計時關閉與開啟時間誤差統計
 
 // ============================================================================
 // WiFi 連接設定區 - 使用者需要修改的部分
@@ -66,14 +87,52 @@
 #define BROKER_PORT 24509                // 自定義 MQTT 埠號
 #define CLIENT_ID "soilsensorcapture_esp32c3" // MQTT 客戶端 ID，必須唯一
 #define MQTT_BROKER "mqtt://switchback.proxy.rlwy.net:24509" // 完整的 MQTT 連接 URI
+#define NTP_SERVER "pool.ntp.org"              // SNTP 時間伺服器 (payload 牆鐘時間戳)
+
+// ============================================================================
+// 遙測傳輸選擇區 - 依部署選擇 MQTT/TCP 或 CoAP/UDP
+// 電池供電、間歇喚醒的節點建議使用 CoAP，省去 TCP 握手、CONNECT 與心跳
+// ============================================================================
+#define TELEMETRY_TRANSPORT TELEMETRY_TRANSPORT_MQTT // TELEMETRY_TRANSPORT_MQTT / _COAP / _GATEWAY (葉節點)
+#define COAP_SERVER_HOST "switchback.proxy.rlwy.net" // CoAP 伺服器主機名稱
+#define COAP_SERVER_PORT 5683                        // CoAP 預設 UDP 埠號
+#define COAP_COMMAND_POLL_INTERVAL_MS 10000          // CoAP 指令輪詢間隔 (毫秒)
+
+// ============================================================================
+// 站點閘道器設定區 - 大型站點由單一節點聚合所有葉節點，Broker 連線數從 N 降為 1
+// 閘道器：TELEMETRY_TRANSPORT_MQTT + GATEWAY_SERVICE_ENABLED 1
+// 葉節點：TELEMETRY_TRANSPORT_GATEWAY，GATEWAY_ADDRESS 指向閘道器
+// ============================================================================
+#define GATEWAY_SERVICE_ENABLED 0           // 1 = 本節點擔任站點閘道器
+#define GATEWAY_ADDRESS "192.168.1.50"      // 閘道器 IP (葉節點使用)
+#define GATEWAY_UDP_PORT 47800              // 閘道器 UDP 埠號
+#define GATEWAY_NODE_ID 0                   // 節點 ID 覆寫 (0 = MAC 後 4 bytes)
+
+// ============================================================================
+// 本地 HTTP API 設定區 - 現場平板直接向節點讀取，不必繞經雲端 Broker
+// ============================================================================
+#define LOCAL_API_ENABLED 1                 // 1 = 啟動節點上的 HTTP 伺服器
+#define LOCAL_API_PORT 80                   // HTTP 埠號
 
 // ============================================================================
 // MQTT Topic 定義區 - 訊息主題設計，與樹莓派版本互相兼容
 // ============================================================================
 #define TOPIC_DATA "soilsensorcapture/esp/data"      // 感測器資料發布主題
+#define TOPIC_DATA_BACKFILL "soilsensorcapture/esp/data/backfill" // 離線期間讀數的批次補送主題
 #define TOPIC_COMMAND "soilsensorcapture/esp/command" // 接收遠端指令主題
 #define TOPIC_STATUS "soilsensorcapture/esp/status"   // 系統狀態發布主題
 #define TOPIC_RESPONSE "soilsensorcapture/esp/response" // 指令回應發布主題
+#define TOPIC_WATERING "soilsensorcapture/esp/watering" // 澆水結果與效率指標主題
+#define TOPIC_ALERT "soilsensorcapture/esp/alert"       // 異常警報主題
+#define TOPIC_BENCH "soilsensorcapture/esp/bench"       // ADC 基準測試結果主題
+#define TOPIC_GATEWAY_BATCH "soilsensorcapture/gateway/batch" // 閘道器批次讀數主題
+#define TOPIC_ENVELOPE "soilsensorcapture/esp/envelope" // 同一排程週期合併發布的信封主題
+#define TOPIC_CONN "soilsensorcapture/esp/conn"         // 連線品質統計主題
+#define TOPIC_OTA_SELFTEST "soilsensorcapture/esp/ota/selftest" // OTA 自我測試結果主題
+#define TOPIC_CAPTURE "soilsensorcapture/esp/capture"   // 原始 ADC 擷取分段上傳主題
+#define TOPIC_OTA_RECORD "soilsensorcapture/esp/ota/record" // OTA 嘗試紀錄 (各階段時間) 主題
+#define TOPIC_FORECAST "soilsensorcapture/esp/forecast"  // 乾燥速率與剩餘時間預測主題
+#define TOPIC_LIVE "soilsensorcapture/esp/live"          // LIVE_STREAM 即時高頻讀數訊框主題
 
 // ============================================================================
 // 硬體腳位定義區 - ESP32-C3 Super Mini 專用設定
@@ -81,6 +140,27 @@
 #define SOIL_SENSOR_ADC_CHANNEL ADC_CHANNEL_0 // 土壤感測器 ADC 通道 (對應 GPIO0)
 #define PUMP_GPIO GPIO_NUM_6                  // 泵浦控制腳位 (GPIO6)
 #define LED_GPIO GPIO_NUM_8                   // 內建 LED 腳位 (GPIO8，反向邏輯)
+#define FLOW_METER_GPIO GPIO_NUM_7            // 流量感測器脈衝輸入 (GPIO7)
+
+// ============================================================================
+// 流量計設定區 - 霍爾式流量感測器，用於定量澆水 ("WATER:200") 與出水量統計
+// ============================================================================
+#define FLOW_PULSES_PER_LITER 450             // 感測器 K 值 (YF-S201 約 450，依實測校正)
+#define FLOW_METER_ENABLED 0                  // 1 = 已安裝流量感測器
+#define FLOW_METER_MOCK 0                     // 1 = 模擬脈衝來源 (無硬體測試定量澆水流程)
+#define FLOW_MOCK_ML_PER_MIN 1200             // 模擬來源的出水流量
+
+// ============================================================================
+// 泵浦控制設定區 - 開啟時同時啟動單次計時器，由計時器回呼直接關閉泵浦
+// ============================================================================
+#define PUMP_MAX_ON_MS 60000                  // 單次開啟上限 (須 >= 定量澆水最長出水時間)
+#define PUMP_JITTER_BOUND_US 2000             // 計時關閉允許誤差，超過計為違規
+#define PUMP_CONTROL_MOCK 0                   // 1 = 不操作 GPIO (無硬體測試澆水流程)
+
+// ============================================================================
+// 原始擷取設定區 - CAPTURE 指令的樣本緩衝區 (開機時配置，每個樣本 2 bytes)
+// ============================================================================
+#define RAW_CAPTURE_BUFFER_SAMPLES 16384      // 32 KB：5 kHz 約 3.3 秒、20 kHz 約 0.8 秒
 
 // ============================================================================
 // 感測器校準參數區 - 根據實際測試調整
@@ -89,11 +169,85 @@
 #define WATER_VALUE 1400   // 感測器完全浸在水中的 ADC 讀值
 #define SAMPLE_COUNT 10   // 每次讀取的採樣次數，用於平均化以提高精度
 
+// ============================================================================
+// 溫度補償設定區 - 電容式探頭讀值隨溫度漂移，造成日夜濕度波動
+// ============================================================================
+#define TEMP_SENSOR_SOURCE TEMP_SOURCE_INTERNAL   // TEMP_SOURCE_NONE / _INTERNAL (晶片) / _NTC (外接探頭)
+#define TEMP_SENSOR_OFFSET_X100 0                 // 溫度校正偏移 (0.01°C)，內建感測器可填入自熱偏移
+#define NTC_ADC_CHANNEL ADC_CHANNEL_1             // 外接 NTC 分壓點 (GPIO1)
+#define NTC_SERIES_OHMS 10000                     // NTC 上拉電阻
+#define NTC_R0_OHMS 10000                         // NTC 25°C 阻值
+#define NTC_BETA 3950                             // NTC B 值
+#define MOISTURE_COMP_MODEL MOISTURE_COMP_LEARNED // MOISTURE_COMP_NONE / _FIXED / _LEARNED (tools/moisture_comp_sim.py 模擬驗證)
+#define MOISTURE_COMP_COEFF_X1000 0               // 初始溫度係數 (0.001% / °C)，學習生效 (約 2-8 天) 前補償值等於原始值
+#define MOISTURE_COMP_REF_TEMP_X100 2500          // 補償參考溫度 (0.01°C)
+
+// ============================================================================
+// 乾燥預測設定區 - 裝置端擬合乾燥速率，預測濕度降到門檻的剩餘時間
+// ============================================================================
+#define DRYING_THRESHOLD_PCT 30.0f    // 需要澆水的濕度門檻 (%)
+#define DRYING_FORGET_FACTOR 0.93f    // RLS 遺忘因子 (每小時區段，約等於最近 14 小時)
+#define DRYING_SETTLE_S 1800          // 澆水或降雨後等待滲透穩定的時間 (秒)
+#define DRYING_FORECAST_PUBLISH_S 900 // 預測未明顯變化時的最長發布間隔 (秒)
+
+// ============================================================================
+// 附加感測器設定區 - 依節點實際安裝的感測器啟用，不需另外分支韌體
+// 欄位會併入 soil_data (例如 air_temperature、air_humidity、light_lux)
+// ============================================================================
+#define I2C_SDA_GPIO GPIO_NUM_4         // I2C SDA 腳位
+#define I2C_SCL_GPIO GPIO_NUM_5         // I2C SCL 腳位
+#define SENSOR_SHT3X_ENABLED 0          // 1 = SHT3x 空氣溫濕度感測器
+#define SENSOR_BH1750_ENABLED 0         // 1 = BH1750 光照度感測器
+#define SENSOR_MOCK_ENABLED 0           // 1 = 模擬驅動 (在實機上無外接感測器時測試資料流程)
+
 // ============================================================================
 // 資料發送頻率設定
 // ============================================================================
 #define SENSOR_DATA_INTERVAL 60   // 感測器資料發送間隔 (秒)
 #define SYSTEM_STATUS_INTERVAL 30 // 系統狀態發送間隔 (秒)
+#define BACKFILL_BATCH_SIZE 16    // 補送時每則訊息包含的讀數筆數 (記憶體壓力下自動縮小)
+#define TELEMETRY_ENVELOPE_ENABLED 0 // 1 = 同一週期到期的資料與狀態合併為單一信封發布 (低頻寬站點)
+#define SAMPLE_SLOT_ALIGNED 1     // 1 = 時間同步後在 epoch 時槽邊界採樣 (全場同一時刻，供空間濕度分佈圖)
+#define SAMPLE_PUBLISH_SPREAD_MS 20000 // 採樣後的發布分散時間窗 (各裝置依 MAC 取固定偏移，避免同時發布)
+#define SAMPLE_PUBLISH_OFFSET_MS -1    // 固定發布偏移 (-1 = 由 MAC 決定；MAC 雜湊偏移相近的節點可手動指定)
+
+// ============================================================================
+// 任務堆疊設定 - 尚未在硬體上量測，數值為估計值，實際剩餘量見系統狀態 stack_free
+// 估計方式：gcc -fstack-usage / -fcallgraph-info (主機 x86-64、-Og) 取本專案程式碼最深路徑，
+//           再加上 ESP-IDF 函式庫 (vfprintf、mbedTLS 寫入) 約 1.5 KB 的預留
+// ============================================================================
+#define SENSOR_TASK_STACK_SIZE 6144    // 感測器任務：估計最深 1.9 KB (ota_recorder_poll → CoAP 發布) + 1.5 KB 函式庫 ≈ 3.4 KB
+#define TASK_STACK_WARN_BYTES 768      // 任務堆疊剩餘低於此值時記錄警告
+
+// ============================================================================
+// 記憶體壓力門檻 - OTA (8 KB 任務堆疊 + 下載緩衝區 + TLS) 期間可用堆積會大幅下降
+// ============================================================================
+#define MEM_PRESSURE_ELEVATED_BYTES 48000   // 低於此值：系統狀態改用精簡編碼、批次減半
+#define MEM_PRESSURE_HIGH_BYTES 32000       // 低於此值：暫停離線讀數補送與歷史查詢
+#define MEM_PRESSURE_CRITICAL_BYTES 20000   // 低於此值：延後非必要指令
+#define MEM_PRESSURE_MIN_BLOCK_BYTES 8192   // 最大連續區塊低於此值時壓力再提高一級
+#define MEM_PRESSURE_HYSTERESIS_BYTES 4096  // 恢復時需超過門檻的餘裕
+
+// ============================================================================
+// 電源管理設定區 - 需搭配 sdkconfig.defaults 的 CONFIG_PM_ENABLE 與 tickless idle
+// ADC 擷取、資料編碼、TLS 握手與 OTA 期間才持鎖維持全速，其餘時間降頻 / 淺眠
+// ============================================================================
+#define PM_MAX_CPU_FREQ_MHZ 160             // 持鎖時的 CPU 頻率
+#define PM_MIN_CPU_FREQ_MHZ 40              // idle 時的 CPU 頻率 (XTAL)
+#define PM_LIGHT_SLEEP_ENABLED 1            // 1 = idle 時自動淺眠 (WiFi 維持 DTIM 喚醒)
+
+// ============================================================================
+// OTA 自我測試預算 - 新韌體相對舊韌體穩態效能可接受的退化量，超出即自動回滾
+// 需搭配 sdkconfig.defaults 的 CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+// ============================================================================
+#define OTA_SELFTEST_WINDOW_S 900               // 自我測試時間窗 (累計連線 15 分鐘，涵蓋多個發布週期)
+#define OTA_SELFTEST_HEAP_MARGIN_BYTES 8192     // 堆積下限最多可降低 8 KB
+#define OTA_SELFTEST_PUBLISH_MARGIN_PM 50       // 發布成功率最多可降低 5 個百分點
+#define OTA_SELFTEST_CMD_P99_BUDGET_PCT 50      // 指令延遲 p99 最多可增加 50%
+#define OTA_SELFTEST_CMD_P99_SLACK_US 20000     // 加上 20 ms 寬限 (p99 以 2 的冪次分桶估計)
+#define OTA_SELFTEST_CPU_MARGIN_PM 100          // CPU 使用率最多可增加 10 個百分點
+#define OTA_SELFTEST_MIN_PUBLISHES 10           // 發布次數不足時不比較成功率
+#define OTA_SELFTEST_MIN_COMMANDS 5             // 指令數不足時不比較 p99
 
 // ============================================================================
 // 日誌系統設定
@@ -105,15 +259,18 @@ static const char *TAG = "SOIL_SENSOR"; // 日誌標籤，用於識別此模組
 // ============================================================================
 static EventGroupHandle_t s_wifi_event_group; // WiFi 事件群組句柄
 #define WIFI_CONNECTED_BIT BIT0                // WiFi 連接成功事件位元 (第0位)
+#define MQTT_CONNECTED_BIT BIT1                // MQTT 已收到 CONNACK 事件位元 (第1位)
 
 // ============================================================================
 // 全域變數區 - 系統狀態和硬體句柄
 // ============================================================================
 static esp_mqtt_client_handle_t mqtt_client;   // MQTT 客戶端句柄
-static adc_oneshot_unit_handle_t adc1_handle;  // ADC1 單元句柄 (ESP-IDF v5.0+ 新API)
-static adc_cali_handle_t adc1_cali_handle = NULL; // ADC 校準句柄，用於電壓轉換
 // static bool pump_enabled = false;              // 泵浦開關狀態 (false=關閉, true=開啟)
 static int data_counter = 0;                   // 資料發送計數器，用於統計
+static TaskHandle_t sensor_task_handle = NULL;  // 感測器任務句柄 (MQTT 連線時喚醒補送)
+static uint32_t last_published_seq = 0;        // 最後一筆已發布讀數的歷史序號
+static int last_mqtt_error = 0;                // 最近一次 MQTT 錯誤類型 (斷線原因分類)
+static bool mqtt_connecting = false;           // 連線握手中 (持有 TLS 電源鎖)
 static int wifi_retry_count = 0;               // WiFi 重連計數器
 #define WIFI_MAXIMUM_RETRY 10                  // 最大重連次數
 
@@ -193,6 +350,7 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
         // 取得斷線原因
         wifi_event_sta_disconnected_t* disconnected_event = (wifi_event_sta_disconnected_t*) event_data;
         ESP_LOGW(TAG, "⚠️ WiFi 斷線 (原因碼: %d)", disconnected_event->reason);
+        conn_stats_link_down(CONN_LINK_WIFI, disconnected_event->reason);
         
         // 清除 WiFi 連接事件位元
         xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
@@ -232,6 +390,7 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
         
         // 重置 WiFi 重連計數器
         wifi_retry_count = 0;
+        conn_stats_link_up(CONN_LINK_WIFI);
         
         // 設定 WiFi 連接成功事件位元 (來自 freertos/event_groups.h)
         // 參數：事件群組句柄, 要設定的位元
@@ -253,19 +412,50 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
     esp_mqtt_event_handle_t event = event_data;
     esp_mqtt_client_handle_t client = event->client;
     
+    // 連線握手期間維持 CPU 全速，CONNACK 或斷線後釋放
+    if (event_id == MQTT_EVENT_BEFORE_CONNECT && !mqtt_connecting) {
+        mqtt_connecting = true;
+        power_mgmt_acquire(PM_SUBSYS_TLS);
+    } else if ((event_id == MQTT_EVENT_CONNECTED || event_id == MQTT_EVENT_DISCONNECTED) && mqtt_connecting) {
+        mqtt_connecting = false;
+        power_mgmt_release(PM_SUBSYS_TLS);
+    }
+    
     switch ((esp_mqtt_event_id_t)event_id) {
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "✅ MQTT 已連接到 %s", BROKER_HOST);
+        xEventGroupSetBits(s_wifi_event_group, MQTT_CONNECTED_BIT);
+        conn_stats_link_up(CONN_LINK_MQTT);
+        last_mqtt_error = 0;
+        if (sensor_task_handle != NULL) {
+            xTaskNotifyGive(sensor_task_handle);  // 立即補送離線期間的讀數
+        }
         esp_mqtt_client_subscribe(client, TOPIC_COMMAND, 0);
         ESP_LOGI(TAG, "📝 已訂閱指令主題: %s (QoS 0)", TOPIC_COMMAND);
+        if (gateway_service_is_enabled()) {
+            // 葉節點指令主題：TOPIC_COMMAND/<節點ID>
+            esp_mqtt_client_subscribe(client, TOPIC_COMMAND "/+", 0);
+            ESP_LOGI(TAG, "📝 已訂閱葉節點指令主題: %s/+", TOPIC_COMMAND);
+        }
         break;
         
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGW(TAG, "⚠️ MQTT 斷線，將自動重連...");
+        xEventGroupClearBits(s_wifi_event_group, MQTT_CONNECTED_BIT);
+        // 斷線原因：WiFi 已先斷線，或最近一次 MQTT 錯誤 (TCP 傳輸 / 拒絕連線)
+        conn_stats_link_down(CONN_LINK_MQTT,
+                             (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT) == 0
+                                 ? CONN_STATS_REASON_WIFI_DOWN : last_mqtt_error);
+        break;
+        
+    case MQTT_EVENT_PUBLISHED:
+        // 🔄 新增：QoS 1/2 的 PUBACK/PUBCOMP，作為首筆確認時間 (與 CoAP ACK 同一量測點)
+        telemetry_note_ack();
         break;
         
     case MQTT_EVENT_ERROR:
         ESP_LOGE(TAG, "❌ MQTT 錯誤: error_type=%d", event->error_handle->error_type);
+        last_mqtt_error = event->error_handle->error_type;
         if (event->error_handle->error_type == MQTT_ERROR_TYPE_TCP_TRANSPORT) {
             ESP_LOGE(TAG, "TCP 傳輸錯誤: 0x%x", event->error_handle->esp_tls_last_esp_err);
         }
@@ -273,27 +463,37 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
         
     case MQTT_EVENT_DATA:
         ESP_LOGI(TAG, "收到 MQTT 指令: %.*s", event->data_len, event->data);
+        conn_stats_add_bytes(0, event->topic_len + event->data_len);
         
-        // 🔄 新的處理方式：使用指令處理模組
-        // 解析指令類型
-        command_type_t cmd_type = parse_command(event->data, event->data_len);
-        
-        if (cmd_type != CMD_UNKNOWN) {
-            // 將指令加入處理佇列
-            esp_err_t result = enqueue_command(cmd_type, NULL);
-            
-            if (result == ESP_OK) {
-                ESP_LOGI(TAG, "✅ 指令已加入處理佇列");
-            } else {
-                ESP_LOGW(TAG, "⚠️ 指令佇列忙碌，請稍後重試");
-                // 可以選擇發送錯誤回應
-                esp_mqtt_client_publish(client, TOPIC_RESPONSE, 
-                                      "系統忙碌，請稍後重試", 0, 0, 0);
+        // 閘道器：TOPIC_COMMAND/<節點ID> 的指令轉送給對應葉節點
+        const int prefix_len = sizeof(TOPIC_COMMAND "/") - 1;
+        if (gateway_service_is_enabled() && event->topic_len > prefix_len &&
+            strncmp(event->topic, TOPIC_COMMAND "/", prefix_len) == 0) {
+            char node_hex[9] = {0};
+            int node_len = event->topic_len - prefix_len;
+            memcpy(node_hex, event->topic + prefix_len, node_len < 8 ? node_len : 8);
+            if (gateway_route_command(node_hex, event->data, event->data_len) == ESP_ERR_INVALID_SIZE) {
+                command_handler_reject_oversize("閘道器下行", event->data_len);
             }
-        } else {
+            break;
+        }
+        
+        // 🔄 新的處理方式：使用指令處理模組 (與 CoAP 輪詢共用)
+        esp_err_t result = dispatch_command_payload(event->data, event->data_len);
+        
+        if (result == ESP_OK) {
+            ESP_LOGI(TAG, "✅ 指令已加入處理佇列");
+        } else if (result == ESP_ERR_NOT_SUPPORTED) {
             ESP_LOGW(TAG, "⚠️ 未知的 MQTT 指令");
             esp_mqtt_client_publish(client, TOPIC_RESPONSE, 
                                   "未知指令", 0, 0, 0);
+        } else if (result == ESP_ERR_INVALID_STATE) {
+            ESP_LOGW(TAG, "⌛ 指令已過期，未加入佇列");
+        } else {
+            ESP_LOGW(TAG, "⚠️ 指令佇列忙碌，請稍後重試");
+            // 可以選擇發送錯誤回應
+            esp_mqtt_client_publish(client, TOPIC_RESPONSE, 
+                                  "系統忙碌，請稍後重試", 0, 0, 0);
         }
         break;
         
@@ -442,138 +642,184 @@ esp_mqtt_client_handle_t get_mqtt_client(void)
 {
     return mqtt_client;
 }
-// ============================================================================
-// ADC 初始化函數
-// 功能：設定 ADC1 單元，配置通道，初始化校準
-// 無參數，無返回值
-// 注意：使用 ESP-IDF v5.0+ 的新 ADC API
-// ============================================================================
-static void adc_init(void)
+
+bool mqtt_is_connected(void)
 {
-    // ADC1 單元初始化配置 (來自 esp_adc/adc_oneshot.h)
-    adc_oneshot_unit_init_cfg_t init_config1 = {
-        .unit_id = ADC_UNIT_1,              // 指定 ADC1 單元
-        .ulp_mode = ADC_ULP_MODE_DISABLE,   // 停用超低功耗模式
-    };
-    // 建立新的 ADC 單元 (來自 esp_adc/adc_oneshot.h)
-    // 參數：初始化配置, ADC 句柄指標
-    ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config1, &adc1_handle));
-    
-    // ADC 通道配置 (來自 esp_adc/adc_oneshot.h)
-    adc_oneshot_chan_cfg_t config = {
-        .bitwidth = ADC_BITWIDTH_12,    // 12位元解析度 (0-4095)
-        .atten = ADC_ATTEN_DB_12,       // 11dB 衰減，測量範圍 0-3.3V
-    };
-    // 配置 ADC 通道 (來自 esp_adc/adc_oneshot.h)
-    // 參數：ADC 句柄, 通道編號, 通道配置
-    ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, SOIL_SENSOR_ADC_CHANNEL, &config));
-    
-    // ADC 校準初始化 - 提高電壓轉換精度
-    // 檢查是否支援曲線擬合校準 (來自 esp_adc/adc_cali_scheme.h)
-#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
-    // 曲線擬合校準配置
-    adc_cali_curve_fitting_config_t cali_config = {
-        .unit_id = ADC_UNIT_1,                    // ADC 單元
-        .chan = SOIL_SENSOR_ADC_CHANNEL,          // ADC 通道
-        .atten = ADC_ATTEN_DB_12,                 // 衰減設定
-        .bitwidth = ADC_BITWIDTH_12,              // 位元寬度
-    };
-    // 建立曲線擬合校準方案 (來自 esp_adc/adc_cali_scheme.h)
-    esp_err_t ret = adc_cali_create_scheme_curve_fitting(&cali_config, &adc1_cali_handle);
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "ADC 校準方案：Curve Fitting");
-    }
-#endif
-
-    // 如果曲線擬合不支援，嘗試線性擬合校準
-#if ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
-    if (!adc1_cali_handle) {  // 如果還沒有校準句柄
-        // 線性擬合校準配置
-        adc_cali_line_fitting_config_t cali_config = {
-            .unit_id = ADC_UNIT_1,
-            .atten = ADC_ATTEN_DB_12,
-            .bitwidth = ADC_BITWIDTH_12,
-        };
-        // 建立線性擬合校準方案 (來自 esp_adc/adc_cali_scheme.h)
-        esp_err_t ret = adc_cali_create_scheme_line_fitting(&cali_config, &adc1_cali_handle);
-        if (ret == ESP_OK) {
-            ESP_LOGI(TAG, "ADC 校準方案：Line Fitting");
-        }
+    if (s_wifi_event_group == NULL) {
+        return false;
     }
-#endif
-    
-    ESP_LOGI(TAG, "ADC 初始化完成");
+    return (xEventGroupGetBits(s_wifi_event_group) & MQTT_CONNECTED_BIT) != 0;
 }
 
 // ============================================================================
-// 土壤濕度讀取函數
-// 功能：執行多次 ADC 採樣，計算平均值，轉換為電壓和濕度百分比
-// 參數：raw_adc - 原始 ADC 值指標, voltage - 電壓值指標, moisture - 濕度百分比指標
-// 無返回值，結果透過指標參數返回
+// 補送離線期間的讀數
+// 功能：讀數一律先進入 sensor_history 環形緩衝區；未連線時只記錄不編碼，
+//       連線後依序號由舊到新分批發布，直到 before_seq (不含)
+// 返回：true 表示已補送完畢，false 表示途中發布失敗 (下次再從斷點繼續)
 // ============================================================================
-static void read_soil_moisture(int *raw_adc, float *voltage, float *moisture)
+static bool flush_sensor_backlog(uint32_t before_seq)
 {
-    // 多次採樣累加器
-    uint32_t adc_sum = 0;
+    static sensor_reading_t batch[BACKFILL_BATCH_SIZE];
+    size_t count;
     
-    // 執行多次採樣以提高精度
-    for (int i = 0; i < SAMPLE_COUNT; i++) {
-        int raw_value;  // 單次 ADC 讀值
+    while (last_published_seq + 1 < before_seq) {
+        // 🔄 新增：記憶體壓力過高時暫停補送 (讀數保留在環形緩衝區)，批次依壓力縮小
+        if (mem_pressure_get_tier() >= MEM_PRESSURE_HIGH) {
+            return false;
+        }
+        count = sensor_history_read(last_published_seq, batch, mem_pressure_batch_limit(BACKFILL_BATCH_SIZE));
+        if (count == 0) {
+            break;
+        }
+        while (count > 0 && batch[count - 1].seq >= before_seq) {
+            count--;
+        }
+        if (count == 0) {
+            break;
+        }
+        
+        // 離線時間超過環形緩衝區容量時，最舊的讀數已被覆寫
+        uint32_t dropped = batch[0].seq - last_published_seq - 1;
+        if (dropped > 0) {
+            ESP_LOGW(TAG, "⚠️ 離線期間有 %lu 筆讀數已被覆寫，無法補送", dropped);
+        }
+        
+        cJSON *json = cJSON_CreateObject();
+        cJSON_AddStringToObject(json, "type", "soil_data_batch");
+        cJSON_AddNumberToObject(json, "dropped", dropped);
+        cJSON *readings = cJSON_AddArrayToObject(json, "readings");
+        for (size_t i = 0; i < count; i++) {
+            const sensor_reading_t *r = &batch[i];
+            cJSON *item = cJSON_CreateObject();
+            cJSON_AddNumberToObject(item, "seq", r->seq);
+            cJSON_AddNumberToObject(item, "timestamp", r->uptime_ms / 1000);
+            cJSON_AddNumberToObject(item, "voltage", r->voltage_mv / 1000.0);
+            cJSON_AddNumberToObject(item, "moisture", r->moisture_x10 / 10.0);
+            cJSON_AddNumberToObject(item, "raw_adc", r->raw_adc);
+            cJSON_AddBoolToObject(item, "gpio_status", r->pump_on);
+            if (r->temp_x100 != SENSOR_HISTORY_NO_TEMP) {
+                cJSON_AddNumberToObject(item, "temperature", r->temp_x100 / 100.0);
+                cJSON_AddNumberToObject(item, "moisture_compensated", r->moisture_comp_x10 / 10.0);
+            }
+            // 記錄時尚未同步的讀數，以目前的時間對應補上牆鐘時間
+            int64_t ts_ms = r->epoch_ms >= 0 ? r->epoch_ms : time_sync_uptime_to_epoch_ms(r->uptime_ms * 1000);
+            if (ts_ms >= 0) {
+                cJSON_AddNumberToObject(item, "ts_ms", (double)ts_ms);
+            }
+            cJSON_AddItemToArray(readings, item);
+        }
         
-        // 執行 ADC 單次讀取 (來自 esp_adc/adc_oneshot.h)
-        // 參數：ADC 句柄, 通道, 讀值指標
-        ESP_ERROR_CHECK(adc_oneshot_read(adc1_handle, SOIL_SENSOR_ADC_CHANNEL, &raw_value));
+        char *json_string = cJSON_PrintUnformatted(json);
+        cJSON_Delete(json);
+        if (json_string == NULL) {
+            return false;
+        }
         
-        adc_sum += raw_value;  // 累加讀值
+        esp_err_t err = telemetry_publish(TOPIC_DATA_BACKFILL, json_string, 0, 1, 0);
+        free(json_string);
+        if (err != ESP_OK) {
+            return false;
+        }
         
-        // 短暫延遲以允許 ADC 穩定 (來自 freertos/task.h)
-        // pdMS_TO_TICKS(10) 將 10 毫秒轉換為系統時鐘滴答數
-        vTaskDelay(pdMS_TO_TICKS(10));
+        ESP_LOGI(TAG, "📤 已補送 %d 筆離線讀數 (#%lu ~ #%lu)", (int)count, batch[0].seq, batch[count - 1].seq);
+        last_published_seq = batch[count - 1].seq;
     }
     
-    // 計算平均值
-    *raw_adc = adc_sum / SAMPLE_COUNT;
-    
-    // 將 ADC 原始值轉換為電壓
-    int voltage_mv;  // 電壓(毫伏)
+    return true;
+}
+
+// ============================================================================
+// 葉節點：依序把歷史緩衝區中尚未確認的讀數交給閘道器
+// 功能：閘道器未確認 (離線、葉節點表已滿) 的讀數留在 sensor_history，下次採樣時從斷點重送
+// 返回：true 表示已送到 before_seq (不含)，false 表示途中未確認
+// ============================================================================
+static bool flush_gateway_backlog(uint32_t before_seq)
+{
+    static sensor_reading_t pending[BACKFILL_BATCH_SIZE];
     
-    if (adc1_cali_handle) {  // 如果有校準句柄
-        // 使用校準函數轉換 (來自 esp_adc/adc_cali.h)
-        // 參數：校準句柄, 原始值, 電壓指標(mV)
-        ESP_ERROR_CHECK(adc_cali_raw_to_voltage(adc1_cali_handle, *raw_adc, &voltage_mv));
-        *voltage = voltage_mv / 1000.0;  // 轉換為伏特
-    } else {
-        // 如果沒有校準，使用線性近似計算
-        // ADC 12位元: 0-4095 對應 0-3.3V
-        *voltage = (*raw_adc * 3.3) / 4095.0;
+    while (last_published_seq + 1 < before_seq) {
+        size_t count = sensor_history_read(last_published_seq, pending, BACKFILL_BATCH_SIZE);
+        if (count == 0) {
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (pending[i].seq >= before_seq) {
+                return true;
+            }
+            if (gateway_leaf_send_reading(&pending[i]) != ESP_OK) {
+                return false;
+            }
+            last_published_seq = pending[i].seq;
+            data_counter++;
+        }
     }
     
-    // 計算濕度百分比
-    // 公式：(乾燥值 - 目前值) / (乾燥值 - 濕潤值) * 100
-    *moisture = (float)(AIR_VALUE - *raw_adc) * 100.0 / (AIR_VALUE - WATER_VALUE);
-    
-    // 限制濕度值在 0-100% 範圍內
-    if (*moisture > 100.0) *moisture = 100.0;
-    if (*moisture < 0.0) *moisture = 0.0;
+    return true;
 }
 
 // ============================================================================
-// 發送感測器資料函數
-// 功能：讀取感測器，建立 JSON 格式資料，透過 MQTT 發送
-// 無參數，無返回值
+// 建立感測器資料函數
+// 功能：讀取感測器並記錄到歷史緩衝區，建立 JSON 格式資料 (由 publish_due_records 發布)
+// 參數：seq_out - 回傳此讀數的歷史序號
+//       slot_ms - 本次採樣的時槽邊界 (epoch 毫秒，-1 表示未對齊)
+// 返回：soil_data JSON 物件；已由其他路徑處理 (閘道器、離線暫存) 或讀取失敗時為 NULL
 // JSON 格式與樹莓派版本保持一致以確保相容性
 // ============================================================================
-static void send_sensor_data(void)
+static cJSON *build_sensor_data(uint32_t *seq_out, int64_t slot_ms)
 {
     int raw_adc;
     float voltage;
     float moisture;
     
-    read_soil_moisture(&raw_adc, &voltage, &moisture);    
+    int64_t sample_us = esp_timer_get_time();  // 採樣當下的時間，用於牆鐘時間戳
+    if (soil_sensor_read(&raw_adc, &voltage, &moisture) != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 感測器讀取失敗");
+        return NULL;
+    }
+    int32_t skew_ms = sample_slot_record(slot_ms, sample_us);  // 🔄 新增：相對時槽邊界的採樣偏差
+    
+    // 🔄 新增：同一採樣週期讀取溫度並做定點溫度補償
+    int32_t temp_x100 = TEMP_SENSOR_INVALID;
+    int moisture_x10 = (int)(moisture * 10.0f + 0.5f);
+    int moisture_comp_x10 = moisture_x10;
+    if (temp_sensor_read(&temp_x100) == ESP_OK) {
+        moisture_comp_x10 = moisture_comp_process(moisture_x10, temp_x100, sample_us);
+    } else {
+        temp_x100 = TEMP_SENSOR_INVALID;
+    }
+    uint32_t seq = sensor_history_record(raw_adc, voltage, moisture, moisture_comp_x10,
+                                         temp_x100 == TEMP_SENSOR_INVALID ? SENSOR_HISTORY_NO_TEMP : temp_x100,
+                                         get_pump_status(), sample_us);
+    drying_forecast_update(moisture_comp_x10, sample_us);  // 🔄 新增：乾燥速率預測 (離線與閘道器模式也持續學習)
+    
+    // 葉節點：以精簡二進位格式交給閘道器，省去 JSON 編碼 (先依序重送之前未確認的讀數)
+    if (telemetry_transport_get_type() == TELEMETRY_TRANSPORT_GATEWAY) {
+        if (flush_gateway_backlog(seq + 1)) {
+            ESP_LOGI(TAG, "[%d] ADC:%d 電壓:%.3fV 濕度:%.1f%% GPIO:%s (經閘道器)", 
+                    data_counter, raw_adc, voltage, moisture, get_pump_status() ? "ON" : "OFF");
+        } else {
+            ESP_LOGI(TAG, "📦 閘道器未確認，讀數 #%lu 暫存待重送 (ADC:%d 濕度:%.1f%%)", seq, raw_adc, moisture);
+        }
+        return NULL;
+    }
+    
+    // 🔄 新增：Broker 未連線時只保留在歷史緩衝區，不做 JSON 編碼與發布
+    if (!telemetry_is_connected()) {
+        ESP_LOGI(TAG, "📦 MQTT 未連線，讀數 #%lu 暫存待補送 (ADC:%d 濕度:%.1f%%)", seq, raw_adc, moisture);
+        return NULL;
+    }
+    
+    // 先依序補送較舊的讀數，確保後端收到的順序與採樣順序一致
+    if (!flush_sensor_backlog(seq)) {
+        ESP_LOGI(TAG, "📦 尚有未補送的讀數，讀數 #%lu 暫存待補送 (記憶體壓力: %s)",
+                 seq, mem_pressure_tier_name(mem_pressure_get_tier()));
+        return NULL;
+    }
+    
     // printf("⚡ REALTIME: ADC=%d, 濕度=%.1f%%\n", raw_adc, moisture);
     cJSON *json = cJSON_CreateObject();
     
-    cJSON *timestamp = cJSON_CreateNumber(esp_timer_get_time() / 1000000);
+    cJSON *timestamp = cJSON_CreateNumber(sample_us / 1000000);
     cJSON *v = cJSON_CreateNumber(voltage);
     cJSON *m = cJSON_CreateNumber(moisture);
     cJSON *adc = cJSON_CreateNumber(raw_adc);
@@ -590,31 +836,72 @@ static void send_sensor_data(void)
     cJSON_AddItemToObject(json, "gpio_status", gpio_status);
     cJSON_AddItemToObject(json, "type", type);
     
-    char *json_string = cJSON_Print(json);
+    // 🔄 新增：溫度與補償後濕度 (原始 moisture 欄位維持不變)
+    if (temp_x100 != TEMP_SENSOR_INVALID) {
+        cJSON_AddNumberToObject(json, "temperature", temp_x100 / 100.0);
+        cJSON_AddNumberToObject(json, "moisture_compensated", moisture_comp_x10 / 10.0);
+    }
     
-    if (json_string) {
-        esp_mqtt_client_publish(mqtt_client, TOPIC_DATA, json_string, 0, 0, 0);
-        
-        data_counter++;
-        
-        ESP_LOGI(TAG, "[%d] ADC:%d 電壓:%.3fV 濕度:%.1f%% GPIO:%s (每%d秒/QoS 0)", 
-                data_counter, raw_adc, voltage, moisture, 
-                current_pump_status ? "ON" : "OFF", SENSOR_DATA_INTERVAL);
-        
-        free(json_string);
+    // 🔄 新增：SNTP 同步後的採樣時間 (epoch 毫秒)，未同步時不附加
+    int64_t sample_ms = time_sync_uptime_to_epoch_ms(sample_us);
+    if (sample_ms >= 0) {
+        cJSON_AddNumberToObject(json, "ts_ms", (double)sample_ms);
     }
     
-    cJSON_Delete(json);
+    // 🔄 新增：對齊的時槽邊界與採樣偏差 (後端以 slot_ms 分組繪製同一時刻的空間分佈)
+    if (slot_ms >= 0) {
+        cJSON_AddNumberToObject(json, "slot_ms", (double)slot_ms);
+        cJSON_AddNumberToObject(json, "sample_skew_ms", skew_ms);
+    }
+    
+    // 🔄 新增：同一次喚醒批次讀取其他已註冊的感測器，欄位併入同一筆資料
+    sensor_registry_collect(json, sample_us);
+    
+    ESP_LOGI(TAG, "ADC:%d 電壓:%.3fV 濕度:%.1f%% GPIO:%s (讀數 #%lu)", 
+            raw_adc, voltage, moisture, current_pump_status ? "ON" : "OFF", seq);
+    
+    *seq_out = seq;
+    return json;
 }
 
 // ============================================================================
-// 發送系統狀態函數
-// 功能：建立系統狀態 JSON，透過 MQTT 發送系統資訊
-// 無參數，無返回值
+// 建立系統狀態函數
+// 功能：建立系統狀態 JSON (由 publish_due_records 發布)
+// 返回：system_status JSON 物件；未連線或已改用精簡編碼直接發布時為 NULL
 // JSON 格式與樹莓派版本保持一致
 // ============================================================================
-static void send_system_status(void)
+// ============================================================================
+// 任務堆疊剩餘量 (ESP-IDF 的 uxTaskGetStackHighWaterMark 以 bytes 為單位)
+// ============================================================================
+static void add_stack_free(cJSON *stack_free, const char *task, uint32_t free_bytes)
 {
+    cJSON_AddNumberToObject(stack_free, task, free_bytes);
+    if (free_bytes < TASK_STACK_WARN_BYTES) {
+        ESP_LOGW(TAG, "⚠️ %s 堆疊剩餘僅 %lu bytes，需調高堆疊大小", task, free_bytes);
+    }
+}
+
+static cJSON *build_system_status(void)
+{
+    // 狀態訊息僅反映當下，離線期間不需要補送
+    if (!telemetry_is_connected()) {
+        return NULL;
+    }
+    
+    // 🔄 新增：記憶體壓力下改用精簡編碼 (堆疊緩衝區，不建立 cJSON 樹)
+    mem_pressure_tier_t tier = mem_pressure_get_tier();
+    if (tier >= MEM_PRESSURE_ELEVATED) {
+        char compact[192];
+        int len = snprintf(compact, sizeof(compact),
+                           "{\"type\":\"system_status\",\"compact\":true,\"system\":\"online\","
+                           "\"uptime\":%lld,\"free_heap\":%lu,\"gpio_status\":%s,\"mem_pressure\":\"%s\"}",
+                           esp_timer_get_time() / 1000000, esp_get_free_heap_size(),
+                           get_pump_status() ? "true" : "false", mem_pressure_tier_name(tier));
+        telemetry_publish(TOPIC_STATUS, compact, len, 2, 1);
+        ESP_LOGI(TAG, "📈 發送精簡系統狀態 (記憶體壓力: %s)", mem_pressure_tier_name(tier));
+        return NULL;
+    }
+    
     cJSON *json = cJSON_CreateObject();
     
     cJSON *timestamp = cJSON_CreateNumber(esp_timer_get_time() / 1000000);
@@ -641,6 +928,11 @@ static void send_system_status(void)
     cJSON *ota_updates = cJSON_CreateNumber(ota_stats.total_updates);
     cJSON *ota_success = cJSON_CreateNumber(ota_stats.successful_updates);
     cJSON *ota_state = cJSON_CreateNumber((int)ota_get_state());
+    
+    // 🔄 新增：傳輸層統計 (用於比較 MQTT 與 CoAP 的喚醒到送出 / 確認時間)
+    telemetry_stats_t transport_stats;
+    telemetry_get_stats(&transport_stats);
+    cJSON *transport = cJSON_CreateString(telemetry_transport_name());
     cJSON *type = cJSON_CreateString("system_status");
     
     cJSON_AddItemToObject(json, "timestamp", timestamp);
@@ -650,23 +942,246 @@ static void send_system_status(void)
     cJSON_AddItemToObject(json, "gpio_status", gpio_status);
     cJSON_AddItemToObject(json, "commands_processed", cmd_processed);
     cJSON_AddItemToObject(json, "command_errors", cmd_errors);
+    
+    // 🔄 新增：指令期限統計 (過期捨棄 / 完成時已逾期)
+    uint32_t expired_cmds, late_cmds;
+    get_command_deadline_stats(&expired_cmds, &late_cmds);
+    cJSON_AddNumberToObject(json, "commands_expired", expired_cmds);
+    cJSON_AddNumberToObject(json, "commands_late", late_cmds);
     cJSON_AddItemToObject(json, "water_count", water_count_json);
+    
+    // 🔄 新增：流量計出水量 (最近一次與累計)
+    if (flow_meter_is_available()) {
+        flow_meter_stats_t flow_stats;
+        flow_meter_get_stats(&flow_stats);
+        cJSON_AddNumberToObject(json, "water_last_ml", flow_stats.last_ml);
+        cJSON_AddNumberToObject(json, "water_total_ml", (double)flow_stats.total_ml);
+    }
+    
+    // 🔄 新增：泵浦計時關閉統計 (實際開啟時間與誤差)
+    pump_control_stats_t pump_stats;
+    pump_control_get_stats(&pump_stats);
+    cJSON *pump = cJSON_CreateObject();
+    cJSON_AddBoolToObject(pump, "isr_dispatch", pump_stats.isr_dispatch);
+    cJSON_AddNumberToObject(pump, "activations", pump_stats.activations);
+    cJSON_AddNumberToObject(pump, "timer_offs", pump_stats.timer_offs);
+    cJSON_AddNumberToObject(pump, "early_stops", pump_stats.early_stops);
+    cJSON_AddNumberToObject(pump, "bound_violations", pump_stats.bound_violations);
+    if (pump_stats.timer_offs > 0) {
+        cJSON_AddNumberToObject(pump, "jitter_avg_us", (double)(pump_stats.jitter_abs_sum_us / pump_stats.timer_offs));
+        cJSON_AddNumberToObject(pump, "jitter_max_us", pump_stats.jitter_max_us);
+    }
+    if (pump_stats.activations > 0) {
+        cJSON_AddNumberToObject(pump, "last_on_ms", pump_stats.last.actual_us / 1000.0);
+        cJSON_AddNumberToObject(pump, "last_jitter_us", pump_stats.last.jitter_us);
+    }
+    cJSON_AddItemToObject(json, "pump", pump);
     cJSON_AddItemToObject(json, "firmware_version", firmware_version);
     cJSON_AddItemToObject(json, "ota_updates", ota_updates);
     cJSON_AddItemToObject(json, "ota_success", ota_success);
     cJSON_AddItemToObject(json, "ota_state", ota_state);
+    
+    // 🔄 新增：OTA 自我測試狀態 (新韌體待驗證期間)
+    uint32_t selftest_remaining_s = 0;
+    ota_selftest_state_t selftest_state = ota_selftest_get_state(&selftest_remaining_s);
+    if (selftest_state != OTA_SELFTEST_NONE) {
+        cJSON_AddStringToObject(json, "ota_selftest", ota_selftest_state_name(selftest_state));
+        cJSON_AddNumberToObject(json, "ota_selftest_remaining_s", selftest_remaining_s);
+    }
+    cJSON_AddItemToObject(json, "transport", transport);
+    
+    // 🔄 新增：站點閘道器訊框統計 (葉節點與閘道器)
+    if (TELEMETRY_TRANSPORT == TELEMETRY_TRANSPORT_GATEWAY || gateway_service_is_enabled()) {
+        gateway_stats_t gw_stats;
+        gateway_get_stats(&gw_stats);
+        cJSON *gw = cJSON_CreateObject();
+        cJSON_AddNumberToObject(gw, "frames_sent", gw_stats.frames_sent);
+        cJSON_AddNumberToObject(gw, "send_failures", gw_stats.send_failures);
+        cJSON_AddNumberToObject(gw, "oversize_dropped", gw_stats.oversize_dropped);
+        if (gateway_service_is_enabled()) {
+            cJSON_AddNumberToObject(gw, "leaves", gw_stats.leaves_known);
+            cJSON_AddNumberToObject(gw, "leaves_full", gw_stats.leaves_full);
+            cJSON_AddNumberToObject(gw, "commands_failed", gw_stats.commands_failed);
+            cJSON_AddNumberToObject(gw, "duplicates_dropped", gw_stats.duplicates_dropped);
+            cJSON_AddNumberToObject(gw, "leaf_reboots", gw_stats.leaf_reboots);
+            cJSON_AddNumberToObject(gw, "batch_retries", gw_stats.batch_retries);
+            cJSON_AddNumberToObject(gw, "batch_dropped", gw_stats.batch_dropped);
+        } else {
+            cJSON_AddNumberToObject(gw, "commands_rejected", gw_stats.commands_rejected);
+        }
+        cJSON_AddItemToObject(json, "gateway", gw);
+    }
+    cJSON_AddNumberToObject(json, "first_send_ms", transport_stats.first_send_ms);
+    cJSON_AddNumberToObject(json, "first_ack_ms", transport_stats.first_ack_ms);
+    cJSON_AddNumberToObject(json, "oversize_dropped", transport_stats.oversize_dropped);
+    cJSON_AddNumberToObject(json, "publish_skipped", transport_stats.publish_skipped);  // 🔄 新增：未連線而略過，不計入失敗
+    
+    // 🔄 新增：任務堆疊剩餘量 (歷史最低)，驗證估計的堆疊大小
+    cJSON *stack_free = cJSON_CreateObject();
+    add_stack_free(stack_free, "sensor_task", uxTaskGetStackHighWaterMark(NULL));
+    add_stack_free(stack_free, "cmd_handler", get_command_task_stack_free());
+    cJSON_AddItemToObject(json, "stack_free", stack_free);
+    
+    // 🔄 新增：時間同步狀態
+    time_sync_stats_t sync_stats;
+    time_sync_get_stats(&sync_stats);
+    int64_t now_ms = time_sync_now_ms();
+    if (now_ms >= 0) {
+        cJSON_AddNumberToObject(json, "ts_ms", (double)now_ms);
+    }
+    cJSON_AddBoolToObject(json, "time_synced", sync_stats.synced);
+    cJSON_AddNumberToObject(json, "clock_drift_ppm", sync_stats.drift_ppm);
+    cJSON_AddStringToObject(json, "mem_pressure", mem_pressure_tier_name(tier));
+    
+    // 🔄 新增：全場同步採樣 (對齊狀態、採樣偏差、發布偏移)
+    sample_slot_stats_t slot_stats;
+    sample_slot_get_stats(&slot_stats);
+    cJSON *sampling = cJSON_CreateObject();
+    cJSON_AddBoolToObject(sampling, "aligned", slot_stats.aligned);
+    cJSON_AddNumberToObject(sampling, "period_s", slot_stats.period_s);
+    cJSON_AddNumberToObject(sampling, "publish_offset_ms", slot_stats.publish_offset_ms);
+    cJSON_AddNumberToObject(sampling, "skew_last_ms", slot_stats.last_skew_ms);
+    cJSON_AddNumberToObject(sampling, "skew_avg_ms", slot_stats.avg_skew_ms);
+    cJSON_AddNumberToObject(sampling, "skew_max_ms", slot_stats.max_skew_ms);
+    cJSON_AddNumberToObject(sampling, "missed_slots", slot_stats.missed_slots);
+    cJSON_AddNumberToObject(sampling, "clock_steps_back", slot_stats.clock_steps_back);
+    cJSON_AddNumberToObject(sampling, "publish_lag_ms", slot_stats.last_publish_lag_ms);
+    cJSON_AddItemToObject(json, "sampling", sampling);
+    
+    // 🔄 新增：乾燥速率預測
+    drying_forecast_t fc;
+    drying_forecast_get(&fc);
+    cJSON *forecast = cJSON_CreateObject();
+    cJSON_AddStringToObject(forecast, "state", drying_state_name(fc.state));
+    cJSON_AddNumberToObject(forecast, "rate_pct_per_h", fc.rate_pct_per_h);
+    if (fc.state == DRYING_STATE_DRYING) {
+        cJSON_AddNumberToObject(forecast, "hours_to_threshold", fc.hours_to_threshold);
+        cJSON_AddNumberToObject(forecast, "hours_low", fc.hours_low);
+        cJSON_AddNumberToObject(forecast, "hours_high", fc.hours_high);
+    }
+    cJSON_AddNumberToObject(forecast, "blocks", fc.blocks);
+    cJSON_AddNumberToObject(forecast, "resets", fc.resets);
+    cJSON_AddItemToObject(json, "forecast", forecast);
+    
+    // 🔄 新增：即時串流狀態 (技術人員確認串流是否仍在進行、上次為何結束)
+    live_stream_stats_t live_stats;
+    live_stream_get_stats(&live_stats);
+    cJSON *live = cJSON_CreateObject();
+    cJSON_AddBoolToObject(live, "active", live_stats.active);
+    if (live_stats.active) {
+        cJSON_AddNumberToObject(live, "hz", live_stats.rate_hz);
+        cJSON_AddNumberToObject(live, "remaining_s", live_stats.remaining_s);
+    }
+    cJSON_AddNumberToObject(live, "sessions", live_stats.sessions);
+    cJSON_AddNumberToObject(live, "late_samples", live_stats.late_samples);
+    cJSON_AddStringToObject(live, "last_end", live_stream_end_name(live_stats.last_end));
+    cJSON_AddItemToObject(json, "live_stream", live);
+    
+    // 🔄 新增：電源管理統計 (清醒比例、各子系統持鎖時間、指令派送延遲)
+    power_mgmt_stats_t pm_stats;
+    power_mgmt_get_stats(&pm_stats);
+    cJSON *pm = cJSON_CreateObject();
+    cJSON_AddBoolToObject(pm, "enabled", pm_stats.enabled);
+    if (pm_stats.awake_permille >= 0) {
+        cJSON_AddNumberToObject(pm, "awake_pct", pm_stats.awake_permille / 10.0);
+    }
+    cJSON *lock_ms = cJSON_CreateObject();
+    for (int s = 0; s < PM_SUBSYS_COUNT; s++) {
+        cJSON_AddNumberToObject(lock_ms, power_mgmt_subsys_name(s), (double)(pm_stats.locks[s].hold_us / 1000));
+    }
+    cJSON_AddItemToObject(pm, "lock_ms", lock_ms);
+    cJSON_AddNumberToObject(pm, "cmd_latency_avg_ms", pm_stats.cmd_latency_avg_us / 1000.0);
+    cJSON_AddNumberToObject(pm, "cmd_latency_max_ms", pm_stats.cmd_latency_max_us / 1000.0);
+    cJSON_AddItemToObject(json, "pm", pm);
     cJSON_AddItemToObject(json, "type", type);
     
-    char *json_string = cJSON_Print(json);
+    ESP_LOGI(TAG, "📈 系統狀態 (指令統計: 成功=%lu, 錯誤=%lu, 澆水=%lu)", 
+             processed_cmds, error_cmds, watering_count);
+    return json;
+}
+
+// ============================================================================
+// 發布單一紀錄 (內部函數)
+// 功能：序列化並發布到紀錄本身的主題，發布後釋放 JSON 物件
+// 不做縮排排版：完整系統狀態排版後會超過 CoAP 區塊與閘道器訊框大小
+// ============================================================================
+static esp_err_t publish_record(const char *topic, cJSON *json, int qos, int retain)
+{
+    char *json_string = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    if (json_string == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
     
-    if (json_string) {
-        esp_mqtt_client_publish(mqtt_client, TOPIC_STATUS, json_string, 0, 2, 1);
-        ESP_LOGI(TAG, "📈 發送系統狀態 (指令統計: 成功=%lu, 錯誤=%lu, 澆水=%lu) [每%d秒/QoS 2/Retained]", 
-                 processed_cmds, error_cmds, watering_count, SYSTEM_STATUS_INTERVAL);
+    esp_err_t err = telemetry_publish(topic, json_string, 0, qos, retain);
+    free(json_string);
+    return err;
+}
+
+// ============================================================================
+// 發布同一排程週期到期的紀錄
+// 功能：資料與狀態同時到期且啟用信封模式時合併為單一發布，否則各自發布到原主題
+// 信封中每筆子紀錄保留原本的 topic / qos / retain，後端依此拆回各主題
+// (包含以 retain 重新發布狀態)；信封本身以 QoS 1 發布，資料子紀錄附 seq 供後端去重
+// 參數：data / status - 到期的紀錄 (可為 NULL)，函數會取得並釋放其所有權
+//       seq - data 的歷史序號
+// ============================================================================
+static void publish_due_records(cJSON *data, uint32_t seq, cJSON *status)
+{
+    if (TELEMETRY_ENVELOPE_ENABLED && data != NULL && status != NULL) {
+        cJSON *envelope = cJSON_CreateObject();
+        cJSON_AddStringToObject(envelope, "type", "envelope");
+        cJSON_AddNumberToObject(envelope, "timestamp", esp_timer_get_time() / 1000000);
+        cJSON *records = cJSON_AddArrayToObject(envelope, "records");
+        
+        cJSON *data_record = cJSON_CreateObject();
+        cJSON_AddStringToObject(data_record, "topic", TOPIC_DATA);
+        cJSON_AddNumberToObject(data_record, "qos", 0);
+        cJSON_AddBoolToObject(data_record, "retain", false);
+        cJSON_AddNumberToObject(data_record, "seq", seq);
+        cJSON_AddItemToObject(data_record, "payload", data);
+        cJSON_AddItemToArray(records, data_record);
+        
+        cJSON *status_record = cJSON_CreateObject();
+        cJSON_AddStringToObject(status_record, "topic", TOPIC_STATUS);
+        cJSON_AddNumberToObject(status_record, "qos", 2);
+        cJSON_AddBoolToObject(status_record, "retain", true);
+        cJSON_AddItemToObject(status_record, "payload", status);
+        cJSON_AddItemToArray(records, status_record);
+        
+        // 低頻寬站點：信封不做縮排排版
+        char *json_string = cJSON_PrintUnformatted(envelope);
+        size_t envelope_len = json_string != NULL ? strlen(json_string) : 0;
+        if (json_string != NULL && envelope_len <= telemetry_max_payload()) {
+            cJSON_Delete(envelope);
+            esp_err_t err = telemetry_publish(TOPIC_ENVELOPE, json_string, envelope_len, 1, 0);
+            if (err == ESP_OK) {
+                last_published_seq = seq;
+                data_counter++;
+                ESP_LOGI(TAG, "[%d] 📦 資料與系統狀態合併發布 (%d bytes) [信封/QoS 1]",
+                         data_counter, (int)envelope_len);
+            }
+            free(json_string);
+            return;
+        }
+        
+        // 🔄 新增：信封超過傳輸上限時取回子紀錄，改為各自發布到原主題
         free(json_string);
+        data = cJSON_DetachItemFromObject(data_record, "payload");
+        status = cJSON_DetachItemFromObject(status_record, "payload");
+        cJSON_Delete(envelope);
+        ESP_LOGW(TAG, "⚠️ 信封 %d bytes 超過傳輸上限，改為分開發布", (int)envelope_len);
     }
     
-    cJSON_Delete(json);
+    if (data != NULL && publish_record(TOPIC_DATA, data, 0, 0) == ESP_OK) {
+        last_published_seq = seq;
+        data_counter++;
+        ESP_LOGI(TAG, "[%d] 感測器資料已發布 (每%d秒/QoS 0)", data_counter, SENSOR_DATA_INTERVAL);
+    }
+    
+    if (status != NULL && publish_record(TOPIC_STATUS, status, 2, 1) == ESP_OK) {
+        ESP_LOGI(TAG, "📈 系統狀態已發布 [每%d秒/QoS 2/Retained]", SYSTEM_STATUS_INTERVAL);
+    }
 }
 
 // ============================================================================
@@ -694,8 +1209,10 @@ static void blink_led(int times)
 // ============================================================================
 static void sensor_task(void *pvParameters)
 {
-    uint32_t last_data_time = 0;    // 上次發送資料的時間
     uint32_t last_status_time = 0;  // 上次發送狀態的時間
+    cJSON *pending_data = NULL;     // 🔄 新增：已在時槽邊界採樣、等待發布偏移的讀數
+    uint32_t pending_seq = 0;
+    int64_t pending_slot_ms = -1;
     
     while (1) {  // 任務主循環，永不結束
         // 等待 WiFi 連接完成 (來自 freertos/event_groups.h)
@@ -707,21 +1224,97 @@ static void sensor_task(void *pvParameters)
         // 取得目前時間 (秒)
         uint32_t now = esp_timer_get_time() / 1000000;
         
-        // 每60秒發送感測器資料 (土壤濕度變化緩慢，減少網路負載)
-        if (now - last_data_time >= SENSOR_DATA_INTERVAL) {
-            send_sensor_data();   // 發送感測器資料
+        // MQTT 剛完成連線 (或重連) 時立即補送，不等下一個採樣週期
+        // (等待發布偏移的讀數已在歷史緩衝區中，此時補送會與稍後的即時發布重複)
+        sensor_reading_t latest;
+        if (pending_data == NULL &&
+            telemetry_transport_get_type() != TELEMETRY_TRANSPORT_GATEWAY && telemetry_is_connected() &&
+            mem_pressure_get_tier() < MEM_PRESSURE_HIGH &&
+            sensor_history_latest(&latest) && latest.seq > last_published_seq) {
+            flush_sensor_backlog(latest.seq + 1);
+        }
+        
+        // 回報記憶體壓力等級變化 (升級與恢復)
+        mem_pressure_report_transitions();
+        
+        // 連線品質統計 (每小時累計值、每日日報)
+        conn_stats_report();
+        
+        // 新韌體自我測試時間窗結束時判定：標記有效或回滾
+        ota_selftest_poll();
+        
+        // 🔄 新增：上傳前一次 (或重啟前) 的 OTA 嘗試紀錄
+        ota_recorder_poll();
+        
+        // 🔄 新增：乾燥預測有明顯變化或到達發布間隔時發布
+        drying_forecast_poll();
+        
+        cJSON *data = NULL;
+        cJSON *status = NULL;
+        uint32_t seq = 0;
+        int64_t slot_ms = -1;
+        
+        // 🔄 新增：採樣時刻對齊全場共同的時槽邊界 (未同步時退回開機時間間隔)
+        bool data_due = sample_slot_due(&slot_ms);
+        bool publish_due = pending_data != NULL &&
+                           (data_due || sample_slot_publish_wait_ms(pending_slot_ms) == 0);
+        
+        // 🔄 新增：有紀錄到期時才持鎖全速編碼，縮短清醒時間 (ADC 擷取另有 APB 鎖)
+        bool records_due = data_due || publish_due ||
+                           now - last_status_time >= SYSTEM_STATUS_INTERVAL;
+        if (records_due) {
+            power_mgmt_acquire(PM_SUBSYS_ENCODE);
+        }
+        
+        // 🔄 新增：前一個時槽的讀數到了本裝置的發布偏移才送出 (下一個時槽已到則立即送出)
+        if (publish_due) {
+            sample_slot_note_published(pending_slot_ms);
+            if (data_due) {
+                publish_due_records(pending_data, pending_seq, NULL);
+            } else {
+                data = pending_data;
+                seq = pending_seq;
+            }
+            pending_data = NULL;
+        }
+        
+        // 每60秒採樣感測器資料 (土壤濕度變化緩慢，減少網路負載)
+        if (data_due) {
+            data = build_sensor_data(&seq, slot_ms); // 讀取感測器並建立資料
             blink_led(1);         // LED 閃爍1次表示資料發送
-            last_data_time = now; // 更新發送時間
+            if (data != NULL && sample_slot_publish_wait_ms(slot_ms) > 0) {
+                pending_data = data;
+                pending_seq = seq;
+                pending_slot_ms = slot_ms;
+                data = NULL;
+            } else if (data != NULL) {
+                sample_slot_note_published(slot_ms);
+            }
         }
         
         // 每30秒發送系統狀態 (保留較高頻率以監控系統健康狀態)
         if (now - last_status_time >= SYSTEM_STATUS_INTERVAL) {
-            send_system_status();    // 發送系統狀態
+            status = build_system_status(); // 建立系統狀態
             last_status_time = now;  // 更新發送時間
         }
         
-        // 短暫延遲，讓其他任務有機會執行 (來自 freertos/task.h)
-        vTaskDelay(pdMS_TO_TICKS(500));  // 延遲 500ms
+        // 🔄 新增：同一週期到期的紀錄一起交給發布函數 (信封模式下合併為單一發布)
+        publish_due_records(data, seq, status);
+        if (records_due) {
+            power_mgmt_release(PM_SUBSYS_ENCODE);
+        }
+        
+        // 短暫延遲，讓其他任務有機會執行；MQTT 連線事件會提前喚醒
+        // 🔄 新增：下一個時槽邊界或發布時間較近時縮短等待，準時醒來 (多等一個 tick 避免提早醒來空轉)
+        uint32_t wait_ms = 500;  // 最多等待 500ms
+        uint32_t slot_wait_ms = sample_slot_ms_until_due();
+        if (slot_wait_ms < wait_ms) {
+            wait_ms = slot_wait_ms;
+        }
+        if (pending_data != NULL && sample_slot_publish_wait_ms(pending_slot_ms) < wait_ms) {
+            wait_ms = sample_slot_publish_wait_ms(pending_slot_ms);
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms) + 1);
     }
 }
 
@@ -745,6 +1338,9 @@ void app_main(void)
         ret = nvs_flash_init();              // 重新初始化
     }
     ESP_ERROR_CHECK(ret);  // 檢查初始化結果
+    
+    // 🔄 新增：動態調頻與自動淺眠 (須在建立各子系統鎖的使用者之前)
+    power_mgmt_init(PM_MAX_CPU_FREQ_MHZ, PM_MIN_CPU_FREQ_MHZ, PM_LIGHT_SLEEP_ENABLED);
 
     // ========================================================================
     // 系統啟動資訊輸出
@@ -771,15 +1367,164 @@ void app_main(void)
     gpio_set_level(PUMP_GPIO, 0);  // 泵浦關閉
     gpio_set_level(LED_GPIO, 1);   // LED 熄滅 (反向邏輯)
     
+    // 🔄 新增：泵浦控制 (計時器關閉泵浦，指令任務停滯時泵浦仍會準時關閉)
+    pump_control_config_t pump_config = {
+        .gpio = PUMP_GPIO,
+        .max_on_ms = PUMP_MAX_ON_MS,
+        .jitter_bound_us = PUMP_JITTER_BOUND_US,
+        .mock = PUMP_CONTROL_MOCK,
+    };
+    if (pump_control_init(&pump_config) != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 泵浦控制初始化失敗，澆水指令將被拒絕");
+    }
+    
     // 開機 LED 指示 - 閃爍3次表示系統啟動
     blink_led(3);
     
     // ========================================================================
     // 各模組初始化
     // ========================================================================
-    adc_init();       // 初始化 ADC
+    soil_sensor_config_t sensor_config = {
+        .channel = SOIL_SENSOR_ADC_CHANNEL,
+        .air_value = AIR_VALUE,
+        .water_value = WATER_VALUE,
+        .sample_count = SAMPLE_COUNT,
+        .sample_delay_ms = 10,
+    };
+    ESP_ERROR_CHECK(soil_sensor_init(&sensor_config)); // 初始化 ADC
+    
+    // 🔄 新增：溫度感測器與濕度溫度補償 (溫度失效時只回報原始濕度)
+    temp_sensor_config_t temp_config = {
+        .source = TEMP_SENSOR_SOURCE,
+        .offset_x100 = TEMP_SENSOR_OFFSET_X100,
+        .ntc_channel = NTC_ADC_CHANNEL,
+        .ntc_series_ohms = NTC_SERIES_OHMS,
+        .ntc_r0_ohms = NTC_R0_OHMS,
+        .ntc_beta = NTC_BETA,
+    };
+    if (temp_sensor_init(&temp_config) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 溫度感測器初始化失敗，停用溫度補償");
+    }
+    moisture_comp_config_t comp_config = {
+        .model = MOISTURE_COMP_MODEL,
+        .coeff_x1000 = MOISTURE_COMP_COEFF_X1000,
+        .ref_temp_x100 = MOISTURE_COMP_REF_TEMP_X100,
+    };
+    moisture_comp_init(&comp_config);
+    
+    // 🔄 新增：乾燥速率預測 (使用補償後濕度)
+    drying_forecast_config_t forecast_config = {
+        .threshold_pct = DRYING_THRESHOLD_PCT,
+        .forget_factor = DRYING_FORGET_FACTOR,
+        .settle_s = DRYING_SETTLE_S,
+        .publish_interval_s = DRYING_FORECAST_PUBLISH_S,
+    };
+    if (drying_forecast_init(&forecast_config, TOPIC_FORECAST) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 乾燥預測初始化失敗，停用剩餘時間預測");
+    }
+    
+    // 🔄 新增：附加感測器驅動 (初始化失敗的感測器只會略過其欄位)
+    if (SENSOR_SHT3X_ENABLED || SENSOR_BH1750_ENABLED) {
+        sensor_drivers_i2c_init(I2C_SDA_GPIO, I2C_SCL_GPIO);
+    }
+    if (SENSOR_SHT3X_ENABLED) {
+        sensor_registry_register(sensor_driver_sht3x(SHT3X_DEFAULT_ADDR));
+    }
+    if (SENSOR_BH1750_ENABLED) {
+        sensor_registry_register(sensor_driver_bh1750(BH1750_DEFAULT_ADDR));
+    }
+    if (SENSOR_MOCK_ENABLED) {
+        sensor_registry_register(sensor_driver_mock_climate());
+        sensor_registry_register(sensor_driver_mock_light());
+    }
+    sensor_history_init(); // 初始化讀數歷史 (本地 API 與串流共用)
+    
+    // 🔄 新增：記憶體壓力監測 (各模組依等級降級，等級變化發布到警報主題)
+    mem_pressure_config_t pressure_config = {
+        .elevated_bytes = MEM_PRESSURE_ELEVATED_BYTES,
+        .high_bytes = MEM_PRESSURE_HIGH_BYTES,
+        .critical_bytes = MEM_PRESSURE_CRITICAL_BYTES,
+        .min_block_bytes = MEM_PRESSURE_MIN_BLOCK_BYTES,
+        .hysteresis_bytes = MEM_PRESSURE_HYSTERESIS_BYTES,
+    };
+    if (mem_pressure_init(&pressure_config, TOPIC_ALERT) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 記憶體壓力監測啟動失敗，低記憶體時不會自動降級");
+    }
+    conn_stats_init(TOPIC_CONN); // 連線品質統計 (須在 WiFi / MQTT 事件開始前)
     wifi_init_sta();  // 初始化 WiFi (Station 模式)
-    mqtt_init();      // 初始化 MQTT 客戶端
+    if (TELEMETRY_TRANSPORT == TELEMETRY_TRANSPORT_MQTT) {
+        mqtt_init();  // 初始化 MQTT 客戶端 (CoAP 部署不建立 TCP 連線)
+    }
+    
+    // 🔄 新增：節點 ID 覆寫 (MAC 後 4 bytes 在站點內重複時手動指定)
+    gateway_set_node_id(GATEWAY_NODE_ID);
+    
+    // 🔄 初始化遙測傳輸層
+    telemetry_transport_config_t transport_config = {
+        .type = TELEMETRY_TRANSPORT,
+        .coap_host = COAP_SERVER_HOST,
+        .coap_port = COAP_SERVER_PORT,
+        .command_path = TOPIC_COMMAND,
+        .command_poll_interval_ms = COAP_COMMAND_POLL_INTERVAL_MS,
+        .gateway_host = GATEWAY_ADDRESS,
+        .gateway_port = GATEWAY_UDP_PORT,
+    };
+    ret = telemetry_transport_init(&transport_config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 遙測傳輸層初始化失敗");
+        return;  // 終止程式執行
+    }
+    
+    // 🔄 新增：SNTP 時間同步 (WiFi 連線後自動完成第一次同步)
+    if (TELEMETRY_TRANSPORT != TELEMETRY_TRANSPORT_GATEWAY) {
+        ret = time_sync_init(NTP_SERVER);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "⚠️ 時間同步模組初始化失敗，payload 將只含開機時間");
+        }
+    }
+    
+    // 🔄 新增：採樣時槽 (同步後全場在同一時刻採樣，發布依裝置偏移分散)
+    sample_slot_config_t slot_config = {
+        .align = SAMPLE_SLOT_ALIGNED,
+        .period_s = SENSOR_DATA_INTERVAL,
+        .publish_spread_ms = SAMPLE_PUBLISH_SPREAD_MS,
+        .publish_offset_ms = SAMPLE_PUBLISH_OFFSET_MS,
+    };
+    if (sample_slot_init(&slot_config) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 採樣時槽初始化失敗，維持開機時間間隔採樣");
+    }
+    
+    // 🔄 新增：澆水回應監測 (須在指令處理模組之前，澆水指令會使用)
+    ret = watering_monitor_init(TOPIC_WATERING, TOPIC_ALERT);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 澆水監測初始化失敗，澆水將不會驗證");
+    }
+    
+    // 🔄 新增：流量計 (未安裝時澆水維持定時出水，定量指令會被拒絕)
+    if (FLOW_METER_ENABLED) {
+        flow_meter_config_t flow_config = {
+            .gpio = FLOW_METER_GPIO,
+            .pulses_per_liter = FLOW_PULSES_PER_LITER,
+            .mock = FLOW_METER_MOCK,
+            .mock_ml_per_min = FLOW_MOCK_ML_PER_MIN,
+        };
+        if (flow_meter_init(&flow_config) != ESP_OK) {
+            ESP_LOGW(TAG, "⚠️ 流量計初始化失敗，無法定量澆水");
+        }
+    }
+    
+    // 🔄 新增：ADC 基準測試 (ADC_BENCH 指令)
+    adc_bench_init(TOPIC_BENCH);
+    
+    // 🔄 新增：原始 ADC 擷取 (CAPTURE 指令，緩衝區在開機時預先配置)
+    if (raw_capture_init(RAW_CAPTURE_BUFFER_SAMPLES, TOPIC_CAPTURE) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 原始擷取模組初始化失敗，CAPTURE 指令無法使用");
+    }
+    
+    // 🔄 新增：即時串流 (LIVE_STREAM 指令，任務閒置時阻塞不佔 CPU)
+    if (live_stream_init(TOPIC_LIVE) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 即時串流模組初始化失敗，LIVE_STREAM 指令無法使用");
+    }
     
     // 🔄 初始化指令處理模組
     ret = command_handler_init();
@@ -794,6 +1539,42 @@ void app_main(void)
         ESP_LOGE(TAG, "❌ OTA 更新模組初始化失敗");
         return;  // 終止程式執行
     }
+    
+    // 🔄 新增：OTA 飛行紀錄器 (須在 OTA 任務啟動前，重啟前未結束的嘗試在此標記為中斷)
+    if (ota_recorder_init(TOPIC_OTA_RECORD) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ OTA 飛行紀錄器初始化失敗");
+    }
+    
+    // 🔄 新增：OTA 效能自我測試 (新韌體待驗證時與舊韌體基準比較，超出預算自動回滾)
+    ota_selftest_config_t selftest_config = {
+        .window_s = OTA_SELFTEST_WINDOW_S,
+        .heap_floor_margin_bytes = OTA_SELFTEST_HEAP_MARGIN_BYTES,
+        .publish_rate_margin_permille = OTA_SELFTEST_PUBLISH_MARGIN_PM,
+        .cmd_p99_budget_pct = OTA_SELFTEST_CMD_P99_BUDGET_PCT,
+        .cmd_p99_slack_us = OTA_SELFTEST_CMD_P99_SLACK_US,
+        .cpu_margin_permille = OTA_SELFTEST_CPU_MARGIN_PM,
+        .min_publishes = OTA_SELFTEST_MIN_PUBLISHES,
+        .min_commands = OTA_SELFTEST_MIN_COMMANDS,
+    };
+    if (ota_selftest_init(&selftest_config, TOPIC_OTA_SELFTEST) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ OTA 自我測試啟動失敗，新韌體不會自動標記有效");
+    }
+    
+    // 🔄 新增：站點閘道器服務 (僅閘道器節點)
+    if (GATEWAY_SERVICE_ENABLED && TELEMETRY_TRANSPORT == TELEMETRY_TRANSPORT_MQTT) {
+        ret = gateway_service_init(GATEWAY_UDP_PORT, TOPIC_GATEWAY_BATCH);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "❌ 閘道器服務初始化失敗");
+        }
+    }
+    
+    // 🔄 新增：本地 HTTP API
+    if (LOCAL_API_ENABLED) {
+        ret = local_api_init(LOCAL_API_PORT);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "⚠️ 本地 HTTP API 啟動失敗，僅透過遠端傳輸提供資料");
+        }
+    }
 
     // ========================================================================
     // 建立 FreeRTOS 任務
@@ -802,10 +1583,10 @@ void app_main(void)
     // 參數：任務函數, 任務名稱, 堆疊大小, 任務參數, 優先順序, 任務句柄
     xTaskCreate(sensor_task,    // 任務函數
                 "sensor_task",  // 任務名稱 (用於除錯)
-                4096,          // 堆疊大小 (bytes)
+                SENSOR_TASK_STACK_SIZE, // 堆疊大小 (bytes)
                 NULL,          // 任務參數
                 5,             // 優先順序 (0-24，數字越大優先順序越高)
-                NULL);         // 任務句柄 (不需要時可為 NULL)
+                &sensor_task_handle); // 任務句柄 (MQTT 連線時用來喚醒補送)
     
     // ========================================================================
     // 系統初始化完成
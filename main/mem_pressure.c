@@ -0,0 +1,279 @@
+// ============================================================================
+// mem_pressure.c - 記憶體壓力監測模組實作
+// 功能：esp_timer 週期量測堆積並更新等級 (只讀取堆積統計，不配置記憶體)；
+//       等級變化先記錄在固定大小的佇列，由週期任務以 snprintf 組訊息發布
+// ============================================================================
+
+#include "mem_pressure.h"
+#include "telemetry_transport.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define TRANSITION_QUEUE_SIZE   4       // 尚未發布的等級變化上限 (超過時保留最新的)
+#define REPORT_JSON_SIZE        224     // 等級變化通知的最大長度
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "MEM_PRESSURE";
+
+// ============================================================================
+// 等級變化記錄
+// ============================================================================
+typedef struct {
+    mem_pressure_tier_t from;
+    mem_pressure_tier_t to;
+    uint32_t free_bytes;
+    uint32_t largest_block;
+    int64_t uptime_ms;
+} tier_transition_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static mem_pressure_config_t pressure_config;
+static const char *report_topic = NULL;
+static esp_timer_handle_t check_timer = NULL;
+static portMUX_TYPE pressure_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static volatile mem_pressure_tier_t current_tier = MEM_PRESSURE_NORMAL;
+static mem_pressure_stats_t pressure_stats = {0};
+static int64_t tier_entered_us = 0;
+static volatile uint32_t alloc_failures = 0;
+
+static tier_transition_t transitions[TRANSITION_QUEUE_SIZE];
+static size_t transition_head = 0;
+static size_t transition_count = 0;
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void check_timer_callback(void *arg);
+static mem_pressure_tier_t classify(uint32_t free_bytes, uint32_t largest_block, mem_pressure_tier_t tier);
+static void alloc_failed_hook(size_t size, uint32_t caps, const char *function_name);
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t mem_pressure_init(const mem_pressure_config_t* config, const char* topic)
+{
+    if (config == NULL || topic == NULL ||
+        !(config->elevated_bytes > config->high_bytes && config->high_bytes > config->critical_bytes)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(&pressure_config, config, sizeof(mem_pressure_config_t));
+    report_topic = topic;
+    tier_entered_us = esp_timer_get_time();
+
+    // 記錄配置失敗的次數，配合等級判斷是否需要調整門檻
+    heap_caps_register_failed_alloc_callback(alloc_failed_hook);
+
+    esp_timer_create_args_t timer_args = {
+        .callback = check_timer_callback,
+        .name = "mem_pressure",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &check_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(check_timer, MEM_PRESSURE_CHECK_INTERVAL_MS * 1000ULL);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 無法啟動記憶體監測計時器: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    check_timer_callback(NULL);  // 立即量測一次，初始化完成即有正確等級
+
+    ESP_LOGI(TAG, "✅ 記憶體壓力監測啟動 - 門檻 %lu / %lu / %lu bytes，最小區塊 %lu bytes",
+             config->elevated_bytes, config->high_bytes, config->critical_bytes, config->min_block_bytes);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 查詢介面
+// ============================================================================
+mem_pressure_tier_t mem_pressure_get_tier(void)
+{
+    return current_tier;
+}
+
+size_t mem_pressure_batch_limit(size_t nominal)
+{
+    size_t limit;
+    switch (current_tier) {
+        case MEM_PRESSURE_NORMAL:
+            limit = nominal;
+            break;
+        case MEM_PRESSURE_ELEVATED:
+            limit = nominal / 2;
+            break;
+        default:
+            limit = nominal / 4;
+            break;
+    }
+    return limit > 0 ? limit : 1;
+}
+
+const char* mem_pressure_tier_name(mem_pressure_tier_t tier)
+{
+    switch (tier) {
+        case MEM_PRESSURE_ELEVATED:
+            return "elevated";
+        case MEM_PRESSURE_HIGH:
+            return "high";
+        case MEM_PRESSURE_CRITICAL:
+            return "critical";
+        case MEM_PRESSURE_NORMAL:
+        default:
+            return "normal";
+    }
+}
+
+void mem_pressure_get_stats(mem_pressure_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&pressure_lock);
+    memcpy(stats, &pressure_stats, sizeof(mem_pressure_stats_t));
+    stats->alloc_failures = alloc_failures;
+    stats->time_in_tier_s[stats->tier] += (uint32_t)((now_us - tier_entered_us) / 1000000);
+    portEXIT_CRITICAL(&pressure_lock);
+}
+
+// ============================================================================
+// 發布等級變化
+// ============================================================================
+void mem_pressure_report_transitions(void)
+{
+    if (report_topic == NULL) {
+        return;
+    }
+
+    while (telemetry_is_connected()) {
+        tier_transition_t t;
+        bool have = false;
+
+        portENTER_CRITICAL(&pressure_lock);
+        if (transition_count > 0) {
+            t = transitions[(transition_head + TRANSITION_QUEUE_SIZE - transition_count) % TRANSITION_QUEUE_SIZE];
+            have = true;
+        }
+        portEXIT_CRITICAL(&pressure_lock);
+
+        if (!have) {
+            break;
+        }
+
+        // 壓力下仍需送得出去：堆疊緩衝區 + snprintf，不建立 cJSON 樹
+        char msg[REPORT_JSON_SIZE];
+        int len = snprintf(msg, sizeof(msg),
+                           "{\"type\":\"mem_pressure\",\"from\":\"%s\",\"to\":\"%s\",\"free_heap\":%lu,"
+                           "\"largest_block\":%lu,\"min_free_heap\":%lu,\"alloc_failures\":%lu,\"uptime_ms\":%lld}",
+                           mem_pressure_tier_name(t.from), mem_pressure_tier_name(t.to),
+                           t.free_bytes, t.largest_block, (uint32_t)esp_get_minimum_free_heap_size(),
+                           alloc_failures, t.uptime_ms);
+        if (telemetry_publish(report_topic, msg, len, 1, 0) != ESP_OK) {
+            break;  // 保留在佇列中，下次再送
+        }
+
+        portENTER_CRITICAL(&pressure_lock);
+        if (transition_count > 0) {
+            transition_count--;
+        }
+        portEXIT_CRITICAL(&pressure_lock);
+    }
+}
+
+// ============================================================================
+// 週期量測 (esp_timer 任務中執行)
+// ============================================================================
+static void check_timer_callback(void *arg)
+{
+    uint32_t free_bytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    uint32_t largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    int64_t now_us = esp_timer_get_time();
+
+    mem_pressure_tier_t previous = current_tier;
+    mem_pressure_tier_t tier = classify(free_bytes, largest_block, previous);
+
+    portENTER_CRITICAL(&pressure_lock);
+    pressure_stats.free_bytes = free_bytes;
+    pressure_stats.largest_block = largest_block;
+    pressure_stats.min_free_bytes = esp_get_minimum_free_heap_size();
+    if (tier != previous) {
+        pressure_stats.time_in_tier_s[previous] += (uint32_t)((now_us - tier_entered_us) / 1000000);
+        pressure_stats.tier = tier;
+        pressure_stats.transitions++;
+        tier_entered_us = now_us;
+        current_tier = tier;
+
+        transitions[transition_head] = (tier_transition_t){
+            .from = previous,
+            .to = tier,
+            .free_bytes = free_bytes,
+            .largest_block = largest_block,
+            .uptime_ms = now_us / 1000,
+        };
+        transition_head = (transition_head + 1) % TRANSITION_QUEUE_SIZE;
+        if (transition_count < TRANSITION_QUEUE_SIZE) {
+            transition_count++;
+        }
+    }
+    portEXIT_CRITICAL(&pressure_lock);
+
+    if (tier > previous) {
+        ESP_LOGW(TAG, "⚠️ 記憶體壓力升高: %s → %s (可用 %lu bytes，最大區塊 %lu bytes)",
+                 mem_pressure_tier_name(previous), mem_pressure_tier_name(tier), free_bytes, largest_block);
+    } else if (tier < previous) {
+        ESP_LOGI(TAG, "✅ 記憶體壓力降低: %s → %s (可用 %lu bytes)",
+                 mem_pressure_tier_name(previous), mem_pressure_tier_name(tier), free_bytes);
+    }
+}
+
+// ============================================================================
+// 等級判定 (內部函數)
+// 升級立即生效；降級需可用堆積高於該門檻加上 hysteresis
+// ============================================================================
+static mem_pressure_tier_t classify(uint32_t free_bytes, uint32_t largest_block, mem_pressure_tier_t tier)
+{
+    const uint32_t thresholds[] = {
+        [MEM_PRESSURE_ELEVATED] = pressure_config.elevated_bytes,
+        [MEM_PRESSURE_HIGH] = pressure_config.high_bytes,
+        [MEM_PRESSURE_CRITICAL] = pressure_config.critical_bytes,
+    };
+
+    mem_pressure_tier_t target = MEM_PRESSURE_NORMAL;
+    for (int t = MEM_PRESSURE_CRITICAL; t > MEM_PRESSURE_NORMAL; t--) {
+        // 已在此等級 (或更高) 時，需要額外的餘裕才會退出
+        uint32_t threshold = thresholds[t] + (tier >= t ? pressure_config.hysteresis_bytes : 0);
+        if (free_bytes < threshold) {
+            target = (mem_pressure_tier_t)t;
+            break;
+        }
+    }
+
+    // 總量足夠但碎片化：TLS、OTA 緩衝區等大區塊配置仍會失敗
+    if (largest_block < pressure_config.min_block_bytes && target < MEM_PRESSURE_CRITICAL) {
+        target = (mem_pressure_tier_t)(target + 1);
+    }
+    return target;
+}
+
+// ============================================================================
+// 配置失敗計數 (在配置失敗的呼叫端上下文執行，只做計數)
+// ============================================================================
+static void alloc_failed_hook(size_t size, uint32_t caps, const char *function_name)
+{
+    alloc_failures++;
+}
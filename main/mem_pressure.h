@@ -0,0 +1,98 @@
+// ============================================================================
+// mem_pressure.h - 記憶體壓力監測模組標頭檔
+// 功能：定期量測可用堆積與最大連續區塊，分級判定記憶體壓力，
+//       各模組依等級降級 (精簡狀態編碼、暫停補送、縮小批次、延後非必要指令)，
+//       壓力解除後自動恢復，等級變化會發布通知
+// ============================================================================
+
+#ifndef MEM_PRESSURE_H
+#define MEM_PRESSURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define MEM_PRESSURE_CHECK_INTERVAL_MS  1000    // 堆積量測間隔
+
+// ============================================================================
+// 壓力等級 (數值越大越嚴重，每一級包含前一級的降級措施)
+// ============================================================================
+typedef enum {
+    MEM_PRESSURE_NORMAL = 0,    // 正常
+    MEM_PRESSURE_ELEVATED,      // 系統狀態改用精簡編碼，批次縮為 1/2
+    MEM_PRESSURE_HIGH,          // 暫停離線讀數補送與歷史查詢，批次縮為 1/4
+    MEM_PRESSURE_CRITICAL,      // 延後非必要指令，僅執行澆水與取消 OTA
+} mem_pressure_tier_t;
+
+// ============================================================================
+// 門檻配置 (可用堆積低於門檻即進入該等級)
+// ============================================================================
+typedef struct {
+    uint32_t elevated_bytes;    // ELEVATED 門檻
+    uint32_t high_bytes;        // HIGH 門檻
+    uint32_t critical_bytes;    // CRITICAL 門檻
+    uint32_t min_block_bytes;   // 最大連續區塊低於此值時等級再提高一級 (碎片化)
+    uint32_t hysteresis_bytes;  // 降級恢復需高於門檻的餘裕，避免在門檻附近反覆切換
+} mem_pressure_config_t;
+
+// ============================================================================
+// 記憶體壓力統計資訊
+// ============================================================================
+typedef struct {
+    mem_pressure_tier_t tier;       // 目前等級
+    uint32_t free_bytes;            // 最近一次量測的可用堆積
+    uint32_t largest_block;         // 最近一次量測的最大連續區塊
+    uint32_t min_free_bytes;        // 開機以來最低可用堆積
+    uint32_t transitions;           // 等級變化次數
+    uint32_t alloc_failures;        // 堆積配置失敗次數
+    uint32_t time_in_tier_s[4];     // 各等級累計停留秒數
+} mem_pressure_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化記憶體壓力監測，啟動定期量測計時器
+ *
+ * @param config 門檻配置
+ * @param report_topic 等級變化通知的發布主題
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t mem_pressure_init(const mem_pressure_config_t* config, const char* report_topic);
+
+/**
+ * @brief 取得目前壓力等級 (可在任何任務呼叫，不會阻塞)
+ */
+mem_pressure_tier_t mem_pressure_get_tier(void);
+
+/**
+ * @brief 依目前等級縮小批次大小
+ *
+ * @param nominal 正常情況下的批次大小
+ * @return size_t 建議批次大小 (至少為 1)
+ */
+size_t mem_pressure_batch_limit(size_t nominal);
+
+/**
+ * @brief 發布尚未回報的等級變化 (由可連網的週期任務呼叫，不使用 cJSON)
+ */
+void mem_pressure_report_transitions(void);
+
+/**
+ * @brief 取得等級名稱 ("normal" / "elevated" / "high" / "critical")
+ */
+const char* mem_pressure_tier_name(mem_pressure_tier_t tier);
+
+/**
+ * @brief 取得記憶體壓力統計資訊
+ *
+ * @param stats 統計資訊結構指標
+ */
+void mem_pressure_get_stats(mem_pressure_stats_t* stats);
+
+#endif // MEM_PRESSURE_H
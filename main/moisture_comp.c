@@ -0,0 +1,294 @@
+// ============================================================================
+// moisture_comp.c - 濕度溫度補償模組實作
+// 功能：補償路徑全為整數運算；學習先將讀數整理成 1 小時區段平均，
+//       以相鄰區段的差分做帶截距、帶遺忘因子的最小平方 Δm = c + k·ΔT：
+//       - 相鄰 60 秒讀數的溫度變化只有 0.0x°C，遠小於讀數雜訊，無法估出係數；
+//         小時區段平均壓低雜訊，日夜溫差在區段之間才有足夠的變化量
+//       - 截距 c 吸收乾燥造成的穩定下降，避免把乾燥趨勢誤算成溫度係數
+//       - 區段內出現真實的濕度步階 (澆水、降雨) 時，該區段不納入學習
+// ============================================================================
+
+#include "moisture_comp.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define LEARN_BLOCK_US          (3600LL * 1000000)     // 區段長度 (1 小時)
+#define LEARN_BLOCK_MIN_SAMPLES 20          // 區段內讀數少於此值 (長時間離線) 不採用
+#define LEARN_FORGET_FACTOR     0.98f       // 每區段的遺忘因子 (約 50 小時的有效視窗)
+#define LEARN_MAX_PAIR_GAP_US   (10LL * 60 * 1000000)  // 相鄰讀數最長間隔，超過時不做步階判斷
+#define LEARN_MAX_STEP_X10      15          // 相鄰讀數變化超過 1.5% 視為真實變化，該區段不納入學習
+#define LEARN_MIN_BLOCKS        24          // 至少學習一整天的日夜循環
+#define LEARN_MIN_SXX           10.0f       // 去均值後的 ΔT² 累積量 (°C²) 達此值才採用學習結果
+#define LEARN_MAX_COEFF_X1000   2000        // 係數上限 (±2% / °C)
+#define LEARN_SAVE_INTERVAL     6           // 每學習此區段數寫入一次 NVS (約 6 小時)
+#define NVS_NAMESPACE           "moist_comp"
+#define NVS_KEY_STATE           "state"
+#define COMP_STATE_VERSION      2
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "MOIST_COMP";
+
+// ============================================================================
+// NVS 保存的學習狀態
+// ============================================================================
+typedef struct {
+    uint8_t version;
+    uint8_t learned;
+    uint16_t reserved;
+    int32_t coeff_x1000;
+    float n;                    // 加權區段對數
+    float sx;                   // ΣΔT，單位 °C
+    float sy;                   // ΣΔm，單位 %
+    float sxx;                  // Σ(ΔT²)，單位 °C²
+    float sxy;                  // Σ(Δm·ΔT)，單位 %·°C
+    uint32_t samples;           // 已學習的區段對數
+} moisture_comp_state_t;
+
+// ============================================================================
+// 進行中的小時區段
+// ============================================================================
+typedef struct {
+    int64_t start_us;
+    int64_t moisture_sum_x10;
+    int64_t temp_sum_x100;
+    uint32_t count;
+    bool disturbed;             // 區段內有真實濕度步階
+} learn_block_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static moisture_comp_config_t comp_config = { .model = MOISTURE_COMP_NONE };
+static moisture_comp_state_t comp_state = { .version = COMP_STATE_VERSION };
+static portMUX_TYPE comp_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// 學習狀態只由採樣任務存取
+static bool have_prev = false;
+static int prev_moisture_x10 = 0;
+static int64_t prev_sample_us = 0;
+static learn_block_t block = { 0 };
+static bool have_prev_block = false;
+static float prev_block_moisture = 0;
+static float prev_block_temp = 0;
+static int64_t prev_block_start_us = 0;
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void learn_from_sample(int moisture_x10, int32_t temp_x100, int64_t sample_us);
+static void learn_from_block(float moisture, float temp, int64_t start_us);
+static void load_state(void);
+static void save_state(void);
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t moisture_comp_init(const moisture_comp_config_t* config)
+{
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(&comp_config, config, sizeof(moisture_comp_config_t));
+    comp_state.coeff_x1000 = config->coeff_x1000;
+
+    if (comp_config.model == MOISTURE_COMP_LEARNED) {
+        load_state();
+    }
+
+    ESP_LOGI(TAG, "✅ 濕度溫度補償初始化完成 - 模型: %s，係數 %.3f%%/°C，參考 %.2f°C",
+             moisture_comp_model_name(), comp_state.coeff_x1000 / 1000.0f,
+             comp_config.ref_temp_x100 / 100.0f);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 補償 (定點) 與學習
+// ============================================================================
+int moisture_comp_process(int moisture_x10, int32_t temp_x100, int64_t sample_us)
+{
+    if (comp_config.model == MOISTURE_COMP_NONE) {
+        return moisture_x10;
+    }
+
+    if (comp_config.model == MOISTURE_COMP_LEARNED) {
+        learn_from_sample(moisture_x10, temp_x100, sample_us);
+    }
+
+    portENTER_CRITICAL(&comp_lock);
+    int32_t coeff_x1000 = comp_state.coeff_x1000;
+    portEXIT_CRITICAL(&comp_lock);
+
+    // (0.001%/°C) * (0.01°C) = 1e-5 %，換算為 0.1% 需除以 10000 (四捨五入)
+    int32_t delta = coeff_x1000 * (temp_x100 - comp_config.ref_temp_x100);
+    int32_t correction_x10 = (delta >= 0 ? delta + 5000 : delta - 5000) / 10000;
+    int compensated_x10 = moisture_x10 - correction_x10;
+
+    if (compensated_x10 > 1000) compensated_x10 = 1000;
+    if (compensated_x10 < 0) compensated_x10 = 0;
+    return compensated_x10;
+}
+
+const char* moisture_comp_model_name(void)
+{
+    switch (comp_config.model) {
+        case MOISTURE_COMP_FIXED:
+            return "fixed";
+        case MOISTURE_COMP_LEARNED:
+            return "learned";
+        case MOISTURE_COMP_NONE:
+        default:
+            return "none";
+    }
+}
+
+void moisture_comp_get_stats(moisture_comp_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&comp_lock);
+    stats->model = comp_config.model;
+    stats->coeff_x1000 = comp_state.coeff_x1000;
+    stats->learn_samples = comp_state.samples;
+    stats->learned = comp_state.learned;
+    portEXIT_CRITICAL(&comp_lock);
+}
+
+// ============================================================================
+// 累積小時區段，區段結束時交給學習 (內部函數)
+// ============================================================================
+static void learn_from_sample(int moisture_x10, int32_t temp_x100, int64_t sample_us)
+{
+    // 相鄰讀數的步階代表真實濕度變化 (澆水、降雨)，標記整個區段不納入學習
+    bool step = have_prev && sample_us - prev_sample_us <= LEARN_MAX_PAIR_GAP_US &&
+                (moisture_x10 - prev_moisture_x10 > LEARN_MAX_STEP_X10 ||
+                 moisture_x10 - prev_moisture_x10 < -LEARN_MAX_STEP_X10);
+    have_prev = true;
+    prev_moisture_x10 = moisture_x10;
+    prev_sample_us = sample_us;
+
+    if (block.count > 0 && sample_us - block.start_us >= LEARN_BLOCK_US) {
+        if (block.disturbed || block.count < LEARN_BLOCK_MIN_SAMPLES) {
+            // 受干擾或資料不足的區段切斷差分鏈，下一個區段重新起算
+            have_prev_block = false;
+        } else {
+            learn_from_block(block.moisture_sum_x10 / 10.0f / block.count,
+                             block.temp_sum_x100 / 100.0f / block.count, block.start_us);
+        }
+        memset(&block, 0, sizeof(block));
+    }
+
+    if (block.count == 0) {
+        block.start_us = sample_us;
+    }
+    block.moisture_sum_x10 += moisture_x10;
+    block.temp_sum_x100 += temp_x100;
+    block.count++;
+    block.disturbed |= step;
+}
+
+// ============================================================================
+// 以相鄰區段平均的差分更新係數 (內部函數)
+// ============================================================================
+static void learn_from_block(float moisture, float temp, int64_t start_us)
+{
+    // 區段之間有空檔 (離線、重開機) 時只作為新的起點
+    bool usable = have_prev_block && start_us - prev_block_start_us <= 2 * LEARN_BLOCK_US;
+    float dm = moisture - prev_block_moisture;
+    float dt = temp - prev_block_temp;
+
+    have_prev_block = true;
+    prev_block_moisture = moisture;
+    prev_block_temp = temp;
+    prev_block_start_us = start_us;
+
+    if (!usable) {
+        return;
+    }
+
+    bool save = false;
+    bool changed = false;
+    int32_t coeff_x1000 = 0;
+    float sxx_centered = 0;
+    uint32_t samples = 0;
+
+    portENTER_CRITICAL(&comp_lock);
+    comp_state.n = LEARN_FORGET_FACTOR * comp_state.n + 1.0f;
+    comp_state.sx = LEARN_FORGET_FACTOR * comp_state.sx + dt;
+    comp_state.sy = LEARN_FORGET_FACTOR * comp_state.sy + dm;
+    comp_state.sxx = LEARN_FORGET_FACTOR * comp_state.sxx + dt * dt;
+    comp_state.sxy = LEARN_FORGET_FACTOR * comp_state.sxy + dm * dt;
+    comp_state.samples++;
+    samples = comp_state.samples;
+
+    // 去均值後的溫度變化累積足夠才更新，避免恆溫期間以雜訊估出極端係數
+    sxx_centered = comp_state.sxx - comp_state.sx * comp_state.sx / comp_state.n;
+    if (comp_state.samples >= LEARN_MIN_BLOCKS && sxx_centered >= LEARN_MIN_SXX) {
+        float sxy_centered = comp_state.sxy - comp_state.sx * comp_state.sy / comp_state.n;
+        coeff_x1000 = (int32_t)(sxy_centered / sxx_centered * 1000.0f);
+        if (coeff_x1000 > LEARN_MAX_COEFF_X1000) coeff_x1000 = LEARN_MAX_COEFF_X1000;
+        if (coeff_x1000 < -LEARN_MAX_COEFF_X1000) coeff_x1000 = -LEARN_MAX_COEFF_X1000;
+        changed = !comp_state.learned;
+        comp_state.coeff_x1000 = coeff_x1000;
+        comp_state.learned = 1;
+    }
+    save = (comp_state.samples % LEARN_SAVE_INTERVAL) == 0;
+    portEXIT_CRITICAL(&comp_lock);
+
+    if (changed) {
+        ESP_LOGI(TAG, "📐 學習係數生效: %.3f%%/°C (%lu 個區段對，ΣΔT² %.1f °C²)",
+                 coeff_x1000 / 1000.0f, samples, sxx_centered);
+    }
+    if (save) {
+        save_state();
+    }
+}
+
+// ============================================================================
+// NVS 學習狀態存取 (內部函數)
+// ============================================================================
+static void load_state(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+
+    moisture_comp_state_t stored;
+    size_t size = sizeof(stored);
+    if (nvs_get_blob(handle, NVS_KEY_STATE, &stored, &size) == ESP_OK &&
+        size == sizeof(stored) && stored.version == COMP_STATE_VERSION && stored.learned) {
+        comp_state = stored;
+        ESP_LOGI(TAG, "載入學習係數 %.3f%%/°C (%lu 筆)", stored.coeff_x1000 / 1000.0f, stored.samples);
+    }
+    nvs_close(handle);
+}
+
+static void save_state(void)
+{
+    portENTER_CRITICAL(&comp_lock);
+    moisture_comp_state_t snapshot = comp_state;
+    portEXIT_CRITICAL(&comp_lock);
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, NVS_KEY_STATE, &snapshot, sizeof(snapshot));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 無法儲存補償係數: %s", esp_err_to_name(err));
+    }
+}
@@ -0,0 +1,77 @@
+// ============================================================================
+// moisture_comp.h - 濕度溫度補償模組標頭檔
+// 功能：以定點運算將濕度讀數補償到參考溫度，抑制電容式探頭隨溫度產生的日夜波動；
+//       補償係數可固定配置或由小時區段平均的濕度/溫度變化線上學習
+// ============================================================================
+
+#ifndef MOISTURE_COMP_H
+#define MOISTURE_COMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 補償模型
+// ============================================================================
+typedef enum {
+    MOISTURE_COMP_NONE = 0,     // 不補償 (補償值等於原始值)
+    MOISTURE_COMP_FIXED,        // 固定係數
+    MOISTURE_COMP_LEARNED,      // 以配置係數為初值，線上學習並存入 NVS (模擬見 tools/moisture_comp_sim.py)
+} moisture_comp_model_t;
+
+// ============================================================================
+// 補償配置
+// 補償公式 (定點)：comp_x10 = moisture_x10 - coeff_x1000 * (temp_x100 - ref_temp_x100) / 10000
+// ============================================================================
+typedef struct {
+    moisture_comp_model_t model;
+    int32_t coeff_x1000;        // 溫度係數 (0.001% / °C)，正值表示溫度升高時讀數偏高
+    int32_t ref_temp_x100;      // 參考溫度 (0.01°C)
+} moisture_comp_config_t;
+
+// ============================================================================
+// 補償統計資訊
+// ============================================================================
+typedef struct {
+    moisture_comp_model_t model;
+    int32_t coeff_x1000;        // 目前使用的係數
+    uint32_t learn_samples;     // 已納入學習的小時區段對數量
+    bool learned;               // 學習結果是否已取代配置初值
+} moisture_comp_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化補償模組 (學習模型會從 NVS 載入先前的係數)
+ *
+ * @param config 補償配置
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t moisture_comp_init(const moisture_comp_config_t* config);
+
+/**
+ * @brief 補償一筆讀數，學習模型同時以此讀數更新係數
+ *
+ * @param moisture_x10 原始濕度 (0.1%)
+ * @param temp_x100 同一採樣週期的溫度 (0.01°C)
+ * @param sample_us 採樣當下的 esp_timer_get_time()
+ * @return int 補償後濕度 (0.1%，限制在 0-1000)
+ */
+int moisture_comp_process(int moisture_x10, int32_t temp_x100, int64_t sample_us);
+
+/**
+ * @brief 取得補償模型名稱 ("none" / "fixed" / "learned")
+ */
+const char* moisture_comp_model_name(void);
+
+/**
+ * @brief 取得補償統計資訊
+ *
+ * @param stats 統計資訊結構指標
+ */
+void moisture_comp_get_stats(moisture_comp_stats_t* stats);
+
+#endif // MOISTURE_COMP_H
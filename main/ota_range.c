@@ -0,0 +1,440 @@
+// ============================================================================
+// ota_range.c - OTA 多連線分段下載模組實作
+// 功能：每條連線一個工作任務，輪流認領下一個區塊並以 Range 請求下載到重排緩衝區；
+//       呼叫者的任務只負責依序寫入，區塊在寫入後才釋放給下一個認領者
+// ============================================================================
+
+#include "ota_range.h"
+#include "ota_recorder.h"
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_http_client.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define OTA_RANGE_SLOTS             (OTA_RANGE_RAM_BUDGET / OTA_RANGE_BLOCK_SIZE)
+#define OTA_RANGE_WORKER_STACK      8192    // 工作任務堆疊 (含 TLS 交握，與單一連線的 OTA 任務相同)
+#define OTA_RANGE_TLS_HEAP          (40 * 1024) // 每條連線的 TLS 工作階段堆積估計 (mbedTLS 收發緩衝 + 交握)
+#define OTA_RANGE_HEAP_RESERVE      (32 * 1024) // 建立連線後仍須保留給其他模組的堆積
+#define OTA_RANGE_POLL_MS           200     // 等待區塊 / 空槽時檢查中止旗標的間隔
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "OTA_RANGE";
+
+// ============================================================================
+// 內部結構定義
+// ============================================================================
+typedef enum {
+    SLOT_FREE = 0,      // 可被認領
+    SLOT_FILLING,       // 工作任務下載中
+    SLOT_READY,         // 已下載，等待依序寫入
+} slot_state_t;
+
+// 同一時間只有一個 OTA 在進行，下載狀態以靜態配置
+typedef struct {
+    const ota_range_config_t *config;
+    char *buffer;                           // OTA_RANGE_SLOTS 個區塊
+    int blocks;
+    int next_block;                         // 下一個待認領的區塊
+    slot_state_t slot_state[OTA_RANGE_SLOTS];
+    int slot_len[OTA_RANGE_SLOTS];
+    volatile bool abort;
+    esp_err_t error;                        // 最後一條連線失敗的錯誤
+    uint32_t retries;
+    int alive;                              // 仍在下載的工作任務數
+    int handed_back[OTA_RANGE_MAX_CONNECTIONS]; // 失敗連線交還的區塊 (其槽仍保留給該區塊)
+    int handed_back_count;
+    uint32_t lost_connections;              // 失敗後退出的連線數
+    portMUX_TYPE lock;
+    SemaphoreHandle_t free_slots;           // 可認領的槽數：保證進行中的區塊依序號落在不同槽
+    SemaphoreHandle_t ready;                // 有區塊完成或發生錯誤
+    SemaphoreHandle_t exited;               // 工作任務結束
+} range_job_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static range_job_t job = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void range_worker_task(void *pvParameters);
+static esp_err_t fetch_block(esp_http_client_handle_t client, int block, char *dst, int *out_len);
+static int claim_block(void);
+static void fail_worker(int block, esp_err_t err);
+static esp_err_t probe_event_handler(esp_http_client_event_t *evt);
+
+// ============================================================================
+// 確認 Range 支援並取得韌體大小
+// ============================================================================
+esp_err_t ota_range_probe(const char* url, uint32_t timeout_ms, int* content_length)
+{
+    int total = -1;
+    esp_http_client_config_t http_config = {
+        .url = url,
+        .timeout_ms = timeout_ms,
+        .event_handler = probe_event_handler,
+        .user_data = &total,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&http_config);
+    if (client == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_http_client_set_header(client, "Range", "bytes=0-0");
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err == ESP_OK) {
+        // 探測連線隨即關閉，不計入 CONNECT / HEADERS 階段 (由第一條工作連線標記)
+        esp_http_client_fetch_headers(client);
+        int status = esp_http_client_get_status_code(client);
+        if (status != 206 || total <= 0) {
+            ESP_LOGW(TAG, "⚠️ 伺服器不支援 Range 請求 (HTTP %d)", status);
+            err = ESP_ERR_NOT_SUPPORTED;
+        }
+    } else {
+        ESP_LOGE(TAG, "❌ 無法連接到伺服器: %s", esp_err_to_name(err));
+    }
+    esp_http_client_cleanup(client);
+
+    if (err == ESP_OK) {
+        *content_length = total;
+    }
+    return err;
+}
+
+// 擷取 "Content-Range: bytes 0-0/<總長度>"
+static esp_err_t probe_event_handler(esp_http_client_event_t *evt)
+{
+    if (evt->event_id == HTTP_EVENT_ON_HEADER && strcasecmp(evt->header_key, "Content-Range") == 0) {
+        const char *slash = strchr(evt->header_value, '/');
+        if (slash != NULL && slash[1] != '*') {
+            *(int *)evt->user_data = atoi(slash + 1);
+        }
+    }
+    return ESP_OK;
+}
+
+// ============================================================================
+// 多連線下載 (寫入端)
+// ============================================================================
+esp_err_t ota_range_download(const ota_range_config_t* config, ota_range_sink_t sink, void* ctx,
+                             ota_range_stats_t* stats)
+{
+    if (config == NULL || sink == NULL || config->content_length <= 0 ||
+        config->connections < 2 || config->connections > OTA_RANGE_MAX_CONNECTIONS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    job.config = config;
+    job.blocks = (config->content_length + OTA_RANGE_BLOCK_SIZE - 1) / OTA_RANGE_BLOCK_SIZE;
+    job.next_block = 0;
+    job.abort = false;
+    job.error = ESP_OK;
+    job.retries = 0;
+    job.alive = 0;
+    job.handed_back_count = 0;
+    job.lost_connections = 0;
+    memset(job.slot_state, 0, sizeof(job.slot_state));
+    job.buffer = malloc(OTA_RANGE_SLOTS * OTA_RANGE_BLOCK_SIZE);
+    job.free_slots = xSemaphoreCreateCounting(OTA_RANGE_SLOTS, OTA_RANGE_SLOTS);
+    job.ready = xSemaphoreCreateBinary();
+    job.exited = xSemaphoreCreateCounting(OTA_RANGE_MAX_CONNECTIONS, 0);
+
+    esp_err_t err = ESP_OK;
+    int workers = 0;
+    if (job.buffer == NULL || job.free_slots == NULL || job.ready == NULL || job.exited == NULL) {
+        ESP_LOGE(TAG, "❌ 無法配置重排緩衝區 (%d bytes)", OTA_RANGE_SLOTS * OTA_RANGE_BLOCK_SIZE);
+        err = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    // 每條連線需要一個工作任務堆疊與一個 TLS 工作階段，依目前可用堆積限制連線數
+    size_t free_heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t per_worker = OTA_RANGE_WORKER_STACK + OTA_RANGE_TLS_HEAP;
+    int connections = config->connections;
+    while (connections > 1 && free_heap < OTA_RANGE_HEAP_RESERVE + connections * per_worker) {
+        connections--;
+    }
+    if (connections < config->connections) {
+        ESP_LOGW(TAG, "⚠️ 可用堆積 %u bytes，連線數降為 %d (每條約需 %u bytes)",
+                 (unsigned)free_heap, connections, (unsigned)per_worker);
+    }
+
+    ESP_LOGI(TAG, "🚀 多連線下載: %d bytes，%d 個區塊，%d 條連線，緩衝 %d KB",
+             config->content_length, job.blocks, connections,
+             OTA_RANGE_SLOTS * OTA_RANGE_BLOCK_SIZE / 1024);
+
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < connections; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "ota_range%d", i);
+        portENTER_CRITICAL(&job.lock);
+        job.alive++;
+        portEXIT_CRITICAL(&job.lock);
+        if (xTaskCreate(range_worker_task, name, OTA_RANGE_WORKER_STACK, NULL,
+                        uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+            portENTER_CRITICAL(&job.lock);
+            job.alive--;
+            portEXIT_CRITICAL(&job.lock);
+            break;
+        }
+        workers++;
+    }
+    if (workers == 0) {
+        err = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+    if (workers < connections) {
+        ESP_LOGW(TAG, "⚠️ 只建立了 %d 條連線的工作任務", workers);
+    }
+
+    // 依序寫入：等待下一個區塊所在的槽完成，寫入後釋放給工作任務
+    int64_t wait_us = 0;
+    int block = 0;
+    while (block < job.blocks) {
+        if (config->cancel != NULL && *config->cancel) {
+            err = ESP_ERR_INVALID_STATE;
+            break;
+        }
+
+        int slot = block % OTA_RANGE_SLOTS;
+        portENTER_CRITICAL(&job.lock);
+        bool ready = job.slot_state[slot] == SLOT_READY;
+        esp_err_t worker_err = job.error;
+        portEXIT_CRITICAL(&job.lock);
+
+        if (worker_err != ESP_OK) {
+            err = worker_err;
+            break;
+        }
+        if (!ready) {
+            int64_t t0 = esp_timer_get_time();
+            xSemaphoreTake(job.ready, pdMS_TO_TICKS(OTA_RANGE_POLL_MS));
+            wait_us += esp_timer_get_time() - t0;
+            continue;
+        }
+
+        err = sink(job.buffer + slot * OTA_RANGE_BLOCK_SIZE, job.slot_len[slot], ctx);
+        if (err != ESP_OK) {
+            break;
+        }
+
+        portENTER_CRITICAL(&job.lock);
+        job.slot_state[slot] = SLOT_FREE;
+        portEXIT_CRITICAL(&job.lock);
+        xSemaphoreGive(job.free_slots);
+        block++;
+    }
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+
+    if (stats != NULL) {
+        stats->connections = workers;
+        stats->lost_connections = job.lost_connections;
+        stats->blocks = job.blocks;
+        stats->retries = job.retries;
+        stats->elapsed_ms = elapsed_ms;
+        stats->writer_wait_ms = (uint32_t)(wait_us / 1000);
+        stats->bytes_per_s = elapsed_ms > 0 ? (uint32_t)((uint64_t)config->content_length * 1000 / elapsed_ms) : 0;
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "✅ 多連線下載完成 - %lu ms，重試 %lu 次，中途失去 %lu 條連線，等待連續區塊 %lld ms",
+                 elapsed_ms, job.retries, job.lost_connections, wait_us / 1000);
+    }
+
+cleanup:
+    // 工作任務結束前不能釋放緩衝區 (進行中的讀取受 timeout_ms 限制)
+    job.abort = true;
+    for (int i = 0; i < workers; i++) {
+        xSemaphoreTake(job.exited, portMAX_DELAY);
+    }
+    free(job.buffer);
+    job.buffer = NULL;
+    if (job.free_slots) vSemaphoreDelete(job.free_slots);
+    if (job.ready) vSemaphoreDelete(job.ready);
+    if (job.exited) vSemaphoreDelete(job.exited);
+    job.free_slots = job.ready = job.exited = NULL;
+    return err;
+}
+
+// ============================================================================
+// 工作任務：每條連線一個，保持 keep-alive 連續下載多個區塊
+// ============================================================================
+static void range_worker_task(void *pvParameters)
+{
+    esp_http_client_config_t http_config = {
+        .url = job.config->url,
+        .timeout_ms = job.config->timeout_ms,
+        .keep_alive_enable = true,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&http_config);
+    if (client == NULL) {
+        fail_worker(-1, ESP_ERR_NO_MEM);
+    }
+
+    while (client != NULL && !job.abort) {
+        int block = claim_block();
+        if (block < 0) {
+            // 目前沒有可認領的區塊；其他連線仍可能失敗並交還區塊，等到寫入端結束才退出
+            vTaskDelay(pdMS_TO_TICKS(OTA_RANGE_POLL_MS));
+            continue;
+        }
+
+        int slot = block % OTA_RANGE_SLOTS;
+        int len = 0;
+        esp_err_t err = fetch_block(client, block, job.buffer + slot * OTA_RANGE_BLOCK_SIZE, &len);
+        if (err != ESP_OK) {
+            if (!job.abort) {
+                ESP_LOGE(TAG, "❌ 區塊 %d 下載失敗: %s", block, esp_err_to_name(err));
+                fail_worker(block, err);
+            }
+            break;
+        }
+
+        portENTER_CRITICAL(&job.lock);
+        job.slot_len[slot] = len;
+        job.slot_state[slot] = SLOT_READY;
+        portEXIT_CRITICAL(&job.lock);
+        xSemaphoreGive(job.ready);
+    }
+
+    if (client != NULL) {
+        esp_http_client_cleanup(client);
+    }
+    xSemaphoreGive(job.exited);
+    vTaskDelete(NULL);
+}
+
+// 認領下一個區塊：優先接手失敗連線交還的區塊 (已佔有槽)，否則先取得空槽再認領新區塊，
+// 進行中的區塊數不超過槽數；沒有可認領的區塊時回傳 -1
+static int claim_block(void)
+{
+    int block = -1;
+    portENTER_CRITICAL(&job.lock);
+    if (job.handed_back_count > 0) {
+        block = job.handed_back[--job.handed_back_count];
+    }
+    portEXIT_CRITICAL(&job.lock);
+    if (block >= 0) {
+        return block;
+    }
+
+    if (xSemaphoreTake(job.free_slots, pdMS_TO_TICKS(OTA_RANGE_POLL_MS)) != pdTRUE) {
+        return -1;
+    }
+    portENTER_CRITICAL(&job.lock);
+    if (job.next_block < job.blocks && !job.abort) {
+        block = job.next_block++;
+        job.slot_state[block % OTA_RANGE_SLOTS] = SLOT_FILLING;
+    }
+    portEXIT_CRITICAL(&job.lock);
+    if (block < 0) {
+        xSemaphoreGive(job.free_slots);  // 所有新區塊都已被認領，歸還空槽
+    }
+    return block;
+}
+
+// 下載單一區塊，連線中斷或伺服器錯誤時重新連線重試
+static esp_err_t fetch_block(esp_http_client_handle_t client, int block, char *dst, int *out_len)
+{
+    int start = block * OTA_RANGE_BLOCK_SIZE;
+    int len = job.config->content_length - start;
+    if (len > OTA_RANGE_BLOCK_SIZE) {
+        len = OTA_RANGE_BLOCK_SIZE;
+    }
+    char range[40];
+    snprintf(range, sizeof(range), "bytes=%d-%d", start, start + len - 1);
+
+    esp_err_t err = ESP_FAIL;
+    for (int attempt = 0; attempt <= OTA_RANGE_BLOCK_RETRIES && !job.abort; attempt++) {
+        if (attempt > 0) {
+            esp_http_client_close(client);  // 下一次 open 重新建立連線
+            portENTER_CRITICAL(&job.lock);
+            job.retries++;
+            portEXIT_CRITICAL(&job.lock);
+            // 重新建立 TLS 工作階段前確認堆積足夠，不足時交還區塊給其他連線
+            if (heap_caps_get_free_size(MALLOC_CAP_8BIT) < OTA_RANGE_HEAP_RESERVE + OTA_RANGE_TLS_HEAP) {
+                return ESP_ERR_NO_MEM;
+            }
+        }
+
+        esp_http_client_set_header(client, "Range", range);
+        err = esp_http_client_open(client, 0);
+        if (err != ESP_OK) {
+            continue;
+        }
+        ota_recorder_mark(OTA_STAGE_CONNECT);
+        esp_http_client_fetch_headers(client);
+        ota_recorder_mark(OTA_STAGE_HEADERS);
+        int status = esp_http_client_get_status_code(client);
+        if (status == 200) {
+            esp_http_client_close(client);
+            return ESP_ERR_NOT_SUPPORTED;  // 伺服器忽略 Range，回傳了整個檔案
+        }
+        if (status != 206) {
+            err = ESP_ERR_INVALID_RESPONSE;
+            if (status >= 500) {
+                continue;
+            }
+            esp_http_client_close(client);
+            return err;
+        }
+
+        int got = 0;
+        while (got < len) {
+            int n = esp_http_client_read(client, dst + got, len - got);
+            if (n <= 0) {
+                break;
+            }
+            got += n;
+        }
+        if (got == len) {
+            *out_len = len;
+            return ESP_OK;
+        }
+        err = ESP_ERR_TIMEOUT;
+    }
+
+    esp_http_client_close(client);
+    return job.abort ? ESP_ERR_INVALID_STATE : err;
+}
+
+// 連線失敗：還有其他連線時把區塊交還給它們 (逐步降到單一連線)，最後一條連線失敗才中止下載
+// block 為 -1 表示尚未認領區塊；伺服器不支援 Range 時其他連線也會失敗，直接中止
+static void fail_worker(int block, esp_err_t err)
+{
+    portENTER_CRITICAL(&job.lock);
+    job.alive--;
+    bool last = job.alive == 0 || err == ESP_ERR_NOT_SUPPORTED;
+    if (last) {
+        if (job.error == ESP_OK) {
+            job.error = err;
+        }
+        job.abort = true;
+    } else {
+        job.lost_connections++;
+        if (block >= 0) {
+            job.handed_back[job.handed_back_count++] = block;
+        }
+    }
+    int alive = job.alive;
+    portEXIT_CRITICAL(&job.lock);
+
+    if (!last) {
+        ESP_LOGW(TAG, "⚠️ 連線失敗 (%s)，區塊交還給其餘 %d 條連線", esp_err_to_name(err), alive);
+    }
+    xSemaphoreGive(job.ready);
+}
@@ -0,0 +1,84 @@
+// ============================================================================
+// ota_range.h - OTA 多連線分段下載模組標頭檔
+// 功能：以 2-4 條並行的 HTTP Range 連線下載韌體到固定大小的重排緩衝區，
+//       依序把連續的區塊交給寫入回呼 (esp_ota_write 只接受循序寫入)；
+//       高延遲鏈路上單一連線受 TCP 視窗限制，多連線可疊加可用頻寬
+// ============================================================================
+
+#ifndef OTA_RANGE_H
+#define OTA_RANGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define OTA_RANGE_MAX_CONNECTIONS   4       // 並行連線數上限
+#define OTA_RANGE_BLOCK_SIZE        8192    // 每個 Range 請求的區塊大小
+#define OTA_RANGE_RAM_BUDGET        (48 * 1024) // 重排緩衝區總大小 (區塊數 = 預算 / 區塊大小)
+#define OTA_RANGE_BLOCK_RETRIES     3       // 單一區塊下載失敗的重試次數
+
+// ============================================================================
+// 依序寫入回呼：data 為下一段連續資料，回傳非 ESP_OK 時中止下載
+// ============================================================================
+typedef esp_err_t (*ota_range_sink_t)(const char* data, int len, void* ctx);
+
+// ============================================================================
+// 分段下載設定
+// ============================================================================
+typedef struct {
+    const char* url;                // 韌體 URL
+    int connections;                // 並行連線數 (2 - OTA_RANGE_MAX_CONNECTIONS)
+    uint32_t timeout_ms;            // 每個請求的接收超時
+    int content_length;             // 韌體大小 (由 ota_range_probe 取得)
+    const volatile bool* cancel;    // 非 NULL 且為 true 時中止下載
+} ota_range_config_t;
+
+// ============================================================================
+// 分段下載統計
+// ============================================================================
+typedef struct {
+    int connections;                // 實際建立的連線數 (可能因可用堆積少於設定值)
+    uint32_t lost_connections;      // 中途失敗、把區塊交還給其他連線的連線數
+    uint32_t blocks;                // 區塊數
+    uint32_t retries;               // 區塊重試次數 (含重新連線)
+    uint32_t elapsed_ms;            // 第一個請求到最後一個區塊寫入完成的時間
+    uint32_t writer_wait_ms;        // 寫入端等待下一個連續區塊的時間 (隊頭阻塞)
+    uint32_t bytes_per_s;           // 平均下載速率
+} ota_range_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 確認伺服器支援 Range 請求並取得韌體大小
+ *
+ * 以 "Range: bytes=0-0" 請求，回應須為 206 且帶有 Content-Range 總長度
+ *
+ * @param url 韌體 URL
+ * @param timeout_ms 接收超時
+ * @param content_length 韌體大小
+ * @return esp_err_t ESP_ERR_NOT_SUPPORTED 表示伺服器不支援 Range (應改用單一連線)
+ */
+esp_err_t ota_range_probe(const char* url, uint32_t timeout_ms, int* content_length);
+
+/**
+ * @brief 多連線下載韌體，依序把連續資料交給 sink (在呼叫者的任務中執行)
+ *
+ * 重排緩衝區在開始時一次配置、結束時釋放，記憶體用量固定為 OTA_RANGE_RAM_BUDGET；
+ * 連線數依可用堆積 (每條連線的任務堆疊 + TLS 工作階段) 限制，某條連線失敗時其區塊交還給
+ * 其餘連線繼續下載，只有最後一條連線也失敗時才中止
+ *
+ * @param config 分段下載設定
+ * @param sink 依序寫入回呼
+ * @param ctx 傳給 sink 的參數
+ * @param stats 下載統計 (可為 NULL)
+ * @return esp_err_t sink 的錯誤會原樣回傳；ESP_ERR_NO_MEM 表示無法配置緩衝區或建立任務
+ */
+esp_err_t ota_range_download(const ota_range_config_t* config, ota_range_sink_t sink, void* ctx,
+                             ota_range_stats_t* stats);
+
+#endif // OTA_RANGE_H
@@ -0,0 +1,410 @@
+// ============================================================================
+// ota_recorder.c - OTA 飛行紀錄器模組實作
+// 功能：目前嘗試的紀錄放在 RAM，只在開始、下載 50%、結束 (成功或中止) 與 esp_restart 的
+//       關機回呼中整筆寫回 NVS (key "r<序號 % 槽數>")，避免每個階段都同步寫入快閃拖慢下載；
+//       斷電或當機時只留下最後一次寫入前的階段。"next" 為下一個嘗試序號，
+//       "upload" 為下一筆待上傳的序號。上傳在感測器任務中以 snprintf 格式化
+// ============================================================================
+
+#include "ota_recorder.h"
+#include "telemetry_transport.h"
+#include "time_sync.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_mac.h"
+#include "esp_app_desc.h"
+#include "nvs.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define NVS_NAMESPACE           "ota_rec"
+#define NVS_KEY_NEXT            "next"
+#define NVS_KEY_UPLOAD          "upload"
+#define RECORD_JSON_SIZE        896
+
+// 階段名稱 (上傳 JSON 的 stages 物件欄位)
+static const char *const stage_names[OTA_STAGE_COUNT] = {
+    "connect", "headers", "first_byte",
+    "pct10", "pct20", "pct30", "pct40", "pct50", "pct60", "pct70", "pct80", "pct90",
+    "download_end", "verified", "set_boot",
+};
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "OTA_RECORDER";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static const char *record_topic = NULL;
+static portMUX_TYPE recorder_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static ota_record_t current;            // 進行中的紀錄 (OTA 任務與 Range 工作任務寫入，以 recorder_lock 保護)
+static bool active = false;
+static int64_t start_us = 0;
+static uint32_t next_attempt = 0;       // 下一個嘗試序號
+static uint32_t upload_next = 0;        // 下一筆待上傳的序號
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void save_record(const ota_record_t* record);
+static bool load_record(uint32_t attempt, ota_record_t* record);
+static void save_counter(const char* key, uint32_t value);
+static void recorder_shutdown_handler(void);
+static int format_record(char* buf, size_t size, const ota_record_t* record);
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t ota_recorder_init(const char* topic)
+{
+    if (topic == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    record_topic = topic;
+
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        nvs_get_u32(handle, NVS_KEY_NEXT, &next_attempt);
+        nvs_get_u32(handle, NVS_KEY_UPLOAD, &upload_next);
+        nvs_close(handle);
+    }
+
+    // 環形區只保留最近幾筆，更早的已被覆寫
+    if (next_attempt > OTA_RECORDER_SLOTS && upload_next < next_attempt - OTA_RECORDER_SLOTS) {
+        upload_next = next_attempt - OTA_RECORDER_SLOTS;
+    }
+    if (upload_next > next_attempt) {
+        upload_next = next_attempt;
+    }
+
+    // 前一次嘗試在結束前重啟 (看門狗、斷電、當機)：保留已到達的階段並標記中斷
+    ota_record_t last;
+    if (next_attempt > 0 && load_record(next_attempt - 1, &last) &&
+        last.result == OTA_RECORDER_RESULT_RUNNING) {
+        last.result = OTA_RECORDER_RESULT_INTERRUPTED;
+        last.reset_reason = (uint8_t)esp_reset_reason();
+        save_record(&last);
+        ESP_LOGW(TAG, "⚠️ OTA 嘗試 #%lu 未完成即重啟 (重啟原因 %d，已寫入 %lu bytes)",
+                 last.attempt, last.reset_reason, last.bytes);
+    }
+
+    // esp_restart (指令重啟、記憶體壓力重啟等) 時保存進行中的紀錄
+    esp_err_t err = esp_register_shutdown_handler(recorder_shutdown_handler);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 無法註冊關機回呼: %s", esp_err_to_name(err));
+    }
+
+    ESP_LOGI(TAG, "✅ OTA 飛行紀錄器初始化完成 (已記錄 %lu 次嘗試，%lu 筆待上傳)",
+             next_attempt, next_attempt - upload_next);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 紀錄 (OTA 任務中呼叫)
+// ============================================================================
+void ota_recorder_begin(uint8_t connections)
+{
+    ota_record_t record = {
+        .version = OTA_RECORDER_VERSION,
+        .result = OTA_RECORDER_RESULT_RUNNING,
+        .connections = connections > 0 ? connections : 1,
+        .start_epoch_ms = time_sync_now_ms(),
+        .heap_floor = esp_get_free_heap_size(),
+    };
+    for (int i = 0; i < OTA_STAGE_COUNT; i++) {
+        record.stage_ms[i] = OTA_RECORDER_STAGE_UNSET;
+    }
+    const esp_app_desc_t *app_desc = esp_app_get_description();
+    strncpy(record.running_version, app_desc->version, sizeof(record.running_version) - 1);
+
+    portENTER_CRITICAL(&recorder_lock);
+    record.attempt = next_attempt++;
+    current = record;
+    active = true;
+    start_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&recorder_lock);
+
+    save_counter(NVS_KEY_NEXT, record.attempt + 1);
+    save_record(&record);
+}
+
+// 多連線下載時 ota_range 的工作任務也會標記 (連線、標頭)，階段時間在鎖內寫入
+void ota_recorder_mark(ota_stage_t stage)
+{
+    if (!active || stage >= OTA_STAGE_COUNT) {
+        return;
+    }
+
+    uint32_t free_heap = esp_get_free_heap_size();
+    uint32_t now_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    ota_record_t snapshot;
+    portENTER_CRITICAL(&recorder_lock);
+    bool first = current.stage_ms[stage] == OTA_RECORDER_STAGE_UNSET;
+    if (first) {
+        current.stage_ms[stage] = now_ms;
+        if (free_heap < current.heap_floor) {
+            current.heap_floor = free_heap;
+        }
+    }
+    snapshot = current;
+    portEXIT_CRITICAL(&recorder_lock);
+
+    // 其餘階段只更新 RAM，由結束或關機回呼一併保存
+    if (first && stage == OTA_STAGE_PCT50) {
+        save_record(&snapshot);
+    }
+}
+
+void ota_recorder_progress(uint32_t bytes, uint32_t total_bytes)
+{
+    if (!active) {
+        return;
+    }
+
+    // 每段寫入都取樣堆積 (只讀一個計數器)，NVS 只在 50% 寫入
+    uint32_t free_heap = esp_get_free_heap_size();
+    portENTER_CRITICAL(&recorder_lock);
+    if (free_heap < current.heap_floor) {
+        current.heap_floor = free_heap;
+    }
+    current.bytes = bytes;
+    current.total_bytes = total_bytes;
+    portEXIT_CRITICAL(&recorder_lock);
+
+    if (bytes > 0) {
+        ota_recorder_mark(OTA_STAGE_FIRST_BYTE);
+    }
+    if (total_bytes > 0) {
+        uint32_t decile = (uint32_t)((uint64_t)bytes * 10 / total_bytes);
+        for (uint32_t d = 1; d <= decile && d <= 9; d++) {
+            ota_recorder_mark((ota_stage_t)(OTA_STAGE_PCT10 + d - 1));
+        }
+    }
+}
+
+void ota_recorder_set_target(const char* version)
+{
+    if (active && version != NULL) {
+        portENTER_CRITICAL(&recorder_lock);
+        strncpy(current.target_version, version, sizeof(current.target_version) - 1);
+        portEXIT_CRITICAL(&recorder_lock);
+    }
+}
+
+void ota_recorder_add_retries(uint32_t retries, uint8_t connections)
+{
+    if (!active) {
+        return;
+    }
+    portENTER_CRITICAL(&recorder_lock);
+    uint32_t total = current.retries + retries;
+    current.retries = total > UINT16_MAX ? UINT16_MAX : (uint16_t)total;
+    if (connections > 0) {
+        current.connections = connections;
+    }
+    portEXIT_CRITICAL(&recorder_lock);
+}
+
+void ota_recorder_finish(ota_result_t result, esp_err_t error)
+{
+    if (!active) {
+        return;
+    }
+
+    uint32_t end_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    ota_record_t snapshot;
+    portENTER_CRITICAL(&recorder_lock);
+    current.end_ms = end_ms;
+    current.result = (uint8_t)result;
+    current.error = error;
+    uint32_t first = current.stage_ms[OTA_STAGE_FIRST_BYTE];
+    uint32_t end = current.stage_ms[OTA_STAGE_DOWNLOAD_END];
+    if (first != OTA_RECORDER_STAGE_UNSET && end != OTA_RECORDER_STAGE_UNSET && end > first) {
+        current.bytes_per_s = (uint32_t)((uint64_t)current.bytes * 1000 / (end - first));
+    }
+    snapshot = current;
+    portEXIT_CRITICAL(&recorder_lock);
+    save_record(&snapshot);
+
+    portENTER_CRITICAL(&recorder_lock);
+    active = false;
+    portEXIT_CRITICAL(&recorder_lock);
+
+    ESP_LOGI(TAG, "📼 OTA 嘗試 #%lu 紀錄完成 (%s，%lu ms，%lu bytes，堆積下限 %lu)",
+             snapshot.attempt, ota_recorder_result_name(snapshot.result), snapshot.end_ms,
+             snapshot.bytes, snapshot.heap_floor);
+}
+
+// ============================================================================
+// 上傳 (感測器任務中呼叫，每次最多一筆)
+// ============================================================================
+void ota_recorder_poll(void)
+{
+    if (record_topic == NULL || active || !telemetry_is_connected()) {
+        return;
+    }
+
+    portENTER_CRITICAL(&recorder_lock);
+    uint32_t attempt = upload_next;
+    uint32_t end = next_attempt;
+    portEXIT_CRITICAL(&recorder_lock);
+    if (attempt >= end) {
+        return;
+    }
+
+    ota_record_t record;
+    if (load_record(attempt, &record)) {
+        if (record.result == OTA_RECORDER_RESULT_RUNNING) {
+            return;
+        }
+        char json[RECORD_JSON_SIZE];
+        int len = format_record(json, sizeof(json), &record);
+        if (len <= 0 || len >= (int)sizeof(json) ||
+            telemetry_publish(record_topic, json, len, 1, 0) != ESP_OK) {
+            return;  // 下次輪詢再試
+        }
+        ESP_LOGI(TAG, "📤 已上傳 OTA 嘗試 #%lu 紀錄 (%s)", attempt, ota_recorder_result_name(record.result));
+    } else {
+        ESP_LOGW(TAG, "⚠️ OTA 嘗試 #%lu 紀錄不存在或已被覆寫，略過", attempt);
+    }
+
+    portENTER_CRITICAL(&recorder_lock);
+    if (upload_next == attempt) {
+        upload_next = attempt + 1;  // 上傳期間可能已由 ota_recorder_reupload() 重設
+    }
+    uint32_t saved = upload_next;
+    portEXIT_CRITICAL(&recorder_lock);
+    save_counter(NVS_KEY_UPLOAD, saved);
+}
+
+uint32_t ota_recorder_reupload(void)
+{
+    portENTER_CRITICAL(&recorder_lock);
+    upload_next = next_attempt > OTA_RECORDER_SLOTS ? next_attempt - OTA_RECORDER_SLOTS : 0;
+    uint32_t first = upload_next;
+    uint32_t count = next_attempt - upload_next;
+    portEXIT_CRITICAL(&recorder_lock);
+
+    save_counter(NVS_KEY_UPLOAD, first);
+    return count;
+}
+
+const char* ota_recorder_result_name(uint8_t result)
+{
+    switch (result) {
+        case OTA_RESULT_SUCCESS:                return "success";
+        case OTA_RESULT_URL_ERROR:              return "url_error";
+        case OTA_RESULT_DOWNLOAD_ERROR:         return "download_error";
+        case OTA_RESULT_VERIFY_ERROR:           return "verify_error";
+        case OTA_RESULT_INSTALL_ERROR:          return "install_error";
+        case OTA_RESULT_MEMORY_ERROR:           return "memory_error";
+        case OTA_RESULT_NETWORK_ERROR:          return "network_error";
+        case OTA_RECORDER_RESULT_RUNNING:       return "running";
+        case OTA_RECORDER_RESULT_INTERRUPTED:   return "interrupted";
+        default:                                return "unknown";
+    }
+}
+
+// ============================================================================
+// JSON 格式化 (未到達的階段省略)
+// ============================================================================
+static int format_record(char* buf, size_t size, const ota_record_t* r)
+{
+    uint8_t mac[6] = {0};
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+
+    int len = snprintf(buf, size,
+                       "{\"type\":\"ota_record\",\"node\":\"%02x%02x%02x%02x\",\"attempt\":%lu,"
+                       "\"result\":\"%s\",\"error\":\"%s\",\"error_code\":%ld,\"reset_reason\":%d,"
+                       "\"running_version\":\"%s\",\"target_version\":\"%s\",\"start_ts_ms\":%lld,"
+                       "\"connections\":%d,\"bytes\":%lu,\"total_bytes\":%lu,\"bytes_per_s\":%lu,"
+                       "\"retries\":%d,\"heap_floor\":%lu,\"end_ms\":%lu,\"stages\":{",
+                       mac[2], mac[3], mac[4], mac[5], r->attempt,
+                       ota_recorder_result_name(r->result), esp_err_to_name(r->error), (long)r->error,
+                       r->reset_reason, r->running_version, r->target_version,
+                       (long long)r->start_epoch_ms, r->connections, r->bytes, r->total_bytes,
+                       r->bytes_per_s, r->retries, r->heap_floor, r->end_ms);
+
+    bool first = true;
+    for (int i = 0; i < OTA_STAGE_COUNT && len > 0 && len < (int)size; i++) {
+        if (r->stage_ms[i] == OTA_RECORDER_STAGE_UNSET) {
+            continue;
+        }
+        len += snprintf(buf + len, size - len, "%s\"%s\":%lu", first ? "" : ",", stage_names[i], r->stage_ms[i]);
+        first = false;
+    }
+    if (len > 0 && len < (int)size) {
+        len += snprintf(buf + len, size - len, "}}");
+    }
+    return len;
+}
+
+// ============================================================================
+// NVS 存取
+// ============================================================================
+static void save_record(const ota_record_t* record)
+{
+    char key[8];
+    snprintf(key, sizeof(key), "r%lu", record->attempt % OTA_RECORDER_SLOTS);
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, key, record, sizeof(ota_record_t));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 無法保存 OTA 紀錄: %s", esp_err_to_name(err));
+    }
+}
+
+static bool load_record(uint32_t attempt, ota_record_t* record)
+{
+    char key[8];
+    snprintf(key, sizeof(key), "r%lu", attempt % OTA_RECORDER_SLOTS);
+
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    size_t size = sizeof(ota_record_t);
+    bool loaded = nvs_get_blob(handle, key, record, &size) == ESP_OK && size == sizeof(ota_record_t) &&
+                  record->version == OTA_RECORDER_VERSION && record->attempt == attempt;
+    nvs_close(handle);
+    return loaded;
+}
+
+// esp_restart 前由系統呼叫：保存進行中的紀錄 (仍為 RUNNING，下次開機標記為 INTERRUPTED)
+static void recorder_shutdown_handler(void)
+{
+    if (!active) {
+        return;
+    }
+    ota_record_t snapshot;
+    portENTER_CRITICAL(&recorder_lock);
+    snapshot = current;
+    portEXIT_CRITICAL(&recorder_lock);
+    snapshot.end_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    save_record(&snapshot);
+}
+
+static void save_counter(const char* key, uint32_t value)
+{
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_set_u32(handle, key, value);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
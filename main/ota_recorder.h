@@ -0,0 +1,138 @@
+// ============================================================================
+// ota_recorder.h - OTA 飛行紀錄器模組標頭檔
+// 功能：每次 OTA 嘗試保存一筆精簡紀錄到 NVS 環形區 (保留最近 OTA_RECORDER_SLOTS 筆)：
+//       各階段時間 (連線、標頭、第一個位元組、每 10%、下載結束、驗證、設定啟動分區)、
+//       位元組數、重試次數、速率、堆積下限與最終錯誤 (開始、50%、結束與 esp_restart 時寫入 NVS)；
+//       重啟後 (或失敗後) 連線時
+//       自動上傳尚未上傳的紀錄，供全場比較哪個階段最慢
+// ============================================================================
+
+#ifndef OTA_RECORDER_H
+#define OTA_RECORDER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "ota_update.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define OTA_RECORDER_SLOTS          8           // NVS 保留的嘗試筆數
+#define OTA_RECORDER_STAGE_UNSET    UINT32_MAX  // 尚未到達的階段
+#define OTA_RECORDER_RESULT_RUNNING     0xFE    // 進行中 (未結束即重啟時改為 INTERRUPTED)
+#define OTA_RECORDER_RESULT_INTERRUPTED 0xFF    // 嘗試途中重啟或斷電
+
+// ============================================================================
+// 紀錄階段
+// ============================================================================
+typedef enum {
+    OTA_STAGE_CONNECT = 0,      // 下載連線建立 (多連線時為第一條工作連線，不含 Range 探測)
+    OTA_STAGE_HEADERS,          // 收到下載回應標頭 (同上)
+    OTA_STAGE_FIRST_BYTE,       // 寫入第一段韌體資料
+    OTA_STAGE_PCT10,            // 下載 10% ... 90% (連續 9 個階段)
+    OTA_STAGE_PCT50 = OTA_STAGE_PCT10 + 4,
+    OTA_STAGE_PCT90 = OTA_STAGE_PCT10 + 8,
+    OTA_STAGE_DOWNLOAD_END,     // 下載完成
+    OTA_STAGE_VERIFIED,         // esp_ota_end 驗證完成
+    OTA_STAGE_SET_BOOT,         // 已設定新的啟動分區
+    OTA_STAGE_COUNT
+} ota_stage_t;
+
+// ============================================================================
+// 單次嘗試紀錄 (NVS blob，結構變更時遞增 OTA_RECORDER_VERSION)
+// ============================================================================
+#define OTA_RECORDER_VERSION        1
+
+typedef struct {
+    uint8_t version;
+    uint8_t result;                 // ota_result_t 或 OTA_RECORDER_RESULT_*
+    uint8_t connections;            // 實際使用的連線數
+    uint8_t reset_reason;           // INTERRUPTED 時為重啟原因 (esp_reset_reason_t)
+    uint32_t attempt;               // 嘗試序號 (跨重啟遞增)
+    int64_t start_epoch_ms;         // 開始時的牆鐘時間 (-1 = 尚未同步)
+    uint32_t stage_ms[OTA_STAGE_COUNT]; // 各階段相對開始的時間 (ms)
+    uint32_t end_ms;                // 嘗試結束時間 (ms)
+    uint32_t bytes;                 // 已寫入位元組
+    uint32_t total_bytes;           // 韌體大小 (0 = 未知)
+    uint32_t bytes_per_s;           // 下載速率 (第一個位元組到下載完成)
+    uint32_t heap_floor;            // 嘗試期間的最低可用堆積
+    uint16_t retries;               // 區塊重試與重新連線次數
+    int16_t reserved;
+    int32_t error;                  // 最終的 esp_err_t
+    char running_version[24];       // 嘗試時執行中的韌體版本
+    char target_version[24];        // 映像標頭中的新版本 (未讀到標頭時為空)
+} ota_record_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化紀錄器：載入序號，前一次未結束的紀錄標記為 INTERRUPTED
+ *
+ * @param topic 紀錄上傳主題
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t ota_recorder_init(const char* topic);
+
+/**
+ * @brief 開始一筆新紀錄 (OTA 任務開始時呼叫)
+ *
+ * @param connections 設定的連線數
+ */
+void ota_recorder_begin(uint8_t connections);
+
+/**
+ * @brief 標記到達某個階段 (同一階段只記錄第一次，可由多個任務呼叫)
+ *
+ * 只更新 RAM，到達 OTA_STAGE_PCT50 時才寫入 NVS
+ *
+ * @param stage 階段
+ */
+void ota_recorder_mark(ota_stage_t stage);
+
+/**
+ * @brief 更新已寫入位元組數 (第一個位元組與每 10% 自動標記階段)
+ *
+ * @param bytes 已寫入位元組
+ * @param total_bytes 韌體大小
+ */
+void ota_recorder_progress(uint32_t bytes, uint32_t total_bytes);
+
+/**
+ * @brief 記錄新韌體版本 (讀到映像標頭時)
+ */
+void ota_recorder_set_target(const char* version);
+
+/**
+ * @brief 累加重試次數並記錄實際使用的連線數
+ */
+void ota_recorder_add_retries(uint32_t retries, uint8_t connections);
+
+/**
+ * @brief 結束紀錄並保存 (重啟前必須呼叫)
+ *
+ * @param result OTA 結果
+ * @param error 最終的 esp_err_t
+ */
+void ota_recorder_finish(ota_result_t result, esp_err_t error);
+
+/**
+ * @brief 週期呼叫 (感測器任務)：連線時上傳尚未上傳的已結束紀錄
+ */
+void ota_recorder_poll(void);
+
+/**
+ * @brief 把 NVS 中保留的所有紀錄重新排入上傳
+ *
+ * @return uint32_t 排入的筆數
+ */
+uint32_t ota_recorder_reupload(void);
+
+/**
+ * @brief 取得結果名稱字串
+ */
+const char* ota_recorder_result_name(uint8_t result);
+
+#endif // OTA_RECORDER_H
@@ -0,0 +1,428 @@
+// ============================================================================
+// ota_selftest.c - OTA 效能自我測試模組實作
+// 功能：esp_timer 每秒取樣堆積與 idle 執行時間 (OTA 下載期間的取樣捨棄，
+//       避免下載緩衝區與 TLS 拉低基準)；判定與發布在感測器任務中執行。
+//       新韌體未通過時呼叫 esp_ota_mark_app_invalid_rollback_and_reboot()；
+//       發布相關指標以連線時間計：傳輸層累計連線滿一個時間窗才判定 (斷線期間時間窗延長)，
+//       等待期間重啟時 bootloader 也會回滾
+// ============================================================================
+
+#include "ota_selftest.h"
+#include "ota_update.h"
+#include "power_mgmt.h"
+#include "telemetry_transport.h"
+#include <stdio.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_ota_ops.h"
+#include "esp_app_desc.h"
+#include "nvs.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define NVS_NAMESPACE           "ota_selftest"
+#define NVS_KEY_BASELINE        "baseline"
+#define BASELINE_VERSION        3
+#define RESULT_JSON_SIZE        384
+#define ROLLBACK_DELAY_MS       2000    // 回滾前等待結果送出的時間
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "OTA_SELFTEST";
+
+// ============================================================================
+// NVS 保存的基準 (結構變更時遞增 BASELINE_VERSION)
+// ============================================================================
+typedef struct {
+    uint8_t version;
+    char firmware_version[32];      // 產生基準的韌體版本
+    ota_perf_snapshot_t perf;
+} ota_baseline_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static ota_selftest_config_t selftest_config;
+static const char *result_topic = NULL;
+static esp_timer_handle_t sample_timer = NULL;
+static portMUX_TYPE selftest_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static volatile ota_selftest_state_t selftest_state = OTA_SELFTEST_NONE;
+static bool window_extended = false;
+static ota_baseline_t baseline;
+static bool have_baseline = false;
+
+// 穩態取樣 (由計時器回呼寫入)
+// 堆積下限只取開機後第一個時間窗：下限只會越跑越低，舊韌體若以整段運行時間計算，
+// 與新韌體的時間窗長度不對等，比較會偏向新韌體
+static uint32_t heap_floor = UINT32_MAX;
+static uint32_t heap_window_s = 0;
+static int64_t cpu_window_start_us = 0;
+static uint64_t cpu_window_idle_start = 0;
+static bool cpu_window_tainted = false;
+static uint64_t cpu_busy_sum = 0;
+static uint32_t cpu_windows = 0;
+
+// 發布次數只取傳輸層累計連線滿一個時間窗之前：舊韌體的總次數涵蓋整段運行時間，
+// 新韌體只有一個時間窗，斷線期間的發布又被略過，以相同連線時間比較才對等
+static uint32_t connected_s = 0;
+static bool publish_window_done = false;
+static uint32_t window_publish_ok = 0;
+static uint32_t window_publish_failed = 0;
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void sample_timer_callback(void *arg);
+static bool load_baseline(void);
+static void erase_baseline(void);
+static const char* evaluate(const ota_perf_snapshot_t* now);
+static uint32_t publish_rate_permille(const ota_perf_snapshot_t* perf);
+static void publish_result(bool passed, const char* reason, const ota_perf_snapshot_t* now);
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t ota_selftest_init(const ota_selftest_config_t* config, const char* topic)
+{
+    if (config == NULL || topic == NULL || config->window_s == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&selftest_config, config, sizeof(ota_selftest_config_t));
+    result_topic = topic;
+
+    cpu_window_start_us = esp_timer_get_time();
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    cpu_window_idle_start = ulTaskGetIdleRunTimeCounter();
+#endif
+
+    esp_timer_create_args_t timer_args = {
+        .callback = sample_timer_callback,
+        .name = "ota_selftest",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &sample_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(sample_timer, OTA_SELFTEST_SAMPLE_MS * 1000ULL);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 無法啟動效能取樣計時器: %s", esp_err_to_name(err));
+        return err;
+    }
+    sample_timer_callback(NULL);
+
+    // 只有 bootloader 啟用回滾時，新韌體第一次啟動才會是待驗證狀態
+    esp_ota_img_states_t img_state;
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    if (esp_ota_get_state_partition(running, &img_state) != ESP_OK ||
+        img_state != ESP_OTA_IMG_PENDING_VERIFY) {
+        ESP_LOGI(TAG, "✅ 目前韌體已驗證，持續記錄穩態效能作為下次 OTA 的基準");
+        return ESP_OK;
+    }
+
+    have_baseline = load_baseline();
+    selftest_state = OTA_SELFTEST_RUNNING;
+
+    if (have_baseline) {
+        ESP_LOGW(TAG, "🧪 新韌體待驗證 - 自我測試 %lu 秒連線時間，基準來自 %s (堆積下限 %lu，p99 %lu us)",
+                 config->window_s, baseline.firmware_version,
+                 baseline.perf.heap_floor, baseline.perf.cmd_p99_us);
+    } else {
+        ESP_LOGW(TAG, "🧪 新韌體待驗證 - 自我測試 %lu 秒連線時間 (無舊韌體基準，只檢查能否發布)",
+                 config->window_s);
+    }
+    return ESP_OK;
+}
+
+// ============================================================================
+// 週期判定
+// ============================================================================
+void ota_selftest_poll(void)
+{
+    if (selftest_state != OTA_SELFTEST_RUNNING) {
+        return;
+    }
+
+    ota_perf_snapshot_t now;
+    ota_selftest_snapshot(&now);
+    if (now.publish_window_s < selftest_config.window_s) {
+        // 斷線期間發布被略過，沒有發布不代表新韌體有問題：延長到連線時間足夠再判定
+        if (!window_extended && now.uptime_s >= selftest_config.window_s) {
+            window_extended = true;
+            ESP_LOGW(TAG, "⏳ 時間窗內只連線 %lu 秒，延長自我測試直到累計連線 %lu 秒",
+                     now.publish_window_s, selftest_config.window_s);
+        }
+        return;
+    }
+    const char *reason = evaluate(&now);
+
+    if (reason == NULL) {
+        esp_err_t err = esp_ota_mark_app_valid_cancel_rollback();
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "❌ 無法標記韌體有效: %s", esp_err_to_name(err));
+            return;  // 下次輪詢再試
+        }
+        selftest_state = OTA_SELFTEST_PASSED;
+        erase_baseline();
+        ESP_LOGI(TAG, "✅ 自我測試通過，新韌體已標記為有效");
+        publish_result(true, NULL, &now);
+        return;
+    }
+
+    selftest_state = OTA_SELFTEST_FAILED;
+    ESP_LOGE(TAG, "❌ 自我測試未通過 (%s)，回滾到舊韌體", reason);
+    publish_result(false, reason, &now);
+    vTaskDelay(pdMS_TO_TICKS(ROLLBACK_DELAY_MS));
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+
+    // 只有在沒有可回滾的分區時才會執行到這裡
+    ESP_LOGE(TAG, "❌ 無法回滾 (沒有有效的舊韌體)，保留目前韌體");
+}
+
+// ============================================================================
+// 基準儲存
+// ============================================================================
+esp_err_t ota_selftest_save_baseline(void)
+{
+    ota_baseline_t snapshot = { .version = BASELINE_VERSION };
+    const esp_app_desc_t *app_desc = esp_app_get_description();
+    strncpy(snapshot.firmware_version, app_desc->version, sizeof(snapshot.firmware_version) - 1);
+    ota_selftest_snapshot(&snapshot.perf);
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, NVS_KEY_BASELINE, &snapshot, sizeof(snapshot));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 無法儲存效能基準: %s (新韌體只會檢查能否發布)", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "💾 已儲存效能基準 - 堆積下限 %lu，發布 %lu/%lu，p99 %lu us，CPU %lu‰",
+             snapshot.perf.heap_floor, snapshot.perf.publish_ok,
+             snapshot.perf.publish_ok + snapshot.perf.publish_failed,
+             snapshot.perf.cmd_p99_us, snapshot.perf.cpu_permille);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 查詢介面
+// ============================================================================
+void ota_selftest_snapshot(ota_perf_snapshot_t* snapshot)
+{
+    if (snapshot == NULL) {
+        return;
+    }
+
+    telemetry_stats_t tx_stats;
+    telemetry_get_stats(&tx_stats);
+    power_mgmt_stats_t pm_stats;
+    power_mgmt_get_stats(&pm_stats);
+
+    memset(snapshot, 0, sizeof(ota_perf_snapshot_t));
+    portENTER_CRITICAL(&selftest_lock);
+    snapshot->heap_floor = heap_floor;
+    snapshot->heap_window_s = heap_window_s;
+    snapshot->cpu_permille = cpu_windows > 0 ? (uint32_t)(cpu_busy_sum / cpu_windows) : OTA_SELFTEST_CPU_INVALID;
+    snapshot->publish_window_s = connected_s;
+    if (publish_window_done) {
+        snapshot->publish_ok = window_publish_ok;
+        snapshot->publish_failed = window_publish_failed;
+    } else {
+        snapshot->publish_ok = tx_stats.publish_ok;
+        snapshot->publish_failed = tx_stats.publish_failed;
+    }
+    portEXIT_CRITICAL(&selftest_lock);
+    snapshot->cmd_count = pm_stats.cmd_count;
+    snapshot->cmd_p99_us = pm_stats.cmd_latency_p99_us;
+    snapshot->uptime_s = (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+ota_selftest_state_t ota_selftest_get_state(uint32_t* remaining_s)
+{
+    if (remaining_s != NULL) {
+        portENTER_CRITICAL(&selftest_lock);
+        uint32_t connected = connected_s;
+        portEXIT_CRITICAL(&selftest_lock);
+        *remaining_s = selftest_state == OTA_SELFTEST_RUNNING && connected < selftest_config.window_s
+            ? selftest_config.window_s - connected : 0;
+    }
+    return selftest_state;
+}
+
+const char* ota_selftest_state_name(ota_selftest_state_t state)
+{
+    switch (state) {
+        case OTA_SELFTEST_NONE:    return "none";
+        case OTA_SELFTEST_RUNNING: return "running";
+        case OTA_SELFTEST_PASSED:  return "passed";
+        case OTA_SELFTEST_FAILED:  return "failed";
+        default:                   return "unknown";
+    }
+}
+
+// ============================================================================
+// 穩態取樣 (計時器回呼，不配置記憶體)
+// ============================================================================
+static void sample_timer_callback(void *arg)
+{
+    bool updating = ota_is_updating();
+    uint32_t free_heap = esp_get_free_heap_size();
+    uint32_t uptime_s = (uint32_t)(esp_timer_get_time() / 1000000);
+    bool in_heap_window = uptime_s <= selftest_config.window_s;
+    bool connected = telemetry_is_connected();
+
+    // 連線滿一個時間窗的當下鎖定發布次數 (之後的發布不再計入)
+    telemetry_stats_t tx_stats;
+    bool latch_publishes = !publish_window_done && connected && connected_s + 1 >= selftest_config.window_s;
+    if (latch_publishes) {
+        telemetry_get_stats(&tx_stats);
+    }
+
+    portENTER_CRITICAL(&selftest_lock);
+    if (!publish_window_done && connected) {
+        connected_s++;
+        if (latch_publishes) {
+            window_publish_ok = tx_stats.publish_ok;
+            window_publish_failed = tx_stats.publish_failed;
+            publish_window_done = true;
+        }
+    }
+    if (in_heap_window && !updating && free_heap < heap_floor) {
+        heap_floor = free_heap;
+    }
+    heap_window_s = in_heap_window ? uptime_s : selftest_config.window_s;
+    cpu_window_tainted |= updating;
+    portEXIT_CRITICAL(&selftest_lock);
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    int64_t now_us = esp_timer_get_time();
+    if (now_us - cpu_window_start_us < OTA_SELFTEST_CPU_WINDOW_S * 1000000LL) {
+        return;
+    }
+    uint64_t idle_now = ulTaskGetIdleRunTimeCounter();
+    uint64_t idle_delta = idle_now - cpu_window_idle_start;
+    uint64_t elapsed_us = (uint64_t)(now_us - cpu_window_start_us);
+
+    portENTER_CRITICAL(&selftest_lock);
+    if (!cpu_window_tainted && idle_delta <= elapsed_us) {
+        cpu_busy_sum += 1000 - idle_delta * 1000 / elapsed_us;
+        cpu_windows++;
+    }
+    cpu_window_tainted = false;
+    portEXIT_CRITICAL(&selftest_lock);
+
+    cpu_window_start_us = now_us;
+    cpu_window_idle_start = idle_now;
+#endif
+}
+
+// ============================================================================
+// 與基準比較 (內部函數)
+// 返回：未通過的指標名稱，全部通過時為 NULL
+// ============================================================================
+static const char* evaluate(const ota_perf_snapshot_t* now)
+{
+    uint32_t attempts = now->publish_ok + now->publish_failed;
+
+    // 無論有沒有基準，新韌體至少要能把資料送出去
+    if (now->publish_ok == 0) {
+        return "no_publish";
+    }
+    if (!have_baseline) {
+        return NULL;
+    }
+
+    const ota_perf_snapshot_t *base = &baseline.perf;
+    // 兩邊都是開機後同長度時間窗的下限才比較 (舊韌體開機未滿時間窗就 OTA 時略過)
+    if (base->heap_window_s >= selftest_config.window_s &&
+        now->heap_floor + selftest_config.heap_floor_margin_bytes < base->heap_floor) {
+        return "heap_floor";
+    }
+    // 發布成功率只在兩邊都涵蓋同長度的連線時間時比較
+    if (base->publish_window_s >= selftest_config.window_s &&
+        attempts >= selftest_config.min_publishes &&
+        base->publish_ok + base->publish_failed >= selftest_config.min_publishes &&
+        publish_rate_permille(now) + selftest_config.publish_rate_margin_permille < publish_rate_permille(base)) {
+        return "publish_rate";
+    }
+    if (now->cmd_count >= selftest_config.min_commands && base->cmd_count >= selftest_config.min_commands &&
+        (uint64_t)now->cmd_p99_us > (uint64_t)base->cmd_p99_us * (100 + selftest_config.cmd_p99_budget_pct) / 100 +
+                                    selftest_config.cmd_p99_slack_us) {
+        return "cmd_p99";
+    }
+    if (now->cpu_permille != OTA_SELFTEST_CPU_INVALID && base->cpu_permille != OTA_SELFTEST_CPU_INVALID &&
+        now->cpu_permille > base->cpu_permille + selftest_config.cpu_margin_permille) {
+        return "cpu";
+    }
+    return NULL;
+}
+
+static uint32_t publish_rate_permille(const ota_perf_snapshot_t* perf)
+{
+    uint32_t attempts = perf->publish_ok + perf->publish_failed;
+    return attempts > 0 ? (uint32_t)((uint64_t)perf->publish_ok * 1000 / attempts) : 1000;
+}
+
+// ============================================================================
+// 發布結果 (snprintf，不建立 cJSON 樹)
+// ============================================================================
+static void publish_result(bool passed, const char* reason, const ota_perf_snapshot_t* now)
+{
+    const esp_app_desc_t *app_desc = esp_app_get_description();
+    const ota_perf_snapshot_t *base = &baseline.perf;
+    char json[RESULT_JSON_SIZE];
+    int len = snprintf(json, sizeof(json),
+                       "{\"type\":\"ota_selftest\",\"result\":\"%s\",\"reason\":\"%s\",\"version\":\"%s\","
+                       "\"baseline_version\":\"%s\",\"heap_floor\":[%lu,%lu],\"publish_rate_pm\":[%lu,%lu],"
+                       "\"cmd_p99_us\":[%lu,%lu],\"cpu_pm\":[%ld,%ld],\"window_s\":%lu,\"uptime_s\":%lu}",
+                       passed ? "passed" : "rolled_back", reason != NULL ? reason : "",
+                       app_desc->version, have_baseline ? baseline.firmware_version : "",
+                       have_baseline ? base->heap_floor : 0, now->heap_floor,
+                       have_baseline ? publish_rate_permille(base) : 0, publish_rate_permille(now),
+                       have_baseline ? base->cmd_p99_us : 0, now->cmd_p99_us,
+                       have_baseline && base->cpu_permille != OTA_SELFTEST_CPU_INVALID ? (int32_t)base->cpu_permille : -1,
+                       now->cpu_permille != OTA_SELFTEST_CPU_INVALID ? (int32_t)now->cpu_permille : -1,
+                       selftest_config.window_s, now->uptime_s);
+    if (len > 0 && len < (int)sizeof(json)) {
+        telemetry_publish(result_topic, json, len, 1, 0);
+    }
+}
+
+// ============================================================================
+// NVS 基準存取
+// ============================================================================
+static bool load_baseline(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    size_t size = sizeof(baseline);
+    bool loaded = nvs_get_blob(handle, NVS_KEY_BASELINE, &baseline, &size) == ESP_OK &&
+                  size == sizeof(baseline) && baseline.version == BASELINE_VERSION;
+    nvs_close(handle);
+    return loaded;
+}
+
+static void erase_baseline(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, NVS_KEY_BASELINE);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+}
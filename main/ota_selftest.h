@@ -0,0 +1,107 @@
+// ============================================================================
+// ota_selftest.h - OTA 效能自我測試模組標頭檔
+// 功能：舊韌體在重啟進入新韌體前把穩態效能指標 (開機後第一個時間窗的堆積下限、
+//       發布成功率、指令延遲 p99、CPU 使用率) 存入 NVS；新韌體處於待驗證狀態時，
+//       在自我測試時間窗結束後與基準比較，全部在預算內才標記為有效，
+//       否則自動回滾到舊韌體
+// ============================================================================
+
+#ifndef OTA_SELFTEST_H
+#define OTA_SELFTEST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define OTA_SELFTEST_SAMPLE_MS      1000    // 堆積取樣間隔
+#define OTA_SELFTEST_CPU_WINDOW_S   60      // CPU 使用率的量測區間
+#define OTA_SELFTEST_CPU_INVALID    UINT32_MAX
+
+// ============================================================================
+// 自我測試狀態
+// ============================================================================
+typedef enum {
+    OTA_SELFTEST_NONE = 0,      // 目前韌體已驗證，不需自我測試
+    OTA_SELFTEST_RUNNING,       // 待驗證，自我測試時間窗進行中
+    OTA_SELFTEST_PASSED,        // 已通過並標記為有效
+    OTA_SELFTEST_FAILED,        // 未通過，正在回滾
+} ota_selftest_state_t;
+
+// ============================================================================
+// 效能預算 (新韌體相對舊韌體基準可接受的退化量)
+// ============================================================================
+typedef struct {
+    uint32_t window_s;                      // 自我測試時間窗 (秒)
+    uint32_t heap_floor_margin_bytes;       // 堆積下限可低於基準的量
+    uint32_t publish_rate_margin_permille;  // 發布成功率可低於基準的量 (‰)
+    uint32_t cmd_p99_budget_pct;            // 指令延遲 p99 可高於基準的比例 (%)
+    uint32_t cmd_p99_slack_us;              // p99 的絕對寬限 (基準很低時避免比例過嚴)
+    uint32_t cpu_margin_permille;           // CPU 使用率可高於基準的量 (‰)
+    uint32_t min_publishes;                 // 判定發布成功率所需的最少發布次數
+    uint32_t min_commands;                  // 判定指令 p99 所需的最少指令數
+} ota_selftest_config_t;
+
+// ============================================================================
+// 穩態效能快照 (OTA 下載期間的取樣不計入)
+// ============================================================================
+typedef struct {
+    uint32_t heap_floor;        // 開機後第一個自我測試時間窗內的最低可用堆積 (bytes)
+    uint32_t heap_window_s;     // heap_floor 涵蓋的秒數 (未滿時間窗時不與新韌體比較)
+    uint32_t publish_ok;        // 開機後傳輸層累計連線滿一個時間窗之前的成功發布次數
+    uint32_t publish_failed;    // 同一區間的發布失敗次數
+    uint32_t publish_window_s;  // 上述次數涵蓋的連線秒數 (未滿時間窗時不與新韌體比較)
+    uint32_t cmd_count;         // 已量測的指令數
+    uint32_t cmd_p99_us;        // 指令派送延遲 p99 (us)
+    uint32_t cpu_permille;      // 平均 CPU 使用率 (‰，OTA_SELFTEST_CPU_INVALID 表示未量測)
+    uint32_t uptime_s;          // 快照時的運行時間
+} ota_perf_snapshot_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化自我測試：開始穩態取樣，目前韌體待驗證時載入基準並開始計時
+ *
+ * @param config 效能預算
+ * @param result_topic 自我測試結果發布主題
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t ota_selftest_init(const ota_selftest_config_t* config, const char* result_topic);
+
+/**
+ * @brief 週期呼叫 (感測器任務)：傳輸層累計連線滿一個時間窗時判定並標記有效或回滾
+ */
+void ota_selftest_poll(void);
+
+/**
+ * @brief 新韌體已設為啟動分區後呼叫：把目前韌體的穩態效能存為基準
+ *
+ * @return esp_err_t ESP_OK 表示已儲存
+ */
+esp_err_t ota_selftest_save_baseline(void);
+
+/**
+ * @brief 取得目前韌體的穩態效能快照
+ *
+ * @param snapshot 快照結構指標
+ */
+void ota_selftest_snapshot(ota_perf_snapshot_t* snapshot);
+
+/**
+ * @brief 取得自我測試狀態
+ *
+ * @param remaining_s 進行中時回傳尚需的連線秒數，可為 NULL
+ * @return ota_selftest_state_t 狀態
+ */
+ota_selftest_state_t ota_selftest_get_state(uint32_t* remaining_s);
+
+/**
+ * @brief 取得狀態名稱字串
+ */
+const char* ota_selftest_state_name(ota_selftest_state_t state);
+
+#endif // OTA_SELFTEST_H
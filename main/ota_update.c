@@ -4,6 +4,12 @@
 // ============================================================================
 
 #include "ota_update.h"
+#include "telemetry_transport.h"
+#include "power_mgmt.h"
+#include "ota_selftest.h"
+#include "ota_range.h"
+#include "ota_recorder.h"
+#include "mem_pressure.h"
 #include <string.h>
 #include <stdio.h>
 #include <sys/socket.h>
@@ -58,7 +64,9 @@ typedef struct {
     esp_ota_handle_t update_handle;
     const esp_partition_t *update_partition;
     int binary_file_length;
+    int binary_file_downloaded;
     int image_header_was_checked;
+    bool write_failed;              // 寫入端錯誤 (last_result 已設定)
     esp_app_desc_t new_app_info;
 } ota_context_t;
 
@@ -69,6 +77,9 @@ static void ota_task(void *pvParameter);
 static void ota_update_progress(int percentage, ota_state_t state, const char* message);
 static esp_err_t ota_validate_image_header(esp_app_desc_t *new_app_info);
 static void ota_send_mqtt_status(const char* message);
+static esp_err_t ota_download_single(esp_http_client_handle_t client, ota_context_t *ota_ctx);
+static esp_err_t ota_download_parallel(ota_context_t *ota_ctx, int *connections);
+static esp_err_t ota_write_data(const char *data, int len, void *arg);
 
 // ============================================================================
 // 初始化 OTA 更新模組
@@ -103,6 +114,12 @@ esp_err_t ota_start_update(const ota_config_t* config)
         return ESP_ERR_INVALID_STATE;
     }
     
+    // 目前韌體尚未通過自我測試，沒有可信的效能基準，也可能覆寫回滾用的舊韌體
+    if (ota_selftest_get_state(NULL) == OTA_SELFTEST_RUNNING) {
+        ESP_LOGW(TAG, "⚠️ 目前韌體自我測試中，暫不接受 OTA 更新");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
     ESP_LOGI(TAG, "🔄 啟動 OTA 更新: %s", config->firmware_url);
     
     // 複製配置
@@ -147,6 +164,8 @@ static void ota_task(void *pvParameter)
     memcpy(&ota_ctx.config, config, sizeof(ota_config_t));
     
     ESP_LOGI(TAG, "🚀 OTA 任務開始執行");
+    power_mgmt_acquire(PM_SUBSYS_OTA);  // 下載、寫入與驗證期間維持全速且不淺眠
+    ota_recorder_begin(ota_ctx.config.connections);  // 🔄 新增：各階段時間寫入 NVS，重啟後上傳
     ota_update_progress(0, OTA_STATE_DOWNLOADING, "開始下載韌體");
     
     // 設定 HTTP 客戶端配置
@@ -191,105 +210,46 @@ static void ota_task(void *pvParameter)
         goto ota_end;
     }
     
-    // 執行 HTTP GET 請求
-    err = esp_http_client_open(client, 0);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "❌ 無法連接到伺服器: %s", esp_err_to_name(err));
-        current_state = OTA_STATE_ERROR;
-        ota_stats.failed_updates++;
-        ota_stats.last_result = OTA_RESULT_NETWORK_ERROR;
-        goto ota_end;
+    // 🔄 新增：高延遲鏈路可用多條 Range 連線並行下載 (記憶體吃緊時維持單一連線)
+    int connections = ota_ctx.config.connections;
+    if (connections > 1 && mem_pressure_get_tier() >= MEM_PRESSURE_ELEVATED) {
+        ESP_LOGW(TAG, "⚠️ 記憶體壓力 %s，改用單一連線下載", mem_pressure_tier_name(mem_pressure_get_tier()));
+        connections = 1;
     }
     
-    int content_length = esp_http_client_fetch_headers(client);
-    if (content_length < 0) {
-        ESP_LOGE(TAG, "❌ HTTP 客戶端取得檔案長度失敗");
-        current_state = OTA_STATE_ERROR;
-        ota_stats.failed_updates++;
-        ota_stats.last_result = OTA_RESULT_DOWNLOAD_ERROR;
-        goto ota_end;
+    int64_t download_start_us = esp_timer_get_time();
+    err = ESP_ERR_NOT_SUPPORTED;
+    if (connections > 1) {
+        err = ota_download_parallel(&ota_ctx, &connections);
+        if (err == ESP_ERR_NOT_SUPPORTED) {
+            ESP_LOGW(TAG, "⚠️ 伺服器不支援 Range，改用單一連線下載");
+        }
     }
-    
-    ESP_LOGI(TAG, "📊 韌體大小: %d bytes", content_length);
-    ota_ctx.binary_file_length = content_length;
-    
-    int binary_file_downloaded = 0;
-    char *ota_write_data = malloc(OTA_BUFFER_SIZE);
-    if (!ota_write_data) {
-        ESP_LOGE(TAG, "❌ 無法分配 OTA 緩衝區記憶體");
-        current_state = OTA_STATE_ERROR;
-        ota_stats.failed_updates++;
-        ota_stats.last_result = OTA_RESULT_MEMORY_ERROR;
-        goto ota_end;
+    if (err == ESP_ERR_NOT_SUPPORTED) {
+        connections = 1;
+        err = ota_download_single(client, &ota_ctx);
     }
+    ota_recorder_add_retries(0, connections);
     
-    // 下載和寫入韌體數據
-    while (1) {
+    if (err != ESP_OK) {
         if (cancel_requested) {
             ESP_LOGW(TAG, "⚠️ 使用者取消 OTA 更新");
-            current_state = OTA_STATE_ERROR;
-            ota_stats.failed_updates++;
-            ota_stats.last_result = OTA_RESULT_DOWNLOAD_ERROR;
-            break;
-        }
-        
-        int data_read = esp_http_client_read(client, ota_write_data, OTA_BUFFER_SIZE);
-        if (data_read < 0) {
-            ESP_LOGE(TAG, "❌ HTTP 下載資料錯誤");
-            current_state = OTA_STATE_ERROR;
-            ota_stats.failed_updates++;
             ota_stats.last_result = OTA_RESULT_DOWNLOAD_ERROR;
-            break;
-        } else if (data_read > 0) {
-            // 檢查韌體標頭 (僅第一次)
-            if (ota_ctx.image_header_was_checked == false) {
-                esp_app_desc_t new_app_info;
-                if (data_read > sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
-                    memcpy(&new_app_info, &ota_write_data[sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t)], sizeof(esp_app_desc_t));
-                    ESP_LOGI(TAG, "🔍 新韌體版本: %s", new_app_info.version);
-                    
-                    esp_err_t validate_err = ota_validate_image_header(&new_app_info);
-                    if (validate_err != ESP_OK) {
-                        current_state = OTA_STATE_ERROR;
-                        ota_stats.failed_updates++;
-                        ota_stats.last_result = OTA_RESULT_VERIFY_ERROR;
-                        break;
-                    }
-                    memcpy(&ota_ctx.new_app_info, &new_app_info, sizeof(esp_app_desc_t));
-                    ota_ctx.image_header_was_checked = true;
-                }
-            }
-            
-            // 寫入韌體資料到 flash
-            err = esp_ota_write(ota_ctx.update_handle, (const void *)ota_write_data, data_read);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "❌ esp_ota_write 失敗: %s", esp_err_to_name(err));
-                current_state = OTA_STATE_ERROR;
-                ota_stats.failed_updates++;
-                ota_stats.last_result = OTA_RESULT_INSTALL_ERROR;
-                break;
-            }
-            
-            binary_file_downloaded += data_read;
-            
-            // 更新進度
-            int progress = (binary_file_downloaded * 100) / ota_ctx.binary_file_length;
-            current_progress = progress;
-            
-            if (progress % 10 == 0 && progress > 0) {
-                char progress_msg[64];
-                snprintf(progress_msg, sizeof(progress_msg), "下載進度: %d%%", progress);
-                ota_update_progress(progress, OTA_STATE_DOWNLOADING, progress_msg);
-            }
-            
-        } else if (data_read == 0) {
-            ESP_LOGI(TAG, "✅ 韌體下載完成 (%d bytes)", binary_file_downloaded);
-            break;
         }
+        current_state = OTA_STATE_ERROR;
+        ota_stats.failed_updates++;
+    } else {
+        ota_recorder_mark(OTA_STAGE_DOWNLOAD_END);
+        uint32_t download_ms = (uint32_t)((esp_timer_get_time() - download_start_us) / 1000);
+        ota_stats.last_download_ms = download_ms;
+        ota_stats.last_download_bytes_per_s = download_ms > 0 ?
+            (uint32_t)((uint64_t)ota_ctx.binary_file_downloaded * 1000 / download_ms) : 0;
+        ota_stats.last_connections = connections;
+        ESP_LOGI(TAG, "✅ 韌體下載完成 (%d bytes，%lu ms，%lu KB/s，%d 條連線)",
+                 ota_ctx.binary_file_downloaded, download_ms,
+                 ota_stats.last_download_bytes_per_s / 1024, connections);
     }
     
-    free(ota_write_data);
-    
     if (current_state != OTA_STATE_ERROR) {
         current_state = OTA_STATE_VERIFYING;
         ota_update_progress(95, OTA_STATE_VERIFYING, "驗證韌體完整性");
@@ -307,6 +267,7 @@ static void ota_task(void *pvParameter)
             current_state = OTA_STATE_ERROR;
             ota_stats.failed_updates++;
         } else {
+            ota_recorder_mark(OTA_STAGE_VERIFIED);
             current_state = OTA_STATE_INSTALLING;
             ota_update_progress(98, OTA_STATE_INSTALLING, "安裝新韌體");
             
@@ -318,6 +279,11 @@ static void ota_task(void *pvParameter)
                 ota_stats.failed_updates++;
                 ota_stats.last_result = OTA_RESULT_INSTALL_ERROR;
             } else {
+                ota_recorder_mark(OTA_STAGE_SET_BOOT);
+                
+                // 重啟前保存目前韌體的穩態效能，新韌體以此判定是否回滾
+                ota_selftest_save_baseline();
+                
                 current_state = OTA_STATE_SUCCESS;
                 ota_stats.successful_updates++;
                 ota_stats.last_result = OTA_RESULT_SUCCESS;
@@ -326,6 +292,7 @@ static void ota_task(void *pvParameter)
                 
                 ota_update_progress(100, OTA_STATE_SUCCESS, "更新完成！");
                 ESP_LOGI(TAG, "✅ OTA 更新成功！準備重啟...");
+                ota_recorder_finish(OTA_RESULT_SUCCESS, ESP_OK);  // 須在重啟前保存
                 
                 if (ota_ctx.config.auto_reboot) {
                     ota_send_mqtt_status("✅ OTA 更新成功！將在 3 秒後重啟...");
@@ -342,6 +309,7 @@ ota_end:
     }
     
     if (current_state == OTA_STATE_ERROR) {
+        ota_recorder_finish(ota_stats.last_result, err != ESP_OK ? err : ESP_FAIL);
         char error_msg[128];
         snprintf(error_msg, sizeof(error_msg), 
                 "❌ OTA 更新失敗 (錯誤代碼: %d)", ota_stats.last_result);
@@ -349,11 +317,162 @@ ota_end:
         ESP_LOGE(TAG, "❌ OTA 更新失敗");
     }
     
+    power_mgmt_release(PM_SUBSYS_OTA);
+    
     // 清理任務句柄
     ota_task_handle = NULL;
     vTaskDelete(NULL);
 }
 
+// ============================================================================
+// 單一連線下載 (循序讀取並寫入)
+// ============================================================================
+static esp_err_t ota_download_single(esp_http_client_handle_t client, ota_context_t *ota_ctx)
+{
+    // 執行 HTTP GET 請求
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 無法連接到伺服器: %s", esp_err_to_name(err));
+        ota_stats.last_result = OTA_RESULT_NETWORK_ERROR;
+        return err;
+    }
+    ota_recorder_mark(OTA_STAGE_CONNECT);
+    
+    int content_length = esp_http_client_fetch_headers(client);
+    if (content_length < 0) {
+        ESP_LOGE(TAG, "❌ HTTP 客戶端取得檔案長度失敗");
+        ota_stats.last_result = OTA_RESULT_DOWNLOAD_ERROR;
+        return ESP_FAIL;
+    }
+    ota_recorder_mark(OTA_STAGE_HEADERS);
+    
+    ESP_LOGI(TAG, "📊 韌體大小: %d bytes", content_length);
+    ota_ctx->binary_file_length = content_length;
+    
+    char *buffer = malloc(OTA_BUFFER_SIZE);
+    if (!buffer) {
+        ESP_LOGE(TAG, "❌ 無法分配 OTA 緩衝區記憶體");
+        ota_stats.last_result = OTA_RESULT_MEMORY_ERROR;
+        return ESP_ERR_NO_MEM;
+    }
+    
+    // 下載和寫入韌體數據
+    while (1) {
+        if (cancel_requested) {
+            err = ESP_ERR_INVALID_STATE;
+            break;
+        }
+        
+        int data_read = esp_http_client_read(client, buffer, OTA_BUFFER_SIZE);
+        if (data_read < 0) {
+            ESP_LOGE(TAG, "❌ HTTP 下載資料錯誤");
+            ota_stats.last_result = OTA_RESULT_DOWNLOAD_ERROR;
+            err = ESP_FAIL;
+            break;
+        } else if (data_read > 0) {
+            err = ota_write_data(buffer, data_read, ota_ctx);
+            if (err != ESP_OK) {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+    
+    free(buffer);
+    return err;
+}
+
+// ============================================================================
+// 多連線下載 (ota_range 依序回呼 ota_write_data)
+// ============================================================================
+// connections 輸入設定的連線數，輸出實際建立的連線數
+static esp_err_t ota_download_parallel(ota_context_t *ota_ctx, int *connections)
+{
+    uint32_t timeout_ms = ota_ctx->config.timeout_ms > 0 ? ota_ctx->config.timeout_ms : OTA_RECV_TIMEOUT;
+    int content_length = 0;
+    esp_err_t err = ota_range_probe(ota_ctx->config.firmware_url, timeout_ms, &content_length);
+    if (err != ESP_OK) {
+        // 連線失敗時單一連線多半也會失敗，仍交給單一連線路徑判定與回報
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    
+    ESP_LOGI(TAG, "📊 韌體大小: %d bytes (%d 條 Range 連線)", content_length, *connections);
+    ota_ctx->binary_file_length = content_length;
+    
+    ota_range_config_t range_config = {
+        .url = ota_ctx->config.firmware_url,
+        .connections = *connections,
+        .timeout_ms = timeout_ms,
+        .content_length = content_length,
+        .cancel = &cancel_requested,
+    };
+    ota_range_stats_t range_stats = {0};
+    err = ota_range_download(&range_config, ota_write_data, ota_ctx, &range_stats);
+    if (range_stats.connections > 0) {
+        *connections = range_stats.connections;
+    }
+    ota_recorder_add_retries(range_stats.retries, *connections);
+    if (err == ESP_ERR_NOT_SUPPORTED && ota_ctx->binary_file_downloaded > 0) {
+        err = ESP_FAIL;  // 已寫入部分資料，不能再改用單一連線從頭寫
+    }
+    if (err != ESP_OK && err != ESP_ERR_NOT_SUPPORTED && !ota_ctx->write_failed) {
+        ota_stats.last_result = err == ESP_ERR_NO_MEM ? OTA_RESULT_MEMORY_ERROR : OTA_RESULT_DOWNLOAD_ERROR;
+    }
+    return err;
+}
+
+// ============================================================================
+// 寫入一段連續的韌體資料 (第一段檢查標頭)，並更新進度
+// ============================================================================
+static esp_err_t ota_write_data(const char *data, int len, void *arg)
+{
+    ota_context_t *ota_ctx = (ota_context_t *)arg;
+    
+    // 檢查韌體標頭 (僅第一次)
+    if (ota_ctx->image_header_was_checked == false) {
+        esp_app_desc_t new_app_info;
+        if (len > sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
+            memcpy(&new_app_info, &data[sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t)], sizeof(esp_app_desc_t));
+            ESP_LOGI(TAG, "🔍 新韌體版本: %s", new_app_info.version);
+            
+            esp_err_t validate_err = ota_validate_image_header(&new_app_info);
+            if (validate_err != ESP_OK) {
+                ota_stats.last_result = OTA_RESULT_VERIFY_ERROR;
+                ota_ctx->write_failed = true;
+                return validate_err;
+            }
+            memcpy(&ota_ctx->new_app_info, &new_app_info, sizeof(esp_app_desc_t));
+            ota_ctx->image_header_was_checked = true;
+            ota_recorder_set_target(new_app_info.version);
+        }
+    }
+    
+    // 寫入韌體資料到 flash
+    esp_err_t err = esp_ota_write(ota_ctx->update_handle, (const void *)data, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ esp_ota_write 失敗: %s", esp_err_to_name(err));
+        ota_stats.last_result = OTA_RESULT_INSTALL_ERROR;
+        ota_ctx->write_failed = true;
+        return err;
+    }
+    
+    ota_ctx->binary_file_downloaded += len;
+    ota_recorder_progress(ota_ctx->binary_file_downloaded, ota_ctx->binary_file_length);
+    
+    // 更新進度
+    int progress = (ota_ctx->binary_file_downloaded * 100) / ota_ctx->binary_file_length;
+    current_progress = progress;
+    
+    if (progress % 10 == 0 && progress > 0) {
+        char progress_msg[64];
+        snprintf(progress_msg, sizeof(progress_msg), "下載進度: %d%%", progress);
+        ota_update_progress(progress, OTA_STATE_DOWNLOADING, progress_msg);
+    }
+    
+    return ESP_OK;
+}
+
 // ============================================================================
 // 驗證韌體映像標頭
 // ============================================================================
@@ -398,10 +517,8 @@ static void ota_update_progress(int percentage, ota_state_t state, const char* m
 // ============================================================================
 static void ota_send_mqtt_status(const char* message)
 {
-    esp_mqtt_client_handle_t client = get_mqtt_client();
-    if (client && message) {
-        esp_mqtt_client_publish(client, "soilsensorcapture/esp/ota_status", 
-                               message, 0, 0, 0);
+    if (message) {
+        telemetry_publish("soilsensorcapture/esp/ota_status", message, 0, 0, 0);
     }
 }
 
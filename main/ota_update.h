@@ -49,6 +49,7 @@ typedef struct {
     char version[32];               // 目標版本號
     bool auto_reboot;               // 更新完成後是否自動重啟
     uint32_t timeout_ms;            // 下載超時時間 (毫秒)
+    uint8_t connections;            // 並行 HTTP Range 連線數 (0/1 = 單一連線，最多 4)
     ota_progress_callback_t callback; // 進度回調函數
 } ota_config_t;
 
@@ -62,6 +63,9 @@ typedef struct {
     uint32_t last_update_time;      // 上次更新時間戳
     char last_version[32];          // 上次更新版本
     ota_result_t last_result;       // 上次更新結果
+    uint32_t last_download_ms;      // 上次下載時間
+    uint32_t last_download_bytes_per_s; // 上次下載速率
+    uint8_t last_connections;       // 上次實際使用的連線數 (不支援 Range 時退回 1)
 } ota_statistics_t;
 
 // ============================================================================
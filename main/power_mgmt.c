@@ -0,0 +1,242 @@
+// ============================================================================
+// power_mgmt.c - 電源管理模組實作
+// 功能：每個子系統以參考計數包裝 esp_pm 鎖，計數由 0→1 時取得、1→0 時釋放，
+//       並在同一時點累計持鎖時間；統計以 portMUX 保護，可由任何任務呼叫
+// ============================================================================
+
+#include "power_mgmt.h"
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define PM_MAX_LOCKS_PER_SUBSYS     2
+#define CMD_LATENCY_BUCKETS         25      // 2 的冪次分桶：[2^i, 2^(i+1)) us，最後一桶約 16 s 以上
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "POWER_MGMT";
+
+// ============================================================================
+// 子系統鎖設定
+// ============================================================================
+typedef struct {
+    const char *name;
+    uint8_t lock_count;
+    esp_pm_lock_type_t types[PM_MAX_LOCKS_PER_SUBSYS];
+} pm_subsys_desc_t;
+
+static const pm_subsys_desc_t subsys_desc[PM_SUBSYS_COUNT] = {
+    // ADC 取樣時序依賴 APB 時脈，APB 鎖同時會阻止淺眠
+    [PM_SUBSYS_ADC]    = { "adc",    1, { ESP_PM_APB_FREQ_MAX } },
+    [PM_SUBSYS_ENCODE] = { "encode", 1, { ESP_PM_CPU_FREQ_MAX } },
+    // 握手的非對稱運算在低頻下會拖長數秒，容易觸發 broker 逾時
+    [PM_SUBSYS_TLS]    = { "tls",    1, { ESP_PM_CPU_FREQ_MAX } },
+    // OTA 下載期間淺眠會讓 WiFi 掉封包，直接禁止
+    [PM_SUBSYS_OTA]    = { "ota",    2, { ESP_PM_CPU_FREQ_MAX, ESP_PM_NO_LIGHT_SLEEP } },
+    // 脈衝頻率僅數百 Hz，低頻 CPU 即可處理，只需保持清醒
+    [PM_SUBSYS_FLOW]   = { "flow",   1, { ESP_PM_NO_LIGHT_SLEEP } },
+};
+
+typedef struct {
+    esp_pm_lock_handle_t handles[PM_MAX_LOCKS_PER_SUBSYS];
+    uint32_t refcount;
+    int64_t held_since_us;
+    pm_lock_stats_t stats;
+} pm_subsys_state_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static pm_subsys_state_t subsys_state[PM_SUBSYS_COUNT];
+static bool pm_enabled = false;
+static int pm_max_freq_mhz = 0;
+static int pm_min_freq_mhz = 0;
+static bool pm_light_sleep = false;
+static uint32_t cmd_count = 0;
+static uint64_t cmd_latency_total_us = 0;
+static uint32_t cmd_latency_max_us = 0;
+static uint32_t cmd_latency_hist[CMD_LATENCY_BUCKETS];
+static portMUX_TYPE pm_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t power_mgmt_init(int max_freq_mhz, int min_freq_mhz, bool light_sleep)
+{
+    pm_max_freq_mhz = max_freq_mhz;
+    pm_min_freq_mhz = min_freq_mhz;
+    pm_light_sleep = light_sleep;
+
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = max_freq_mhz,
+        .min_freq_mhz = min_freq_mhz,
+        .light_sleep_enable = light_sleep,
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 電源管理設定失敗: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    for (int s = 0; s < PM_SUBSYS_COUNT; s++) {
+        for (int l = 0; l < subsys_desc[s].lock_count; l++) {
+            err = esp_pm_lock_create(subsys_desc[s].types[l], 0, subsys_desc[s].name,
+                                     &subsys_state[s].handles[l]);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "❌ 建立 %s 電源鎖失敗: %s", subsys_desc[s].name, esp_err_to_name(err));
+                return err;
+            }
+        }
+    }
+
+    pm_enabled = true;
+    ESP_LOGI(TAG, "✅ 電源管理已啟用 (%d-%d MHz，淺眠%s)",
+             min_freq_mhz, max_freq_mhz, light_sleep ? "開啟" : "關閉");
+#if !CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    if (light_sleep) {
+        ESP_LOGW(TAG, "⚠️ 未啟用 CONFIG_FREERTOS_USE_TICKLESS_IDLE，自動淺眠不會生效");
+    }
+#endif
+    return ESP_OK;
+#else
+    ESP_LOGW(TAG, "⚠️ 韌體未啟用 CONFIG_PM_ENABLE，只記錄持鎖統計");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+// ============================================================================
+// 取得 / 釋放子系統鎖
+// ============================================================================
+void power_mgmt_acquire(pm_subsys_t subsys)
+{
+    if (subsys >= PM_SUBSYS_COUNT) {
+        return;
+    }
+    pm_subsys_state_t *state = &subsys_state[subsys];
+
+    portENTER_CRITICAL(&pm_lock);
+    bool first = (state->refcount++ == 0);
+    if (first) {
+        state->held_since_us = esp_timer_get_time();
+        state->stats.acquisitions++;
+        state->stats.held = true;
+    }
+    portEXIT_CRITICAL(&pm_lock);
+
+    // esp_pm 鎖本身也有參考計數，但只在 0→1 時取得可讓持鎖時間與實際調頻一致
+    if (first && pm_enabled) {
+        for (int l = 0; l < subsys_desc[subsys].lock_count; l++) {
+            esp_pm_lock_acquire(state->handles[l]);
+        }
+    }
+}
+
+void power_mgmt_release(pm_subsys_t subsys)
+{
+    if (subsys >= PM_SUBSYS_COUNT) {
+        return;
+    }
+    pm_subsys_state_t *state = &subsys_state[subsys];
+
+    portENTER_CRITICAL(&pm_lock);
+    bool last = false;
+    if (state->refcount > 0 && --state->refcount == 0) {
+        last = true;
+        uint32_t held_us = (uint32_t)(esp_timer_get_time() - state->held_since_us);
+        state->stats.hold_us += held_us;
+        if (held_us > state->stats.max_hold_us) {
+            state->stats.max_hold_us = held_us;
+        }
+        state->stats.held = false;
+    }
+    portEXIT_CRITICAL(&pm_lock);
+
+    if (last && pm_enabled) {
+        for (int l = 0; l < subsys_desc[subsys].lock_count; l++) {
+            esp_pm_lock_release(state->handles[l]);
+        }
+    }
+}
+
+// ============================================================================
+// 指令派送延遲
+// ============================================================================
+void power_mgmt_record_command_latency(uint32_t latency_us)
+{
+    portENTER_CRITICAL(&pm_lock);
+    cmd_count++;
+    cmd_latency_total_us += latency_us;
+    if (latency_us > cmd_latency_max_us) {
+        cmd_latency_max_us = latency_us;
+    }
+    int bucket = 0;
+    while (bucket < CMD_LATENCY_BUCKETS - 1 && (latency_us >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    cmd_latency_hist[bucket]++;
+    portEXIT_CRITICAL(&pm_lock);
+}
+
+// ============================================================================
+// 查詢介面
+// ============================================================================
+void power_mgmt_get_stats(power_mgmt_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    memset(stats, 0, sizeof(power_mgmt_stats_t));
+    stats->enabled = pm_enabled;
+    stats->max_freq_mhz = pm_max_freq_mhz;
+    stats->min_freq_mhz = pm_min_freq_mhz;
+    stats->light_sleep = pm_light_sleep;
+
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&pm_lock);
+    for (int s = 0; s < PM_SUBSYS_COUNT; s++) {
+        stats->locks[s] = subsys_state[s].stats;
+        if (subsys_state[s].refcount > 0) {
+            stats->locks[s].hold_us += (uint64_t)(now_us - subsys_state[s].held_since_us);
+        }
+    }
+    stats->cmd_count = cmd_count;
+    stats->cmd_latency_avg_us = cmd_count > 0 ? (uint32_t)(cmd_latency_total_us / cmd_count) : 0;
+    stats->cmd_latency_max_us = cmd_latency_max_us;
+    // p99 取所在分桶的上界 (不超過實測最大值)，高估至多一倍
+    uint32_t rank = cmd_count - cmd_count / 100;
+    uint32_t cumulative = 0;
+    for (int b = 0; b < CMD_LATENCY_BUCKETS && cmd_count > 0; b++) {
+        cumulative += cmd_latency_hist[b];
+        if (cumulative >= rank) {
+            uint32_t upper = (2u << b) - 1;
+            stats->cmd_latency_p99_us = upper < cmd_latency_max_us ? upper : cmd_latency_max_us;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&pm_lock);
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    // idle 任務的執行時間即 CPU 可進入淺眠 / 降頻的時間，清醒比例可作為平均電流的代理指標
+    uint64_t idle_us = ulTaskGetIdleRunTimeCounter();
+    if (now_us > 0 && idle_us <= (uint64_t)now_us) {
+        stats->awake_permille = (int32_t)(1000 - idle_us * 1000 / (uint64_t)now_us);
+    }
+#else
+    stats->awake_permille = -1;
+#endif
+}
+
+const char* power_mgmt_subsys_name(pm_subsys_t subsys)
+{
+    return subsys < PM_SUBSYS_COUNT ? subsys_desc[subsys].name : "unknown";
+}
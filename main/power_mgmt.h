@@ -0,0 +1,105 @@
+// ============================================================================
+// power_mgmt.h - 電源管理模組標頭檔
+// 功能：啟用動態調頻 (DFS) 與自動淺眠，只在 ADC 擷取、資料編碼、
+//       TLS 連線與 OTA 期間持有電源管理鎖，並統計各子系統的持鎖時間、
+//       CPU 清醒比例與指令派送延遲，用於評估省電設定的代價
+// ============================================================================
+
+#ifndef POWER_MGMT_H
+#define POWER_MGMT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 持鎖子系統
+// ============================================================================
+typedef enum {
+    PM_SUBSYS_ADC = 0,      // ADC 擷取 (APB 最高頻率，擷取期間不進淺眠)
+    PM_SUBSYS_ENCODE,       // JSON 編碼與發布 (CPU 最高頻率)
+    PM_SUBSYS_TLS,          // MQTT/TLS 連線握手 (CPU 最高頻率)
+    PM_SUBSYS_OTA,          // OTA 下載與寫入 (CPU 最高頻率且禁止淺眠)
+    PM_SUBSYS_FLOW,         // 流量計脈衝計數 (禁止淺眠，淺眠期間 GPIO 中斷會漏計)
+    PM_SUBSYS_COUNT,
+} pm_subsys_t;
+
+// ============================================================================
+// 單一子系統的持鎖統計
+// ============================================================================
+typedef struct {
+    uint32_t acquisitions;      // 取得鎖次數 (巢狀取得只計第一次)
+    uint64_t hold_us;           // 累計持鎖時間 (us，含目前持有中的時段)
+    uint32_t max_hold_us;       // 單次最長持鎖時間 (us)
+    bool held;                  // 目前是否持有
+} pm_lock_stats_t;
+
+// ============================================================================
+// 電源管理統計
+// ============================================================================
+typedef struct {
+    bool enabled;                               // esp_pm_configure 是否成功
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep;
+    int32_t awake_permille;                     // 開機以來 CPU 非 idle 比例 (‰)，-1 表示未啟用執行時間統計
+    pm_lock_stats_t locks[PM_SUBSYS_COUNT];
+    uint32_t cmd_count;                         // 已量測的指令數
+    uint32_t cmd_latency_avg_us;                // 指令從收到到開始執行的平均延遲 (us)
+    uint32_t cmd_latency_max_us;                // 指令派送最大延遲 (us)
+    uint32_t cmd_latency_p99_us;                // 指令派送延遲 p99 (us，以 2 的冪次分桶估計上界)
+} power_mgmt_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 設定動態調頻與自動淺眠並建立各子系統的電源管理鎖
+ *
+ * 未啟用 CONFIG_PM_ENABLE 時仍會記錄持鎖統計，只是不會實際調頻
+ *
+ * @param max_freq_mhz CPU 最高頻率 (MHz)
+ * @param min_freq_mhz CPU 最低頻率 (MHz，通常為 XTAL 頻率)
+ * @param light_sleep 是否允許 idle 時自動淺眠
+ * @return esp_err_t ESP_OK 表示成功，ESP_ERR_NOT_SUPPORTED 表示韌體未啟用電源管理
+ */
+esp_err_t power_mgmt_init(int max_freq_mhz, int min_freq_mhz, bool light_sleep);
+
+/**
+ * @brief 取得子系統的電源管理鎖 (可巢狀，需與 power_mgmt_release 成對)
+ *
+ * @param subsys 子系統
+ */
+void power_mgmt_acquire(pm_subsys_t subsys);
+
+/**
+ * @brief 釋放子系統的電源管理鎖
+ *
+ * @param subsys 子系統
+ */
+void power_mgmt_release(pm_subsys_t subsys);
+
+/**
+ * @brief 記錄一筆指令派送延遲 (由指令處理任務呼叫)
+ *
+ * @param latency_us 從收到指令到開始執行的時間 (us)
+ */
+void power_mgmt_record_command_latency(uint32_t latency_us);
+
+/**
+ * @brief 取得電源管理統計
+ *
+ * @param stats 統計資訊結構指標
+ */
+void power_mgmt_get_stats(power_mgmt_stats_t* stats);
+
+/**
+ * @brief 子系統名稱 (用於狀態 JSON 與 metrics 標籤)
+ *
+ * @param subsys 子系統
+ * @return const char* 名稱字串
+ */
+const char* power_mgmt_subsys_name(pm_subsys_t subsys);
+
+#endif // POWER_MGMT_H
@@ -0,0 +1,247 @@
+// ============================================================================
+// pump_control.c - 泵浦開關控制模組實作
+// 功能：啟用 CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD 時關閉計時器以 ISR 派送，
+//       否則在最高優先順序的 esp_timer 任務中執行；兩者都不依賴指令任務被排程，
+//       指令任務停滯或被餓死時泵浦仍會在時間到時關閉
+// ============================================================================
+
+#include "pump_control.h"
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+#define PUMP_TIMER_DISPATCH     ESP_TIMER_ISR
+// ISR 中關閉泵浦要在 flash 快取停用時 (NVS / OTA 寫入) 也能執行，gpio_set_level 必須在 IRAM
+#if !CONFIG_GPIO_CTRL_FUNC_IN_IRAM
+#error "ISR 派送的泵浦關閉計時器需要 CONFIG_GPIO_CTRL_FUNC_IN_IRAM=y (見 sdkconfig.defaults)"
+#endif
+#else
+#define PUMP_TIMER_DISPATCH     ESP_TIMER_TASK
+#endif
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "PUMP_CTRL";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static pump_control_config_t pump_config;
+static esp_timer_handle_t off_timer = NULL;
+static portMUX_TYPE pump_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool pump_on = false;
+static int64_t started_us = 0;
+static uint32_t target_ms = 0;
+static TaskHandle_t off_waiter = NULL;
+static uint32_t reported_violations = 0;    // 已記錄日誌的違規次數 (ISR 中不寫日誌，以 pump_lock 保護)
+static pump_control_stats_t stats;
+
+// 分格上限由 ISR 中的 pump_off_locked 查表，放 DRAM (const 預設在 flash .rodata，快取停用時讀取會當機)
+static const DRAM_ATTR uint32_t jitter_le_us[PUMP_JITTER_BUCKETS] = PUMP_JITTER_BUCKET_LE_US;
+static const DRAM_ATTR uint32_t on_time_le_ms[PUMP_ON_TIME_BUCKETS] = PUMP_ON_TIME_BUCKET_LE_MS;
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void pump_off_timer_cb(void *arg);
+static void pump_off_locked(int64_t now_us, bool by_timer);
+static void report_violations(void);
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t pump_control_init(const pump_control_config_t* config)
+{
+    if (config == NULL || config->max_on_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pump_config = *config;
+
+    pump_stats_reset(&stats);
+    stats.isr_dispatch = PUMP_TIMER_DISPATCH == ESP_TIMER_ISR;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = pump_off_timer_cb,
+        .dispatch_method = PUMP_TIMER_DISPATCH,
+        .name = "pump_off",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &off_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 無法建立泵浦關閉計時器: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    if (!pump_config.mock) {
+        gpio_set_level(pump_config.gpio, 0);
+    }
+
+    ESP_LOGI(TAG, "✅ 泵浦控制初始化完成 (GPIO%d，上限 %lu ms，%s 派送%s)",
+             pump_config.gpio, pump_config.max_on_ms, stats.isr_dispatch ? "ISR" : "任務",
+             pump_config.mock ? "，模擬" : "");
+    return ESP_OK;
+}
+
+// ============================================================================
+// 開啟 / 關閉
+// ============================================================================
+esp_err_t pump_control_start(uint32_t on_ms)
+{
+    if (off_timer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (on_ms == 0 || on_ms > pump_config.max_on_ms) {
+        on_ms = pump_config.max_on_ms;
+    }
+
+    portENTER_CRITICAL_SAFE(&pump_lock);
+    bool busy = pump_on;
+    if (!busy) {
+        pump_on = true;
+        target_ms = on_ms;
+        if (!pump_config.mock) {
+            gpio_set_level(pump_config.gpio, 1);
+        }
+        started_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL_SAFE(&pump_lock);
+
+    if (busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // 計時器啟動失敗時不能讓泵浦無人看管
+    esp_err_t err = esp_timer_start_once(off_timer, (uint64_t)on_ms * 1000);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 無法啟動泵浦關閉計時器，立即關閉泵浦: %s", esp_err_to_name(err));
+        pump_control_stop();
+        return err;
+    }
+
+    ESP_LOGI(TAG, "💧 泵浦開啟 - %lu ms 後由計時器關閉", on_ms);
+    return ESP_OK;
+}
+
+uint32_t pump_control_stop(void)
+{
+    esp_timer_stop(off_timer);  // 已觸發或未啟動時回傳錯誤，可忽略
+
+    portENTER_CRITICAL_SAFE(&pump_lock);
+    if (pump_on) {
+        pump_off_locked(esp_timer_get_time(), false);
+    }
+    uint32_t actual_ms = stats.last.actual_us / 1000;
+    portEXIT_CRITICAL_SAFE(&pump_lock);
+
+    return actual_ms;
+}
+
+esp_err_t pump_control_wait_off(uint32_t timeout_ms)
+{
+    ulTaskNotifyTake(pdTRUE, 0);  // 清除先前殘留的通知
+
+    portENTER_CRITICAL_SAFE(&pump_lock);
+    bool on = pump_on;
+    if (on) {
+        off_waiter = xTaskGetCurrentTaskHandle();
+    }
+    portEXIT_CRITICAL_SAFE(&pump_lock);
+
+    if (on) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout_ms));
+
+        portENTER_CRITICAL_SAFE(&pump_lock);
+        off_waiter = NULL;
+        on = pump_on;
+        portEXIT_CRITICAL_SAFE(&pump_lock);
+    }
+
+    report_violations();
+    return on ? ESP_ERR_TIMEOUT : ESP_OK;
+}
+
+bool pump_control_is_on(void)
+{
+    return pump_on;
+}
+
+void pump_control_get_stats(pump_control_stats_t* out)
+{
+    report_violations();
+
+    portENTER_CRITICAL_SAFE(&pump_lock);
+    *out = stats;
+    portEXIT_CRITICAL_SAFE(&pump_lock);
+
+    if (out->timer_offs == 0) {
+        out->jitter_min_us = 0;
+        out->jitter_max_us = 0;
+    }
+}
+
+// ============================================================================
+// 關閉計時器回呼 (ISR 派送時在中斷中執行，不可寫日誌)
+// ============================================================================
+static void IRAM_ATTR pump_off_timer_cb(void *arg)
+{
+    int64_t now_us = esp_timer_get_time();
+    TaskHandle_t waiter = NULL;
+
+    portENTER_CRITICAL_SAFE(&pump_lock);
+    if (pump_on) {
+        pump_off_locked(now_us, true);
+        waiter = off_waiter;
+    }
+    portEXIT_CRITICAL_SAFE(&pump_lock);
+
+    if (waiter != NULL) {
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(waiter, &woken);
+        if (woken) {
+            esp_timer_isr_dispatch_need_yield();
+        }
+#else
+        xTaskNotifyGive(waiter);
+#endif
+    }
+}
+
+// 關閉泵浦並記錄本次開啟 (呼叫者持有 pump_lock)
+// ISR 可達：只呼叫 IRAM 函數、只讀寫 DRAM 資料，不寫日誌、不做 64 位元除法
+static void IRAM_ATTR pump_off_locked(int64_t now_us, bool by_timer)
+{
+    if (!pump_config.mock) {
+        gpio_set_level(pump_config.gpio, 0);
+    }
+    pump_on = false;
+
+    pump_stats_record(&stats, started_us, target_ms, now_us, by_timer, pump_config.jitter_bound_us,
+                      jitter_le_us, on_time_le_ms);
+}
+
+// 在任務環境補寫 ISR 中發生的違規日誌 (統計由計時器回呼寫入，先在鎖內取快照再於鎖外寫日誌)
+static void report_violations(void)
+{
+    portENTER_CRITICAL_SAFE(&pump_lock);
+    uint32_t violations = stats.bound_violations;
+    int32_t last_jitter_us = stats.last.jitter_us;
+    bool report = violations != reported_violations;
+    reported_violations = violations;
+    portEXIT_CRITICAL_SAFE(&pump_lock);
+
+    if (report) {
+        ESP_LOGW(TAG, "⚠️ 泵浦計時關閉誤差超過 %lu us (最近一次 %ld us，累計違規 %lu 次)",
+                 pump_config.jitter_bound_us, last_jitter_us, violations);
+    }
+}
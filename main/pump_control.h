@@ -0,0 +1,72 @@
+// ============================================================================
+// pump_control.h - 泵浦開關控制模組標頭檔
+// 功能：開啟泵浦時同時啟動單次 esp_timer，由計時器回呼 (ISR 派送) 直接關閉泵浦，
+//       關閉時間不受指令任務排程影響；記錄每次實際開啟時間與誤差並累積直方圖
+// ============================================================================
+
+#ifndef PUMP_CONTROL_H
+#define PUMP_CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "pump_stats.h"         // 開啟紀錄與直方圖統計 (pump_control_stats_t)
+
+// ============================================================================
+// 泵浦控制設定
+// ============================================================================
+typedef struct {
+    int gpio;                       // 泵浦控制腳位
+    uint32_t max_on_ms;             // 單次開啟時間上限 (任何開啟請求都不會超過)
+    uint32_t jitter_bound_us;       // 計時關閉的允許誤差，超過即計為違規
+    bool mock;                      // true = 不操作 GPIO (無硬體測試)
+} pump_control_config_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化泵浦控制 (建立關閉計時器，泵浦維持關閉)
+ *
+ * @param config 泵浦控制設定
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t pump_control_init(const pump_control_config_t* config);
+
+/**
+ * @brief 開啟泵浦並排定在 on_ms 後由計時器關閉
+ *
+ * @param on_ms 開啟時間 (超過 max_on_ms 時以上限計)
+ * @return esp_err_t ESP_ERR_INVALID_STATE 表示泵浦已開啟，計時器啟動失敗時泵浦立即關閉
+ */
+esp_err_t pump_control_start(uint32_t on_ms);
+
+/**
+ * @brief 提前關閉泵浦 (泵浦已關閉時不做任何事)
+ *
+ * @return uint32_t 最近一次的實際開啟時間 (ms)
+ */
+uint32_t pump_control_stop(void);
+
+/**
+ * @brief 等待泵浦被計時器關閉
+ *
+ * @param timeout_ms 等待時間
+ * @return esp_err_t ESP_OK 表示已關閉，ESP_ERR_TIMEOUT 表示仍在運轉
+ */
+esp_err_t pump_control_wait_off(uint32_t timeout_ms);
+
+/**
+ * @brief 泵浦目前是否開啟
+ */
+bool pump_control_is_on(void);
+
+/**
+ * @brief 取得泵浦控制統計 (含最近一次開啟紀錄與直方圖)
+ *
+ * @param stats 統計資訊結構指標
+ */
+void pump_control_get_stats(pump_control_stats_t* stats);
+
+#endif // PUMP_CONTROL_H
@@ -0,0 +1,129 @@
+// ============================================================================
+// pump_stats.h - 泵浦開啟紀錄與直方圖統計
+// 功能：記錄每次實際開啟時間與計時關閉誤差並累積直方圖；純計算、不依賴 ESP-IDF，
+//       pump_control.c 在關閉計時器回呼 (ISR 可達) 中呼叫，
+//       主機端以 tools/pump_stats_test.c 驗證分格邊界、違規與提前關閉計數
+// ============================================================================
+
+#ifndef PUMP_STATS_H
+#define PUMP_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_attr.h"
+#endif
+#ifndef FORCE_INLINE_ATTR
+#define FORCE_INLINE_ATTR static inline __attribute__((always_inline))
+#endif
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define PUMP_JITTER_BUCKETS     10
+#define PUMP_ON_TIME_BUCKETS    8
+
+// 直方圖各格上界 (最後一格為 +Inf)
+#define PUMP_JITTER_BUCKET_LE_US    { 50, 100, 250, 500, 1000, 2500, 5000, 10000, 50000, UINT32_MAX }
+#define PUMP_ON_TIME_BUCKET_LE_MS   { 500, 1000, 2000, 5000, 10000, 30000, 60000, UINT32_MAX }
+
+// ============================================================================
+// 單次開啟紀錄
+// ============================================================================
+typedef struct {
+    int64_t started_us;             // 開啟時間 (esp_timer 時間)
+    uint32_t target_ms;             // 計時關閉的目標時間
+    uint32_t actual_us;             // 實際開啟時間
+    int32_t jitter_us;              // 實際 - 目標 (僅計時關閉時有意義)
+    bool timer_off;                 // true = 由計時器關閉，false = 任務提前關閉
+} pump_activation_t;
+
+// ============================================================================
+// 泵浦控制統計
+// ============================================================================
+typedef struct {
+    bool isr_dispatch;              // 計時器回呼在 ISR 中執行 (否則在 esp_timer 任務)
+    uint32_t activations;           // 開啟次數
+    uint32_t timer_offs;            // 由計時器關閉的次數
+    uint32_t early_stops;           // 任務提前關閉的次數 (定量澆水達標、無水流)
+    uint32_t bound_violations;      // 計時關閉誤差超過 jitter_bound_us 的次數
+    int32_t jitter_min_us;
+    int32_t jitter_max_us;
+    uint64_t jitter_abs_sum_us;     // |誤差| 總和 (平均 = 總和 / timer_offs)
+    uint32_t jitter_hist[PUMP_JITTER_BUCKETS];      // |誤差| 落在各格的次數 (非累積)
+    uint64_t on_time_sum_ms;
+    uint32_t on_time_hist[PUMP_ON_TIME_BUCKETS];    // 實際開啟時間落在各格的次數 (非累積)
+    pump_activation_t last;         // 最近一次開啟
+} pump_control_stats_t;
+
+// ============================================================================
+// 統計計算 (強制內聯：呼叫端在 IRAM 中，不能呼叫放在 flash 的函數)
+// ============================================================================
+
+/**
+ * @brief 清除統計 (誤差上下限設為哨兵值，第一次計時關閉時取代)
+ */
+FORCE_INLINE_ATTR void pump_stats_reset(pump_control_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->jitter_min_us = INT32_MAX;
+    stats->jitter_max_us = INT32_MIN;
+}
+
+/**
+ * @brief 記錄一次開啟：實際開啟時間入直方圖，計時關閉時另計誤差與違規
+ *
+ * 只做 32 位元除法；分格上界表由呼叫端提供 (ISR 可達時須放在 DRAM)
+ *
+ * @param stats 統計資訊
+ * @param started_us 開啟時間
+ * @param target_ms 計時關閉的目標時間
+ * @param now_us 關閉時間
+ * @param by_timer true = 由計時器關閉，false = 提前關閉 (不計誤差)
+ * @param jitter_bound_us |誤差| 超過此值計為違規
+ * @param jitter_le_us 誤差分格上界 (PUMP_JITTER_BUCKETS 格)
+ * @param on_time_le_ms 開啟時間分格上界 (PUMP_ON_TIME_BUCKETS 格)
+ */
+FORCE_INLINE_ATTR void pump_stats_record(pump_control_stats_t *stats, int64_t started_us, uint32_t target_ms,
+                                         int64_t now_us, bool by_timer, uint32_t jitter_bound_us,
+                                         const uint32_t *jitter_le_us, const uint32_t *on_time_le_ms)
+{
+    pump_activation_t *last = &stats->last;
+    last->started_us = started_us;
+    last->target_ms = target_ms;
+    last->actual_us = (uint32_t)(now_us - started_us);
+    last->jitter_us = (int32_t)(last->actual_us - (int64_t)target_ms * 1000);
+    last->timer_off = by_timer;
+
+    stats->activations++;
+    stats->on_time_sum_ms += last->actual_us / 1000;
+    int b = 0;
+    while (b < PUMP_ON_TIME_BUCKETS - 1 && last->actual_us / 1000 > on_time_le_ms[b]) {
+        b++;
+    }
+    stats->on_time_hist[b]++;
+
+    if (!by_timer) {
+        stats->early_stops++;
+        return;
+    }
+
+    // 誤差只對計時關閉有意義 (提前關閉本來就短於目標)
+    stats->timer_offs++;
+    uint32_t abs_jitter = last->jitter_us < 0 ? (uint32_t)-last->jitter_us : (uint32_t)last->jitter_us;
+    stats->jitter_abs_sum_us += abs_jitter;
+    if (last->jitter_us < stats->jitter_min_us) stats->jitter_min_us = last->jitter_us;
+    if (last->jitter_us > stats->jitter_max_us) stats->jitter_max_us = last->jitter_us;
+    b = 0;
+    while (b < PUMP_JITTER_BUCKETS - 1 && abs_jitter > jitter_le_us[b]) {
+        b++;
+    }
+    stats->jitter_hist[b]++;
+    if (abs_jitter > jitter_bound_us) {
+        stats->bound_violations++;
+    }
+}
+
+#endif // PUMP_STATS_H
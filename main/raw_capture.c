@@ -0,0 +1,530 @@
+// ============================================================================
+// raw_capture.c - 高取樣率原始 ADC 擷取模組實作
+// 功能：擷取期間以 soil_sensor_acquire() 獨佔 ADC 並暫時提高任務優先順序，
+//       避免 DMA 緩衝區溢位；擷取緩衝區同時掛上 soil_sensor 的讀取路徑，
+//       澆水監測與一般讀數在擷取期間照常取得土壤通道讀值；
+//       上傳時降回最低的非閒置優先順序，每段之間讓出 CPU，
+//       連線中斷或記憶體壓力偏高時暫停，不影響一般遙測發布
+// ============================================================================
+
+#include "raw_capture.h"
+#include "soil_sensor.h"
+#include "telemetry_transport.h"
+#include "mem_pressure.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_adc/adc_continuous.h"
+#include "mbedtls/base64.h"
+#include "cJSON.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define CAPTURE_TASK_STACK_SIZE     4096
+#define CAPTURE_SAMPLE_PRIORITY     5                       // 擷取期間高於一般工作任務
+#define CAPTURE_UPLOAD_PRIORITY     (tskIDLE_PRIORITY + 1)  // 上傳期間低於所有正常工作任務
+#define CAPTURE_FRAME_BYTES         256     // 每次讀取的 DMA 訊框大小
+#define CAPTURE_STORE_FRAMES        8       // 驅動內部緩衝的訊框數
+#define CAPTURE_ACQUIRE_TIMEOUT_MS  2000    // 等待 ADC 獨佔權的時間
+#define CAPTURE_CHUNK_PREFIX_MAX    192     // 分段訊息 JSON 前綴 (不含 Base64 資料) 的長度上限
+#define CAPTURE_CHUNK_INTERVAL_MS   50      // 每段上傳之間的間隔
+#define CAPTURE_RETRY_DELAY_MS      1000    // 無法發布時的重試間隔
+#define CAPTURE_UPLOAD_TIMEOUT_MS   300000  // 上傳總時間上限 (超過即放棄這次擷取)
+#define DELTA8_ESCAPE               0x80    // 差分超出 ±127 時，後接 2 bytes 絕對值
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "RAW_CAPTURE";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static const char *capture_topic = NULL;
+static uint16_t *sample_buffer = NULL;     // 開機時配置的樣本緩衝區
+static uint32_t buffer_capacity = 0;
+static TaskHandle_t capture_task_handle = NULL;
+static portMUX_TYPE capture_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile raw_capture_state_t state = RAW_CAPTURE_IDLE;
+static volatile bool sampling_active = false;  // DMA 已開始轉換
+
+static raw_capture_request_t request;
+static uint32_t capture_id = 0;
+static uint32_t target_samples = 0;
+static uint32_t captured_samples = 0;
+static bool triggered_by_pump = false;
+static int64_t start_us = 0;
+static int64_t end_us = 0;
+static int64_t pump_on_us = 0;              // 0 表示擷取期間未發生
+static int64_t pump_off_us = 0;
+static volatile uint32_t overflow_count = 0;
+
+static uint8_t frame_buffer[CAPTURE_FRAME_BYTES];
+static uint8_t encode_buffer[RAW_CAPTURE_CHUNK_SAMPLES * 3];
+static char chunk_message[((sizeof(encode_buffer) + 2) / 3) * 4 + CAPTURE_CHUNK_PREFIX_MAX];
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void raw_capture_task(void *pvParameters);
+static esp_err_t run_capture(void);
+static void upload_capture(void);
+static bool publish_with_retry(const char *message, int len, int64_t deadline_us);
+static size_t encode_chunk(const uint16_t *src, uint32_t count, bool compress, uint8_t *out);
+static uint32_t chunk_samples_for_transport(bool compress);
+static int32_t time_to_index(int64_t event_us);
+static void set_state(raw_capture_state_t new_state);
+
+// ============================================================================
+// 初始化與參數解析
+// ============================================================================
+esp_err_t raw_capture_init(uint32_t buffer_samples, const char* topic)
+{
+    if (topic == NULL || buffer_samples == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    sample_buffer = malloc(buffer_samples * sizeof(uint16_t));
+    if (sample_buffer == NULL) {
+        ESP_LOGE(TAG, "❌ 無法配置擷取緩衝區 (%lu bytes)", buffer_samples * sizeof(uint16_t));
+        return ESP_ERR_NO_MEM;
+    }
+    buffer_capacity = buffer_samples;
+    capture_topic = topic;
+
+    if (xTaskCreate(raw_capture_task, "raw_capture", CAPTURE_TASK_STACK_SIZE, NULL,
+                    CAPTURE_UPLOAD_PRIORITY, &capture_task_handle) != pdPASS) {
+        free(sample_buffer);
+        sample_buffer = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "✅ 原始擷取模組初始化完成 (緩衝區 %lu 樣本 / %lu bytes)",
+             buffer_samples, buffer_samples * sizeof(uint16_t));
+    return ESP_OK;
+}
+
+esp_err_t raw_capture_parse_args(const char* args, raw_capture_request_t* req)
+{
+    req->rate_hz = RAW_CAPTURE_DEFAULT_RATE_HZ;
+    req->duration_ms = RAW_CAPTURE_DEFAULT_DURATION_MS;
+    req->on_pump = false;
+    req->compress = true;
+
+    if (args == NULL || args[0] == '\0') {
+        return ESP_OK;
+    }
+
+    // 數字依序為毫秒、取樣率；pump / raw 為旗標，順序不拘
+    int numbers = 0;
+    const char *token = args;
+    while (token != NULL && *token != '\0') {
+        const char *sep = strchr(token, ':');
+        size_t len = sep != NULL ? (size_t)(sep - token) : strlen(token);
+
+        if (len == 4 && strncmp(token, "pump", 4) == 0) {
+            req->on_pump = true;
+        } else if (len == 3 && strncmp(token, "raw", 3) == 0) {
+            req->compress = false;
+        } else if (len > 0) {
+            char *end = NULL;
+            unsigned long value = strtoul(token, &end, 10);
+            if (end != token + len) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (numbers == 0) {
+                if (value == 0 || value > RAW_CAPTURE_MAX_DURATION_MS) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                req->duration_ms = value;
+            } else if (numbers == 1) {
+                if (value < RAW_CAPTURE_MIN_RATE_HZ || value > RAW_CAPTURE_MAX_RATE_HZ) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                req->rate_hz = value;
+            } else {
+                return ESP_ERR_INVALID_ARG;
+            }
+            numbers++;
+        }
+
+        token = sep != NULL ? sep + 1 : NULL;
+    }
+
+    return ESP_OK;
+}
+
+// ============================================================================
+// 開始擷取與泵浦觸發
+// ============================================================================
+esp_err_t raw_capture_start(const raw_capture_request_t* req, uint32_t* samples)
+{
+    if (capture_task_handle == NULL || req == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&capture_lock);
+    bool busy = state != RAW_CAPTURE_IDLE;
+    if (!busy) {
+        pump_on_us = 0;
+        pump_off_us = 0;
+        state = req->on_pump ? RAW_CAPTURE_ARMED : RAW_CAPTURE_SAMPLING;
+    }
+    portEXIT_CRITICAL(&capture_lock);
+
+    if (busy) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // 超過緩衝區容量時縮短擷取時間，而不是降低取樣率 (高頻成分才是診斷重點)
+    uint64_t wanted = (uint64_t)req->rate_hz * req->duration_ms / 1000;
+    request = *req;
+    target_samples = wanted > buffer_capacity ? buffer_capacity : (uint32_t)wanted;
+    triggered_by_pump = req->on_pump;
+    if (samples != NULL) {
+        *samples = target_samples;
+    }
+
+    if (!req->on_pump) {
+        xTaskNotifyGive(capture_task_handle);
+    }
+    ESP_LOGI(TAG, "📈 原始擷取%s - %lu 樣本 @ %lu Hz", req->on_pump ? "已預備 (等待泵浦啟動)" : "開始",
+             target_samples, req->rate_hz);
+    return ESP_OK;
+}
+
+void raw_capture_pump_starting(void)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&capture_lock);
+    bool armed = state == RAW_CAPTURE_ARMED;
+    if (armed) {
+        state = RAW_CAPTURE_SAMPLING;
+    }
+    // 泵浦觸發時 DMA 尚未開始，啟動時間點早於第一個樣本 (標頭以 pump_on_offset_ms 回報)
+    if ((armed || sampling_active) && pump_on_us == 0) {
+        pump_on_us = now_us;
+    }
+    portEXIT_CRITICAL(&capture_lock);
+
+    if (armed) {
+        xTaskNotifyGive(capture_task_handle);
+    }
+}
+
+void raw_capture_pump_stopped(void)
+{
+    if (sampling_active && pump_off_us == 0) {
+        pump_off_us = esp_timer_get_time();
+    }
+}
+
+raw_capture_state_t raw_capture_get_state(void)
+{
+    return state;
+}
+
+const char* raw_capture_state_name(raw_capture_state_t s)
+{
+    switch (s) {
+        case RAW_CAPTURE_IDLE:      return "idle";
+        case RAW_CAPTURE_ARMED:     return "armed";
+        case RAW_CAPTURE_SAMPLING:  return "sampling";
+        case RAW_CAPTURE_UPLOADING: return "uploading";
+        default:                    return "unknown";
+    }
+}
+
+static void set_state(raw_capture_state_t new_state)
+{
+    portENTER_CRITICAL(&capture_lock);
+    state = new_state;
+    portEXIT_CRITICAL(&capture_lock);
+}
+
+// ============================================================================
+// 擷取任務 (常駐，每次擷取由任務通知喚醒)
+// ============================================================================
+static void raw_capture_task(void *pvParameters)
+{
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        capture_id++;
+        vTaskPrioritySet(NULL, CAPTURE_SAMPLE_PRIORITY);
+        esp_err_t err = run_capture();
+        vTaskPrioritySet(NULL, CAPTURE_UPLOAD_PRIORITY);
+
+        if (err == ESP_OK && captured_samples > 0) {
+            set_state(RAW_CAPTURE_UPLOADING);
+            upload_capture();
+        } else {
+            ESP_LOGW(TAG, "⚠️ 原始擷取失敗: %s", esp_err_to_name(err));
+        }
+
+        set_state(RAW_CAPTURE_IDLE);
+    }
+}
+
+// ============================================================================
+// 擷取：驅動內部緩衝區溢位時在中斷中計數 (代表樣本有缺漏，頻譜不可信)
+// ============================================================================
+static bool IRAM_ATTR on_pool_overflow(adc_continuous_handle_t handle,
+                                       const adc_continuous_evt_data_t *edata, void *user_data)
+{
+    overflow_count++;
+    return false;
+}
+
+static esp_err_t run_capture(void)
+{
+    soil_sensor_config_t sensor_config;
+    soil_sensor_get_config(&sensor_config);
+
+    captured_samples = 0;
+    overflow_count = 0;
+
+    esp_err_t err = soil_sensor_acquire(pdMS_TO_TICKS(CAPTURE_ACQUIRE_TIMEOUT_MS));
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    adc_continuous_handle_t handle = NULL;
+    adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = CAPTURE_FRAME_BYTES * CAPTURE_STORE_FRAMES,
+        .conv_frame_size = CAPTURE_FRAME_BYTES,
+    };
+    err = adc_continuous_new_handle(&handle_config, &handle);
+    if (err != ESP_OK) {
+        soil_sensor_release();
+        return err;
+    }
+
+    adc_digi_pattern_config_t pattern = {
+        .atten = ADC_ATTEN_DB_12,
+        .channel = sensor_config.channel,
+        .unit = ADC_UNIT_1,
+        .bit_width = ADC_BITWIDTH_12,
+    };
+    adc_continuous_config_t dig_config = {
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = request.rate_hz,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,     // ESP32-C3 的 DMA 輸出格式
+    };
+    adc_continuous_evt_cbs_t callbacks = {
+        .on_pool_ovf = on_pool_overflow,
+    };
+
+    err = adc_continuous_config(handle, &dig_config);
+    if (err == ESP_OK) {
+        err = adc_continuous_register_event_callbacks(handle, &callbacks, NULL);
+    }
+    if (err == ESP_OK) {
+        err = adc_continuous_start(handle);
+    }
+
+    if (err == ESP_OK) {
+        start_us = esp_timer_get_time();
+        sampling_active = true;
+        soil_sensor_capture_attach(sample_buffer);
+
+        // 預期時間加 1 秒寬限，DMA 停止送資料時不會無限等待
+        int64_t deadline_us = start_us + (int64_t)target_samples * 1000000 / request.rate_hz + 1000000;
+        while (captured_samples < target_samples && esp_timer_get_time() < deadline_us) {
+            uint32_t out_len = 0;
+            if (adc_continuous_read(handle, frame_buffer, sizeof(frame_buffer), &out_len, 100) != ESP_OK) {
+                continue;
+            }
+            for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= out_len && captured_samples < target_samples;
+                 i += SOC_ADC_DIGI_RESULT_BYTES) {
+                adc_digi_output_data_t *p = (adc_digi_output_data_t *)&frame_buffer[i];
+                if (p->type2.channel == sensor_config.channel) {
+                    sample_buffer[captured_samples++] = p->type2.data;
+                }
+            }
+            soil_sensor_capture_update(captured_samples);
+        }
+
+        soil_sensor_capture_detach();
+        end_us = esp_timer_get_time();
+        sampling_active = false;
+        adc_continuous_stop(handle);
+    }
+
+    adc_continuous_deinit(handle);
+    soil_sensor_release();
+
+    ESP_LOGI(TAG, "📊 原始擷取完成 - %lu/%lu 樣本，%lld ms，溢位 %lu 次",
+             captured_samples, target_samples, (end_us - start_us) / 1000, overflow_count);
+    return err;
+}
+
+// ============================================================================
+// 上傳：先發布描述資訊，再逐段發布編碼後的樣本 (每段可獨立解碼)
+// ============================================================================
+static int32_t time_to_index(int64_t event_us)
+{
+    if (event_us == 0) {
+        return -1;
+    }
+    int64_t index = (event_us - start_us) * (int64_t)request.rate_hz / 1000000;
+    if (index < 0) {
+        return 0;
+    }
+    return index > captured_samples ? (int32_t)captured_samples : (int32_t)index;
+}
+
+static void upload_capture(void)
+{
+    soil_sensor_config_t sensor_config;
+    soil_sensor_get_config(&sensor_config);
+
+    const char *encoding = request.compress ? "delta8" : "raw16";
+    uint32_t chunk_samples = chunk_samples_for_transport(request.compress);
+    if (chunk_samples == 0) {
+        ESP_LOGW(TAG, "⚠️ 傳輸層上限 %u bytes 放不下分段，放棄上傳擷取 #%lu",
+                 (unsigned)telemetry_max_payload(), capture_id);
+        return;
+    }
+    uint32_t chunks = (captured_samples + chunk_samples - 1) / chunk_samples;
+
+    int min_code = sample_buffer[0];
+    int max_code = sample_buffer[0];
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < captured_samples; i++) {
+        if (sample_buffer[i] < min_code) min_code = sample_buffer[i];
+        if (sample_buffer[i] > max_code) max_code = sample_buffer[i];
+        sum += sample_buffer[i];
+    }
+
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "type", "raw_capture");
+    cJSON_AddNumberToObject(json, "id", capture_id);
+    cJSON_AddStringToObject(json, "trigger", triggered_by_pump ? "pump" : "command");
+    cJSON_AddNumberToObject(json, "rate_hz", request.rate_hz);
+    cJSON_AddNumberToObject(json, "samples", captured_samples);
+    cJSON_AddNumberToObject(json, "duration_ms", (double)((end_us - start_us) / 1000));
+    cJSON_AddNumberToObject(json, "overflows", overflow_count);
+    cJSON_AddStringToObject(json, "encoding", encoding);
+    cJSON_AddNumberToObject(json, "chunks", chunks);
+    cJSON_AddNumberToObject(json, "chunk_samples", chunk_samples);
+    cJSON_AddNumberToObject(json, "pump_on_index", time_to_index(pump_on_us));
+    if (pump_on_us != 0) {
+        // 負值表示泵浦在第一個樣本之前啟動 (泵浦觸發時的 DMA 啟動延遲)
+        cJSON_AddNumberToObject(json, "pump_on_offset_ms", (double)((pump_on_us - start_us) / 1000));
+    }
+    cJSON_AddNumberToObject(json, "pump_off_index", time_to_index(pump_off_us));
+    cJSON_AddNumberToObject(json, "channel", sensor_config.channel);
+    cJSON_AddNumberToObject(json, "air_value", sensor_config.air_value);
+    cJSON_AddNumberToObject(json, "water_value", sensor_config.water_value);
+    cJSON_AddNumberToObject(json, "mean", (double)sum / captured_samples);
+    cJSON_AddNumberToObject(json, "p2p", max_code - min_code);
+    char *header = cJSON_PrintUnformatted(json);
+    cJSON_Delete(json);
+    if (header == NULL) {
+        ESP_LOGW(TAG, "⚠️ 記憶體不足，放棄上傳擷取 #%lu", capture_id);
+        return;
+    }
+
+    int64_t deadline_us = esp_timer_get_time() + CAPTURE_UPLOAD_TIMEOUT_MS * 1000LL;
+    bool ok = publish_with_retry(header, 0, deadline_us);
+    free(header);
+
+    // 分段以固定格式寫入靜態緩衝區，上傳期間不再配置記憶體
+    size_t total_bytes = 0;
+    for (uint32_t chunk = 0; ok && chunk < chunks; chunk++) {
+        uint32_t offset = chunk * chunk_samples;
+        uint32_t count = captured_samples - offset;
+        if (count > chunk_samples) {
+            count = chunk_samples;
+        }
+        size_t encoded_len = encode_chunk(&sample_buffer[offset], count, request.compress, encode_buffer);
+        total_bytes += encoded_len;
+
+        int prefix = snprintf(chunk_message, sizeof(chunk_message),
+                              "{\"type\":\"raw_capture_chunk\",\"id\":%lu,\"chunk\":%lu,\"offset\":%lu,"
+                              "\"samples\":%lu,\"encoding\":\"%s\",\"data\":\"",
+                              capture_id, chunk, offset, count, encoding);
+        size_t b64_len = 0;
+        if (mbedtls_base64_encode((unsigned char *)chunk_message + prefix, sizeof(chunk_message) - prefix - 2,
+                                  &b64_len, encode_buffer, encoded_len) != 0) {
+            ESP_LOGE(TAG, "❌ Base64 編碼緩衝區不足");
+            break;
+        }
+        memcpy(chunk_message + prefix + b64_len, "\"}", 3);
+
+        ok = publish_with_retry(chunk_message, prefix + (int)b64_len + 2, deadline_us);
+        vTaskDelay(pdMS_TO_TICKS(CAPTURE_CHUNK_INTERVAL_MS));
+    }
+
+    if (ok) {
+        ESP_LOGI(TAG, "✅ 擷取 #%lu 上傳完成 - %lu 段，%u bytes (%s，原始 %lu bytes)",
+                 capture_id, chunks, (unsigned)total_bytes, encoding, captured_samples * 2);
+    } else {
+        ESP_LOGW(TAG, "⚠️ 擷取 #%lu 上傳未完成，已放棄", capture_id);
+    }
+}
+
+static bool publish_with_retry(const char *message, int len, int64_t deadline_us)
+{
+    while (esp_timer_get_time() < deadline_us) {
+        // 斷線或記憶體壓力偏高時暫停 (與離線補送相同的退讓條件)
+        if (telemetry_is_connected() && mem_pressure_get_tier() < MEM_PRESSURE_HIGH &&
+            telemetry_publish(capture_topic, message, len, 1, 0) == ESP_OK) {
+            return true;
+        }
+        vTaskDelay(pdMS_TO_TICKS(CAPTURE_RETRY_DELAY_MS));
+    }
+    return false;
+}
+
+// ============================================================================
+// 每段樣本數：以最壞情況的編碼長度 (delta8 每樣本 3 bytes、raw16 2 bytes) 與 Base64 膨脹
+// 估算，讓分段訊息不超過目前傳輸層的上限
+// ============================================================================
+static uint32_t chunk_samples_for_transport(bool compress)
+{
+    size_t max_payload = telemetry_max_payload();
+    if (max_payload <= CAPTURE_CHUNK_PREFIX_MAX + 2) {
+        return 0;
+    }
+    size_t encoded_budget = (max_payload - CAPTURE_CHUNK_PREFIX_MAX - 2) / 4 * 3;
+    size_t samples = encoded_budget / (compress ? 3 : 2);
+    return samples > RAW_CAPTURE_CHUNK_SAMPLES ? RAW_CAPTURE_CHUNK_SAMPLES : (uint32_t)samples;
+}
+
+// ============================================================================
+// 樣本編碼
+// delta8：與前一樣本的差 (-127 ~ 127) 以 1 byte 表示，否則寫入 0x80 後接
+//         2 bytes 小端序絕對值；每段第一個樣本一律為絕對值，分段可獨立解碼
+// raw16：每個樣本 2 bytes 小端序
+// ============================================================================
+static size_t encode_chunk(const uint16_t *src, uint32_t count, bool compress, uint8_t *out)
+{
+    size_t len = 0;
+    int prev = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        int delta = (int)src[i] - prev;
+        if (compress && i > 0 && delta >= -127 && delta <= 127) {
+            out[len++] = (uint8_t)(int8_t)delta;
+        } else {
+            if (compress) {
+                out[len++] = DELTA8_ESCAPE;
+            }
+            out[len++] = src[i] & 0xFF;
+            out[len++] = src[i] >> 8;
+        }
+        prev = src[i];
+    }
+    return len;
+}
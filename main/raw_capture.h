@@ -0,0 +1,101 @@
+// ============================================================================
+// raw_capture.h - 高取樣率原始 ADC 擷取模組標頭檔
+// 功能：以連續 (DMA) 模式用 kHz 等級取樣率擷取原始 ADC 碼到開機時預先配置的
+//       RAM 緩衝區，用於診斷探頭雜訊與泵浦馬達的電磁干擾；可由指令立即觸發
+//       或預備在下一次泵浦啟動時觸發，完成後以低優先順序分段上傳 (可選差分壓縮)
+// ============================================================================
+
+#ifndef RAW_CAPTURE_H
+#define RAW_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define RAW_CAPTURE_DEFAULT_RATE_HZ     5000    // 預設取樣率
+#define RAW_CAPTURE_MIN_RATE_HZ         1000    // 取樣率下限 (DMA 模式最低約 611 Hz)
+#define RAW_CAPTURE_MAX_RATE_HZ         20000   // 取樣率上限
+#define RAW_CAPTURE_DEFAULT_DURATION_MS 2000    // 預設擷取時間
+#define RAW_CAPTURE_MAX_DURATION_MS     4000    // 獨佔 ADC 的時間上限 (期間土壤通道讀數改由擷取緩衝區提供)
+#define RAW_CAPTURE_CHUNK_SAMPLES       512     // 每段上傳的樣本數上限 (依 telemetry_max_payload() 再縮小)
+
+// ============================================================================
+// 擷取狀態
+// ============================================================================
+typedef enum {
+    RAW_CAPTURE_IDLE = 0,       // 閒置
+    RAW_CAPTURE_ARMED,          // 等待泵浦啟動觸發
+    RAW_CAPTURE_SAMPLING,       // 擷取中 (獨佔 ADC)
+    RAW_CAPTURE_UPLOADING,      // 分段上傳中
+} raw_capture_state_t;
+
+// ============================================================================
+// 擷取請求
+// ============================================================================
+typedef struct {
+    uint32_t rate_hz;           // 取樣率
+    uint32_t duration_ms;       // 擷取時間 (受緩衝區容量限制，超過時縮短)
+    bool on_pump;               // true = 等到下一次泵浦啟動才開始
+    bool compress;              // true = 差分編碼 (delta8)，false = 16 位元原始碼 (raw16)
+} raw_capture_request_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化擷取模組：預先配置樣本緩衝區並建立擷取任務
+ *
+ * 緩衝區在開機時配置，之後擷取與上傳都不再配置大塊記憶體
+ *
+ * @param buffer_samples 緩衝區容量 (樣本數，每個樣本 2 bytes)
+ * @param topic 擷取資料發布主題
+ * @return esp_err_t ESP_ERR_NO_MEM 表示緩衝區配置失敗
+ */
+esp_err_t raw_capture_init(uint32_t buffer_samples, const char* topic);
+
+/**
+ * @brief 解析指令參數，格式為 "[<毫秒>][:<Hz>][:pump][:raw]"，例如 "3000:10000:pump"
+ *
+ * @param args 指令參數 (可為 NULL 或空字串，使用預設值)
+ * @param request 解析出的擷取請求
+ * @return esp_err_t ESP_ERR_INVALID_ARG 表示格式錯誤或超出範圍
+ */
+esp_err_t raw_capture_parse_args(const char* args, raw_capture_request_t* request);
+
+/**
+ * @brief 開始擷取 (立即返回)；on_pump 時只預備，等泵浦啟動才開始
+ *
+ * @param request 擷取請求
+ * @param samples 實際會擷取的樣本數 (可為 NULL)
+ * @return esp_err_t ESP_ERR_INVALID_STATE 表示已有擷取在進行或尚未上傳完成
+ */
+esp_err_t raw_capture_start(const raw_capture_request_t* request, uint32_t* samples);
+
+/**
+ * @brief 泵浦即將啟動 (開啟泵浦 GPIO 前呼叫，立即返回，不延後泵浦啟動)
+ *
+ * 已預備泵浦觸發時喚醒擷取任務開始擷取；DMA 啟動需要數毫秒，紀錄從泵浦啟動後開始，
+ * 基準雜訊取泵浦關閉後的樣本 (擷取時間應長於出水時間)
+ */
+void raw_capture_pump_starting(void);
+
+/**
+ * @brief 泵浦已關閉 (記錄關閉時間點，對應到樣本索引)
+ */
+void raw_capture_pump_stopped(void);
+
+/**
+ * @brief 取得目前狀態
+ */
+raw_capture_state_t raw_capture_get_state(void);
+
+/**
+ * @brief 取得狀態名稱字串
+ */
+const char* raw_capture_state_name(raw_capture_state_t state);
+
+#endif // RAW_CAPTURE_H
@@ -0,0 +1,218 @@
+// ============================================================================
+// sample_slot.c - 全場同步採樣時槽模組實作
+// 功能：時槽邊界 = epoch 毫秒取整到週期的整數倍，同步後各節點不需互相通訊
+//       即在同一時刻採樣；偏差統計以同一個時間對應換算採樣時刻，
+//       反映的是任務排程延遲 (節點間的時鐘誤差另見 time_sync 的同步誤差)
+// ============================================================================
+
+#include "sample_slot.h"
+#include "time_sync.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_mac.h"
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "SAMPLE_SLOT";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static sample_slot_config_t slot_config = { .period_s = 60 };
+static portMUX_TYPE slot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t publish_offset_ms = 0;
+static int64_t last_sample_us = -1;     // 上次採樣時刻 (開機時間)
+static int64_t last_slot_ms = -1;       // 上次採樣的時槽邊界 (-1 = 尚未對齊)
+static uint64_t abs_skew_sum_ms = 0;
+static sample_slot_stats_t stats;
+
+// ============================================================================
+// 內部工具函數
+// ============================================================================
+static inline int64_t period_ms(void)
+{
+    return (int64_t)slot_config.period_s * 1000;
+}
+
+// FNV-1a：同一批量產裝置的 MAC 只有末幾位不同，雜湊後在分散時間窗內較均勻
+static uint32_t mac_hash(void)
+{
+    uint8_t mac[6] = {0};
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        hash = (hash ^ mac[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t sample_slot_init(const sample_slot_config_t* config)
+{
+    if (config == NULL || config->period_s == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t spread_ms = config->publish_spread_ms;
+    if (spread_ms >= config->period_s * 1000) {
+        // 發布必須在下一個時槽開始前完成，否則讀數會互相覆蓋
+        spread_ms = config->period_s * 1000 / 2;
+        ESP_LOGW(TAG, "⚠️ 發布分散時間窗須小於時槽長度，改為 %lu ms", spread_ms);
+    }
+
+    uint32_t offset_ms = 0;
+    if (config->publish_offset_ms >= 0) {
+        offset_ms = spread_ms > 0 ? (uint32_t)config->publish_offset_ms % spread_ms : 0;
+    } else if (spread_ms > 0) {
+        offset_ms = mac_hash() % spread_ms;
+    }
+
+    portENTER_CRITICAL(&slot_lock);
+    slot_config = *config;
+    slot_config.publish_spread_ms = spread_ms;
+    publish_offset_ms = offset_ms;
+    last_sample_us = -1;
+    last_slot_ms = -1;
+    abs_skew_sum_ms = 0;
+    memset(&stats, 0, sizeof(stats));
+    stats.period_s = config->period_s;
+    stats.publish_offset_ms = offset_ms;
+    stats.last_slot_ms = -1;
+    portEXIT_CRITICAL(&slot_lock);
+
+    ESP_LOGI(TAG, "✅ 採樣時槽初始化完成 (%s，每 %lu 秒，發布偏移 %lu / %lu ms)",
+             config->align ? "同步後對齊 epoch" : "開機時間間隔",
+             config->period_s, offset_ms, spread_ms);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 採樣排程
+// ============================================================================
+bool sample_slot_due(int64_t* slot_ms)
+{
+    int64_t now_us = esp_timer_get_time();
+    int64_t now_ms = slot_config.align ? time_sync_now_ms() : -1;
+    *slot_ms = -1;
+
+    if (now_ms < 0) {
+        // 尚未同步：維持原本以開機時間計算的間隔
+        return last_sample_us < 0 || now_us - last_sample_us >= period_ms() * 1000;
+    }
+
+    int64_t slot = now_ms - now_ms % period_ms();
+    if (last_slot_ms >= 0 && slot < last_slot_ms - period_ms()) {
+        // 時鐘往回跳超過一個時槽 (SNTP 大幅修正、手動校時)：不重新對齊的話，
+        // 要等牆鐘追上舊時槽才會再採樣
+        ESP_LOGW(TAG, "⚠️ 時鐘倒退 %lld ms，重新對齊時槽", last_slot_ms - slot);
+        portENTER_CRITICAL(&slot_lock);
+        last_slot_ms = -1;
+        stats.clock_steps_back++;
+        portEXIT_CRITICAL(&slot_lock);
+    }
+    if (slot <= last_slot_ms) {
+        return false;
+    }
+    // 剛同步 (或剛開機)：目前時槽已開始太久就等下一個邊界，只在切換時多等一次
+    if (last_slot_ms < 0 && now_ms - slot > SAMPLE_SLOT_CATCHUP_MS) {
+        return false;
+    }
+
+    *slot_ms = slot;
+    return true;
+}
+
+int32_t sample_slot_record(int64_t slot_ms, int64_t sample_us)
+{
+    int64_t sample_ms = slot_ms >= 0 ? time_sync_uptime_to_epoch_ms(sample_us) : -1;
+    int32_t skew_ms = 0;
+
+    portENTER_CRITICAL(&slot_lock);
+    last_sample_us = sample_us;
+    if (slot_ms < 0 || sample_ms < 0) {
+        stats.aligned = false;
+        stats.unaligned_samples++;
+        portEXIT_CRITICAL(&slot_lock);
+        return 0;
+    }
+
+    if (last_slot_ms >= 0 && slot_ms - last_slot_ms > period_ms()) {
+        stats.missed_slots += (uint32_t)((slot_ms - last_slot_ms) / period_ms() - 1);
+    }
+    last_slot_ms = slot_ms;
+
+    skew_ms = (int32_t)(sample_ms - slot_ms);
+    uint32_t abs_skew = (uint32_t)(skew_ms < 0 ? -skew_ms : skew_ms);
+    stats.aligned = true;
+    stats.aligned_samples++;
+    stats.last_slot_ms = slot_ms;
+    stats.last_skew_ms = skew_ms;
+    abs_skew_sum_ms += abs_skew;
+    stats.avg_skew_ms = (uint32_t)(abs_skew_sum_ms / stats.aligned_samples);
+    if (abs_skew > stats.max_skew_ms) {
+        stats.max_skew_ms = abs_skew;
+    }
+    portEXIT_CRITICAL(&slot_lock);
+
+    return skew_ms;
+}
+
+uint32_t sample_slot_ms_until_due(void)
+{
+    int64_t now_ms = slot_config.align ? time_sync_now_ms() : -1;
+    if (now_ms >= 0) {
+        return (uint32_t)(period_ms() - now_ms % period_ms());
+    }
+
+    if (last_sample_us < 0) {
+        return 0;
+    }
+    int64_t elapsed_ms = (esp_timer_get_time() - last_sample_us) / 1000;
+    return elapsed_ms >= period_ms() ? 0 : (uint32_t)(period_ms() - elapsed_ms);
+}
+
+// ============================================================================
+// 發布排程
+// ============================================================================
+uint32_t sample_slot_publish_wait_ms(int64_t slot_ms)
+{
+    int64_t now_ms = time_sync_now_ms();
+    if (slot_ms < 0 || now_ms < 0) {
+        return 0;
+    }
+
+    int64_t wait_ms = slot_ms + publish_offset_ms - now_ms;
+    return wait_ms > 0 ? (uint32_t)wait_ms : 0;
+}
+
+void sample_slot_note_published(int64_t slot_ms)
+{
+    int64_t now_ms = time_sync_now_ms();
+    if (slot_ms < 0 || now_ms < 0) {
+        return;
+    }
+
+    portENTER_CRITICAL(&slot_lock);
+    stats.last_publish_lag_ms = (int32_t)(now_ms - slot_ms);
+    portEXIT_CRITICAL(&slot_lock);
+}
+
+// ============================================================================
+// 統計
+// ============================================================================
+void sample_slot_get_stats(sample_slot_stats_t* out)
+{
+    if (out == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&slot_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&slot_lock);
+}
@@ -0,0 +1,111 @@
+// ============================================================================
+// sample_slot.h - 全場同步採樣時槽模組標頭檔
+// 功能：時間同步後把採樣時刻對齊 epoch 時槽邊界 (週期的整數倍)，整片苗床的節點
+//       在同一牆鐘時刻採樣；發布則延後一個依裝置 MAC 決定的固定偏移，避免
+//       所有節點在同一瞬間送出。回報每次採樣相對時槽邊界的偏差 (skew)；
+//       尚未同步時退回以開機時間計算的固定間隔
+// ============================================================================
+
+#ifndef SAMPLE_SLOT_H
+#define SAMPLE_SLOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define SAMPLE_SLOT_CATCHUP_MS      2000    // 剛同步時，目前時槽開始超過此時間就等下一個邊界
+
+// ============================================================================
+// 採樣時槽設定
+// ============================================================================
+typedef struct {
+    bool align;                     // true = 同步後對齊 epoch 時槽；false = 一律使用開機時間間隔
+    uint32_t period_s;              // 時槽長度 (秒)，與資料發送間隔相同
+    uint32_t publish_spread_ms;     // 發布分散時間窗 (須小於時槽長度)
+    int32_t publish_offset_ms;      // 固定發布偏移 (-1 = 由 MAC 雜湊在分散時間窗內決定)
+} sample_slot_config_t;
+
+// ============================================================================
+// 採樣時槽統計
+// ============================================================================
+typedef struct {
+    bool aligned;                   // 最近一次採樣已對齊時槽
+    uint32_t period_s;              // 時槽長度 (秒)
+    uint32_t publish_offset_ms;     // 本裝置的發布偏移
+    uint32_t aligned_samples;       // 對齊時槽的採樣次數
+    uint32_t unaligned_samples;     // 未同步時以開機時間間隔採樣的次數
+    uint32_t missed_slots;          // 錯過的時槽數 (任務延遲超過一個週期)
+    uint32_t clock_steps_back;      // 時鐘倒退超過一個時槽而重新對齊的次數
+    int64_t last_slot_ms;           // 最近一次採樣的時槽邊界 (epoch 毫秒，-1 = 尚未對齊)
+    int32_t last_skew_ms;           // 最近一次採樣時刻 - 時槽邊界
+    uint32_t avg_skew_ms;           // 平均 |skew|
+    uint32_t max_skew_ms;           // 最大 |skew|
+    int32_t last_publish_lag_ms;    // 最近一次發布時刻 - 時槽邊界 (含發布偏移)
+} sample_slot_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化採樣時槽並決定本裝置的發布偏移
+ *
+ * @param config 採樣時槽設定
+ * @return esp_err_t ESP_ERR_INVALID_ARG 表示時槽長度為 0
+ */
+esp_err_t sample_slot_init(const sample_slot_config_t* config);
+
+/**
+ * @brief 檢查是否該採樣
+ *
+ * 已同步時每個時槽採樣一次 (邊界之後第一次呼叫即到期)，任務延遲跨過多個
+ * 時槽時只採樣最新的時槽並計入 missed_slots；時鐘倒退超過一個時槽時重新對齊
+ * 並計入 clock_steps_back；未同步時以開機時間間隔判斷
+ *
+ * @param slot_ms 回傳本次採樣的時槽邊界 (epoch 毫秒)，未對齊時為 -1
+ * @return bool true 表示應立即採樣
+ */
+bool sample_slot_due(int64_t* slot_ms);
+
+/**
+ * @brief 記錄一次採樣並計算相對時槽邊界的偏差
+ *
+ * @param slot_ms sample_slot_due() 回傳的時槽邊界
+ * @param sample_us 採樣時刻 (esp_timer_get_time)
+ * @return int32_t 採樣偏差 (毫秒)，未對齊時為 0
+ */
+int32_t sample_slot_record(int64_t slot_ms, int64_t sample_us);
+
+/**
+ * @brief 距離下一次採樣的時間 (供主循環決定等待時間，準時在邊界醒來)
+ *
+ * @return uint32_t 毫秒
+ */
+uint32_t sample_slot_ms_until_due(void);
+
+/**
+ * @brief 距離該時槽讀數應發布的時間 (時槽邊界 + 發布偏移)
+ *
+ * @param slot_ms 讀數的時槽邊界 (-1 表示未對齊，立即發布)
+ * @return uint32_t 毫秒，0 表示已到發布時間
+ */
+uint32_t sample_slot_publish_wait_ms(int64_t slot_ms);
+
+/**
+ * @brief 記錄時槽讀數已發布 (更新發布延遲統計)
+ *
+ * @param slot_ms 讀數的時槽邊界
+ */
+void sample_slot_note_published(int64_t slot_ms);
+
+/**
+ * @brief 取得採樣時槽統計
+ *
+ * @param stats 統計資訊結構指標
+ */
+void sample_slot_get_stats(sample_slot_stats_t* stats);
+
+#endif // SAMPLE_SLOT_H
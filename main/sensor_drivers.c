@@ -0,0 +1,280 @@
+// ============================================================================
+// sensor_drivers.c - 內建感測器驅動實作
+// 功能：I2C 驅動使用 ESP-IDF v5 的 i2c_master API，以單次量測模式讀取
+//       (量測之間感測器自動休眠)
+// ============================================================================
+
+#include "sensor_drivers.h"
+#include <math.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/i2c_master.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define I2C_SCL_SPEED_HZ        100000  // 標準模式，長線材較穩定
+#define I2C_TIMEOUT_MS          50
+
+#define SHT3X_CMD_MEASURE_HIGH  0x2400  // 單次量測、高重複性、不使用 clock stretching
+#define SHT3X_MEASURE_MS        16      // 高重複性量測時間 (規格 15.5 ms)
+#define BH1750_CMD_POWER_ON     0x01
+#define BH1750_CMD_ONE_TIME_H   0x20    // 單次高解析度模式 (1 lx)，量測後自動斷電
+#define BH1750_MEASURE_MS       180     // 高解析度量測時間 (規格最大 180 ms)
+
+#define MOCK_DAY_SECONDS        86400.0f
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "SENSOR_DRV";
+
+// ============================================================================
+// 驅動私有資料
+// ============================================================================
+typedef struct {
+    uint8_t addr;
+    i2c_master_dev_handle_t dev;
+} i2c_sensor_ctx_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static i2c_master_bus_handle_t i2c_bus = NULL;
+static i2c_sensor_ctx_t sht3x_ctx;
+static i2c_sensor_ctx_t bh1750_ctx;
+static sensor_driver_t sht3x_driver;
+static sensor_driver_t bh1750_driver;
+static uint32_t mock_noise_state = 0x12345678;
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static esp_err_t i2c_sensor_attach(void *ctx);
+static esp_err_t sht3x_read(void *ctx, float *values);
+static esp_err_t bh1750_read(void *ctx, float *values);
+static esp_err_t mock_climate_read(void *ctx, float *values);
+static esp_err_t mock_light_read(void *ctx, float *values);
+static float mock_day_phase(void);
+static float mock_noise(float amplitude);
+
+// ============================================================================
+// I2C 匯流排
+// ============================================================================
+esp_err_t sensor_drivers_i2c_init(int sda_gpio, int scl_gpio)
+{
+    if (i2c_bus != NULL) {
+        return ESP_OK;
+    }
+
+    i2c_master_bus_config_t bus_config = {
+        .i2c_port = -1,                     // 自動選擇
+        .sda_io_num = sda_gpio,
+        .scl_io_num = scl_gpio,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .flags.enable_internal_pullup = true,
+    };
+    esp_err_t err = i2c_new_master_bus(&bus_config, &i2c_bus);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ I2C 匯流排初始化失敗: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "✅ I2C 匯流排初始化完成 (SDA=%d, SCL=%d)", sda_gpio, scl_gpio);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 驅動描述
+// ============================================================================
+const sensor_driver_t* sensor_driver_sht3x(uint8_t addr)
+{
+    sht3x_ctx.addr = addr;
+    sht3x_driver = (sensor_driver_t){
+        .name = "sht3x",
+        .cadence_s = 60,
+        .sample_cost_us = SHT3X_MEASURE_MS * 1000 + 1000,
+        .field_count = 2,
+        .fields = {
+            { .name = "air_temperature", .unit = "°C", .decimals = 2, .smoothing_pct = 0 },
+            { .name = "air_humidity", .unit = "%RH", .decimals = 1, .smoothing_pct = 50 },
+        },
+        .init = i2c_sensor_attach,
+        .read = sht3x_read,
+        .ctx = &sht3x_ctx,
+    };
+    return &sht3x_driver;
+}
+
+const sensor_driver_t* sensor_driver_bh1750(uint8_t addr)
+{
+    bh1750_ctx.addr = addr;
+    bh1750_driver = (sensor_driver_t){
+        .name = "bh1750",
+        .cadence_s = 300,       // 光照僅用於日照統計，讀取較耗時，降低頻率
+        .sample_cost_us = BH1750_MEASURE_MS * 1000 + 1000,
+        .field_count = 1,
+        .fields = {
+            { .name = "light_lux", .unit = "lx", .decimals = 0, .smoothing_pct = 0 },
+        },
+        .init = i2c_sensor_attach,
+        .read = bh1750_read,
+        .ctx = &bh1750_ctx,
+    };
+    return &bh1750_driver;
+}
+
+const sensor_driver_t* sensor_driver_mock_climate(void)
+{
+    static const sensor_driver_t driver = {
+        .name = "mock_climate",
+        .cadence_s = 60,
+        .sample_cost_us = 100,
+        .field_count = 2,
+        .fields = {
+            { .name = "air_temperature", .unit = "°C", .decimals = 2, .smoothing_pct = 0 },
+            { .name = "air_humidity", .unit = "%RH", .decimals = 1, .smoothing_pct = 50 },
+        },
+        .read = mock_climate_read,
+    };
+    return &driver;
+}
+
+const sensor_driver_t* sensor_driver_mock_light(void)
+{
+    static const sensor_driver_t driver = {
+        .name = "mock_light",
+        .cadence_s = 300,
+        .sample_cost_us = 100,
+        .field_count = 1,
+        .fields = {
+            { .name = "light_lux", .unit = "lx", .decimals = 0, .smoothing_pct = 0 },
+        },
+        .read = mock_light_read,
+    };
+    return &driver;
+}
+
+// ============================================================================
+// I2C 驅動 (內部函數)
+// ============================================================================
+// SHT3x 資料以 CRC-8 (多項式 0x31，初值 0xFF) 保護
+static uint8_t sht3x_crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static esp_err_t i2c_sensor_attach(void *ctx)
+{
+    i2c_sensor_ctx_t *sensor = (i2c_sensor_ctx_t *)ctx;
+    if (i2c_bus == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t err = i2c_master_probe(i2c_bus, sensor->addr, I2C_TIMEOUT_MS);
+    if (err != ESP_OK) {
+        return err;  // 感測器未安裝
+    }
+
+    i2c_device_config_t dev_config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = sensor->addr,
+        .scl_speed_hz = I2C_SCL_SPEED_HZ,
+    };
+    return i2c_master_bus_add_device(i2c_bus, &dev_config, &sensor->dev);
+}
+
+static esp_err_t sht3x_read(void *ctx, float *values)
+{
+    i2c_sensor_ctx_t *sensor = (i2c_sensor_ctx_t *)ctx;
+    const uint8_t cmd[2] = { SHT3X_CMD_MEASURE_HIGH >> 8, SHT3X_CMD_MEASURE_HIGH & 0xFF };
+    uint8_t data[6];
+
+    esp_err_t err = i2c_master_transmit(sensor->dev, cmd, sizeof(cmd), I2C_TIMEOUT_MS);
+    if (err != ESP_OK) {
+        return err;
+    }
+    vTaskDelay(pdMS_TO_TICKS(SHT3X_MEASURE_MS));
+    err = i2c_master_receive(sensor->dev, data, sizeof(data), I2C_TIMEOUT_MS);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (sht3x_crc8(&data[0], 2) != data[2] || sht3x_crc8(&data[3], 2) != data[5]) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    uint16_t raw_t = (uint16_t)(data[0] << 8 | data[1]);
+    uint16_t raw_rh = (uint16_t)(data[3] << 8 | data[4]);
+    values[0] = -45.0f + 175.0f * raw_t / 65535.0f;
+    values[1] = 100.0f * raw_rh / 65535.0f;
+    return ESP_OK;
+}
+
+static esp_err_t bh1750_read(void *ctx, float *values)
+{
+    i2c_sensor_ctx_t *sensor = (i2c_sensor_ctx_t *)ctx;
+    uint8_t cmd = BH1750_CMD_POWER_ON;
+    uint8_t data[2];
+
+    esp_err_t err = i2c_master_transmit(sensor->dev, &cmd, 1, I2C_TIMEOUT_MS);
+    if (err == ESP_OK) {
+        cmd = BH1750_CMD_ONE_TIME_H;
+        err = i2c_master_transmit(sensor->dev, &cmd, 1, I2C_TIMEOUT_MS);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    vTaskDelay(pdMS_TO_TICKS(BH1750_MEASURE_MS));
+    err = i2c_master_receive(sensor->dev, data, sizeof(data), I2C_TIMEOUT_MS);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    values[0] = (data[0] << 8 | data[1]) / 1.2f;  // 規格：計數 / 1.2 = lx
+    return ESP_OK;
+}
+
+
+// ============================================================================
+// 模擬驅動 (內部函數)
+// 以開機時間產生 24 小時週期：正午溫度最高、濕度最低，夜間光照為 0
+// ============================================================================
+static esp_err_t mock_climate_read(void *ctx, float *values)
+{
+    float phase = mock_day_phase();
+    values[0] = 22.0f + 6.0f * sinf(phase) + mock_noise(0.1f);
+    values[1] = 60.0f - 15.0f * sinf(phase) + mock_noise(1.0f);
+    return ESP_OK;
+}
+
+static esp_err_t mock_light_read(void *ctx, float *values)
+{
+    float daylight = sinf(mock_day_phase());
+    values[0] = daylight > 0 ? 20000.0f * daylight + mock_noise(200.0f) : 0.0f;
+    return ESP_OK;
+}
+
+static float mock_day_phase(void)
+{
+    // 開機時視為早上 6 點，正弦在正午達到最大值
+    float day_s = fmodf(esp_timer_get_time() / 1000000.0f, MOCK_DAY_SECONDS);
+    return 2.0f * (float)M_PI * day_s / MOCK_DAY_SECONDS;
+}
+
+static float mock_noise(float amplitude)
+{
+    // 固定種子的 LCG，讓模擬輸出可重現
+    mock_noise_state = mock_noise_state * 1664525u + 1013904223u;
+    return amplitude * ((mock_noise_state >> 8) / 8388608.0f - 1.0f);
+}
@@ -0,0 +1,60 @@
+// ============================================================================
+// sensor_drivers.h - 內建感測器驅動標頭檔
+// 功能：提供可註冊到 sensor_registry 的驅動描述：
+//       SHT3x 空氣溫濕度 (I2C)、BH1750 光照度 (I2C)，
+//       以及無硬體測試用的模擬驅動 (實機以 SENSOR_MOCK_ENABLED 啟用)
+// ============================================================================
+
+#ifndef SENSOR_DRIVERS_H
+#define SENSOR_DRIVERS_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sensor_registry.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define SHT3X_DEFAULT_ADDR      0x44    // ADDR 腳接地
+#define BH1750_DEFAULT_ADDR     0x23    // ADDR 腳接地
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 建立 I2C 主控匯流排 (I2C 驅動註冊前呼叫一次)
+ *
+ * @param sda_gpio SDA 腳位
+ * @param scl_gpio SCL 腳位
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t sensor_drivers_i2c_init(int sda_gpio, int scl_gpio);
+
+/**
+ * @brief SHT3x 空氣溫濕度驅動，輸出 air_temperature (°C)、air_humidity (%RH)
+ *
+ * @param addr I2C 位址 (0x44 或 0x45)
+ * @return const sensor_driver_t* 驅動描述
+ */
+const sensor_driver_t* sensor_driver_sht3x(uint8_t addr);
+
+/**
+ * @brief BH1750 光照度驅動，輸出 light_lux (lx)
+ *
+ * @param addr I2C 位址 (0x23 或 0x5C)
+ * @return const sensor_driver_t* 驅動描述
+ */
+const sensor_driver_t* sensor_driver_bh1750(uint8_t addr);
+
+/**
+ * @brief 模擬空氣溫濕度驅動 (以開機時間產生日夜週期，欄位與 SHT3x 相同)
+ */
+const sensor_driver_t* sensor_driver_mock_climate(void);
+
+/**
+ * @brief 模擬光照度驅動 (欄位與 BH1750 相同)
+ */
+const sensor_driver_t* sensor_driver_mock_light(void);
+
+#endif // SENSOR_DRIVERS_H
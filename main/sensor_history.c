@@ -0,0 +1,147 @@
+// ============================================================================
+// sensor_history.c - 感測器讀數快照與環形歷史緩衝區實作
+// 功能：固定大小環形緩衝區 (無動態配置)，寫入一次、多個讀取端共用
+// ============================================================================
+
+#include "sensor_history.h"
+#include <string.h>
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "time_sync.h"
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "HISTORY";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static sensor_reading_t ring[SENSOR_HISTORY_CAPACITY];
+static uint32_t last_seq = 0;                       // 最新紀錄序號 (0 表示沒有紀錄)
+static SemaphoreHandle_t history_mutex = NULL;
+static TaskHandle_t watchers[SENSOR_HISTORY_MAX_WATCHERS];
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t sensor_history_init(void)
+{
+    history_mutex = xSemaphoreCreateMutex();
+    if (history_mutex == NULL) {
+        ESP_LOGE(TAG, "無法建立歷史緩衝區互斥鎖");
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(ring, 0, sizeof(ring));
+    memset(watchers, 0, sizeof(watchers));
+    ESP_LOGI(TAG, "✅ 讀數歷史初始化完成 (%d 筆)", SENSOR_HISTORY_CAPACITY);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 記錄新讀數
+// ============================================================================
+uint32_t sensor_history_record(int raw_adc, float voltage, float moisture, int moisture_comp_x10,
+                               int32_t temp_x100, bool pump_on, int64_t sample_us)
+{
+    if (history_mutex == NULL) {
+        return 0;
+    }
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+
+    uint32_t seq = ++last_seq;
+    sensor_reading_t *r = &ring[seq % SENSOR_HISTORY_CAPACITY];
+    r->seq = seq;
+    r->uptime_ms = sample_us / 1000;
+    r->epoch_ms = time_sync_uptime_to_epoch_ms(sample_us);
+    r->raw_adc = raw_adc;
+    r->voltage_mv = (uint16_t)(voltage * 1000.0f + 0.5f);
+    r->moisture_x10 = (uint16_t)(moisture * 10.0f + 0.5f);
+    r->moisture_comp_x10 = moisture_comp_x10;
+    r->temp_x100 = (temp_x100 > INT16_MIN && temp_x100 <= INT16_MAX) ? temp_x100 : SENSOR_HISTORY_NO_TEMP;
+    r->pump_on = pump_on;
+
+    for (int i = 0; i < SENSOR_HISTORY_MAX_WATCHERS; i++) {
+        if (watchers[i] != NULL) {
+            xTaskNotifyGive(watchers[i]);
+        }
+    }
+
+    xSemaphoreGive(history_mutex);
+    return seq;
+}
+
+// ============================================================================
+// 讀取最新快照
+// ============================================================================
+bool sensor_history_latest(sensor_reading_t* out)
+{
+    if (history_mutex == NULL || out == NULL) {
+        return false;
+    }
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    bool available = last_seq > 0;
+    if (available) {
+        memcpy(out, &ring[last_seq % SENSOR_HISTORY_CAPACITY], sizeof(sensor_reading_t));
+    }
+    xSemaphoreGive(history_mutex);
+
+    return available;
+}
+
+// ============================================================================
+// 依序號讀取歷史
+// ============================================================================
+size_t sensor_history_read(uint32_t after_seq, sensor_reading_t* out, size_t max_count)
+{
+    if (history_mutex == NULL || out == NULL || max_count == 0) {
+        return 0;
+    }
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+
+    uint32_t oldest = last_seq >= SENSOR_HISTORY_CAPACITY ? last_seq - SENSOR_HISTORY_CAPACITY + 1 : 1;
+    uint32_t first = after_seq + 1 > oldest ? after_seq + 1 : oldest;
+    size_t count = 0;
+
+    for (uint32_t seq = first; seq <= last_seq && count < max_count; seq++) {
+        memcpy(&out[count++], &ring[seq % SENSOR_HISTORY_CAPACITY], sizeof(sensor_reading_t));
+    }
+
+    xSemaphoreGive(history_mutex);
+    return count;
+}
+
+// ============================================================================
+// 註冊/取消等待任務
+// ============================================================================
+esp_err_t sensor_history_watch(TaskHandle_t task)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    for (int i = 0; i < SENSOR_HISTORY_MAX_WATCHERS; i++) {
+        if (watchers[i] == NULL) {
+            watchers[i] = task;
+            err = ESP_OK;
+            break;
+        }
+    }
+    xSemaphoreGive(history_mutex);
+
+    return err;
+}
+
+void sensor_history_unwatch(TaskHandle_t task)
+{
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    for (int i = 0; i < SENSOR_HISTORY_MAX_WATCHERS; i++) {
+        if (watchers[i] == task) {
+            watchers[i] = NULL;
+        }
+    }
+    xSemaphoreGive(history_mutex);
+}
@@ -0,0 +1,99 @@
+// ============================================================================
+// sensor_history.h - 感測器讀數快照與環形歷史緩衝區標頭檔
+// 功能：保存最新讀數與最近 N 筆歷史，供本地 HTTP API、串流等讀取端共用
+// ============================================================================
+
+#ifndef SENSOR_HISTORY_H
+#define SENSOR_HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define SENSOR_HISTORY_CAPACITY     256     // 歷史筆數 (每筆 32 bytes，共 8 KB)
+#define SENSOR_HISTORY_MAX_WATCHERS 4       // 最多同時等待新讀數的任務數
+
+// ============================================================================
+// 單筆讀數紀錄 (定點格式，避免浮點並縮小體積)
+// 64 位元欄位放最前面，避免 8 byte 對齊的填充 (依此順序為 32 bytes)
+// ============================================================================
+typedef struct {
+    int64_t uptime_ms;          // 採樣時的開機毫秒數
+    int64_t epoch_ms;           // 採樣時的 epoch 毫秒 (-1 表示尚未同步)
+    uint32_t seq;               // 遞增序號 (從 1 開始)
+    uint16_t raw_adc;           // 原始 ADC 值
+    uint16_t voltage_mv;        // 電壓 (毫伏)
+    uint16_t moisture_x10;      // 濕度 (0.1%)
+    uint16_t moisture_comp_x10; // 溫度補償後濕度 (0.1%)
+    int16_t temp_x100;          // 溫度 (0.01°C，SENSOR_HISTORY_NO_TEMP 表示無溫度)
+    uint8_t pump_on;            // 採樣時泵浦狀態
+} sensor_reading_t;
+
+#define SENSOR_HISTORY_NO_TEMP  INT16_MIN
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化讀數歷史模組
+ *
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t sensor_history_init(void);
+
+/**
+ * @brief 記錄一筆新讀數並通知所有等待中的任務
+ *
+ * @param raw_adc 原始 ADC 值
+ * @param voltage 電壓 (V)
+ * @param moisture 濕度百分比
+ * @param moisture_comp_x10 溫度補償後濕度 (0.1%)
+ * @param temp_x100 溫度 (0.01°C)，無溫度時傳入 SENSOR_HISTORY_NO_TEMP
+ * @param pump_on 泵浦狀態
+ * @param sample_us 採樣當下的 esp_timer_get_time()
+ * @return uint32_t 新紀錄的序號
+ */
+uint32_t sensor_history_record(int raw_adc, float voltage, float moisture, int moisture_comp_x10,
+                               int32_t temp_x100, bool pump_on, int64_t sample_us);
+
+/**
+ * @brief 取得最新讀數快照
+ *
+ * @param out 讀數結構指標
+ * @return bool false 表示尚無任何讀數
+ */
+bool sensor_history_latest(sensor_reading_t* out);
+
+/**
+ * @brief 依序號讀取歷史 (由舊到新)
+ *
+ * @param after_seq 只回傳序號大於此值的紀錄 (0 表示從最舊的開始)
+ * @param out 輸出陣列
+ * @param max_count 輸出陣列容量
+ * @return size_t 實際複製的筆數
+ */
+size_t sensor_history_read(uint32_t after_seq, sensor_reading_t* out, size_t max_count);
+
+/**
+ * @brief 註冊任務，在有新讀數時以 task notification 喚醒
+ *
+ * @param task 任務句柄
+ * @return esp_err_t ESP_ERR_NO_MEM 表示等待者已滿
+ */
+esp_err_t sensor_history_watch(TaskHandle_t task);
+
+/**
+ * @brief 取消註冊等待任務
+ *
+ * @param task 任務句柄
+ */
+void sensor_history_unwatch(TaskHandle_t task);
+
+#endif // SENSOR_HISTORY_H
@@ -0,0 +1,213 @@
+// ============================================================================
+// sensor_registry.c - 感測器驅動註冊表實作
+// 功能：驅動表為靜態配置；只由感測器任務呼叫 collect，統計讀取以 portMUX 保護
+// ============================================================================
+
+#include "sensor_registry.h"
+#include <math.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define COST_LEARN_SHIFT    2       // 讀取成本估計的 EWMA 權重 (新值 1/4)
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "SENSOR_REG";
+
+// ============================================================================
+// 驅動槽位
+// ============================================================================
+typedef struct {
+    sensor_driver_t driver;
+    bool online;
+    bool have_value;
+    int64_t last_read_us;
+    float values[SENSOR_DRIVER_MAX_FIELDS];     // 濾波後的值
+    sensor_driver_stats_t stats;
+} driver_slot_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static driver_slot_t slots[SENSOR_REGISTRY_MAX_DRIVERS];
+static size_t slot_count = 0;
+static portMUX_TYPE registry_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static bool read_slot(driver_slot_t* slot);
+static void add_fields(cJSON* json, const driver_slot_t* slot);
+
+// ============================================================================
+// 註冊驅動
+// ============================================================================
+esp_err_t sensor_registry_register(const sensor_driver_t* driver)
+{
+    if (driver == NULL || driver->read == NULL || driver->field_count == 0 ||
+        driver->field_count > SENSOR_DRIVER_MAX_FIELDS || driver->cadence_s == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (slot_count >= SENSOR_REGISTRY_MAX_DRIVERS) {
+        ESP_LOGE(TAG, "❌ 驅動註冊表已滿，無法註冊 %s", driver->name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    driver_slot_t *slot = &slots[slot_count];
+    memset(slot, 0, sizeof(driver_slot_t));
+    memcpy(&slot->driver, driver, sizeof(sensor_driver_t));
+    slot->stats.name = driver->name;
+    slot->stats.cost_us = driver->sample_cost_us;
+
+    esp_err_t err = driver->init != NULL ? driver->init(driver->ctx) : ESP_OK;
+    slot->online = (err == ESP_OK);
+    slot->stats.online = slot->online;
+    slot_count++;
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 感測器驅動 %s 初始化失敗: %s", driver->name, esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "✅ 已註冊感測器驅動 %s (%d 個欄位，每 %lu 秒，約 %lu us)",
+             driver->name, driver->field_count, driver->cadence_s, driver->sample_cost_us);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 批次讀取並輸出
+// ============================================================================
+size_t sensor_registry_collect(cJSON* json, int64_t now_us)
+{
+    bool attempted[SENSOR_REGISTRY_MAX_DRIVERS] = {0};
+    uint32_t spent_us = 0;
+    size_t read_count = 0;
+
+    // 每輪挑出逾期最久的驅動，直到沒有到期驅動或預算用盡
+    while (1) {
+        driver_slot_t *next = NULL;
+        int64_t next_overdue = -1;
+        size_t next_index = 0;
+
+        for (size_t i = 0; i < slot_count; i++) {
+            driver_slot_t *slot = &slots[i];
+            if (!slot->online || attempted[i]) {
+                continue;
+            }
+            int64_t overdue = slot->have_value
+                ? now_us - slot->last_read_us - slot->driver.cadence_s * 1000000LL
+                : INT64_MAX;
+            if (overdue >= 0 && overdue > next_overdue) {
+                next = slot;
+                next_overdue = overdue;
+                next_index = i;
+            }
+        }
+        if (next == NULL) {
+            break;
+        }
+        attempted[next_index] = true;
+
+        // 至少讀取一個驅動，避免高成本驅動永遠被順延
+        if (read_count > 0 && spent_us + next->stats.cost_us > SENSOR_REGISTRY_WAKE_BUDGET_US) {
+            portENTER_CRITICAL(&registry_lock);
+            next->stats.deferred++;
+            portEXIT_CRITICAL(&registry_lock);
+            continue;
+        }
+
+        int64_t start_us = esp_timer_get_time();
+        bool ok = read_slot(next);
+        uint32_t cost_us = (uint32_t)(esp_timer_get_time() - start_us);
+        spent_us += cost_us;
+        read_count++;
+
+        portENTER_CRITICAL(&registry_lock);
+        // 以實測耗時修正成本估計，讓預算排程逐步貼近實際
+        next->stats.cost_us += ((int32_t)cost_us - (int32_t)next->stats.cost_us) >> COST_LEARN_SHIFT;
+        if (ok) {
+            next->stats.reads++;
+        } else {
+            next->stats.errors++;
+        }
+        portEXIT_CRITICAL(&registry_lock);
+    }
+
+    for (size_t i = 0; i < slot_count; i++) {
+        const driver_slot_t *slot = &slots[i];
+        if (slot->have_value &&
+            now_us - slot->last_read_us <= SENSOR_REGISTRY_STALE_FACTOR * slot->driver.cadence_s * 1000000LL) {
+            add_fields(json, slot);
+        }
+    }
+
+    return read_count;
+}
+
+// ============================================================================
+// 查詢介面
+// ============================================================================
+size_t sensor_registry_count(void)
+{
+    return slot_count;
+}
+
+esp_err_t sensor_registry_get_stats(size_t index, sensor_driver_stats_t* stats)
+{
+    if (index >= slot_count || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&registry_lock);
+    memcpy(stats, &slots[index].stats, sizeof(sensor_driver_stats_t));
+    portEXIT_CRITICAL(&registry_lock);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 讀取單一驅動並套用 EWMA 濾波 (內部函數)
+// ============================================================================
+static bool read_slot(driver_slot_t* slot)
+{
+    float raw[SENSOR_DRIVER_MAX_FIELDS];
+    esp_err_t err = slot->driver.read(slot->driver.ctx, raw);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 感測器 %s 讀取失敗: %s", slot->driver.name, esp_err_to_name(err));
+        return false;
+    }
+
+    for (int f = 0; f < slot->driver.field_count; f++) {
+        uint8_t pct = slot->driver.fields[f].smoothing_pct;
+        if (!slot->have_value || pct == 0 || pct >= 100 || isnan(slot->values[f])) {
+            slot->values[f] = raw[f];
+        } else {
+            slot->values[f] += (raw[f] - slot->values[f]) * pct / 100.0f;
+        }
+    }
+    slot->have_value = true;
+    slot->last_read_us = esp_timer_get_time();
+    return true;
+}
+
+// ============================================================================
+// 將驅動欄位加入 JSON (內部函數)
+// ============================================================================
+static void add_fields(cJSON* json, const driver_slot_t* slot)
+{
+    for (int f = 0; f < slot->driver.field_count; f++) {
+        const sensor_field_desc_t *field = &slot->driver.fields[f];
+        float value = slot->values[f];
+        if (isnan(value)) {
+            continue;  // 驅動以 NAN 表示此欄位本次無效
+        }
+
+        float scale = powf(10.0f, field->decimals);
+        cJSON_AddNumberToObject(json, field->name, roundf(value * scale) / scale);
+    }
+}
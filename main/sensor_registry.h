@@ -0,0 +1,99 @@
+// ============================================================================
+// sensor_registry.h - 感測器驅動註冊表標頭檔
+// 功能：各感測器驅動宣告讀取成本、讀取週期與輸出欄位後註冊；
+//       每次採樣喚醒時依成本預算批次讀取到期的驅動，輸出經共用濾波後
+//       併入同一筆讀數 JSON，與土壤濕度走相同的編碼 / 發布流程
+// ============================================================================
+
+#ifndef SENSOR_REGISTRY_H
+#define SENSOR_REGISTRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "cJSON.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define SENSOR_REGISTRY_MAX_DRIVERS     8       // 最多註冊的驅動數
+#define SENSOR_DRIVER_MAX_FIELDS        4       // 每個驅動最多輸出欄位數
+#define SENSOR_REGISTRY_WAKE_BUDGET_US  500000  // 每次喚醒的讀取時間預算 (超出者順延到下次)
+#define SENSOR_REGISTRY_STALE_FACTOR    3       // 超過 N 個讀取週期未更新的欄位不再發布
+
+// ============================================================================
+// 輸出欄位描述
+// ============================================================================
+typedef struct {
+    const char *name;           // JSON 欄位名稱 (例如 "air_humidity")
+    const char *unit;           // 單位 (僅供日誌與文件)
+    uint8_t decimals;           // 發布時保留的小數位數
+    uint8_t smoothing_pct;      // EWMA 新值權重 (%)，0 或 100 表示不濾波
+} sensor_field_desc_t;
+
+// ============================================================================
+// 感測器驅動描述
+// ============================================================================
+typedef struct {
+    const char *name;                                   // 驅動名稱 (日誌用)
+    uint32_t cadence_s;                                 // 讀取週期 (秒)
+    uint32_t sample_cost_us;                            // 預估單次讀取耗時 (排程用，實測後自動修正)
+    uint8_t field_count;                                // 輸出欄位數
+    sensor_field_desc_t fields[SENSOR_DRIVER_MAX_FIELDS];
+    esp_err_t (*init)(void *ctx);                       // 初始化 (可為 NULL)
+    esp_err_t (*read)(void *ctx, float *values);        // 讀取，依 fields 順序寫入 values
+    void *ctx;                                          // 驅動私有資料
+} sensor_driver_t;
+
+// ============================================================================
+// 單一驅動統計資訊
+// ============================================================================
+typedef struct {
+    const char *name;
+    uint32_t reads;             // 成功讀取次數
+    uint32_t errors;            // 讀取失敗次數
+    uint32_t deferred;          // 因超出喚醒預算而順延的次數
+    uint32_t cost_us;           // 目前使用的讀取成本估計
+    bool online;                // 初始化是否成功
+} sensor_driver_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 註冊感測器驅動並執行其初始化 (初始化失敗的驅動保留在表中但不讀取)
+ *
+ * @param driver 驅動描述 (內容會被複製，ctx 指向的資料需持續有效)
+ * @return esp_err_t ESP_ERR_NO_MEM 表示註冊表已滿，其他錯誤為驅動初始化結果
+ */
+esp_err_t sensor_registry_register(const sensor_driver_t* driver);
+
+/**
+ * @brief 批次讀取到期的驅動，並將所有有效欄位加入讀數 JSON
+ *
+ * 依逾期時間由久到短排序讀取，累計成本超過 SENSOR_REGISTRY_WAKE_BUDGET_US 者順延；
+ * 未到期的驅動沿用上次 (已濾波) 的值
+ *
+ * @param json 讀數 JSON 物件
+ * @param now_us 目前的 esp_timer_get_time()
+ * @return size_t 本次實際讀取的驅動數
+ */
+size_t sensor_registry_collect(cJSON* json, int64_t now_us);
+
+/**
+ * @brief 取得已註冊的驅動數
+ */
+size_t sensor_registry_count(void);
+
+/**
+ * @brief 取得指定驅動的統計資訊
+ *
+ * @param index 驅動索引 (0 ~ sensor_registry_count() - 1)
+ * @param stats 統計資訊結構指標
+ * @return esp_err_t ESP_ERR_INVALID_ARG 表示索引超出範圍
+ */
+esp_err_t sensor_registry_get_stats(size_t index, sensor_driver_stats_t* stats);
+
+#endif // SENSOR_REGISTRY_H
@@ -0,0 +1,371 @@
+// ============================================================================
+// soil_sensor.c - 土壤濕度感測器 (ADC) 模組實作
+// 功能：使用 ESP-IDF v5.0+ 的 adc_oneshot 與 adc_cali API
+// ============================================================================
+
+#include "soil_sensor.h"
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "power_mgmt.h"
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "SOIL_ADC";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static soil_sensor_config_t sensor_config;
+static adc_oneshot_unit_handle_t adc1_handle = NULL;   // ADC1 單元句柄
+static adc_cali_handle_t adc1_cali_handle = NULL;      // 土壤通道的 ADC 校準句柄，用於電壓轉換
+static SemaphoreHandle_t adc_mutex = NULL;             // adc_oneshot 存取互斥鎖
+
+// 連續模式擷取期間的樣本來源 (擷取任務寫入，讀取端不取互斥鎖)
+#define CAPTURE_TAP_SAMPLES     32      // soil_sensor_read() 每次採樣從擷取緩衝區平均的樣本數
+#define CAPTURE_POLL_MS         10      // 擷取已開始但尚無樣本時的等待間隔
+static const uint16_t *volatile capture_samples = NULL;
+static volatile uint32_t capture_count = 0;
+
+// 額外通道與各自的校準句柄 (曲線擬合校準與通道綁定，不可共用土壤通道的句柄)
+#define EXTRA_CHANNEL_MAX   4
+static adc_channel_t extra_channels[EXTRA_CHANNEL_MAX];
+static adc_cali_handle_t extra_cali_handles[EXTRA_CHANNEL_MAX];
+static int extra_channel_count = 0;
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static adc_cali_handle_t create_cali_handle(adc_channel_t channel);
+static int raw_to_mv(adc_cali_handle_t handle, int raw_adc);
+static bool lock_or_capture(int samples, int* raw_adc);
+
+// ============================================================================
+// ADC 初始化
+// ============================================================================
+esp_err_t soil_sensor_init(const soil_sensor_config_t* config)
+{
+    if (config == NULL || config->air_value == config->water_value || config->sample_count <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(&sensor_config, config, sizeof(soil_sensor_config_t));
+
+    adc_mutex = xSemaphoreCreateMutex();
+    if (adc_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // ADC1 單元初始化配置
+    adc_oneshot_unit_init_cfg_t init_config1 = {
+        .unit_id = ADC_UNIT_1,              // 指定 ADC1 單元
+        .ulp_mode = ADC_ULP_MODE_DISABLE,   // 停用超低功耗模式
+    };
+    esp_err_t err = adc_oneshot_new_unit(&init_config1, &adc1_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 無法建立 ADC 單元: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // ADC 通道配置
+    adc_oneshot_chan_cfg_t chan_config = {
+        .bitwidth = ADC_BITWIDTH_12,    // 12位元解析度 (0-4095)
+        .atten = ADC_ATTEN_DB_12,       // 12dB 衰減，測量範圍 0-3.3V
+    };
+    err = adc_oneshot_config_channel(adc1_handle, sensor_config.channel, &chan_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 無法配置 ADC 通道: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    adc1_cali_handle = create_cali_handle(sensor_config.channel);
+
+    ESP_LOGI(TAG, "ADC 初始化完成");
+    return ESP_OK;
+}
+
+// ============================================================================
+// 平均採樣 (每次讀取個別上鎖，讓高頻監測可以穿插)
+// ============================================================================
+esp_err_t soil_sensor_read(int* raw_adc, float* voltage, float* moisture)
+{
+    if (adc_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t adc_sum = 0;
+
+    // 整段平均採樣期間保持 APB 頻率，避免取樣間隔中淺眠/降頻造成讀值偏移
+    power_mgmt_acquire(PM_SUBSYS_ADC);
+    for (int i = 0; i < sensor_config.sample_count; i++) {
+        int raw_value;
+        esp_err_t err = ESP_OK;
+
+        if (lock_or_capture(CAPTURE_TAP_SAMPLES, &raw_value)) {
+            err = adc_oneshot_read(adc1_handle, sensor_config.channel, &raw_value);
+            xSemaphoreGive(adc_mutex);
+        }
+        if (err != ESP_OK) {
+            power_mgmt_release(PM_SUBSYS_ADC);
+            return err;
+        }
+
+        adc_sum += raw_value;
+
+        // 短暫延遲以允許 ADC 穩定
+        vTaskDelay(pdMS_TO_TICKS(sensor_config.sample_delay_ms));
+    }
+    power_mgmt_release(PM_SUBSYS_ADC);
+
+    *raw_adc = adc_sum / sensor_config.sample_count;
+    *voltage = soil_sensor_raw_to_voltage(*raw_adc);
+    *moisture = soil_sensor_raw_to_moisture(*raw_adc);
+    return ESP_OK;
+}
+
+esp_err_t soil_sensor_read_raw(int samples, int* raw_adc)
+{
+    if (adc_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (samples <= 0 || raw_adc == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t adc_sum = 0;
+    esp_err_t err = ESP_OK;
+
+    if (!lock_or_capture(samples, raw_adc)) {
+        return ESP_OK;  // 擷取進行中，已由擷取緩衝區取得
+    }
+    power_mgmt_acquire(PM_SUBSYS_ADC);
+    for (int i = 0; i < samples && err == ESP_OK; i++) {
+        int raw_value = 0;
+        err = adc_oneshot_read(adc1_handle, sensor_config.channel, &raw_value);
+        adc_sum += raw_value;
+    }
+    power_mgmt_release(PM_SUBSYS_ADC);
+    xSemaphoreGive(adc_mutex);
+
+    if (err == ESP_OK) {
+        *raw_adc = adc_sum / samples;
+    }
+    return err;
+}
+
+// ============================================================================
+// 額外通道 (共用 ADC1 單元與互斥鎖)
+// ============================================================================
+esp_err_t soil_sensor_add_channel(adc_channel_t channel)
+{
+    if (adc_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    adc_oneshot_chan_cfg_t chan_config = {
+        .bitwidth = ADC_BITWIDTH_12,
+        .atten = ADC_ATTEN_DB_12,
+    };
+
+    xSemaphoreTake(adc_mutex, portMAX_DELAY);
+    esp_err_t err = adc_oneshot_config_channel(adc1_handle, channel, &chan_config);
+    xSemaphoreGive(adc_mutex);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    for (int i = 0; i < extra_channel_count; i++) {
+        if (extra_channels[i] == channel) {
+            return ESP_OK;  // 重複加入，沿用既有的校準句柄
+        }
+    }
+    if (extra_channel_count >= EXTRA_CHANNEL_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    extra_channels[extra_channel_count] = channel;
+    extra_cali_handles[extra_channel_count] = create_cali_handle(channel);
+    extra_channel_count++;
+    return ESP_OK;
+}
+
+esp_err_t soil_sensor_read_channel_mv(adc_channel_t channel, int samples, int* voltage_mv)
+{
+    if (adc_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (samples <= 0 || voltage_mv == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    adc_cali_handle_t cali_handle = NULL;
+    for (int i = 0; i < extra_channel_count; i++) {
+        if (extra_channels[i] == channel) {
+            cali_handle = extra_cali_handles[i];
+            break;
+        }
+    }
+
+    uint32_t adc_sum = 0;
+    esp_err_t err = ESP_OK;
+
+    xSemaphoreTake(adc_mutex, portMAX_DELAY);
+    power_mgmt_acquire(PM_SUBSYS_ADC);
+    for (int i = 0; i < samples && err == ESP_OK; i++) {
+        int raw_value = 0;
+        err = adc_oneshot_read(adc1_handle, channel, &raw_value);
+        adc_sum += raw_value;
+    }
+    power_mgmt_release(PM_SUBSYS_ADC);
+    xSemaphoreGive(adc_mutex);
+
+    if (err == ESP_OK) {
+        *voltage_mv = raw_to_mv(cali_handle, adc_sum / samples);
+    }
+    return err;
+}
+
+// ============================================================================
+// 獨佔存取
+// ============================================================================
+esp_err_t soil_sensor_acquire(TickType_t timeout)
+{
+    if (adc_mutex == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xSemaphoreTake(adc_mutex, timeout) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    power_mgmt_acquire(PM_SUBSYS_ADC);  // 連續模式 DMA 同樣依賴 APB 時脈
+    return ESP_OK;
+}
+
+void soil_sensor_release(void)
+{
+    power_mgmt_release(PM_SUBSYS_ADC);
+    xSemaphoreGive(adc_mutex);
+}
+
+// ============================================================================
+// 擷取緩衝區讀取路徑
+// ============================================================================
+void soil_sensor_capture_attach(const uint16_t* samples)
+{
+    capture_count = 0;
+    capture_samples = samples;
+}
+
+void soil_sensor_capture_update(uint32_t count)
+{
+    capture_count = count;
+}
+
+void soil_sensor_capture_detach(void)
+{
+    capture_samples = NULL;
+    capture_count = 0;
+}
+
+// 取得 adc_oneshot 的使用權 (回傳 true，呼叫者讀完後釋放互斥鎖)，
+// 或在連續模式擷取進行中時直接以擷取緩衝區最新的樣本平均填入 raw_adc (回傳 false)
+static bool lock_or_capture(int samples, int* raw_adc)
+{
+    while (true) {
+        const uint16_t *buffer = capture_samples;
+        uint32_t count = capture_count;
+        if (buffer != NULL && count > 0) {
+            uint32_t n = (uint32_t)samples < count ? (uint32_t)samples : count;
+            uint32_t sum = 0;
+            for (uint32_t i = count - n; i < count; i++) {
+                sum += buffer[i];
+            }
+            *raw_adc = sum / n;
+            return false;
+        }
+        // 擷取剛開始尚無樣本，或擷取以外的獨佔 (ADC 基準測試) 時等待
+        if (xSemaphoreTake(adc_mutex, pdMS_TO_TICKS(CAPTURE_POLL_MS)) == pdTRUE) {
+            return true;
+        }
+    }
+}
+
+void soil_sensor_get_config(soil_sensor_config_t* config)
+{
+    if (config != NULL) {
+        memcpy(config, &sensor_config, sizeof(soil_sensor_config_t));
+    }
+}
+
+// ============================================================================
+// 換算函數
+// ============================================================================
+float soil_sensor_raw_to_moisture(int raw_adc)
+{
+    // 公式：(乾燥值 - 目前值) / (乾燥值 - 濕潤值) * 100
+    float moisture = (float)(sensor_config.air_value - raw_adc) * 100.0f /
+                     (sensor_config.air_value - sensor_config.water_value);
+
+    // 限制濕度值在 0-100% 範圍內
+    if (moisture > 100.0f) moisture = 100.0f;
+    if (moisture < 0.0f) moisture = 0.0f;
+    return moisture;
+}
+
+float soil_sensor_raw_to_voltage(int raw_adc)
+{
+    return raw_to_mv(adc1_cali_handle, raw_adc) / 1000.0f;
+}
+
+static int raw_to_mv(adc_cali_handle_t handle, int raw_adc)
+{
+    int voltage_mv;
+
+    if (handle && adc_cali_raw_to_voltage(handle, raw_adc, &voltage_mv) == ESP_OK) {
+        return voltage_mv;
+    }
+
+    // 沒有校準時使用線性近似：12位元 0-4095 對應 0-3.3V
+    return (raw_adc * 3300 + 2047) / 4095;
+}
+
+// ============================================================================
+// ADC 校準句柄建立 (內部函數) - 優先使用曲線擬合
+// ============================================================================
+static adc_cali_handle_t create_cali_handle(adc_channel_t channel)
+{
+    adc_cali_handle_t handle = NULL;
+
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+    adc_cali_curve_fitting_config_t cali_config = {
+        .unit_id = ADC_UNIT_1,
+        .chan = channel,
+        .atten = ADC_ATTEN_DB_12,
+        .bitwidth = ADC_BITWIDTH_12,
+    };
+    if (adc_cali_create_scheme_curve_fitting(&cali_config, &handle) == ESP_OK) {
+        ESP_LOGI(TAG, "ADC 通道 %d 校準方案：Curve Fitting", channel);
+    }
+#endif
+
+    // 如果曲線擬合不支援，嘗試線性擬合校準 (以整個 ADC 單元為單位)
+#if ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    if (!handle) {
+        adc_cali_line_fitting_config_t line_config = {
+            .unit_id = ADC_UNIT_1,
+            .atten = ADC_ATTEN_DB_12,
+            .bitwidth = ADC_BITWIDTH_12,
+        };
+        if (adc_cali_create_scheme_line_fitting(&line_config, &handle) == ESP_OK) {
+            ESP_LOGI(TAG, "ADC 通道 %d 校準方案：Line Fitting", channel);
+        }
+    }
+#else
+    (void)channel;
+#endif
+
+    return handle;
+}
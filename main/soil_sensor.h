@@ -0,0 +1,128 @@
+// ============================================================================
+// soil_sensor.h - 土壤濕度感測器 (ADC) 模組標頭檔
+// 功能：ADC 初始化、校準、平均採樣與濕度換算；adc_oneshot 非執行緒安全，
+//       所有讀取經由本模組的互斥鎖序列化，供多個任務共用
+// ============================================================================
+
+#ifndef SOIL_SENSOR_H
+#define SOIL_SENSOR_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_adc/adc_oneshot.h"
+#include "freertos/FreeRTOS.h"
+
+// ============================================================================
+// 感測器配置
+// ============================================================================
+typedef struct {
+    adc_channel_t channel;      // ADC1 通道
+    int air_value;              // 乾燥空氣中的 ADC 讀值 (濕度 0%)
+    int water_value;            // 完全浸水的 ADC 讀值 (濕度 100%)
+    int sample_count;           // soil_sensor_read() 的平均採樣次數
+    uint32_t sample_delay_ms;   // soil_sensor_read() 每次採樣間隔
+} soil_sensor_config_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化 ADC 單元、通道與校準方案
+ *
+ * @param config 感測器配置
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t soil_sensor_init(const soil_sensor_config_t* config);
+
+/**
+ * @brief 平均採樣並換算電壓與濕度 (依配置的次數與間隔)
+ *
+ * @param raw_adc 平均 ADC 值
+ * @param voltage 電壓 (V)
+ * @param moisture 濕度百分比 (0-100)
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t soil_sensor_read(int* raw_adc, float* voltage, float* moisture);
+
+/**
+ * @brief 連續快速採樣並回傳平均值 (無延遲，用於高頻監測)
+ *
+ * @param samples 採樣次數
+ * @param raw_adc 平均 ADC 值
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t soil_sensor_read_raw(int samples, int* raw_adc);
+
+/**
+ * @brief 在同一個 ADC1 單元上配置額外通道 (例如外接溫度探頭)，並建立該通道專用的校準句柄
+ *
+ * @param channel ADC1 通道
+ * @return esp_err_t ESP_OK 表示成功，ESP_ERR_NO_MEM 表示額外通道已達上限
+ */
+esp_err_t soil_sensor_add_channel(adc_channel_t channel);
+
+/**
+ * @brief 讀取額外通道的平均電壓 (連續快速採樣)
+ *
+ * @param channel 已以 soil_sensor_add_channel() 配置的通道
+ * @param samples 採樣次數
+ * @param voltage_mv 平均電壓 (毫伏)
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t soil_sensor_read_channel_mv(adc_channel_t channel, int samples, int* voltage_mv);
+
+/**
+ * @brief 暫時取得 ADC 獨佔權 (例如切換到連續採樣模式時)
+ *
+ * 持有期間其他讀取端會阻塞等待，呼叫者應盡快以 soil_sensor_release() 釋放
+ *
+ * @param timeout 等待時間
+ * @return esp_err_t ESP_ERR_TIMEOUT 表示逾時
+ */
+esp_err_t soil_sensor_acquire(TickType_t timeout);
+
+/**
+ * @brief 釋放 soil_sensor_acquire() 取得的獨佔權
+ */
+void soil_sensor_release(void);
+
+/**
+ * @brief 連續模式擷取土壤通道時，把擷取緩衝區掛上讀取路徑 (持有獨佔權期間呼叫)
+ *
+ * 掛上後 soil_sensor_read() 與 soil_sensor_read_raw() 不再等待獨佔權，
+ * 改以緩衝區中最新的樣本平均回傳 (同為 12 位元原始碼)，澆水監測與一般讀數不會被擷取阻塞；
+ * soil_sensor_read_channel_mv() 讀的是其他通道，仍會等到擷取結束
+ *
+ * @param samples 擷取緩衝區 (擷取結束後仍須有效)
+ */
+void soil_sensor_capture_attach(const uint16_t* samples);
+
+/**
+ * @brief 更新擷取緩衝區中已寫入的樣本數 (每個 DMA 訊框後呼叫)
+ */
+void soil_sensor_capture_update(uint32_t count);
+
+/**
+ * @brief 取下擷取緩衝區 (釋放獨佔權前呼叫)
+ */
+void soil_sensor_capture_detach(void);
+
+/**
+ * @brief 取得目前的感測器配置
+ *
+ * @param config 配置結構指標
+ */
+void soil_sensor_get_config(soil_sensor_config_t* config);
+
+/**
+ * @brief ADC 原始值換算為濕度百分比 (0-100)
+ */
+float soil_sensor_raw_to_moisture(int raw_adc);
+
+/**
+ * @brief ADC 原始值換算為電壓 (V)，有校準時使用校準曲線
+ */
+float soil_sensor_raw_to_voltage(int raw_adc);
+
+#endif // SOIL_SENSOR_H
@@ -0,0 +1,272 @@
+// ============================================================================
+// telemetry_transport.c - 遙測傳輸抽象層實作
+// 功能：將發布請求導向 MQTT 或 CoAP，並統計送達延遲
+// ============================================================================
+
+#include "telemetry_transport.h"
+#include "conn_stats.h"
+#include "coap_client.h"
+#include "gateway.h"
+#include "command_handler.h"
+#include <string.h>
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+
+// ============================================================================
+// 外部函數引用 (來自 main.c)
+// ============================================================================
+extern esp_mqtt_client_handle_t get_mqtt_client(void);
+extern bool mqtt_is_connected(void);
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define COAP_POLL_TASK_STACK_SIZE   3072    // 指令輪詢任務堆疊大小
+#define COAP_POLL_TASK_PRIORITY     3       // 指令輪詢任務優先順序
+#define COAP_COMMAND_BUFFER_SIZE    COMMAND_MAX_PAYLOAD // 指令回應緩衝區大小 (與指令處理模組的上限一致)
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "TELEMETRY";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static telemetry_transport_config_t transport_config = {
+    .type = TELEMETRY_TRANSPORT_MQTT,
+};
+static telemetry_stats_t transport_stats = {
+    .first_send_ms = -1,
+    .first_ack_ms = -1,
+};
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;  // MQTT 事件、CoAP 輪詢與各發布任務都會更新統計
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void coap_command_poll_task(void *pvParameters);
+
+// ============================================================================
+// 初始化遙測傳輸層
+// ============================================================================
+esp_err_t telemetry_transport_init(const telemetry_transport_config_t* config)
+{
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(&transport_config, config, sizeof(telemetry_transport_config_t));
+
+    if (transport_config.type == TELEMETRY_TRANSPORT_COAP) {
+        esp_err_t err = coap_client_init(transport_config.coap_host, transport_config.coap_port);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "❌ CoAP 客戶端初始化失敗: %s", esp_err_to_name(err));
+            return err;
+        }
+
+        BaseType_t task_result = xTaskCreate(
+            coap_command_poll_task,
+            "coap_poll",
+            COAP_POLL_TASK_STACK_SIZE,
+            NULL,
+            COAP_POLL_TASK_PRIORITY,
+            NULL
+        );
+        if (task_result != pdPASS) {
+            ESP_LOGE(TAG, "❌ 無法建立 CoAP 指令輪詢任務");
+            return ESP_ERR_NO_MEM;
+        }
+    } else if (transport_config.type == TELEMETRY_TRANSPORT_GATEWAY) {
+        esp_err_t err = gateway_leaf_init(transport_config.gateway_host, transport_config.gateway_port);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "❌ 葉節點初始化失敗: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    ESP_LOGI(TAG, "✅ 遙測傳輸層初始化完成 - 傳輸: %s", telemetry_transport_name());
+    return ESP_OK;
+}
+
+// ============================================================================
+// 發布訊息
+// ============================================================================
+esp_err_t telemetry_publish(const char* topic, const char* data, int len, int qos, int retain)
+{
+    if (topic == NULL || data == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (len <= 0) {
+        len = strlen(data);
+    }
+
+    size_t max_payload = telemetry_max_payload();
+    if ((size_t)len > max_payload) {
+        portENTER_CRITICAL(&stats_lock);
+        transport_stats.oversize_dropped++;
+        portEXIT_CRITICAL(&stats_lock);
+        ESP_LOGW(TAG, "⚠️ %s 訊息 %d bytes 超過 %s 上限 %u bytes，未送出",
+                 topic, len, telemetry_transport_name(), (unsigned)max_payload);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    esp_err_t err;
+
+    // 呼叫返回即表示下一站已確認的傳輸 (CoAP CON、閘道器)
+    bool acked = false;
+    bool skipped = false;
+
+    if (transport_config.type == TELEMETRY_TRANSPORT_COAP) {
+        err = coap_client_post(topic, (const uint8_t *)data, len, qos > 0);
+        acked = qos > 0 || (size_t)len > COAP_CLIENT_BLOCK_SIZE;
+    } else if (transport_config.type == TELEMETRY_TRANSPORT_GATEWAY) {
+        err = gateway_leaf_relay(topic, data, len, qos, retain);
+        acked = true;
+    } else {
+        esp_mqtt_client_handle_t client = get_mqtt_client();
+        if (client == NULL || !mqtt_is_connected()) {
+            // 未連線時不交給客戶端排隊 (QoS > 0 會無上限地堆在 outbox)，另計為略過而非失敗
+            err = ESP_ERR_INVALID_STATE;
+            skipped = true;
+        } else {
+            int msg_id = esp_mqtt_client_publish(client, topic, data, len, qos, retain);
+            err = msg_id >= 0 ? ESP_OK : ESP_FAIL;
+        }
+    }
+
+    int64_t end_us = esp_timer_get_time();
+    bool first_send = false;
+    portENTER_CRITICAL(&stats_lock);
+    if (err == ESP_OK) {
+        transport_stats.publish_ok++;
+        transport_stats.bytes_sent += len;
+        transport_stats.last_publish_ms = (end_us - start_us) / 1000;
+        if (transport_stats.first_send_ms < 0) {
+            // 各傳輸都以呼叫發布的時間點計算，CoAP CON 等待 ACK 的時間另計於 first_ack_ms
+            transport_stats.first_send_ms = start_us / 1000;
+            first_send = true;
+        }
+        if (acked && transport_stats.first_ack_ms < 0) {
+            transport_stats.first_ack_ms = end_us / 1000;
+        }
+    } else if (skipped) {
+        transport_stats.publish_skipped++;
+    } else {
+        transport_stats.publish_failed++;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (err == ESP_OK) {
+        conn_stats_add_bytes(len, 0);
+    }
+    if (first_send) {
+        ESP_LOGI(TAG, "📬 首筆資料送出 (%s) - 喚醒後 %lld ms", telemetry_transport_name(), start_us / 1000);
+    }
+    return err;
+}
+
+// ============================================================================
+// 單則訊息上限與發布確認
+// ============================================================================
+size_t telemetry_max_payload(void)
+{
+    switch (transport_config.type) {
+        case TELEMETRY_TRANSPORT_COAP:
+            return COAP_CLIENT_MAX_PAYLOAD;
+        case TELEMETRY_TRANSPORT_GATEWAY:
+            return GATEWAY_MAX_RELAY_PAYLOAD;
+        case TELEMETRY_TRANSPORT_MQTT:
+        default:
+            return TELEMETRY_MQTT_MAX_PAYLOAD;
+    }
+}
+
+void telemetry_note_ack(void)
+{
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    portENTER_CRITICAL(&stats_lock);
+    bool first_ack = transport_stats.first_ack_ms < 0;
+    if (first_ack) {
+        transport_stats.first_ack_ms = now_ms;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (first_ack) {
+        ESP_LOGI(TAG, "📬 首筆資料已確認 (%s) - 喚醒後 %lld ms", telemetry_transport_name(), now_ms);
+    }
+}
+
+// ============================================================================
+// 取得傳輸資訊與統計
+// ============================================================================
+bool telemetry_is_connected(void)
+{
+    if (transport_config.type == TELEMETRY_TRANSPORT_MQTT) {
+        return mqtt_is_connected();
+    }
+    return true;
+}
+
+telemetry_transport_type_t telemetry_transport_get_type(void)
+{
+    return transport_config.type;
+}
+
+const char* telemetry_transport_name(void)
+{
+    switch (transport_config.type) {
+        case TELEMETRY_TRANSPORT_COAP:
+            return "coap";
+        case TELEMETRY_TRANSPORT_GATEWAY:
+            return "gateway";
+        case TELEMETRY_TRANSPORT_MQTT:
+        default:
+            return "mqtt";
+    }
+}
+
+void telemetry_get_stats(telemetry_stats_t* stats)
+{
+    if (stats != NULL) {
+        portENTER_CRITICAL(&stats_lock);
+        memcpy(stats, &transport_stats, sizeof(telemetry_stats_t));
+        portEXIT_CRITICAL(&stats_lock);
+    }
+}
+
+// ============================================================================
+// CoAP 指令輪詢任務 (FreeRTOS 任務)
+// CoAP 沒有訂閱機制，定期以 GET 取得待執行的指令
+// ============================================================================
+static void coap_command_poll_task(void *pvParameters)
+{
+    uint8_t buffer[COAP_COMMAND_BUFFER_SIZE];
+
+    ESP_LOGI(TAG, "🚀 CoAP 指令輪詢任務已啟動 (每 %lu ms)", transport_config.command_poll_interval_ms);
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(transport_config.command_poll_interval_ms));
+
+        size_t len = 0;
+        uint8_t code = 0;
+        esp_err_t err = coap_client_get(transport_config.command_path, buffer, sizeof(buffer), &len, &code);
+        if (err == ESP_ERR_INVALID_SIZE) {
+            // 截斷的 JSON 可能解析失敗或解析出錯誤的欄位，整則拒收
+            command_handler_reject_oversize("CoAP", len);
+            continue;
+        }
+        if (err != ESP_OK || len == 0) {
+            continue;  // 沒有待執行的指令或網路尚未就緒
+        }
+
+        ESP_LOGI(TAG, "收到 CoAP 指令: %.*s", (int)len, (const char *)buffer);
+        dispatch_command_payload((const char *)buffer, (int)len);
+    }
+}
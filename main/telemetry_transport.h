@@ -0,0 +1,134 @@
+// ============================================================================
+// telemetry_transport.h - 遙測傳輸抽象層標頭檔
+// 功能：統一的發布介面，依部署選擇 MQTT/TCP 或 CoAP/UDP 傳輸
+// ============================================================================
+
+#ifndef TELEMETRY_TRANSPORT_H
+#define TELEMETRY_TRANSPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 傳輸類型定義
+// ============================================================================
+typedef enum {
+    TELEMETRY_TRANSPORT_MQTT = 0,   // MQTT over TCP (預設)
+    TELEMETRY_TRANSPORT_COAP,       // CoAP over UDP (適合低功耗間歇喚醒節點)
+    TELEMETRY_TRANSPORT_GATEWAY,    // 區域 UDP 交由站點閘道器轉送 (葉節點)
+} telemetry_transport_type_t;
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define TELEMETRY_MQTT_MAX_PAYLOAD  8192    // MQTT 單則訊息上限 (QoS > 0 整則複製進 outbox)
+
+// ============================================================================
+// 傳輸配置結構
+// ============================================================================
+typedef struct {
+    telemetry_transport_type_t type;    // 傳輸類型
+    const char* coap_host;              // CoAP 伺服器 (僅 CoAP 使用)
+    uint16_t coap_port;                 // CoAP 埠號 (僅 CoAP 使用)
+    const char* command_path;           // 指令輪詢資源路徑 (僅 CoAP 使用)
+    uint32_t command_poll_interval_ms;  // 指令輪詢間隔 (僅 CoAP 使用)
+    const char* gateway_host;           // 閘道器 IP (僅葉節點使用)
+    uint16_t gateway_port;              // 閘道器 UDP 埠號 (僅葉節點使用)
+} telemetry_transport_config_t;
+
+// ============================================================================
+// 傳輸統計資訊
+// ============================================================================
+typedef struct {
+    uint32_t publish_ok;            // 成功發布次數
+    uint32_t publish_failed;        // 發布失敗次數 (不含未連線而略過的)
+    uint32_t publish_skipped;       // MQTT 未連線而未送出的次數
+    uint32_t bytes_sent;            // 已發送位元組數 (不含協定標頭)
+    uint32_t oversize_dropped;      // 超過 telemetry_max_payload() 而未送出的訊息數
+    int64_t first_send_ms;          // 開機/喚醒到第一筆資料交給傳輸層送出的時間 (各傳輸同一量測點，-1 表示尚未送出)
+    int64_t first_ack_ms;           // 開機/喚醒到下一站第一次確認的時間 (MQTT PUBACK/PUBCOMP、CoAP ACK、閘道器 ACK；
+                                    // MQTT QoS 0 與 CoAP NON 沒有確認，-1 表示尚未確認)
+    uint32_t last_publish_ms;       // 最近一次發布耗時 (CoAP CON 與閘道器含 ACK 往返時間)
+} telemetry_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化遙測傳輸層
+ *
+ * MQTT 模式下沿用 main.c 建立的 MQTT 客戶端；
+ * CoAP 模式下初始化 CoAP 客戶端並建立指令輪詢任務；
+ * 閘道器模式下初始化葉節點 UDP 連線
+ *
+ * @param config 傳輸配置結構指標
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t telemetry_transport_init(const telemetry_transport_config_t* config);
+
+/**
+ * @brief 透過目前的傳輸發布訊息
+ *
+ * MQTT：對應 esp_mqtt_client_publish()
+ * CoAP：topic 轉為 Uri-Path，qos 0 使用 NON，qos >= 1 使用 CON
+ * 閘道器：整則訊息交由閘道器以其 MQTT 連線轉送
+ *
+ * @param topic 主題 (CoAP 資源路徑)
+ * @param data 資料內容
+ * @param len 資料長度 (0 表示以 strlen 計算)
+ * @param qos 服務品質
+ * @param retain 是否保留 (MQTT 與閘道器轉送有效)
+ * @return esp_err_t ESP_OK 表示發布成功；ESP_ERR_INVALID_SIZE 表示超過 telemetry_max_payload()
+ */
+esp_err_t telemetry_publish(const char* topic, const char* data, int len, int qos, int retain);
+
+/**
+ * @brief 取得目前傳輸的單則訊息上限
+ *
+ * 產生大訊息的模組 (信封、原始擷取分段) 依此縮小或拆分，
+ * 超過上限的發布會被拒絕並計入 oversize_dropped
+ *
+ * @return size_t 單則訊息資料內容的最大位元組數
+ */
+size_t telemetry_max_payload(void);
+
+/**
+ * @brief 記錄下一站的發布確認 (MQTT_EVENT_PUBLISHED 呼叫)
+ */
+void telemetry_note_ack(void);
+
+/**
+ * @brief 檢查傳輸層目前是否能送出訊息
+ *
+ * MQTT 依 Broker 連線狀態 (CONNACK 後為 true，斷線即為 false)；
+ * CoAP 與閘道器為 UDP 無連線傳輸，恆為 true
+ *
+ * @return bool true 表示可發布
+ */
+bool telemetry_is_connected(void);
+
+/**
+ * @brief 取得目前傳輸類型
+ *
+ * @return telemetry_transport_type_t 傳輸類型
+ */
+telemetry_transport_type_t telemetry_transport_get_type(void);
+
+/**
+ * @brief 取得目前傳輸名稱 ("mqtt" / "coap" / "gateway")
+ *
+ * @return const char* 傳輸名稱
+ */
+const char* telemetry_transport_name(void);
+
+/**
+ * @brief 取得傳輸統計資訊
+ *
+ * @param stats 統計資訊結構指標
+ */
+void telemetry_get_stats(telemetry_stats_t* stats);
+
+#endif // TELEMETRY_TRANSPORT_H
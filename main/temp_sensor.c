@@ -0,0 +1,161 @@
+// ============================================================================
+// temp_sensor.c - 溫度感測器 HAL 實作
+// 功能：內建感測器使用 temperature_sensor 驅動；NTC 以 B 值方程式換算
+// ============================================================================
+
+#include "temp_sensor.h"
+#include "soil_sensor.h"
+#include <math.h>
+#include <string.h>
+#include "esp_log.h"
+#include "soc/soc_caps.h"
+#if SOC_TEMP_SENSOR_SUPPORTED
+#include "driver/temperature_sensor.h"
+#endif
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define NTC_SAMPLES             8           // NTC 每次讀取的快速採樣次數
+#define NTC_SUPPLY_MV           3300        // 分壓電路供電電壓
+#define KELVIN_OFFSET           273.15f
+#define NTC_T0_KELVIN           (25.0f + KELVIN_OFFSET)
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "TEMP_SENSOR";
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static temp_sensor_config_t temp_config = { .source = TEMP_SOURCE_NONE };
+#if SOC_TEMP_SENSOR_SUPPORTED
+static temperature_sensor_handle_t tsens_handle = NULL;
+#endif
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static esp_err_t read_internal(float* celsius);
+static esp_err_t read_ntc(float* celsius);
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t temp_sensor_init(const temp_sensor_config_t* config)
+{
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = ESP_OK;
+
+    switch (config->source) {
+        case TEMP_SOURCE_INTERNAL: {
+#if SOC_TEMP_SENSOR_SUPPORTED
+            // 土壤環境大致落在 -10~80°C，選擇對應量測範圍以取得最佳精度
+            temperature_sensor_config_t tsens_config = TEMPERATURE_SENSOR_CONFIG_DEFAULT(-10, 80);
+            err = temperature_sensor_install(&tsens_config, &tsens_handle);
+            if (err == ESP_OK) {
+                err = temperature_sensor_enable(tsens_handle);
+            }
+#else
+            err = ESP_ERR_NOT_SUPPORTED;
+#endif
+            break;
+        }
+        case TEMP_SOURCE_NTC:
+            if (config->ntc_series_ohms == 0 || config->ntc_r0_ohms == 0 || config->ntc_beta == 0) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            err = soil_sensor_add_channel(config->ntc_channel);
+            break;
+        case TEMP_SOURCE_NONE:
+        default:
+            break;
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "❌ 溫度感測器初始化失敗: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    memcpy(&temp_config, config, sizeof(temp_sensor_config_t));
+    ESP_LOGI(TAG, "✅ 溫度感測器初始化完成 - 來源: %s", temp_sensor_source_name());
+    return ESP_OK;
+}
+
+// ============================================================================
+// 讀取溫度
+// ============================================================================
+esp_err_t temp_sensor_read(int32_t* temp_x100)
+{
+    if (temp_x100 == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    float celsius = 0;
+    esp_err_t err;
+
+    switch (temp_config.source) {
+        case TEMP_SOURCE_INTERNAL:
+            err = read_internal(&celsius);
+            break;
+        case TEMP_SOURCE_NTC:
+            err = read_ntc(&celsius);
+            break;
+        default:
+            return ESP_ERR_INVALID_STATE;
+    }
+
+    if (err == ESP_OK) {
+        *temp_x100 = (int32_t)lroundf(celsius * 100.0f) + temp_config.offset_x100;
+    }
+    return err;
+}
+
+const char* temp_sensor_source_name(void)
+{
+    switch (temp_config.source) {
+        case TEMP_SOURCE_INTERNAL:
+            return "internal";
+        case TEMP_SOURCE_NTC:
+            return "ntc";
+        case TEMP_SOURCE_NONE:
+        default:
+            return "none";
+    }
+}
+
+// ============================================================================
+// 各來源讀取 (內部函數)
+// ============================================================================
+static esp_err_t read_internal(float* celsius)
+{
+#if SOC_TEMP_SENSOR_SUPPORTED
+    return temperature_sensor_get_celsius(tsens_handle, celsius);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+static esp_err_t read_ntc(float* celsius)
+{
+    int voltage_mv = 0;
+    esp_err_t err = soil_sensor_read_channel_mv(temp_config.ntc_channel, NTC_SAMPLES, &voltage_mv);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (voltage_mv <= 0 || voltage_mv >= NTC_SUPPLY_MV) {
+        return ESP_ERR_INVALID_RESPONSE;  // 探頭斷線或短路
+    }
+
+    // NTC 接地端：R_ntc = R_series * V / (Vcc - V)
+    float r_ntc = (float)temp_config.ntc_series_ohms * voltage_mv / (NTC_SUPPLY_MV - voltage_mv);
+
+    // B 值方程式：1/T = 1/T0 + ln(R/R0)/B
+    float inv_t = 1.0f / NTC_T0_KELVIN + logf(r_ntc / temp_config.ntc_r0_ohms) / temp_config.ntc_beta;
+    *celsius = 1.0f / inv_t - KELVIN_OFFSET;
+    return ESP_OK;
+}
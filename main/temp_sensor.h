@@ -0,0 +1,68 @@
+// ============================================================================
+// temp_sensor.h - 溫度感測器 HAL 標頭檔
+// 功能：統一晶片內建溫度感測器與外接 NTC 熱敏電阻的讀取介面，
+//       輸出 0.01°C 定點整數，供濕度溫度補償使用
+// ============================================================================
+
+#ifndef TEMP_SENSOR_H
+#define TEMP_SENSOR_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_adc/adc_oneshot.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define TEMP_SENSOR_INVALID INT32_MIN   // 無溫度讀數時的標記值
+
+// ============================================================================
+// 溫度來源
+// ============================================================================
+typedef enum {
+    TEMP_SOURCE_NONE = 0,       // 不量測溫度 (停用補償)
+    TEMP_SOURCE_INTERNAL,       // ESP32-C3 內建溫度感測器 (晶片溫度，含自熱偏移)
+    TEMP_SOURCE_NTC,            // 外接 NTC 熱敏電阻 (分壓接 ADC1，NTC 接地端)
+} temp_source_t;
+
+// ============================================================================
+// 溫度感測器配置
+// ============================================================================
+typedef struct {
+    temp_source_t source;
+    int32_t offset_x100;        // 讀數校正偏移 (0.01°C)，內建感測器用來扣除自熱
+    // 以下僅 TEMP_SOURCE_NTC 使用
+    adc_channel_t ntc_channel;  // NTC 分壓點所接的 ADC1 通道
+    uint32_t ntc_series_ohms;   // 上拉電阻值
+    uint32_t ntc_r0_ohms;       // NTC 在 25°C 的阻值
+    uint32_t ntc_beta;          // NTC B 值
+} temp_sensor_config_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化溫度感測器
+ *
+ * NTC 來源需在 soil_sensor_init() 之後呼叫 (共用 ADC1 單元)
+ *
+ * @param config 溫度感測器配置
+ * @return esp_err_t ESP_OK 表示成功，ESP_ERR_NOT_SUPPORTED 表示晶片不支援該來源
+ */
+esp_err_t temp_sensor_init(const temp_sensor_config_t* config);
+
+/**
+ * @brief 讀取溫度
+ *
+ * @param temp_x100 溫度 (0.01°C)
+ * @return esp_err_t ESP_ERR_INVALID_STATE 表示未啟用
+ */
+esp_err_t temp_sensor_read(int32_t* temp_x100);
+
+/**
+ * @brief 取得溫度來源名稱 ("none" / "internal" / "ntc")
+ */
+const char* temp_sensor_source_name(void);
+
+#endif // TEMP_SENSOR_H
@@ -0,0 +1,234 @@
+// ============================================================================
+// time_sync.c - SNTP 時間同步模組實作
+// 功能：SNTP 同步、開機時間到 epoch 的對應、漂移估計、自適應同步間隔、
+//       深度睡眠期間以 RTC 記憶體保存狀態
+// ============================================================================
+
+#include "time_sync.h"
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_attr.h"
+#include "esp_sntp.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define TIME_SYNC_RTC_MAGIC         0x54534E31  // "TSN1"
+#define TIME_SYNC_MIN_INTERVAL_S    900         // 最短同步間隔 15 分鐘
+#define TIME_SYNC_MAX_INTERVAL_S    86400       // 最長同步間隔 24 小時
+#define TIME_SYNC_GOOD_ERROR_MS     50          // 誤差低於此值時加倍間隔
+#define TIME_SYNC_BAD_ERROR_MS      250         // 誤差高於此值時減半間隔
+#define TIME_SYNC_MIN_DRIFT_SPAN_S  60          // 估算漂移所需的最短同步間距
+#define TIME_SYNC_DRIFT_GAIN        0.5f        // 漂移估計的平滑增益
+#define TIME_SYNC_MAX_DRIFT_PPM     500.0f      // 漂移估計上限
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "TIME_SYNC";
+
+// ============================================================================
+// 深度睡眠期間保留的狀態 (RTC slow memory)
+// esp_timer 在喚醒後歸零，因此只保存 epoch 端的資訊
+// ============================================================================
+typedef struct {
+    uint32_t magic;
+    float drift_ppm;
+    uint32_t sync_count;
+    uint32_t sync_interval_s;
+    int32_t last_error_ms;
+    int64_t last_sync_epoch_ms;
+} time_sync_rtc_state_t;
+
+static RTC_DATA_ATTR time_sync_rtc_state_t rtc_state;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static portMUX_TYPE time_sync_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool synced = false;
+static int64_t anchor_uptime_us = 0;    // 對應基準點：開機時間
+static int64_t anchor_epoch_us = 0;     // 對應基準點：epoch 時間
+static esp_timer_handle_t deferred_start_timer = NULL;
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static int64_t time_sync_map_locked(int64_t uptime_us);
+static void time_sync_notification_cb(struct timeval *tv);
+static void time_sync_start_sntp(void *arg);
+
+// ============================================================================
+// 初始化時間同步模組
+// ============================================================================
+esp_err_t time_sync_init(const char* server)
+{
+    if (server == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t start_delay_s = 0;
+
+    if (rtc_state.magic == TIME_SYNC_RTC_MAGIC && esp_reset_reason() == ESP_RST_DEEPSLEEP) {
+        // 深度睡眠期間系統時間由 RTC 維持，重新建立對應基準點
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        anchor_uptime_us = esp_timer_get_time();
+        anchor_epoch_us = (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+        synced = true;
+
+        int64_t next_sync_ms = rtc_state.last_sync_epoch_ms + (int64_t)rtc_state.sync_interval_s * 1000;
+        int64_t now_ms = anchor_epoch_us / 1000;
+        if (next_sync_ms > now_ms) {
+            start_delay_s = (next_sync_ms - now_ms) / 1000;
+        }
+        ESP_LOGI(TAG, "💤 沿用深度睡眠前的時間對應 (漂移 %.2f ppm，%lu 秒後同步)",
+                 rtc_state.drift_ppm, start_delay_s);
+    } else {
+        memset(&rtc_state, 0, sizeof(rtc_state));
+        rtc_state.magic = TIME_SYNC_RTC_MAGIC;
+        rtc_state.sync_interval_s = TIME_SYNC_MIN_INTERVAL_S;
+    }
+
+    esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, server);
+    sntp_set_time_sync_notification_cb(time_sync_notification_cb);
+    sntp_set_sync_interval(rtc_state.sync_interval_s * 1000);
+
+    if (start_delay_s == 0) {
+        time_sync_start_sntp(NULL);
+    } else {
+        // 尚未到同步時間：延後啟動 SNTP，省下喚醒後的網路往返
+        esp_timer_create_args_t timer_args = {
+            .callback = time_sync_start_sntp,
+            .name = "sntp_start",
+        };
+        esp_err_t err = esp_timer_create(&timer_args, &deferred_start_timer);
+        if (err != ESP_OK) {
+            return err;
+        }
+        esp_timer_start_once(deferred_start_timer, (uint64_t)start_delay_s * 1000000ULL);
+    }
+
+    ESP_LOGI(TAG, "✅ 時間同步模組初始化完成 - 伺服器: %s", server);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 查詢與轉換
+// ============================================================================
+bool time_sync_is_synced(void)
+{
+    return synced;
+}
+
+int64_t time_sync_uptime_to_epoch_ms(int64_t uptime_us)
+{
+    if (!synced) {
+        return -1;
+    }
+
+    portENTER_CRITICAL(&time_sync_lock);
+    int64_t epoch_us = time_sync_map_locked(uptime_us);
+    portEXIT_CRITICAL(&time_sync_lock);
+
+    return epoch_us / 1000;
+}
+
+int64_t time_sync_now_ms(void)
+{
+    return time_sync_uptime_to_epoch_ms(esp_timer_get_time());
+}
+
+void time_sync_get_stats(time_sync_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&time_sync_lock);
+    stats->synced = synced;
+    stats->sync_count = rtc_state.sync_count;
+    stats->drift_ppm = rtc_state.drift_ppm;
+    stats->last_error_ms = rtc_state.last_error_ms;
+    stats->sync_interval_s = rtc_state.sync_interval_s;
+    stats->last_sync_epoch_ms = rtc_state.last_sync_epoch_ms;
+    portEXIT_CRITICAL(&time_sync_lock);
+}
+
+// ============================================================================
+// 以基準點與漂移估計換算 epoch (內部函數，呼叫者持有 time_sync_lock)
+// ============================================================================
+static int64_t time_sync_map_locked(int64_t uptime_us)
+{
+    int64_t elapsed_us = uptime_us - anchor_uptime_us;
+    return anchor_epoch_us + elapsed_us + (int64_t)(elapsed_us * (double)rtc_state.drift_ppm / 1e6);
+}
+
+// ============================================================================
+// SNTP 同步完成回調 (在 lwIP 任務中執行)
+// ============================================================================
+static void time_sync_notification_cb(struct timeval *tv)
+{
+    int64_t uptime_us = esp_timer_get_time();
+    int64_t epoch_us = (int64_t)tv->tv_sec * 1000000LL + tv->tv_usec;
+    int32_t error_ms = 0;
+
+    portENTER_CRITICAL(&time_sync_lock);
+
+    if (synced) {
+        int64_t error_us = epoch_us - time_sync_map_locked(uptime_us);
+        int64_t span_us = uptime_us - anchor_uptime_us;
+        error_ms = error_us / 1000;
+
+        // 殘餘誤差 / 經過時間 = 尚未補償的漂移
+        if (span_us >= TIME_SYNC_MIN_DRIFT_SPAN_S * 1000000LL) {
+            float residual_ppm = (float)((double)error_us * 1e6 / (double)span_us);
+            float drift = rtc_state.drift_ppm + TIME_SYNC_DRIFT_GAIN * residual_ppm;
+            if (drift > TIME_SYNC_MAX_DRIFT_PPM) drift = TIME_SYNC_MAX_DRIFT_PPM;
+            if (drift < -TIME_SYNC_MAX_DRIFT_PPM) drift = -TIME_SYNC_MAX_DRIFT_PPM;
+            rtc_state.drift_ppm = drift;
+        }
+
+        // 自適應間隔：預測準確就拉長，誤差大就縮短
+        int32_t abs_error_ms = error_ms < 0 ? -error_ms : error_ms;
+        if (abs_error_ms <= TIME_SYNC_GOOD_ERROR_MS && rtc_state.sync_interval_s < TIME_SYNC_MAX_INTERVAL_S) {
+            rtc_state.sync_interval_s *= 2;
+        } else if (abs_error_ms >= TIME_SYNC_BAD_ERROR_MS && rtc_state.sync_interval_s > TIME_SYNC_MIN_INTERVAL_S) {
+            rtc_state.sync_interval_s /= 2;
+        }
+        if (rtc_state.sync_interval_s > TIME_SYNC_MAX_INTERVAL_S) rtc_state.sync_interval_s = TIME_SYNC_MAX_INTERVAL_S;
+        if (rtc_state.sync_interval_s < TIME_SYNC_MIN_INTERVAL_S) rtc_state.sync_interval_s = TIME_SYNC_MIN_INTERVAL_S;
+    }
+
+    anchor_uptime_us = uptime_us;
+    anchor_epoch_us = epoch_us;
+    synced = true;
+    rtc_state.sync_count++;
+    rtc_state.last_error_ms = error_ms;
+    rtc_state.last_sync_epoch_ms = epoch_us / 1000;
+    uint32_t interval_s = rtc_state.sync_interval_s;
+
+    portEXIT_CRITICAL(&time_sync_lock);
+
+    // lwIP 在回調結束後才排程下一次請求，於此更新即可生效
+    sntp_set_sync_interval(interval_s * 1000);
+
+    ESP_LOGI(TAG, "🕒 SNTP 同步完成 #%lu - 誤差 %ld ms，漂移 %.2f ppm，下次同步 %lu 秒後",
+             rtc_state.sync_count, error_ms, rtc_state.drift_ppm, interval_s);
+}
+
+// ============================================================================
+// 啟動 SNTP (內部函數，可由延遲計時器呼叫)
+// ============================================================================
+static void time_sync_start_sntp(void *arg)
+{
+    if (!esp_sntp_enabled()) {
+        esp_sntp_init();
+        ESP_LOGI(TAG, "🚀 SNTP 已啟動");
+    }
+}
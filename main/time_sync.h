@@ -0,0 +1,70 @@
+// ============================================================================
+// time_sync.h - SNTP 時間同步模組標頭檔
+// 功能：維護開機時間 (esp_timer) 到 Unix epoch 的對應關係，估算時脈漂移，
+//       提供採樣當下的毫秒級牆鐘時間戳
+// ============================================================================
+
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 時間同步統計資訊
+// ============================================================================
+typedef struct {
+    bool synced;                // 是否已有有效的時間對應
+    uint32_t sync_count;        // SNTP 同步次數 (跨深度睡眠累計)
+    float drift_ppm;            // 估算的本地時脈漂移 (ppm，正值表示本地較慢)
+    int32_t last_error_ms;      // 上次同步時，預測時間與 SNTP 時間的誤差 (毫秒)
+    uint32_t sync_interval_s;   // 目前的同步間隔 (秒)
+    int64_t last_sync_epoch_ms; // 上次同步的 epoch 時間 (毫秒)
+} time_sync_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化時間同步模組並啟動 SNTP
+ *
+ * 從深度睡眠喚醒時沿用 RTC 記憶體中的對應關係與漂移估計，
+ * 若尚未到下次同步時間則延後啟動 SNTP
+ *
+ * @param server NTP 伺服器主機名稱
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t time_sync_init(const char* server);
+
+/**
+ * @brief 檢查是否已取得有效的牆鐘時間
+ *
+ * @return bool true 表示已同步
+ */
+bool time_sync_is_synced(void);
+
+/**
+ * @brief 將開機時間 (esp_timer_get_time) 轉換為 epoch 毫秒 (含漂移補償)
+ *
+ * @param uptime_us 開機後的微秒數 (通常在採樣當下取得)
+ * @return int64_t epoch 毫秒，尚未同步時回傳 -1
+ */
+int64_t time_sync_uptime_to_epoch_ms(int64_t uptime_us);
+
+/**
+ * @brief 取得目前 epoch 毫秒 (含漂移補償)
+ *
+ * @return int64_t epoch 毫秒，尚未同步時回傳 -1
+ */
+int64_t time_sync_now_ms(void);
+
+/**
+ * @brief 取得時間同步統計資訊
+ *
+ * @param stats 統計資訊結構指標
+ */
+void time_sync_get_stats(time_sync_stats_t* stats);
+
+#endif // TIME_SYNC_H
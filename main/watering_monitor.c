@@ -0,0 +1,546 @@
+// ============================================================================
+// watering_monitor.c - 澆水回應驗證模組實作
+// 功能：泵浦啟動後以 10 Hz 採樣濕度，監測結束後計算：
+//       - 上升幅度：平滑後峰值 - 澆水前濕度
+//       - 時間常數：從泵浦啟動到達成 63.2% 上升幅度的時間
+//       正常結果以 EWMA 更新基準並存入 NVS，異常則發布警報
+// ============================================================================
+
+#include "watering_monitor.h"
+#include "soil_sensor.h"
+#include "telemetry_transport.h"
+#include "flow_meter.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "cJSON.h"
+
+// ============================================================================
+// 模組內部常數定義
+// ============================================================================
+#define MONITOR_TASK_STACK_SIZE     4096    // 監測任務堆疊大小
+#define MONITOR_TASK_PRIORITY       3       // 監測任務優先順序 (低於指令處理)
+#define MONITOR_TRACE_LEN           (WATERING_WINDOW_MS / WATERING_SAMPLE_INTERVAL_MS)
+#define MONITOR_PRE_SAMPLES         16      // 澆水前濕度的快速採樣次數
+#define MONITOR_TICK_SAMPLES        4       // 每個採樣點的快速平均次數
+#define MONITOR_SMOOTH_HALF_WIDTH   2       // 峰值搜尋的移動平均半寬 (前後各 2 點)
+#define BASELINE_ALPHA              0.2f    // 基準 EWMA 權重
+#define BASELINE_MIN_SAMPLES        3       // 基準樣本數達此值後才做相對比較
+#define NVS_NAMESPACE               "watering"
+#define NVS_KEY_BASELINE            "baseline"
+#define NVS_KEY_LOCKOUT             "lockout"   // 暫停澆水剩餘秒數 (u32)
+#define BASELINE_VERSION            1
+
+// ============================================================================
+// 日誌標籤
+// ============================================================================
+static const char *TAG = "WATERING";
+
+// ============================================================================
+// NVS 保存的基準 (結構變更時遞增 BASELINE_VERSION)
+// ============================================================================
+typedef struct {
+    uint8_t version;
+    uint8_t consecutive_failures;
+    uint16_t reserved;
+    float rise;                 // 基準上升幅度 (%)
+    float tau_s;                // 基準時間常數 (秒)
+    uint32_t samples;           // 累計樣本數
+} watering_baseline_t;
+
+// ============================================================================
+// 模組內部狀態變數
+// ============================================================================
+static const char *result_topic = NULL;
+static const char *alert_topic = NULL;
+static TaskHandle_t monitor_task_handle = NULL;
+static portMUX_TYPE monitor_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static watering_baseline_t baseline = { .version = BASELINE_VERSION };
+static watering_monitor_stats_t monitor_stats = { .last_tau_s = -1, .last_result = WATERING_RESULT_OK };
+static int64_t lockout_until_us = 0;
+
+// 單次監測的狀態 (由 begin/pump_stopped 寫入，監測任務讀取)
+static bool monitoring = false;
+static uint32_t extra_pulses = 0;
+static int pre_moisture_x10 = 0;
+static int64_t pump_start_us = 0;
+static int64_t pump_stop_us = 0;
+
+static uint16_t trace[MONITOR_TRACE_LEN];  // 濕度軌跡 (0.1%)
+
+// ============================================================================
+// 內部函數宣告
+// ============================================================================
+static void watering_monitor_task(void *pvParameters);
+static void analyze_and_report(int samples);
+static void publish_result(watering_result_t result, int pre_x10, int peak_x10, int rise_x10,
+                           int tau_ms, int pump_ms, float baseline_ratio);
+static void load_baseline(void);
+static void save_baseline(void);
+static void load_lockout(void);
+static void save_lockout(uint32_t remaining_s);
+static int moisture_x10_from_raw(int raw_adc);
+
+// ============================================================================
+// 初始化
+// ============================================================================
+esp_err_t watering_monitor_init(const char* result_topic_name, const char* alert_topic_name)
+{
+    if (result_topic_name == NULL || alert_topic_name == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    result_topic = result_topic_name;
+    alert_topic = alert_topic_name;
+    load_baseline();
+    load_lockout();
+
+    BaseType_t task_result = xTaskCreate(
+        watering_monitor_task,
+        "watering_mon",
+        MONITOR_TASK_STACK_SIZE,
+        NULL,
+        MONITOR_TASK_PRIORITY,
+        &monitor_task_handle
+    );
+    if (task_result != pdPASS) {
+        ESP_LOGE(TAG, "❌ 無法建立澆水監測任務");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "✅ 澆水監測初始化完成 - 基準上升 %.1f%% (τ %.1f 秒，%lu 筆)",
+             baseline.rise, baseline.tau_s, baseline.samples);
+    return ESP_OK;
+}
+
+// ============================================================================
+// 泵浦控制掛鉤
+// ============================================================================
+bool watering_monitor_pump_allowed(uint32_t* remaining_s)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&monitor_lock);
+    int64_t until_us = lockout_until_us;
+    portEXIT_CRITICAL(&monitor_lock);
+
+    if (until_us <= now_us) {
+        if (until_us != 0) {
+            // 暫停到期：清除 NVS 中的剩餘時間，避免下次開機又重新暫停
+            portENTER_CRITICAL(&monitor_lock);
+            bool expired = lockout_until_us == until_us;
+            if (expired) {
+                lockout_until_us = 0;
+            }
+            portEXIT_CRITICAL(&monitor_lock);
+            if (expired) {
+                save_lockout(0);
+                ESP_LOGI(TAG, "✅ 暫停澆水已到期，恢復澆水");
+            }
+        }
+        return true;
+    }
+    if (remaining_s != NULL) {
+        *remaining_s = (until_us - now_us) / 1000000;
+    }
+    return false;
+}
+
+void watering_monitor_clear_lockout(void)
+{
+    portENTER_CRITICAL(&monitor_lock);
+    bool was_locked = lockout_until_us != 0;
+    uint8_t failures = baseline.consecutive_failures;
+    lockout_until_us = 0;
+    baseline.consecutive_failures = 0;
+    portEXIT_CRITICAL(&monitor_lock);
+
+    save_lockout(0);
+    if (failures > 0) {
+        save_baseline();
+    }
+    ESP_LOGI(TAG, "🔓 已解除暫停澆水 (%s，連續無回應 %u 次歸零)",
+             was_locked ? "暫停中" : "未暫停", failures);
+}
+
+void watering_monitor_begin(void)
+{
+    if (monitor_task_handle == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&monitor_lock);
+    bool busy = monitoring;
+    if (busy) {
+        extra_pulses++;
+    }
+    portEXIT_CRITICAL(&monitor_lock);
+
+    if (busy) {
+        ESP_LOGW(TAG, "⚠️ 監測期間再次澆水，本次監測結果將不列入判定");
+        return;
+    }
+
+    int raw_adc = 0;
+    if (soil_sensor_read_raw(MONITOR_PRE_SAMPLES, &raw_adc) != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 無法讀取澆水前濕度，略過本次監測");
+        return;
+    }
+
+    portENTER_CRITICAL(&monitor_lock);
+    monitoring = true;
+    extra_pulses = 0;
+    pre_moisture_x10 = moisture_x10_from_raw(raw_adc);
+    pump_start_us = esp_timer_get_time();
+    pump_stop_us = 0;
+    portEXIT_CRITICAL(&monitor_lock);
+
+    xTaskNotifyGive(monitor_task_handle);
+}
+
+void watering_monitor_pump_stopped(void)
+{
+    portENTER_CRITICAL(&monitor_lock);
+    if (monitoring && pump_stop_us == 0) {
+        pump_stop_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&monitor_lock);
+}
+
+// ============================================================================
+// 查詢函數
+// ============================================================================
+const char* watering_result_name(watering_result_t result)
+{
+    switch (result) {
+        case WATERING_RESULT_OK:            return "ok";
+        case WATERING_RESULT_WEAK:          return "weak_response";
+        case WATERING_RESULT_NO_RESPONSE:   return "no_response";
+        case WATERING_RESULT_SATURATED:     return "saturated";
+        case WATERING_RESULT_INVALID:       return "invalid";
+        default:                            return "unknown";
+    }
+}
+
+void watering_monitor_get_stats(watering_monitor_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    uint32_t remaining_s = 0;
+    bool allowed = watering_monitor_pump_allowed(&remaining_s);
+
+    portENTER_CRITICAL(&monitor_lock);
+    memcpy(stats, &monitor_stats, sizeof(watering_monitor_stats_t));
+    stats->consecutive_failures = baseline.consecutive_failures;
+    stats->baseline_rise = baseline.rise;
+    stats->baseline_tau_s = baseline.tau_s;
+    stats->baseline_samples = baseline.samples;
+    portEXIT_CRITICAL(&monitor_lock);
+
+    stats->lockout_remaining_s = allowed ? 0 : remaining_s;
+}
+
+// ============================================================================
+// 監測任務 (FreeRTOS 任務)
+// 固定週期採樣，採樣本身只佔用 ADC 數十微秒，不影響其他讀取端
+// ============================================================================
+static void watering_monitor_task(void *pvParameters)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        ESP_LOGI(TAG, "💧 開始監測澆水回應 (%d 秒)", WATERING_WINDOW_MS / 1000);
+
+        TickType_t last_wake = xTaskGetTickCount();
+        int samples = 0;
+        while (samples < MONITOR_TRACE_LEN) {
+            int raw_adc = 0;
+            if (soil_sensor_read_raw(MONITOR_TICK_SAMPLES, &raw_adc) == ESP_OK) {
+                trace[samples++] = moisture_x10_from_raw(raw_adc);
+            }
+            vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(WATERING_SAMPLE_INTERVAL_MS));
+        }
+
+        analyze_and_report(samples);
+
+        portENTER_CRITICAL(&monitor_lock);
+        monitoring = false;
+        portEXIT_CRITICAL(&monitor_lock);
+    }
+}
+
+// ============================================================================
+// 分析軌跡、更新基準並發布結果
+// ============================================================================
+static void analyze_and_report(int samples)
+{
+    portENTER_CRITICAL(&monitor_lock);
+    int pre_x10 = pre_moisture_x10;
+    int pump_ms = pump_stop_us > 0 ? (pump_stop_us - pump_start_us) / 1000 : 0;
+    uint32_t extra = extra_pulses;
+    portEXIT_CRITICAL(&monitor_lock);
+
+    // 移動平均後找峰值，抑制單點雜訊造成的假上升
+    int peak_x10 = pre_x10;
+    for (int i = MONITOR_SMOOTH_HALF_WIDTH; i < samples - MONITOR_SMOOTH_HALF_WIDTH; i++) {
+        int sum = 0;
+        for (int k = -MONITOR_SMOOTH_HALF_WIDTH; k <= MONITOR_SMOOTH_HALF_WIDTH; k++) {
+            sum += trace[i + k];
+        }
+        int smoothed = sum / (2 * MONITOR_SMOOTH_HALF_WIDTH + 1);
+        if (smoothed > peak_x10) {
+            peak_x10 = smoothed;
+        }
+    }
+    int rise_x10 = peak_x10 - pre_x10;
+
+    // 時間常數：第一個達到 63.2% 上升幅度的採樣點
+    int tau_ms = -1;
+    if (rise_x10 > 0) {
+        int target_x10 = pre_x10 + (rise_x10 * 632 + 500) / 1000;
+        for (int i = 0; i < samples; i++) {
+            if (trace[i] >= target_x10) {
+                tau_ms = (i + 1) * WATERING_SAMPLE_INTERVAL_MS;
+                break;
+            }
+        }
+    }
+
+    float rise = rise_x10 / 10.0f;
+    float baseline_ratio = -1;
+    watering_result_t result;
+
+    portENTER_CRITICAL(&monitor_lock);
+    bool baseline_ready = baseline.samples >= BASELINE_MIN_SAMPLES && baseline.rise > 0;
+    if (baseline_ready) {
+        baseline_ratio = rise / baseline.rise;
+    }
+
+    if (extra > 0) {
+        result = WATERING_RESULT_INVALID;
+    } else if (pre_x10 >= WATERING_SATURATED_X10) {
+        result = WATERING_RESULT_SATURATED;
+    } else if (rise_x10 < WATERING_MIN_RISE_X10) {
+        result = WATERING_RESULT_NO_RESPONSE;
+    } else if (baseline_ready && baseline_ratio < WATERING_WEAK_RATIO) {
+        result = WATERING_RESULT_WEAK;
+    } else {
+        result = WATERING_RESULT_OK;
+    }
+
+    monitor_stats.monitored++;
+    monitor_stats.last_rise = rise;
+    monitor_stats.last_tau_s = tau_ms >= 0 ? tau_ms / 1000.0f : -1;
+    monitor_stats.last_result = result;
+
+    bool baseline_changed = false;
+    bool lockout_started = false;
+    switch (result) {
+        case WATERING_RESULT_OK:
+            // 只以正常結果學習，避免水箱逐漸見底時基準跟著下滑
+            if (baseline.samples == 0) {
+                baseline.rise = rise;
+                baseline.tau_s = tau_ms / 1000.0f;
+            } else {
+                baseline.rise += BASELINE_ALPHA * (rise - baseline.rise);
+                baseline.tau_s += BASELINE_ALPHA * (tau_ms / 1000.0f - baseline.tau_s);
+            }
+            baseline.samples++;
+            baseline.consecutive_failures = 0;
+            monitor_stats.ok_count++;
+            baseline_changed = true;
+            break;
+        case WATERING_RESULT_WEAK:
+            baseline.consecutive_failures = 0;
+            monitor_stats.weak_count++;
+            baseline_changed = true;
+            break;
+        case WATERING_RESULT_NO_RESPONSE:
+            if (baseline.consecutive_failures < UINT8_MAX) {
+                baseline.consecutive_failures++;
+            }
+            if (baseline.consecutive_failures >= WATERING_DRY_LOCKOUT_COUNT) {
+                lockout_until_us = esp_timer_get_time() + (int64_t)WATERING_LOCKOUT_S * 1000000LL;
+                lockout_started = true;
+            }
+            monitor_stats.no_response_count++;
+            baseline_changed = true;
+            break;
+        default:
+            break;
+    }
+    portEXIT_CRITICAL(&monitor_lock);
+
+    if (baseline_changed) {
+        save_baseline();
+    }
+    if (lockout_started) {
+        save_lockout(WATERING_LOCKOUT_S);
+    }
+
+    ESP_LOGI(TAG, "📊 澆水結果: %s - 上升 %.1f%% (%.1f → %.1f)，τ %d ms，出水 %d ms",
+             watering_result_name(result), rise, pre_x10 / 10.0f, peak_x10 / 10.0f, tau_ms, pump_ms);
+
+    publish_result(result, pre_x10, peak_x10, rise_x10, tau_ms, pump_ms, baseline_ratio);
+}
+
+// ============================================================================
+// 發布結果與警報
+// ============================================================================
+static void publish_result(watering_result_t result, int pre_x10, int peak_x10, int rise_x10,
+                           int tau_ms, int pump_ms, float baseline_ratio)
+{
+    watering_monitor_stats_t stats;
+    watering_monitor_get_stats(&stats);
+
+    float rise = rise_x10 / 10.0f;
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "type", "watering_result");
+    cJSON_AddStringToObject(json, "result", watering_result_name(result));
+    cJSON_AddNumberToObject(json, "moisture_before", pre_x10 / 10.0);
+    cJSON_AddNumberToObject(json, "moisture_peak", peak_x10 / 10.0);
+    cJSON_AddNumberToObject(json, "rise", rise);
+    cJSON_AddNumberToObject(json, "tau_ms", tau_ms);
+    cJSON_AddNumberToObject(json, "pump_ms", pump_ms);
+    // 澆水效率：每秒出水帶來的濕度上升
+    cJSON_AddNumberToObject(json, "rise_per_pump_s", pump_ms > 0 ? rise * 1000.0f / pump_ms : 0);
+    // 有流量計時以實際出水量計算效率 (水壓變化時比出水時間準確)
+    if (flow_meter_is_available()) {
+        flow_meter_stats_t flow_stats;
+        flow_meter_get_stats(&flow_stats);
+        cJSON_AddNumberToObject(json, "volume_ml", flow_stats.last_ml);
+        cJSON_AddNumberToObject(json, "rise_per_100ml", flow_stats.last_ml > 0 ? rise * 100.0f / flow_stats.last_ml : 0);
+    }
+    cJSON_AddNumberToObject(json, "baseline_rise", stats.baseline_rise);
+    cJSON_AddNumberToObject(json, "baseline_ratio", baseline_ratio);
+    cJSON_AddNumberToObject(json, "consecutive_failures", stats.consecutive_failures);
+    cJSON_AddNumberToObject(json, "timestamp", esp_timer_get_time() / 1000000);
+
+    char *json_string = cJSON_PrintUnformatted(json);
+    if (json_string != NULL) {
+        telemetry_publish(result_topic, json_string, 0, 1, 0);
+        free(json_string);
+    }
+    cJSON_Delete(json);
+
+    if (result != WATERING_RESULT_WEAK && result != WATERING_RESULT_NO_RESPONSE) {
+        return;
+    }
+
+    char alert[256];
+    int len = snprintf(alert, sizeof(alert),
+                       "{\"type\":\"watering_alert\",\"reason\":\"%s\",\"rise\":%.1f,"
+                       "\"baseline_rise\":%.1f,\"consecutive_failures\":%lu,\"lockout_s\":%lu}",
+                       watering_result_name(result), rise, stats.baseline_rise,
+                       stats.consecutive_failures, stats.lockout_remaining_s);
+    telemetry_publish(alert_topic, alert, len, 1, 0);
+
+    if (stats.lockout_remaining_s > 0) {
+        ESP_LOGE(TAG, "❌ 連續 %lu 次澆水無回應，疑似水箱乾涸或管路堵塞 - 暫停澆水 %lu 秒",
+                 stats.consecutive_failures, stats.lockout_remaining_s);
+    } else {
+        ESP_LOGW(TAG, "⚠️ 澆水回應異常 (%s)", watering_result_name(result));
+    }
+}
+
+// ============================================================================
+// NVS 基準存取
+// ============================================================================
+static void load_baseline(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;  // 首次啟動，尚無基準
+    }
+
+    watering_baseline_t stored;
+    size_t size = sizeof(stored);
+    if (nvs_get_blob(handle, NVS_KEY_BASELINE, &stored, &size) == ESP_OK &&
+        size == sizeof(stored) && stored.version == BASELINE_VERSION) {
+        baseline = stored;
+    }
+    nvs_close(handle);
+}
+
+static void save_baseline(void)
+{
+    portENTER_CRITICAL(&monitor_lock);
+    watering_baseline_t snapshot = baseline;
+    portEXIT_CRITICAL(&monitor_lock);
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, NVS_KEY_BASELINE, &snapshot, sizeof(snapshot));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 無法儲存澆水基準: %s", esp_err_to_name(err));
+    }
+}
+
+// ============================================================================
+// NVS 暫停狀態存取
+// 只保存剩餘秒數：開機時尚未校時，無法得知停機多久，因此停機時間不計入暫停，
+// 重開機後以保存的剩餘時間重新計算 (寧可多停，也不在水箱仍乾涸時空轉泵浦)；
+// 補水後以 CLEAR_LOCKOUT 指令解除
+// ============================================================================
+static void load_lockout(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+
+    uint32_t remaining_s = 0;
+    if (nvs_get_u32(handle, NVS_KEY_LOCKOUT, &remaining_s) == ESP_OK && remaining_s > 0) {
+        if (remaining_s > WATERING_LOCKOUT_S) {
+            remaining_s = WATERING_LOCKOUT_S;
+        }
+        portENTER_CRITICAL(&monitor_lock);
+        lockout_until_us = esp_timer_get_time() + (int64_t)remaining_s * 1000000LL;
+        portEXIT_CRITICAL(&monitor_lock);
+        ESP_LOGW(TAG, "⚠️ 重開機前處於暫停澆水狀態，繼續暫停 %lu 秒 (補水後可用 CLEAR_LOCKOUT 解除)",
+                 remaining_s);
+    }
+    nvs_close(handle);
+}
+
+static void save_lockout(uint32_t remaining_s)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        if (remaining_s > 0) {
+            err = nvs_set_u32(handle, NVS_KEY_LOCKOUT, remaining_s);
+        } else {
+            err = nvs_erase_key(handle, NVS_KEY_LOCKOUT);
+            if (err == ESP_ERR_NVS_NOT_FOUND) {
+                err = ESP_OK;
+            }
+        }
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "⚠️ 無法儲存暫停澆水狀態: %s", esp_err_to_name(err));
+    }
+}
+
+static int moisture_x10_from_raw(int raw_adc)
+{
+    return (int)(soil_sensor_raw_to_moisture(raw_adc) * 10.0f + 0.5f);
+}
@@ -0,0 +1,106 @@
+// ============================================================================
+// watering_monitor.h - 澆水回應驗證模組標頭檔
+// 功能：每次泵浦脈衝期間與之後高頻採樣濕度，在裝置上計算上升幅度與時間常數，
+//       與學習到的基準比較，偵測水箱乾涸或管路堵塞並發布警報與澆水效率指標
+// ============================================================================
+
+#ifndef WATERING_MONITOR_H
+#define WATERING_MONITOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define WATERING_SAMPLE_INTERVAL_MS 100     // 監測期間採樣間隔
+#define WATERING_WINDOW_MS          45000   // 泵浦啟動後的監測時間窗
+#define WATERING_MIN_RISE_X10       10      // 最小有效上升幅度 (0.1%)，低於此值視為無回應
+#define WATERING_WEAK_RATIO         0.5f    // 上升幅度低於基準的此比例視為回應偏弱
+#define WATERING_SATURATED_X10      950     // 澆水前濕度已高於此值時不判定 (無上升空間)
+#define WATERING_DRY_LOCKOUT_COUNT  3       // 連續無回應達此次數後暫停澆水
+#define WATERING_LOCKOUT_S          21600   // 暫停澆水時間 (6 小時)
+
+// ============================================================================
+// 單次澆水判定結果
+// ============================================================================
+typedef enum {
+    WATERING_RESULT_OK = 0,         // 上升幅度正常
+    WATERING_RESULT_WEAK,           // 上升幅度明顯低於基準 (出水不足)
+    WATERING_RESULT_NO_RESPONSE,    // 濕度無變化 (疑似乾抽)
+    WATERING_RESULT_SATURATED,      // 土壤已飽和，無法判定
+    WATERING_RESULT_INVALID,        // 監測期間有其他泵浦脈衝，無法判定
+} watering_result_t;
+
+// ============================================================================
+// 澆水監測統計資訊
+// ============================================================================
+typedef struct {
+    uint32_t monitored;             // 已監測的澆水次數
+    uint32_t ok_count;              // 判定正常次數
+    uint32_t weak_count;            // 判定偏弱次數
+    uint32_t no_response_count;     // 判定無回應次數
+    uint32_t consecutive_failures;  // 連續無回應次數
+    uint32_t lockout_remaining_s;   // 暫停澆水剩餘秒數 (0 表示未暫停)
+    float baseline_rise;            // 學習到的基準上升幅度 (%)
+    float baseline_tau_s;           // 學習到的基準時間常數 (秒)
+    uint32_t baseline_samples;      // 基準累計樣本數
+    float last_rise;                // 最近一次上升幅度 (%)
+    float last_tau_s;               // 最近一次時間常數 (秒，-1 表示無上升)
+    watering_result_t last_result;  // 最近一次判定結果
+} watering_monitor_stats_t;
+
+// ============================================================================
+// 函數原型宣告
+// ============================================================================
+
+/**
+ * @brief 初始化澆水監測模組，從 NVS 載入基準並建立監測任務
+ *
+ * @param result_topic 每次澆水結果與效率指標的發布主題
+ * @param alert_topic 異常警報的發布主題
+ * @return esp_err_t ESP_OK 表示成功
+ */
+esp_err_t watering_monitor_init(const char* result_topic, const char* alert_topic);
+
+/**
+ * @brief 檢查目前是否允許啟動泵浦 (連續乾抽後會暫停一段時間)
+ *
+ * @param remaining_s 暫停中時回傳剩餘秒數，可為 NULL
+ * @return bool true 表示允許
+ */
+bool watering_monitor_pump_allowed(uint32_t* remaining_s);
+
+/**
+ * @brief 解除暫停澆水並將連續無回應次數歸零 (補水或排除堵塞後由 CLEAR_LOCKOUT 指令呼叫)
+ *
+ * 暫停狀態保存在 NVS，重開機不會解除，只能到期或由此函數解除
+ */
+void watering_monitor_clear_lockout(void);
+
+/**
+ * @brief 泵浦啟動前呼叫：擷取澆水前濕度並開始監測
+ *
+ * 必須在開啟泵浦之前呼叫，監測期間的後續呼叫只會標記該次監測無效
+ */
+void watering_monitor_begin(void);
+
+/**
+ * @brief 泵浦關閉後呼叫：記錄實際出水時間
+ */
+void watering_monitor_pump_stopped(void);
+
+/**
+ * @brief 取得判定結果名稱字串
+ */
+const char* watering_result_name(watering_result_t result);
+
+/**
+ * @brief 取得澆水監測統計資訊
+ *
+ * @param stats 統計資訊結構指標
+ */
+void watering_monitor_get_stats(watering_monitor_stats_t* stats);
+
+#endif // WATERING_MONITOR_H
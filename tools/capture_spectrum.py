@@ -0,0 +1,216 @@
+# 原始 ADC 擷取頻譜分析 - 重組 CAPTURE 指令分段上傳的樣本並繪製時域波形與頻譜
+# 用法：python tools/capture_spectrum.py --broker <Broker IP> [--port 1883] [--timeout 300] [--out capture.png]
+#       python tools/capture_spectrum.py --file capture.jsonl [--id 3] [--out capture.png]
+#       (capture.jsonl 可由 mosquitto_sub -t soilsensorcapture/esp/capture > capture.jsonl 取得)
+# - 有泵浦啟動/關閉索引時，分別計算基準與運轉中的頻譜，列出干擾最明顯的頻率；
+#   基準優先取泵浦啟動前的樣本，泵浦觸發的擷取從泵浦啟動後才開始，改取泵浦關閉後的樣本
+# - 需要 numpy、matplotlib；--broker 模式另需 paho-mqtt
+import argparse
+import base64
+import json
+import sys
+import time
+
+import numpy as np
+
+TOPIC_CAPTURE = 'soilsensorcapture/esp/capture'
+DELTA8_ESCAPE = 0x80
+WELCH_SEGMENT = 1024
+MIN_SEGMENT = 128  # 泵浦前後的區段短於此長度時不單獨計算頻譜
+
+
+def decode_chunk(encoding, data, count):
+    raw = base64.b64decode(data)
+    if encoding == 'raw16':
+        return np.frombuffer(raw, dtype='<u2', count=count).astype(np.int32)
+
+    # delta8：1 byte 有號差分，0x80 之後接 2 bytes 小端序絕對值
+    out = np.empty(count, dtype=np.int32)
+    pos = 0
+    prev = 0
+    for i in range(count):
+        b = raw[pos]
+        if b == DELTA8_ESCAPE:
+            prev = raw[pos + 1] | (raw[pos + 2] << 8)
+            pos += 3
+        else:
+            prev += b - 256 if b > 127 else b
+            pos += 1
+        out[i] = prev
+    return out
+
+
+class Assembler:
+    """依 id 收集描述資訊與分段，全部到齊時回傳完整擷取"""
+
+    def __init__(self, wanted_id=None):
+        self.wanted_id = wanted_id
+        self.headers = {}
+        self.chunks = {}
+
+    def feed(self, message):
+        capture_id = message.get('id')
+        if self.wanted_id is not None and capture_id != self.wanted_id:
+            return None
+        if message.get('type') == 'raw_capture':
+            self.headers[capture_id] = message
+            self.chunks.setdefault(capture_id, {})
+        elif message.get('type') == 'raw_capture_chunk':
+            self.chunks.setdefault(capture_id, {})[message['chunk']] = message
+        else:
+            return None
+
+        header = self.headers.get(capture_id)
+        parts = self.chunks.get(capture_id, {})
+        if header is None or len(parts) < header['chunks']:
+            return None
+
+        samples = np.zeros(header['samples'], dtype=np.int32)
+        for part in parts.values():
+            decoded = decode_chunk(part['encoding'], part['data'], part['samples'])
+            samples[part['offset']:part['offset'] + part['samples']] = decoded
+        return header, samples
+
+
+def read_file(path, assembler):
+    result = None
+    with open(path, encoding='utf-8') as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith('{'):
+                continue
+            done = assembler.feed(json.loads(line))
+            if done is not None:
+                result = done  # 檔案中有多次擷取時取最後一次完整的
+    return result
+
+
+def read_broker(host, port, timeout, assembler):
+    import paho.mqtt.client as mqtt
+
+    result = {}
+
+    def on_message(client, userdata, msg):
+        done = assembler.feed(json.loads(msg.payload))
+        if done is not None:
+            result['capture'] = done
+
+    client = mqtt.Client()
+    client.on_message = on_message
+    client.connect(host, port)
+    client.subscribe(TOPIC_CAPTURE, qos=1)
+    client.loop_start()
+    print(f'等待擷取資料 ({TOPIC_CAPTURE})...')
+    deadline = time.time() + timeout
+    while 'capture' not in result and time.time() < deadline:
+        time.sleep(0.2)
+    client.loop_stop()
+    client.disconnect()
+    return result.get('capture')
+
+
+def welch_psd(x, rate):
+    """Hann 視窗、50% 重疊的平均功率頻譜密度 (codes²/Hz)"""
+    n = min(WELCH_SEGMENT, len(x))
+    window = np.hanning(n)
+    scale = rate * np.sum(window ** 2)
+    step = n // 2
+    psd = None
+    segments = 0
+    for start in range(0, len(x) - n + 1, step):
+        seg = x[start:start + n] - np.mean(x[start:start + n])
+        spectrum = np.abs(np.fft.rfft(seg * window)) ** 2 / scale
+        psd = spectrum if psd is None else psd + spectrum
+        segments += 1
+    psd[1:-1] *= 2  # 單邊頻譜
+    return np.fft.rfftfreq(n, 1 / rate), psd / segments
+
+
+def main():
+    parser = argparse.ArgumentParser(description='原始 ADC 擷取頻譜分析')
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--broker')
+    source.add_argument('--file')
+    parser.add_argument('--port', type=int, default=1883)
+    parser.add_argument('--timeout', type=float, default=300)
+    parser.add_argument('--id', type=int)
+    parser.add_argument('--out', default='capture.png')
+    args = parser.parse_args()
+
+    assembler = Assembler(args.id)
+    if args.file:
+        capture = read_file(args.file, assembler)
+    else:
+        capture = read_broker(args.broker, args.port, args.timeout, assembler)
+    if capture is None:
+        print('找不到完整的擷取 (描述資訊或分段缺漏)')
+        sys.exit(1)
+
+    header, samples = capture
+    rate = header['rate_hz']
+    on_idx = header.get('pump_on_index', -1)
+    off_idx = header.get('pump_off_index', -1)
+    if off_idx < 0:
+        off_idx = len(samples)
+
+    print(f"擷取 #{header['id']}：{len(samples)} 樣本 @ {rate} Hz，觸發={header['trigger']}，"
+          f"溢位={header['overflows']}，平均={samples.mean():.1f}，σ={samples.std():.2f}，"
+          f"峰對峰={samples.max() - samples.min()}")
+    if header['overflows'] > 0:
+        print('⚠️ 擷取期間 DMA 緩衝區溢位，樣本有缺漏，頻譜僅供參考')
+
+    segments = {'整段': samples}
+    if on_idx >= 0:
+        if on_idx >= MIN_SEGMENT:
+            segments['泵浦啟動前'] = samples[:on_idx]
+        if off_idx - on_idx >= MIN_SEGMENT:
+            segments['泵浦運轉中'] = samples[on_idx:off_idx]
+        if on_idx < MIN_SEGMENT and len(samples) - off_idx >= MIN_SEGMENT:
+            segments['泵浦關閉後'] = samples[off_idx:]
+
+    spectra = {name: welch_psd(seg, rate) for name, seg in segments.items()}
+
+    baseline = next((name for name in ('泵浦啟動前', '泵浦關閉後') if name in spectra), None)
+    if baseline is not None and '泵浦運轉中' in spectra:
+        f_base, p_base = spectra[baseline]
+        f_run, p_run = spectra['泵浦運轉中']
+        base_on_run = np.interp(f_run, f_base, p_base)
+        excess_db = 10 * np.log10((p_run + 1e-12) / (base_on_run + 1e-12))
+        top = np.argsort(excess_db[1:])[::-1][:5] + 1
+        print(f'泵浦運轉中高於基準 ({baseline}) 最多的頻率：')
+        for i in top:
+            print(f'  {f_run[i]:8.1f} Hz  +{excess_db[i]:.1f} dB')
+
+    import matplotlib
+    matplotlib.use('Agg')
+    import matplotlib.pyplot as plt
+
+    fig, (ax_time, ax_freq) = plt.subplots(2, 1, figsize=(11, 8))
+    t_ms = np.arange(len(samples)) * 1000 / rate
+    ax_time.plot(t_ms, samples, linewidth=0.5)
+    if on_idx >= 0:
+        ax_time.axvline(on_idx * 1000 / rate, color='red', linestyle='--', label='pump on')
+    if header.get('pump_off_index', -1) >= 0:
+        ax_time.axvline(off_idx * 1000 / rate, color='black', linestyle='--', label='pump off')
+    if on_idx >= 0:
+        ax_time.legend()
+    ax_time.set_xlabel('time (ms)')
+    ax_time.set_ylabel('ADC code')
+    ax_time.set_title(f"capture #{header['id']} ({rate} Hz, trigger={header['trigger']})")
+
+    labels = {'整段': 'whole capture', '泵浦啟動前': 'before pump', '泵浦運轉中': 'pump running',
+              '泵浦關閉後': 'after pump'}
+    for name, (freqs, psd) in spectra.items():
+        ax_freq.plot(freqs[1:], 10 * np.log10(psd[1:] + 1e-12), linewidth=0.8, label=labels[name])
+    ax_freq.set_xlabel('frequency (Hz)')
+    ax_freq.set_ylabel('PSD (dB codes²/Hz)')
+    ax_freq.legend()
+    ax_freq.grid(True, alpha=0.3)
+
+    fig.tight_layout()
+    fig.savefig(args.out, dpi=120)
+    print(f'已輸出 {args.out}')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,119 @@
+# CoAP 伺服器替身 - 用於本機比較 CoAP/UDP 與 MQTT/TCP 的喚醒到送達時間
+# 用法：python tools/coap_standin_server.py [--port 5683] [--command WATER]
+# - POST：回覆 2.04 Changed (Piggybacked ACK)，並記錄每個資源的到達時間
+# - Block1 分塊 POST (RFC 7959)：中間區塊回覆 2.31 Continue，收齊後才記錄整則訊息
+# - GET 指令資源：回覆 2.05 Content，每次取出一則排隊中的指令 (--command 可重複)
+import argparse
+import socket
+import struct
+import time
+
+COAP_TYPE_CON = 0
+COAP_TYPE_ACK = 2
+CODE_GET = 0x01
+CODE_POST = 0x02
+CODE_CHANGED = 0x44
+CODE_CONTENT = 0x45
+CODE_CONTINUE = 0x5F
+CODE_INCOMPLETE = 0x88
+OPTION_URI_PATH = 11
+OPTION_BLOCK1 = 27
+
+
+def parse(packet: bytes):
+    ver_type_tkl, code, mid = struct.unpack('!BBH', packet[:4])
+    tkl = ver_type_tkl & 0x0F
+    msg_type = (ver_type_tkl >> 4) & 0x03
+    token = packet[4:4 + tkl]
+    pos = 4 + tkl
+    option = 0
+    path = []
+    block1 = None
+    payload = b''
+    while pos < len(packet):
+        if packet[pos] == 0xFF:
+            payload = packet[pos + 1:]
+            break
+        delta, length = packet[pos] >> 4, packet[pos] & 0x0F
+        pos += 1
+        for name in ('delta', 'length'):
+            nibble = delta if name == 'delta' else length
+            if nibble == 13:
+                nibble = packet[pos] + 13
+                pos += 1
+            elif nibble == 14:
+                nibble = struct.unpack('!H', packet[pos:pos + 2])[0] + 269
+                pos += 2
+            if name == 'delta':
+                delta = nibble
+            else:
+                length = nibble
+        option += delta
+        if option == OPTION_URI_PATH:
+            path.append(packet[pos:pos + length].decode())
+        elif option == OPTION_BLOCK1:
+            block1 = int.from_bytes(packet[pos:pos + length], 'big')
+        pos += length
+    return msg_type, code, mid, token, '/'.join(path), block1, payload
+
+
+def ack(mid: int, token: bytes, code: int, payload: bytes = b'', block1=None) -> bytes:
+    header = struct.pack('!BBH', (1 << 6) | (COAP_TYPE_ACK << 4) | len(token), code, mid) + token
+    if block1 is not None:
+        value = block1.to_bytes((block1.bit_length() + 7) // 8, 'big')
+        header += bytes([(13 << 4) | len(value), OPTION_BLOCK1 - 13]) + value
+    return header + (b'\xff' + payload if payload else b'')
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--port', type=int, default=5683)
+    parser.add_argument('--command-path', default='soilsensorcapture/esp/command')
+    parser.add_argument('--command', action='append', default=[])
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(('0.0.0.0', args.port))
+    start = time.monotonic()
+    partial = {}  # (來源, 路徑) -> 已收到的分塊內容
+    replies = {}  # 來源 -> (message id, 回覆)；ACK 遺失時裝置以相同 message id 重傳
+    print(f'CoAP stand-in listening on udp/{args.port}')
+
+    while True:
+        packet, addr = sock.recvfrom(2048)
+        msg_type, code, mid, token, path, block1, payload = parse(packet)
+        elapsed_ms = (time.monotonic() - start) * 1000
+        if msg_type == COAP_TYPE_CON and replies.get(addr, (None,))[0] == mid:
+            sock.sendto(replies[addr][1], addr)
+            continue
+
+        if code == CODE_POST and block1 is not None:
+            num, more, szx = block1 >> 4, (block1 >> 3) & 1, block1 & 7
+            key = (addr, path)
+            if num == 0:
+                partial[key] = b''
+            if key not in partial or len(partial[key]) != num * (16 << szx):
+                reply = ack(mid, token, CODE_INCOMPLETE)
+            elif more:
+                partial[key] += payload
+                reply = ack(mid, token, CODE_CONTINUE, block1=block1)
+            else:
+                payload = partial.pop(key) + payload
+                print(f'[{elapsed_ms:9.1f} ms] {addr[0]} POST /{path} ({len(payload)} bytes, {num + 1} 塊)')
+                reply = ack(mid, token, CODE_CHANGED, block1=block1)
+            replies[addr] = (mid, reply)
+            sock.sendto(reply, addr)
+        elif code == CODE_POST:
+            print(f'[{elapsed_ms:9.1f} ms] {addr[0]} POST /{path} ({len(payload)} bytes, '
+                  f'{"CON" if msg_type == COAP_TYPE_CON else "NON"})')
+            if msg_type == COAP_TYPE_CON:
+                sock.sendto(ack(mid, token, CODE_CHANGED), addr)
+        elif code == CODE_GET and path == args.command_path:
+            command = args.command.pop(0).encode() if args.command else b''
+            sock.sendto(ack(mid, token, CODE_CONTENT, command), addr)
+            if command:
+                print(f'[{elapsed_ms:9.1f} ms] {addr[0]} GET /{path} -> {command.decode()}')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,219 @@
+# 乾燥預測模擬 - 以與韌體相同的區段平均二次 RLS (main/drying_forecast.c) 重播合成或實測乾燥曲線，
+#                檢查剩餘時間預測誤差與 95% 信賴區間的實際涵蓋率，用來挑選遺忘因子與區段長度
+# 用法：python tools/drying_forecast_sim.py [--runs 50] [--forget 0.93] [--threshold 30] [--diurnal 0.8]
+#       python tools/drying_forecast_sim.py --csv ingest_out/soil_data.csv   (以 moisture_compensated 欄位重播)
+# - 合成曲線：指數乾燥 m(t) = m_inf + (m0 - m_inf)·e^(-t/τ)，加上溫度補償後的日夜殘餘波動與白雜訊
+# - 涵蓋率只計入 DRYING 狀態的預測，真值為無雜訊曲線跌破門檻的時間
+# - 曲線在門檻之上趨於平緩時韌體回報 stable 而不預測，另外列出比例
+import argparse
+import csv
+import math
+import random
+import statistics
+
+BLOCK_S = 3600
+MIN_BLOCKS = 6
+MIN_SPAN_S = 10800
+MIN_RATE = 0.01
+MAX_HOURS = 720.0
+RISE_RESET = 3.0
+AUTOCORR_MAX = 0.95
+FILTER_ALPHA = 0.25
+Z_95 = 1.96
+N = 3
+
+
+class DryingForecast:
+    """與韌體相同的狀態機：EMA 濾波、區段平均、φ=[1, t, t²] 帶遺忘因子 RLS、自相關放寬"""
+
+    def __init__(self, threshold, forget):
+        self.threshold = threshold
+        self.forget = forget
+        self.filtered = None
+        self.fitting = False
+
+    def start(self, t_s):
+        self.fitting = True
+        self.fit_start = t_s
+        self.fit_min = self.filtered
+        self.block_start = t_s
+        self.block_sum = 0.0
+        self.block_count = 0
+        self.theta = [self.filtered, 0.0, 0.0]
+        self.P = [[100.0 if i == j else 0.0 for j in range(N)] for i in range(N)]
+        self.err_sum = self.weight_sum = self.lag_cross = self.lag_norm = self.prev = 0.0
+        self.blocks = 0
+
+    def rls_step(self, t_h, y):
+        lam, P, theta = self.forget, self.P, self.theta
+        phi = [1.0, t_h, t_h * t_h]
+        p_phi = [sum(P[i][j] * phi[j] for j in range(N)) for i in range(N)]
+        denom = lam + sum(phi[i] * p_phi[i] for i in range(N))
+        err = y - sum(theta[i] * phi[i] for i in range(N))
+        for i in range(N):
+            theta[i] += p_phi[i] / denom * err
+        for i in range(N):
+            for j in range(i, N):
+                P[i][j] = (P[i][j] - p_phi[i] * p_phi[j] / denom) / lam
+                P[j][i] = P[i][j]
+        post = y - sum(theta[i] * phi[i] for i in range(N))
+        self.err_sum = lam * self.err_sum + post * post
+        self.weight_sum = lam * self.weight_sum + 1.0
+        if self.blocks > 0:
+            self.lag_cross = lam * self.lag_cross + post * self.prev
+            self.lag_norm = lam * self.lag_norm + self.prev * self.prev
+        self.prev = post
+        self.blocks += 1
+
+    def quad_form(self, g):
+        return max(sum(g[i] * self.P[i][j] * g[j] for i in range(N) for j in range(N)), 0.0)
+
+    def update(self, t_s, m):
+        """回傳 (狀態, 剩餘小時, 下限, 上限)"""
+        self.filtered = m if self.filtered is None else self.filtered + FILTER_ALPHA * (m - self.filtered)
+        if self.fitting and self.filtered - self.fit_min > RISE_RESET:
+            self.fitting = False
+        if not self.fitting:
+            self.start(t_s)
+        self.fit_min = min(self.fit_min, self.filtered)
+        self.block_sum += m
+        self.block_count += 1
+        if t_s - self.block_start >= BLOCK_S:
+            mid = self.block_start + (t_s - self.block_start) / 2
+            self.rls_step((mid - self.fit_start) / 3600.0, self.block_sum / self.block_count)
+            self.block_sum, self.block_count, self.block_start = 0.0, 0, t_s
+        return self.forecast((t_s - self.fit_start) / 3600.0)
+
+    def forecast(self, now_h):
+        sigma2 = self.err_sum / (self.weight_sum - N if self.weight_sum > N + 1 else 1.0)
+        rho = self.lag_cross / self.lag_norm if self.lag_norm > 0 else 0.0
+        rho = min(max(rho, 0.0), AUTOCORR_MAX)
+        var_scale = sigma2 * (1 + rho) / (1 - rho)
+        a, b, c = self.theta
+        slope_now = b + 2 * c * now_h
+        if self.filtered <= self.threshold:
+            return 'below_threshold', 0.0, 0.0, 0.0
+        if self.blocks < MIN_BLOCKS or now_h * 3600 < MIN_SPAN_S:
+            return 'learning', None, None, None
+        k = a - self.threshold
+        cross = -1.0
+        if abs(c) < 1e-9:
+            if b < 0:
+                cross = -k / b
+        else:
+            disc = b * b - 4 * c * k
+            if disc >= 0:
+                q = -0.5 * (b + math.copysign(math.sqrt(disc), b if b != 0 else 1.0))
+                r1 = q / c
+                r2 = k / q if q != 0 else r1
+                lo, hi = min(r1, r2), max(r1, r2)
+                cross = lo if lo > now_h else hi
+        slope_cross = b + 2 * c * cross
+        if cross <= now_h or slope_cross >= 0 or -slope_now < MIN_RATE:
+            return 'stable', None, None, None
+        g = [-1.0 / slope_cross, -cross / slope_cross, -cross * cross / slope_cross]
+        sd = math.sqrt(var_scale * self.quad_form(g))
+        hours = cross - now_h
+        return 'drying', min(hours, MAX_HOURS), max(hours - Z_95 * sd, 0.0), min(hours + Z_95 * sd, MAX_HOURS)
+
+
+def synth_curve(rng, threshold, noise, diurnal_max, period_s, days):
+    m0 = rng.uniform(45, 60)
+    m_inf = rng.uniform(10, 25)
+    tau_h = rng.uniform(40, 160)
+    diurnal = rng.uniform(0.0, diurnal_max)
+    phase = rng.uniform(0, 2 * math.pi)
+
+    def truth(t_s):
+        t_h = t_s / 3600.0
+        return m_inf + (m0 - m_inf) * math.exp(-t_h / tau_h) + diurnal * math.sin(2 * math.pi * t_h / 24 + phase)
+
+    times = range(0, days * 86400, period_s)
+    series = [(t, round((truth(t) + rng.gauss(0, noise)) * 10) / 10) for t in times]
+    cross = next((t for t in times if truth(t) <= threshold), None)
+    return series, cross
+
+
+def simulate(args):
+    rng = random.Random(args.seed)
+    covered = total = stable = 0
+    abs_err = []
+    by_horizon = {}
+    for _ in range(args.runs):
+        series, cross_s = synth_curve(rng, args.threshold, args.noise, args.diurnal, args.period, args.days)
+        if cross_s is None:
+            continue
+        model = DryingForecast(args.threshold, args.forget)
+        for t_s, m in series:
+            state, hours, lo, hi = model.update(t_s, m)
+            if t_s >= cross_s or state in ('learning', 'below_threshold'):
+                continue
+            if state == 'stable':
+                stable += 1
+                continue
+            actual_h = (cross_s - t_s) / 3600.0
+            hit = lo <= actual_h <= hi
+            total += 1
+            covered += hit
+            abs_err.append(abs(hours - actual_h))
+            bucket = min(int(actual_h // 24), 5)
+            h, n = by_horizon.get(bucket, (0, 0))
+            by_horizon[bucket] = (h + hit, n + 1)
+    if not total:
+        print('沒有任何 DRYING 預測 (曲線都未跌破門檻)')
+        return
+    print(f'遺忘因子 {args.forget}，門檻 {args.threshold}%，雜訊 σ={args.noise}%，日夜殘餘 ≤{args.diurnal}%，'
+          f'{args.runs} 條曲線')
+    print(f'95% 區間實際涵蓋率 {covered / total * 100:.1f}% ({total} 筆預測)，'
+          f'絕對誤差中位數 {statistics.median(abs_err):.1f} h，'
+          f'跌破門檻前回報 stable 的比例 {stable / (stable + total) * 100:.1f}%')
+    print(f'\n{"實際剩餘":<10} {"預測筆數":>8} {"涵蓋率":>8}')
+    for bucket in sorted(by_horizon):
+        hit, n = by_horizon[bucket]
+        label = f'{bucket * 24}-{bucket * 24 + 24} h' if bucket < 5 else '≥120 h'
+        print(f'{label:<10} {n:>8} {hit / n * 100:>7.1f}%')
+
+
+def replay_csv(args):
+    series = []
+    with open(args.csv, newline='') as f:
+        for row in csv.DictReader(f):
+            value = row.get('moisture_compensated') or row.get('moisture')
+            t = row.get('ts_ms') or row.get('recv_ms')
+            if value and t:
+                series.append((float(t) / 1000.0, float(value)))
+    series.sort()
+    if not series:
+        print('CSV 中沒有可用的讀數')
+        return
+    model = DryingForecast(args.threshold, args.forget)
+    last_state, last_hour = None, None
+    for t_s, m in series:
+        state, hours, lo, hi = model.update(t_s, m)
+        hour = int((t_s - series[0][0]) // 3600)
+        if state != last_state or (state == 'drying' and hour != last_hour):
+            detail = f'{hours:.1f} h (95% {lo:.1f} ~ {hi:.1f})' if state == 'drying' else ''
+            print(f'{t_s - series[0][0]:>10.0f} s  濕度 {model.filtered:5.1f}%  {state:<16} {detail}')
+            last_state, last_hour = state, hour
+
+
+def main():
+    parser = argparse.ArgumentParser(description='乾燥預測 RLS 模擬')
+    parser.add_argument('--runs', type=int, default=50, help='合成乾燥曲線條數')
+    parser.add_argument('--forget', type=float, default=0.93, help='每區段的 RLS 遺忘因子 (DRYING_FORGET_FACTOR)')
+    parser.add_argument('--threshold', type=float, default=30.0, help='濕度門檻 (DRYING_THRESHOLD_PCT)')
+    parser.add_argument('--noise', type=float, default=0.4, help='讀數白雜訊標準差 (%%)')
+    parser.add_argument('--diurnal', type=float, default=0.8, help='溫度補償後日夜殘餘波動振幅上限 (%%)')
+    parser.add_argument('--period', type=int, default=60, help='採樣間隔 (秒)')
+    parser.add_argument('--days', type=int, default=14, help='每條曲線長度 (天)')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--csv', help='改為重播 ingest_bridge 輸出的 soil_data.csv')
+    args = parser.parse_args()
+    if args.csv:
+        replay_csv(args)
+    else:
+        simulate(args)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,234 @@
+# 全場同步採樣模擬與驗證 - 比較開機時間間隔與 epoch 時槽對齊的跨節點採樣偏差，並分析實際匯入資料
+# 用法：python tools/fleet_slot_sim.py --simulate [--nodes 50] [--slots 60] [--period-s 60] [--spread-ms 20000]
+#                                      [--sync-error-ms 15] [--residual-ppm 5] [--sync-interval-s 3600]
+#                                      [--latency-ms 3] [--stall-prob 0.005] [--step-back-s 0] [--seed 1]
+#       python tools/fleet_slot_sim.py --analyze ingest_out/soil_data.csv
+# - --simulate：以與 sample_slot.c 相同的規則 (邊界後第一個 tick 醒來採樣、MAC FNV-1a 雜湊取發布偏移)
+#   模擬整片苗床，時鐘誤差 = SNTP 同步誤差 + 同步後殘餘漂移；輸出每個時槽的真實採樣時刻分佈、
+#   裝置自行回報的 sample_skew_ms，以及每秒發布數峰值 (有無發布分散)；規則是以 Python 重寫的，
+#   沒有與韌體對照，結果只代表這個模型
+# - --simulate --step-back-s N：另外模擬單一節點牆鐘在中途倒退 N 秒 (SNTP 大幅修正)，
+#   以 sample_slot_due() 的規則比較有無「倒退超過一個時槽即重新對齊」時的漏採時間
+# - --analyze：讀取 ingest_bridge 輸出的 soil_data.csv，依 slot_ms 分組計算跨節點 ts_ms 分佈
+#   (即達成的全場採樣偏差)、sample_skew_ms 統計與 recv_ms 的發布分散情形
+# - 兩個節點的 MAC 雜湊偏移太接近時，可在 main.c 以 SAMPLE_PUBLISH_OFFSET_MS 為其中一個指定固定偏移
+import argparse
+import csv
+import random
+import statistics
+from collections import Counter, defaultdict
+
+TICK_MS = 10          # CONFIG_FREERTOS_HZ = 100
+POLL_MS = 500         # sensor_task 最長等待時間
+CATCHUP_MS = 2000     # SAMPLE_SLOT_CATCHUP_MS
+
+
+def fnv1a(data):
+    h = 2166136261
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def percentile(values, p):
+    values = sorted(values)
+    if not values:
+        return 0.0
+    k = min(len(values) - 1, max(0, round(p / 100 * (len(values) - 1))))
+    return values[k]
+
+
+class Node:
+    def __init__(self, rng, args):
+        self.rng = rng
+        self.args = args
+        self.mac = bytes([0x84, 0xF7, 0x03]) + bytes(rng.randrange(256) for _ in range(3))
+        spread = args.spread_ms
+        self.offset_ms = fnv1a(self.mac) % spread if spread > 0 else 0
+        self.boot_ms = rng.uniform(0, args.period_s * 1000)   # 開機時刻 (真實時間)
+        self.residual_ppm = rng.uniform(-args.residual_ppm, args.residual_ppm)
+        self.sync_phase_ms = rng.uniform(0, args.sync_interval_s * 1000)
+        self.sync_errors = {}
+
+    def clock_error_ms(self, t):
+        """節點牆鐘 - 真實時間：每次同步重新抽一個 SNTP 誤差，之後以殘餘漂移累積"""
+        interval = self.args.sync_interval_s * 1000
+        epoch = int((t + self.sync_phase_ms) // interval)
+        if epoch not in self.sync_errors:
+            self.sync_errors[epoch] = self.rng.gauss(0, self.args.sync_error_ms)
+        since_sync = (t + self.sync_phase_ms) - epoch * interval
+        return self.sync_errors[epoch] + since_sync * self.residual_ppm * 1e-6
+
+    def wake_latency_ms(self):
+        latency = self.rng.expovariate(1 / self.args.latency_ms) if self.args.latency_ms > 0 else 0
+        if self.rng.random() < self.args.stall_prob:
+            latency += self.rng.uniform(500, 3000)   # TLS 握手、OTA 寫入等長時間佔用
+        return latency
+
+    def aligned_sample(self, boundary_ms):
+        """回傳 (真實採樣時刻, 裝置回報的 skew, 真實發布時刻)"""
+        err = self.clock_error_ms(boundary_ms)
+        t_boundary = boundary_ms - err                  # 節點牆鐘到達邊界的真實時刻
+        # 等待 = pdMS_TO_TICKS(ms) + 1：在邊界後下一個 tick 醒來
+        wake = t_boundary + self.rng.uniform(0, TICK_MS) + self.wake_latency_ms()
+        skew = wake - t_boundary
+        publish = t_boundary + self.offset_ms + self.rng.uniform(0, TICK_MS) + self.wake_latency_ms()
+        return wake, skew, publish
+
+    def uptime_sample(self, k):
+        """原本的行為：開機後每 period 秒 (以 500ms 輪詢) 採樣並立即發布"""
+        t = self.boot_ms + k * self.args.period_s * 1000 + self.rng.uniform(0, POLL_MS) + self.wake_latency_ms()
+        return t, t
+
+
+def slot_due(now_ms, state, period, reset_on_step_back):
+    """與 sample_slot_due() 相同的規則 (已同步時)；state['last'] 為上次採樣的時槽邊界"""
+    slot = now_ms - now_ms % period
+    if reset_on_step_back and state['last'] >= 0 and slot < state['last'] - period:
+        state['last'] = -1
+        state['resets'] += 1
+    if slot <= state['last']:
+        return None
+    if state['last'] < 0 and now_ms - slot > CATCHUP_MS:
+        return None
+    return slot
+
+
+def clock_step(args):
+    """單一節點牆鐘在中途倒退 step_back_s 秒，回傳各規則的 (採樣次數, 最長無採樣時間 s, 重新對齊次數)"""
+    period = args.period_s * 1000
+    start = 1_700_000_000_000 - 1_700_000_000_000 % period
+    step_at = start + args.slots // 2 * period + period // 3
+    results = {}
+    for reset in (False, True):
+        state = {'last': -1, 'resets': 0}
+        samples = []
+        t = start
+        while t < start + args.slots * period:
+            wall = t - (args.step_back_s * 1000 if t >= step_at else 0)
+            slot = slot_due(wall, state, period, reset)
+            if slot is not None:
+                state['last'] = slot
+                samples.append(t)
+            t += POLL_MS
+        # 最後一次採樣到模擬結束也算 (倒退太多時之後完全不再採樣)
+        ends = samples + [start + args.slots * period]
+        gaps = [b - a for a, b in zip(ends, ends[1:])]
+        results[reset] = (len(samples), max(gaps) / 1000 if gaps else 0.0, state['resets'])
+    return results
+
+
+def summarize_spread(label, per_slot):
+    spreads = [max(v) - min(v) for v in per_slot.values() if len(v) > 1]
+    print(f'{label:<16} 中位數 {statistics.median(spreads):>9.1f} ms   '
+          f'p95 {percentile(spreads, 95):>9.1f} ms   最大 {max(spreads):>9.1f} ms')
+
+
+def peak_per_second(times_ms):
+    counts = Counter(int(t // 1000) for t in times_ms)
+    return max(counts.values()) if counts else 0
+
+
+def simulate(args):
+    rng = random.Random(args.seed)
+    nodes = [Node(rng, args) for _ in range(args.nodes)]
+    period = args.period_s * 1000
+    start = 10 * period   # 所有節點都已開機並同步
+
+    uptime_slots = defaultdict(list)
+    aligned_slots = defaultdict(list)
+    skews = []
+    uptime_publish, aligned_publish, burst_publish = [], [], []
+    for k in range(args.slots):
+        boundary = start + k * period
+        for node in nodes:
+            t, pub = node.uptime_sample(10 + k)
+            uptime_slots[k].append(t)
+            uptime_publish.append(pub)
+            wake, skew, publish = node.aligned_sample(boundary)
+            aligned_slots[k].append(wake)
+            skews.append(skew)
+            aligned_publish.append(publish)
+            burst_publish.append(publish - node.offset_ms)
+
+    offsets = sorted(n.offset_ms for n in nodes)
+    print(f'{args.nodes} 個節點 × {args.slots} 個時槽，週期 {args.period_s} s，SNTP 誤差 σ={args.sync_error_ms} ms，'
+          f'殘餘漂移 ±{args.residual_ppm} ppm，排程延遲 {args.latency_ms} ms，停頓機率 {args.stall_prob}')
+    print('\n跨節點真實採樣時刻分佈 (每個時槽最晚 - 最早)：')
+    summarize_spread('開機時間間隔', uptime_slots)
+    summarize_spread('epoch 時槽對齊', aligned_slots)
+    print('\n裝置回報的 sample_skew_ms (不含時鐘誤差)：')
+    print(f'{"":<16} 平均 {statistics.mean(skews):>9.1f} ms   p95 {percentile(skews, 95):>9.1f} ms   '
+          f'p99 {percentile(skews, 99):>9.1f} ms   最大 {max(skews):>9.1f} ms')
+    print(f'\n發布偏移 {offsets[0]} ~ {offsets[-1]} ms (分散時間窗 {args.spread_ms} ms)，每秒發布數峰值：')
+    print(f'{"開機時間間隔":<16} {peak_per_second(uptime_publish):>5}')
+    print(f'{"對齊、無分散":<16} {peak_per_second(burst_publish):>5}')
+    print(f'{"對齊、依 MAC 分散":<16} {peak_per_second(aligned_publish):>5}')
+
+    if args.step_back_s > 0:
+        print(f'\n單一節點牆鐘在第 {args.slots // 2} 個時槽倒退 {args.step_back_s} s ({args.slots} 個時槽內)：')
+        for reset, label in ((False, '不重新對齊'), (True, '倒退即重新對齊')):
+            count, gap_s, resets = clock_step(args)[reset]
+            print(f'{label:<16} 採樣 {count:>4} 次   最長無採樣 {gap_s:>8.1f} s   重新對齊 {resets} 次')
+
+
+def analyze(path):
+    slots = defaultdict(list)
+    skews = []
+    lags = []
+    unaligned = 0
+    with open(path, newline='') as f:
+        for row in csv.DictReader(f):
+            if not row.get('slot_ms'):
+                unaligned += 1
+                continue
+            slot = int(float(row['slot_ms']))
+            if row.get('ts_ms'):
+                slots[slot].append(float(row['ts_ms']))
+            if row.get('sample_skew_ms'):
+                skews.append(float(row['sample_skew_ms']))
+            if row.get('recv_ms'):
+                lags.append(float(row['recv_ms']) - slot)
+
+    if not slots:
+        print(f'{path}：沒有對齊時槽的讀數 (未對齊 {unaligned} 筆)')
+        return
+
+    multi = {s: v for s, v in slots.items() if len(v) > 1}
+    print(f'{path}：{sum(len(v) for v in slots.values())} 筆對齊讀數，{len(slots)} 個時槽，未對齊 {unaligned} 筆')
+    if multi:
+        print('跨節點 ts_ms 分佈 (每個時槽最晚 - 最早，含各節點時鐘誤差)：')
+        summarize_spread('實測', multi)
+    if skews:
+        print(f'sample_skew_ms：平均 {statistics.mean(skews):.1f}，p95 {percentile(skews, 95):.1f}，最大 {max(skews):.1f}')
+    if lags:
+        print(f'發布延遲 recv_ms - slot_ms：最小 {min(lags) / 1000:.2f} s，中位數 {statistics.median(lags) / 1000:.2f} s，'
+              f'最大 {max(lags) / 1000:.2f} s')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='全場同步採樣模擬與驗證')
+    mode = parser.add_mutually_exclusive_group(required=True)
+    mode.add_argument('--simulate', action='store_true')
+    mode.add_argument('--analyze', metavar='SOIL_DATA_CSV')
+    parser.add_argument('--nodes', type=int, default=50)
+    parser.add_argument('--slots', type=int, default=60)
+    parser.add_argument('--period-s', type=int, default=60)         # SENSOR_DATA_INTERVAL
+    parser.add_argument('--spread-ms', type=int, default=20000)     # SAMPLE_PUBLISH_SPREAD_MS
+    parser.add_argument('--sync-error-ms', type=float, default=15)
+    parser.add_argument('--residual-ppm', type=float, default=5)
+    parser.add_argument('--sync-interval-s', type=int, default=3600)
+    parser.add_argument('--latency-ms', type=float, default=3)
+    parser.add_argument('--stall-prob', type=float, default=0.005)
+    parser.add_argument('--step-back-s', type=int, default=0, help='模擬牆鐘倒退的秒數 (0 = 不模擬)')
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    if args.analyze:
+        analyze(args.analyze)
+    else:
+        simulate(args)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,1364 @@
+// ============================================================================
+// ingest_bridge.c - 主機端高吞吐量遙測匯入橋接器
+// 功能：訂閱本機 MQTT Broker，以零複製 JSON 掃描器解碼節點的 soil_data、
+//       system_status、離線補送批次、閘道器批次、信封格式、OTA 嘗試紀錄、乾燥預測與
+//       LIVE_STREAM 即時訊框，輸出欄式 CSV
+//       (每種紀錄一個檔案、欄位順序固定，可直接以 DuckDB / pandas 讀取)
+// 建置：cc -O2 -std=c11 -o ingest_bridge tools/ingest_bridge.c
+// 用法：./ingest_bridge [--host 127.0.0.1] [--port 1883] [--topic 'soilsensorcapture/#'] [--out ingest_out]
+//       (Broker 斷線時以 1-60 秒指數退避重連並重新訂閱，Ctrl-C 結束並寫出緩衝區)
+//       ./ingest_bridge --stdin [--out DIR]              每行 "主題<TAB>JSON" (重播抓包)
+//       ./ingest_bridge --bench [--messages 2000000]     單核心解碼吞吐量 (messages/s)
+//
+// 零複製：掃描器只記錄原始緩衝區中的 (指標, 長度)，數值與字串不轉換、不配置記憶體，
+//         輸出 CSV 時直接寫出原始位元組；字串中的 JSON 跳脫序列保持原樣
+// ============================================================================
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define MAX_COLUMNS         80
+#define COLUMN_HASH_SLOTS   256     // 2 的冪次，大於最大欄位數的兩倍
+#define MAX_KEY_PATH        64      // 巢狀欄位路徑長度上限 (例如 pm.lock_ms.adc)
+#define MAX_NESTING         3
+#define RX_BUFFER_SIZE      (1 << 20)
+#define OUT_BUFFER_SIZE     (1 << 20)    // 每個輸出表的寫入緩衝區
+#define MQTT_KEEPALIVE_S    60
+#define RECONNECT_MIN_S     1       // Broker 斷線後的第一次重連等待
+#define RECONNECT_MAX_S     60      // 指數退避上限
+#define QOS2_INFLIGHT_MAX   32      // 等待 PUBREL 的 QoS 2 訊息數上限
+
+// ============================================================================
+// 零複製切片與 JSON 掃描器
+// ============================================================================
+typedef struct {
+    const char *p;
+    uint32_t len;
+} slice_t;
+
+typedef enum {
+    VAL_NONE = 0,
+    VAL_STRING,     // 切片不含引號
+    VAL_SCALAR,     // 數字、true、false、null
+    VAL_OBJECT,     // 切片含大括號
+    VAL_ARRAY,      // 切片含中括號
+} value_kind_t;
+
+typedef struct {
+    const char *cur;
+    const char *end;
+} scanner_t;
+
+static inline void skip_ws(scanner_t *s)
+{
+    while (s->cur < s->end && (*s->cur == ' ' || *s->cur == '\n' || *s->cur == '\r' || *s->cur == '\t')) {
+        s->cur++;
+    }
+}
+
+// 掃描字串 (s->cur 指向開頭引號)，回傳不含引號的切片
+static bool scan_string(scanner_t *s, slice_t *out)
+{
+    const char *start = ++s->cur;
+    while (s->cur < s->end) {
+        const char *quote = memchr(s->cur, '"', (size_t)(s->end - s->cur));
+        if (quote == NULL) {
+            return false;
+        }
+        // 前面連續反斜線為奇數個時，這個引號是跳脫字元
+        const char *b = quote;
+        while (b > start && b[-1] == '\\') {
+            b--;
+        }
+        s->cur = quote + 1;
+        if (((quote - b) & 1) == 0) {
+            out->p = start;
+            out->len = (uint32_t)(quote - start);
+            return true;
+        }
+    }
+    return false;
+}
+
+// 跳過物件或陣列 (s->cur 指向開頭括號)，只追蹤深度與字串邊界
+static bool skip_container(scanner_t *s)
+{
+    int depth = 0;
+    while (s->cur < s->end) {
+        char c = *s->cur;
+        if (c == '"') {
+            slice_t ignored;
+            if (!scan_string(s, &ignored)) {
+                return false;
+            }
+            continue;
+        }
+        s->cur++;
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool scan_value(scanner_t *s, slice_t *out, value_kind_t *kind)
+{
+    skip_ws(s);
+    if (s->cur >= s->end) {
+        return false;
+    }
+    const char *start = s->cur;
+    switch (*start) {
+        case '"':
+            *kind = VAL_STRING;
+            return scan_string(s, out);
+        case '{':
+        case '[':
+            *kind = *start == '{' ? VAL_OBJECT : VAL_ARRAY;
+            if (!skip_container(s)) {
+                return false;
+            }
+            break;
+        default:
+            *kind = VAL_SCALAR;
+            while (s->cur < s->end && *s->cur != ',' && *s->cur != '}' && *s->cur != ']' &&
+                   *s->cur != ' ' && *s->cur != '\n' && *s->cur != '\r' && *s->cur != '\t') {
+                s->cur++;
+            }
+            if (s->cur == start) {
+                return false;
+            }
+            break;
+    }
+    out->p = start;
+    out->len = (uint32_t)(s->cur - start);
+    return true;
+}
+
+// 進入物件或陣列：scanner 範圍設為容器內容
+static bool enter(scanner_t *s, slice_t container, char open)
+{
+    if (container.len < 2 || container.p[0] != open) {
+        return false;
+    }
+    s->cur = container.p + 1;
+    s->end = container.p + container.len - 1;
+    return true;
+}
+
+// 取出下一組成員；回傳 1 有成員、0 結束、-1 格式錯誤
+static int next_member(scanner_t *s, slice_t *key, slice_t *val, value_kind_t *kind)
+{
+    skip_ws(s);
+    if (s->cur >= s->end) {
+        return 0;
+    }
+    if (*s->cur == ',') {
+        s->cur++;
+        skip_ws(s);
+    }
+    if (s->cur >= s->end || *s->cur != '"' || !scan_string(s, key)) {
+        return -1;
+    }
+    skip_ws(s);
+    if (s->cur >= s->end || *s->cur != ':') {
+        return -1;
+    }
+    s->cur++;
+    return scan_value(s, val, kind) ? 1 : -1;
+}
+
+static int next_element(scanner_t *s, slice_t *val, value_kind_t *kind)
+{
+    skip_ws(s);
+    if (s->cur >= s->end) {
+        return 0;
+    }
+    if (*s->cur == ',') {
+        s->cur++;
+    }
+    return scan_value(s, val, kind) ? 1 : -1;
+}
+
+static inline bool slice_eq(slice_t a, const char *lit)
+{
+    size_t n = strlen(lit);
+    return a.len == n && memcmp(a.p, lit, n) == 0;
+}
+
+static inline bool slice_ends_with(slice_t a, const char *lit)
+{
+    size_t n = strlen(lit);
+    return a.len >= n && memcmp(a.p + a.len - n, lit, n) == 0;
+}
+
+// ============================================================================
+// 欄式輸出表
+// ============================================================================
+typedef struct {
+    const char *name;
+    const char *const *columns;
+    int column_count;
+    uint8_t hash[COLUMN_HASH_SLOTS];    // 欄位索引 + 1，0 表示空槽
+    int fd;
+    char *out;                          // 自管輸出緩衝區 (避免 stdio 每字元加鎖)
+    size_t used;
+    uint64_t rows;
+} table_t;
+
+typedef struct {
+    table_t *table;
+    slice_t values[MAX_COLUMNS];
+    value_kind_t kinds[MAX_COLUMNS];
+} row_t;
+
+static const char *const SOIL_COLUMNS[] = {
+    "recv_ms", "source", "seq", "timestamp", "ts_ms", "voltage", "moisture", "raw_adc", "gpio_status",
+    "temperature", "moisture_compensated", "air_temperature", "air_humidity", "light_lux",
+    "slot_ms", "sample_skew_ms",
+};
+
+static const char *const STATUS_COLUMNS[] = {
+    "recv_ms", "source", "timestamp", "system", "uptime", "compact", "free_heap", "gpio_status",
+    "commands_processed", "command_errors", "commands_expired", "commands_late", "water_count", "water_last_ml", "water_total_ml",
+    "pump.isr_dispatch", "pump.activations", "pump.timer_offs", "pump.early_stops", "pump.bound_violations",
+    "pump.jitter_avg_us", "pump.jitter_max_us", "pump.last_on_ms", "pump.last_jitter_us",
+    "firmware_version", "ota_updates", "ota_success", "ota_state", "ota_selftest", "ota_selftest_remaining_s",
+    "transport", "first_send_ms", "first_ack_ms", "oversize_dropped", "gateway.send_failures",
+    "gateway.oversize_dropped", "gateway.batch_dropped", "gateway.leaves_full", "ts_ms", "time_synced", "clock_drift_ppm", "mem_pressure",
+    "sampling.aligned", "sampling.publish_offset_ms", "sampling.skew_avg_ms", "sampling.skew_max_ms",
+    "sampling.missed_slots", "sampling.clock_steps_back",
+    "forecast.state", "forecast.rate_pct_per_h", "forecast.hours_to_threshold", "forecast.blocks", "forecast.resets",
+    "live_stream.active", "live_stream.sessions", "live_stream.late_samples", "live_stream.last_end",
+    "pm.enabled", "pm.awake_pct", "pm.lock_ms.adc", "pm.lock_ms.encode", "pm.lock_ms.tls", "pm.lock_ms.ota",
+    "pm.lock_ms.flow", "pm.cmd_latency_avg_ms", "pm.cmd_latency_max_ms",
+};
+
+static const char *const OTA_RECORD_COLUMNS[] = {
+    "recv_ms", "node", "attempt", "result", "error", "error_code", "reset_reason", "running_version",
+    "target_version", "start_ts_ms", "connections", "bytes", "total_bytes", "bytes_per_s", "retries",
+    "heap_floor", "end_ms", "stages.connect", "stages.headers", "stages.first_byte",
+    "stages.pct10", "stages.pct20", "stages.pct30", "stages.pct40", "stages.pct50",
+    "stages.pct60", "stages.pct70", "stages.pct80", "stages.pct90",
+    "stages.download_end", "stages.verified", "stages.set_boot",
+};
+
+static const char *const FORECAST_COLUMNS[] = {
+    "recv_ms", "state", "moisture", "threshold", "rate_pct_per_h", "rate_sd", "rmse", "autocorr", "blocks", "fit_age_s",
+    "resets", "uptime", "ts_ms", "hours_to_threshold", "hours_low", "hours_high", "dry_at_ms",
+};
+
+// 即時訊框每筆讀數一列 (t0 + offset_ms 為開機時間，ts_ms 為訊框開始的牆鐘時間)
+static const char *const LIVE_COLUMNS[] = {
+    "recv_ms", "seq", "t0", "ts_ms", "hz", "offset_ms", "raw_adc", "moisture_x10",
+};
+
+static const char *const GATEWAY_COLUMNS[] = {
+    "recv_ms", "gateway", "batch_timestamp", "batch_ts_ms", "node", "seq", "uptime", "ts_ms", "raw_adc", "voltage",
+    "moisture", "gpio_status",
+};
+
+#define COUNT_OF(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+static table_t soil_table = { .name = "soil_data", .columns = SOIL_COLUMNS, .column_count = COUNT_OF(SOIL_COLUMNS) };
+static table_t status_table = {
+    .name = "system_status", .columns = STATUS_COLUMNS, .column_count = COUNT_OF(STATUS_COLUMNS)
+};
+static table_t gateway_table = {
+    .name = "gateway_readings", .columns = GATEWAY_COLUMNS, .column_count = COUNT_OF(GATEWAY_COLUMNS)
+};
+static table_t ota_record_table = {
+    .name = "ota_record", .columns = OTA_RECORD_COLUMNS, .column_count = COUNT_OF(OTA_RECORD_COLUMNS)
+};
+static table_t forecast_table = {
+    .name = "drying_forecast", .columns = FORECAST_COLUMNS, .column_count = COUNT_OF(FORECAST_COLUMNS)
+};
+static table_t live_table = { .name = "live_stream", .columns = LIVE_COLUMNS, .column_count = COUNT_OF(LIVE_COLUMNS) };
+static table_t *const tables[] = {
+    &soil_table, &status_table, &gateway_table, &ota_record_table, &forecast_table, &live_table
+};
+
+static inline uint32_t fnv1a(const char *p, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void table_build_index(table_t *t)
+{
+    memset(t->hash, 0, sizeof(t->hash));
+    for (int c = 0; c < t->column_count; c++) {
+        uint32_t slot = fnv1a(t->columns[c], strlen(t->columns[c])) & (COLUMN_HASH_SLOTS - 1);
+        while (t->hash[slot] != 0) {
+            slot = (slot + 1) & (COLUMN_HASH_SLOTS - 1);
+        }
+        t->hash[slot] = (uint8_t)(c + 1);
+    }
+}
+
+static int table_column(const table_t *t, const char *key, size_t len)
+{
+    uint32_t slot = fnv1a(key, len) & (COLUMN_HASH_SLOTS - 1);
+    while (t->hash[slot] != 0) {
+        const char *name = t->columns[t->hash[slot] - 1];
+        if (strncmp(name, key, len) == 0 && name[len] == '\0') {
+            return t->hash[slot] - 1;
+        }
+        slot = (slot + 1) & (COLUMN_HASH_SLOTS - 1);
+    }
+    return -1;
+}
+
+static void table_flush(table_t *t)
+{
+    size_t off = 0;
+    while (off < t->used) {
+        ssize_t n = write(t->fd, t->out + off, t->used - off);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "❌ 寫入 %s 失敗: %s\n", t->name, strerror(errno));
+            break;
+        }
+        off += (size_t)n;
+    }
+    t->used = 0;
+}
+
+static inline void table_put(table_t *t, const char *p, size_t len)
+{
+    if (t->used + len > OUT_BUFFER_SIZE) {
+        table_flush(t);
+    }
+    memcpy(t->out + t->used, p, len);
+    t->used += len;
+}
+
+static inline void table_putc(table_t *t, char c)
+{
+    if (t->used == OUT_BUFFER_SIZE) {
+        table_flush(t);
+    }
+    t->out[t->used++] = c;
+}
+
+// dir 為 NULL 時輸出到 /dev/null (基準測試)
+static bool table_open(table_t *t, const char *dir)
+{
+    char path[512];
+    if (dir != NULL) {
+        snprintf(path, sizeof(path), "%s/%s.csv", dir, t->name);
+    } else {
+        snprintf(path, sizeof(path), "/dev/null");
+    }
+    struct stat st;
+    bool exists = stat(path, &st) == 0 && (st.st_size > 0 || dir == NULL);
+    t->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    t->out = malloc(OUT_BUFFER_SIZE);
+    if (t->fd < 0 || t->out == NULL) {
+        fprintf(stderr, "❌ 無法開啟 %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    t->used = 0;
+    if (!exists) {
+        for (int c = 0; c < t->column_count; c++) {
+            table_put(t, t->columns[c], strlen(t->columns[c]));
+            table_putc(t, c + 1 < t->column_count ? ',' : '\n');
+        }
+    }
+    return true;
+}
+
+static void table_close(table_t *t)
+{
+    table_flush(t);
+    close(t->fd);
+    free(t->out);
+}
+
+// ============================================================================
+// 解碼統計
+// ============================================================================
+typedef struct {
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t parse_errors;
+    uint64_t ignored;           // 非遙測主題 (指令回應、警報等)
+    uint64_t unknown_keys;      // 不在欄位表中的欄位 (韌體新增欄位時會增加)
+    uint64_t qos2_duplicates;   // PUBREL 前重送的 QoS 2 PUBLISH (DUP)，不重複匯入
+    uint64_t reconnects;        // Broker 重新連線次數
+} ingest_stats_t;
+
+static ingest_stats_t stats;
+
+// ============================================================================
+// 列組裝與輸出
+// ============================================================================
+static inline void row_begin(row_t *row, table_t *t)
+{
+    row->table = t;
+    memset(row->kinds, 0, sizeof(row->kinds[0]) * (size_t)t->column_count);
+}
+
+static inline void row_set(row_t *row, int col, slice_t val, value_kind_t kind)
+{
+    if (col < 0) {
+        stats.unknown_keys++;
+        return;
+    }
+    row->values[col] = val;
+    row->kinds[col] = kind;
+}
+
+static inline void row_set_key(row_t *row, slice_t key, slice_t val, value_kind_t kind)
+{
+    row_set(row, table_column(row->table, key.p, key.len), val, kind);
+}
+
+static void write_csv_string(table_t *t, slice_t v)
+{
+    if (memchr(v.p, ',', v.len) == NULL && memchr(v.p, '"', v.len) == NULL && memchr(v.p, '\n', v.len) == NULL) {
+        table_put(t, v.p, v.len);
+        return;
+    }
+    table_putc(t, '"');
+    for (uint32_t i = 0; i < v.len; i++) {
+        if (v.p[i] == '"') {
+            table_putc(t, '"');
+        }
+        table_putc(t, v.p[i]);
+    }
+    table_putc(t, '"');
+}
+
+static void row_emit(row_t *row)
+{
+    table_t *t = row->table;
+    for (int c = 0; c < t->column_count; c++) {
+        if (row->kinds[c] == VAL_STRING) {
+            write_csv_string(t, row->values[c]);
+        } else if (row->kinds[c] == VAL_SCALAR && !slice_eq(row->values[c], "null")) {
+            table_put(t, row->values[c].p, row->values[c].len);
+        }
+        table_putc(t, c + 1 < t->column_count ? ',' : '\n');
+    }
+    t->rows++;
+}
+
+// 把物件的成員填入列；巢狀物件以 "父.子" 展開 (只在巢狀時組路徑，頂層直接用原始切片)
+static bool fill_row(row_t *row, slice_t object, const char *prefix, size_t prefix_len, int depth)
+{
+    scanner_t s;
+    if (!enter(&s, object, '{')) {
+        return false;
+    }
+
+    slice_t key, val;
+    value_kind_t kind;
+    int rc;
+    while ((rc = next_member(&s, &key, &val, &kind)) == 1) {
+        if (prefix_len == 0 && kind != VAL_OBJECT) {
+            if (!slice_eq(key, "type")) {   // 紀錄類型已由主題決定
+                row_set_key(row, key, val, kind);
+            }
+            continue;
+        }
+
+        char path[MAX_KEY_PATH];
+        size_t path_len = prefix_len + (prefix_len > 0) + key.len;
+        if (path_len >= sizeof(path)) {
+            stats.unknown_keys++;
+            continue;
+        }
+        memcpy(path, prefix, prefix_len);
+        if (prefix_len > 0) {
+            path[prefix_len] = '.';
+        }
+        memcpy(path + path_len - key.len, key.p, key.len);
+
+        if (kind == VAL_OBJECT) {
+            if (depth + 1 >= MAX_NESTING || !fill_row(row, val, path, path_len, depth + 1)) {
+                stats.unknown_keys++;
+            }
+        } else {
+            row_set(row, table_column(row->table, path, path_len), val, kind);
+        }
+    }
+    return rc == 0;
+}
+
+// ============================================================================
+// 各格式解碼
+// ============================================================================
+static const slice_t SOURCE_LIVE = { "live", 4 };
+static const slice_t SOURCE_BACKFILL = { "backfill", 8 };
+static const slice_t SOURCE_ENVELOPE = { "envelope", 8 };
+
+static bool decode_soil(slice_t payload, slice_t recv_ms, slice_t source, const slice_t *seq)
+{
+    row_t row;
+    row_begin(&row, &soil_table);
+    row_set(&row, 0, recv_ms, VAL_SCALAR);
+    row_set(&row, 1, source, VAL_STRING);
+    if (!fill_row(&row, payload, "", 0, 0)) {
+        return false;
+    }
+    if (seq != NULL) {
+        row_set(&row, 2, *seq, VAL_SCALAR);   // 信封中的序號在子紀錄外層
+    }
+    row_emit(&row);
+    return true;
+}
+
+static bool decode_status(slice_t payload, slice_t recv_ms, slice_t source)
+{
+    row_t row;
+    row_begin(&row, &status_table);
+    row_set(&row, 0, recv_ms, VAL_SCALAR);
+    row_set(&row, 1, source, VAL_STRING);
+    if (!fill_row(&row, payload, "", 0, 0)) {
+        return false;
+    }
+    row_emit(&row);
+    return true;
+}
+
+// 單筆物件直接展開成一列 (OTA 嘗試紀錄、乾燥預測)
+static bool decode_single(table_t *table, slice_t payload, slice_t recv_ms)
+{
+    row_t row;
+    row_begin(&row, table);
+    row_set(&row, 0, recv_ms, VAL_SCALAR);
+    if (!fill_row(&row, payload, "", 0, 0)) {
+        return false;
+    }
+    row_emit(&row);
+    return true;
+}
+
+static bool decode_backfill(slice_t payload, slice_t recv_ms)
+{
+    scanner_t s;
+    if (!enter(&s, payload, '{')) {
+        return false;
+    }
+    slice_t key, val;
+    value_kind_t kind;
+    int rc;
+    while ((rc = next_member(&s, &key, &val, &kind)) == 1) {
+        if (kind != VAL_ARRAY || !slice_eq(key, "readings")) {
+            continue;
+        }
+        scanner_t a;
+        if (!enter(&a, val, '[')) {
+            return false;
+        }
+        slice_t item;
+        value_kind_t item_kind;
+        int arc;
+        while ((arc = next_element(&a, &item, &item_kind)) == 1) {
+            if (item_kind != VAL_OBJECT || !decode_soil(item, recv_ms, SOURCE_BACKFILL, NULL)) {
+                return false;
+            }
+        }
+        if (arc < 0) {
+            return false;
+        }
+    }
+    return rc == 0;
+}
+
+static bool decode_gateway_batch(slice_t payload, slice_t recv_ms)
+{
+    scanner_t s;
+    if (!enter(&s, payload, '{')) {
+        return false;
+    }
+
+    // 批次層欄位可能出現在 readings 之後，先記下切片再展開
+    slice_t gateway = { 0 }, batch_ts = { 0 }, batch_ts_ms = { 0 }, readings = { 0 };
+    slice_t key, val;
+    value_kind_t kind;
+    int rc;
+    while ((rc = next_member(&s, &key, &val, &kind)) == 1) {
+        if (slice_eq(key, "gateway") && kind == VAL_STRING) {
+            gateway = val;
+        } else if (slice_eq(key, "timestamp") && kind == VAL_SCALAR) {
+            batch_ts = val;
+        } else if (slice_eq(key, "ts_ms") && kind == VAL_SCALAR) {
+            batch_ts_ms = val;
+        } else if (slice_eq(key, "readings") && kind == VAL_ARRAY) {
+            readings = val;
+        }
+    }
+    if (rc < 0 || readings.p == NULL) {
+        return false;
+    }
+
+    scanner_t a;
+    if (!enter(&a, readings, '[')) {
+        return false;
+    }
+    slice_t item;
+    value_kind_t item_kind;
+    while ((rc = next_element(&a, &item, &item_kind)) == 1) {
+        row_t row;
+        row_begin(&row, &gateway_table);
+        row_set(&row, 0, recv_ms, VAL_SCALAR);
+        if (gateway.p != NULL) {
+            row_set(&row, 1, gateway, VAL_STRING);
+        }
+        if (batch_ts.p != NULL) {
+            row_set(&row, 2, batch_ts, VAL_SCALAR);
+        }
+        if (batch_ts_ms.p != NULL) {
+            row_set(&row, 3, batch_ts_ms, VAL_SCALAR);
+        }
+        if (item_kind != VAL_OBJECT || !fill_row(&row, item, "", 0, 0)) {
+            return false;
+        }
+        row_emit(&row);
+    }
+    return rc == 0;
+}
+
+static bool decode_live(slice_t payload, slice_t recv_ms)
+{
+    scanner_t s;
+    if (!enter(&s, payload, '{')) {
+        return false;
+    }
+
+    // 訊框層欄位 (seq、t0、ts_ms、hz) 依序對應 LIVE_COLUMNS[1..4]
+    slice_t header[4] = { { 0 } };
+    static const char *const header_keys[4] = { "seq", "t0", "ts_ms", "hz" };
+    slice_t samples = { 0 };
+    slice_t key, val;
+    value_kind_t kind;
+    int rc;
+    while ((rc = next_member(&s, &key, &val, &kind)) == 1) {
+        if (slice_eq(key, "s") && kind == VAL_ARRAY) {
+            samples = val;
+            continue;
+        }
+        for (int i = 0; i < 4; i++) {
+            if (kind == VAL_SCALAR && slice_eq(key, header_keys[i])) {
+                header[i] = val;
+            }
+        }
+    }
+    if (rc < 0 || samples.p == NULL) {
+        return false;
+    }
+
+    scanner_t a;
+    if (!enter(&a, samples, '[')) {
+        return false;
+    }
+    slice_t item;
+    value_kind_t item_kind;
+    while ((rc = next_element(&a, &item, &item_kind)) == 1) {
+        scanner_t e;
+        if (item_kind != VAL_ARRAY || !enter(&e, item, '[')) {
+            return false;
+        }
+        row_t row;
+        row_begin(&row, &live_table);
+        row_set(&row, 0, recv_ms, VAL_SCALAR);
+        for (int i = 0; i < 4; i++) {
+            if (header[i].p != NULL) {
+                row_set(&row, 1 + i, header[i], VAL_SCALAR);
+            }
+        }
+        // [offset_ms, raw_adc, moisture_x10]
+        slice_t field;
+        value_kind_t field_kind;
+        int col = 5, erc;
+        while ((erc = next_element(&e, &field, &field_kind)) == 1) {
+            if (field_kind != VAL_SCALAR || col >= live_table.column_count) {
+                return false;
+            }
+            row_set(&row, col++, field, VAL_SCALAR);
+        }
+        if (erc < 0) {
+            return false;
+        }
+        row_emit(&row);
+    }
+    return rc == 0;
+}
+
+static bool decode_envelope(slice_t payload, slice_t recv_ms)
+{
+    scanner_t s;
+    if (!enter(&s, payload, '{')) {
+        return false;
+    }
+    slice_t key, val;
+    value_kind_t kind;
+    int rc;
+    while ((rc = next_member(&s, &key, &val, &kind)) == 1) {
+        if (kind != VAL_ARRAY || !slice_eq(key, "records")) {
+            continue;
+        }
+        scanner_t a;
+        if (!enter(&a, val, '[')) {
+            return false;
+        }
+        slice_t record;
+        value_kind_t record_kind;
+        int arc;
+        while ((arc = next_element(&a, &record, &record_kind)) == 1) {
+            scanner_t r;
+            if (record_kind != VAL_OBJECT || !enter(&r, record, '{')) {
+                return false;
+            }
+            slice_t topic = { 0 }, seq = { 0 }, inner = { 0 };
+            slice_t rkey, rval;
+            value_kind_t rkind;
+            int rrc;
+            while ((rrc = next_member(&r, &rkey, &rval, &rkind)) == 1) {
+                if (slice_eq(rkey, "topic")) {
+                    topic = rval;
+                } else if (slice_eq(rkey, "seq")) {
+                    seq = rval;
+                } else if (slice_eq(rkey, "payload") && rkind == VAL_OBJECT) {
+                    inner = rval;
+                }
+            }
+            if (rrc < 0 || inner.p == NULL) {
+                return false;
+            }
+            if (slice_ends_with(topic, "/esp/data")) {
+                if (!decode_soil(inner, recv_ms, SOURCE_ENVELOPE, seq.p != NULL ? &seq : NULL)) {
+                    return false;
+                }
+            } else if (slice_ends_with(topic, "/esp/status")) {
+                if (!decode_status(inner, recv_ms, SOURCE_ENVELOPE)) {
+                    return false;
+                }
+            }
+        }
+        if (arc < 0) {
+            return false;
+        }
+    }
+    return rc == 0;
+}
+
+// 依主題選擇解碼器 (與韌體 main.c 的 TOPIC_* 對應)
+static void ingest_message(slice_t topic, const char *payload, size_t len, int64_t recv_ms)
+{
+    char recv_buf[24];
+    int recv_len = snprintf(recv_buf, sizeof(recv_buf), "%lld", (long long)recv_ms);
+    slice_t recv = { recv_buf, (uint32_t)recv_len };
+
+    // 裝置以 cJSON_Print 排版時，頂層物件前後可能有空白
+    scanner_t s = { payload, payload + len };
+    slice_t object;
+    value_kind_t kind;
+    if (!scan_value(&s, &object, &kind) || kind != VAL_OBJECT) {
+        stats.parse_errors++;
+        return;
+    }
+
+    stats.messages++;
+    stats.bytes += len;
+
+    bool ok;
+    if (slice_ends_with(topic, "/esp/data")) {
+        ok = decode_soil(object, recv, SOURCE_LIVE, NULL);
+    } else if (slice_ends_with(topic, "/esp/status")) {
+        ok = decode_status(object, recv, SOURCE_LIVE);
+    } else if (slice_ends_with(topic, "/esp/data/backfill")) {
+        ok = decode_backfill(object, recv);
+    } else if (slice_ends_with(topic, "/gateway/batch")) {
+        ok = decode_gateway_batch(object, recv);
+    } else if (slice_ends_with(topic, "/esp/envelope")) {
+        ok = decode_envelope(object, recv);
+    } else if (slice_ends_with(topic, "/esp/ota/record")) {
+        ok = decode_single(&ota_record_table, object, recv);
+    } else if (slice_ends_with(topic, "/esp/forecast")) {
+        ok = decode_single(&forecast_table, object, recv);
+    } else if (slice_ends_with(topic, "/esp/live")) {
+        ok = decode_live(object, recv);
+    } else {
+        stats.messages--;
+        stats.bytes -= len;
+        stats.ignored++;
+        return;
+    }
+    if (!ok) {
+        stats.parse_errors++;
+    }
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static double monotonic_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ============================================================================
+// 最小 MQTT 3.1.1 訂閱端 (CONNECT / SUBSCRIBE / PUBLISH QoS 0-2 / PINGREQ)
+// QoS 2 依 PUBREL 匯入：PUBLISH 先複製保存並回 PUBREC，Broker 在收到 PUBREC 前
+// 可能以相同封包識別碼重送 (DUP)，收到 PUBREL 才代表不會再重送，此時匯入並回 PUBCOMP
+// ============================================================================
+typedef struct {
+    bool in_use;
+    uint16_t packet_id;
+    int64_t recv_ms;
+    uint32_t topic_len;
+    size_t payload_len;
+    char *data;                 // 主題 + 內容 (rx_buf 會被覆寫，必須複製)
+} qos2_inflight_t;
+
+static uint8_t rx_buf[RX_BUFFER_SIZE];
+static qos2_inflight_t qos2_inflight[QOS2_INFLIGHT_MAX];
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static qos2_inflight_t *qos2_find(uint16_t packet_id)
+{
+    for (int i = 0; i < QOS2_INFLIGHT_MAX; i++) {
+        if (qos2_inflight[i].in_use && qos2_inflight[i].packet_id == packet_id) {
+            return &qos2_inflight[i];
+        }
+    }
+    return NULL;
+}
+
+static void qos2_release(qos2_inflight_t *m)
+{
+    free(m->data);
+    memset(m, 0, sizeof(*m));
+}
+
+// 新連線 (Clean Session) 時 Broker 已丟棄未完成的交換
+static void qos2_clear(void)
+{
+    for (int i = 0; i < QOS2_INFLIGHT_MAX; i++) {
+        if (qos2_inflight[i].in_use) {
+            qos2_release(&qos2_inflight[i]);
+        }
+    }
+}
+
+// 保存 QoS 2 訊息，回傳 false 表示已在等待 PUBREL (重送) 或無法保存
+static bool qos2_store(uint16_t packet_id, slice_t topic, const char *payload, size_t len, int64_t recv_ms,
+                       bool *duplicate)
+{
+    *duplicate = qos2_find(packet_id) != NULL;
+    if (*duplicate) {
+        return false;
+    }
+    for (int i = 0; i < QOS2_INFLIGHT_MAX; i++) {
+        qos2_inflight_t *m = &qos2_inflight[i];
+        if (m->in_use) {
+            continue;
+        }
+        m->data = malloc(topic.len + len);
+        if (m->data == NULL) {
+            return false;
+        }
+        memcpy(m->data, topic.p, topic.len);
+        memcpy(m->data + topic.len, payload, len);
+        m->in_use = true;
+        m->packet_id = packet_id;
+        m->recv_ms = recv_ms;
+        m->topic_len = topic.len;
+        m->payload_len = len;
+        return true;
+    }
+    return false;
+}
+
+static bool send_all(int fd, const uint8_t *p, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static size_t encode_remaining(uint8_t *out, size_t len)
+{
+    size_t n = 0;
+    do {
+        uint8_t b = len % 128;
+        len /= 128;
+        out[n++] = len > 0 ? (b | 0x80) : b;
+    } while (len > 0);
+    return n;
+}
+
+static size_t put_str(uint8_t *out, const char *s)
+{
+    size_t len = strlen(s);
+    out[0] = (uint8_t)(len >> 8);
+    out[1] = (uint8_t)len;
+    memcpy(out + 2, s, len);
+    return len + 2;
+}
+
+static int mqtt_connect(const char *host, const char *port, const char *topic)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *res;
+    if (getaddrinfo(host, port, &hints, &res) != 0) {
+        fprintf(stderr, "❌ 無法解析 %s\n", host);
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+        fprintf(stderr, "❌ 無法連線到 %s:%s\n", host, port);
+        return -1;
+    }
+
+    char client_id[32];
+    snprintf(client_id, sizeof(client_id), "ingest-bridge-%d", (int)getpid());
+
+    uint8_t body[256], pkt[300];
+    size_t n = put_str(body, "MQTT");
+    body[n++] = 4;                      // 協定等級 3.1.1
+    body[n++] = 0x02;                   // Clean Session (重連時重新訂閱)
+    body[n++] = 0;
+    body[n++] = MQTT_KEEPALIVE_S;
+    n += put_str(body + n, client_id);
+    pkt[0] = 0x10;
+    size_t h = 1 + encode_remaining(pkt + 1, n);
+    memcpy(pkt + h, body, n);
+    if (!send_all(fd, pkt, h + n)) {
+        close(fd);
+        return -1;
+    }
+
+    uint8_t connack[4];
+    if (recv(fd, connack, sizeof(connack), MSG_WAITALL) != 4 || connack[0] != 0x20 || connack[3] != 0) {
+        fprintf(stderr, "❌ Broker 拒絕連線\n");
+        close(fd);
+        return -1;
+    }
+
+    n = 0;
+    body[n++] = 0;
+    body[n++] = 1;                      // 封包識別碼
+    n += put_str(body + n, topic);
+    body[n++] = 2;                      // 最高 QoS 2 (系統狀態以 QoS 2 發布)
+    pkt[0] = 0x82;
+    h = 1 + encode_remaining(pkt + 1, n);
+    memcpy(pkt + h, body, n);
+    if (!send_all(fd, pkt, h + n)) {
+        close(fd);
+        return -1;
+    }
+    fprintf(stderr, "✅ 已連線並訂閱 %s\n", topic);
+    return fd;
+}
+
+static bool mqtt_ack(int fd, uint8_t type, uint16_t packet_id)
+{
+    uint8_t ack[4] = { type, 2, (uint8_t)(packet_id >> 8), (uint8_t)packet_id };
+    return send_all(fd, ack, sizeof(ack));
+}
+
+// 處理緩衝區中完整的封包，回傳已消耗的位元組數 (不完整的封包留待下次)
+static size_t mqtt_process(int fd, const uint8_t *buf, size_t len, bool *error)
+{
+    size_t pos = 0;
+    while (pos + 2 <= len) {
+        size_t remaining = 0, mult = 1, h = 1;
+        while (true) {
+            if (pos + h >= len) {
+                return pos;
+            }
+            uint8_t b = buf[pos + h++];
+            remaining += (b & 0x7F) * mult;
+            mult *= 128;
+            if ((b & 0x80) == 0) {
+                break;
+            }
+            if (h > 4) {
+                *error = true;
+                return pos;
+            }
+        }
+        if (pos + h + remaining > len) {
+            if (h + remaining > RX_BUFFER_SIZE) {
+                *error = true;  // 封包超過緩衝區
+            }
+            return pos;
+        }
+
+        uint8_t type = buf[pos];
+        const uint8_t *p = buf + pos + h;
+        if ((type & 0xF0) == 0x30 && remaining >= 2) {
+            int qos = (type >> 1) & 0x03;
+            size_t topic_len = (size_t)p[0] << 8 | p[1];
+            size_t off = 2 + topic_len;
+            uint16_t packet_id = 0;
+            if (qos > 0 && off + 2 <= remaining) {
+                packet_id = (uint16_t)(p[off] << 8 | p[off + 1]);
+                off += 2;
+            }
+            if (off <= remaining) {
+                slice_t topic = { (const char *)p + 2, (uint32_t)topic_len };
+                const char *payload = (const char *)p + off;
+                size_t payload_len = remaining - off;
+                bool duplicate = false;
+                if (qos < 2) {
+                    ingest_message(topic, payload, payload_len, now_ms());
+                } else if (!qos2_store(packet_id, topic, payload, payload_len, now_ms(), &duplicate)) {
+                    if (duplicate) {
+                        stats.qos2_duplicates++;
+                    } else {
+                        // 無法保存時退回收到即匯入 (可能在 Broker 重送時重複一列)
+                        ingest_message(topic, payload, payload_len, now_ms());
+                    }
+                }
+            }
+            if (qos == 1) {
+                mqtt_ack(fd, 0x40, packet_id);          // PUBACK
+            } else if (qos == 2) {
+                mqtt_ack(fd, 0x50, packet_id);          // PUBREC
+            }
+        } else if ((type & 0xF0) == 0x60 && remaining >= 2) {
+            uint16_t packet_id = (uint16_t)(p[0] << 8 | p[1]);
+            qos2_inflight_t *m = qos2_find(packet_id);
+            if (m != NULL) {
+                slice_t topic = { m->data, m->topic_len };
+                ingest_message(topic, m->data + m->topic_len, m->payload_len, m->recv_ms);
+                qos2_release(m);
+            }
+            mqtt_ack(fd, 0x70, packet_id);              // PUBREL → PUBCOMP
+        }
+        pos += h + remaining;
+    }
+    return pos;
+}
+
+// 單次連線的接收迴圈，Broker 斷線或封包錯誤時返回
+static void run_session(int fd)
+{
+    size_t used = 0;
+    double last_tx = monotonic_s();
+    double last_report = last_tx;
+    uint64_t reported_messages = stats.messages;
+    while (!stop_requested) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, 1000);
+        double now = monotonic_s();
+        if (now - last_tx >= MQTT_KEEPALIVE_S / 2) {
+            const uint8_t ping[2] = { 0xC0, 0 };
+            if (!send_all(fd, ping, sizeof(ping))) {
+                fprintf(stderr, "⚠️ Broker 連線中斷\n");
+                return;
+            }
+            last_tx = now;
+        }
+        if (now - last_report >= 10) {
+            fprintf(stderr, "📊 %llu 則訊息 (%.0f msg/s)，資料 %llu / 狀態 %llu / 閘道 %llu / OTA %llu / 預測 %llu / 即時 %llu 列，錯誤 %llu\n",
+                    (unsigned long long)stats.messages, (stats.messages - reported_messages) / (now - last_report),
+                    (unsigned long long)soil_table.rows, (unsigned long long)status_table.rows,
+                    (unsigned long long)gateway_table.rows, (unsigned long long)ota_record_table.rows,
+                    (unsigned long long)forecast_table.rows, (unsigned long long)live_table.rows,
+                    (unsigned long long)stats.parse_errors);
+            for (int t = 0; t < COUNT_OF(tables); t++) {
+                table_flush(tables[t]);
+            }
+            reported_messages = stats.messages;
+            last_report = now;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        ssize_t n = recv(fd, rx_buf + used, sizeof(rx_buf) - used, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "⚠️ Broker 連線中斷\n");
+            return;
+        }
+        used += (size_t)n;
+
+        bool error = false;
+        size_t consumed = mqtt_process(fd, rx_buf, used, &error);
+        if (error) {
+            fprintf(stderr, "❌ MQTT 封包格式錯誤或超過 %d bytes\n", RX_BUFFER_SIZE);
+            return;
+        }
+        memmove(rx_buf, rx_buf + consumed, used - consumed);
+        used -= consumed;
+    }
+}
+
+// 連線、訂閱並接收，斷線後以指數退避重連，直到收到 SIGINT / SIGTERM
+static int run_mqtt(const char *host, const char *port, const char *topic)
+{
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    unsigned backoff_s = RECONNECT_MIN_S;
+    bool connected_before = false;
+    while (!stop_requested) {
+        int fd = mqtt_connect(host, port, topic);
+        if (fd >= 0) {
+            if (connected_before) {
+                stats.reconnects++;
+            }
+            connected_before = true;
+            backoff_s = RECONNECT_MIN_S;
+            run_session(fd);
+            close(fd);
+            qos2_clear();
+            for (int t = 0; t < COUNT_OF(tables); t++) {
+                table_flush(tables[t]);
+            }
+        }
+        if (stop_requested) {
+            break;
+        }
+
+        fprintf(stderr, "🔄 %u 秒後重新連線\n", backoff_s);
+        // sleep 被訊號中斷時提早返回，讓 Ctrl-C 不必等完退避時間
+        sleep(backoff_s);
+        backoff_s = backoff_s * 2 > RECONNECT_MAX_S ? RECONNECT_MAX_S : backoff_s * 2;
+    }
+    return 0;
+}
+
+// ============================================================================
+// 重播模式：每行 "主題<TAB>JSON"
+// ============================================================================
+static int run_stdin(void)
+{
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, stdin)) > 0) {
+        char *tab = memchr(line, '\t', (size_t)len);
+        if (tab == NULL) {
+            stats.parse_errors++;
+            continue;
+        }
+        slice_t topic = { line, (uint32_t)(tab - line) };
+        ingest_message(topic, tab + 1, (size_t)(line + len - tab - 1), now_ms());
+    }
+    free(line);
+    return 0;
+}
+
+// ============================================================================
+// 吞吐量基準測試：以韌體實際格式 (排版與不排版) 的混合語料重複解碼
+// ============================================================================
+static const char BENCH_SOIL_PRETTY[] =
+    "{\n\t\"timestamp\":\t86400,\n\t\"voltage\":\t1.732,\n\t\"moisture\":\t41.5,\n\t\"raw_adc\":\t2150,\n"
+    "\t\"gpio_status\":\tfalse,\n\t\"type\":\t\"soil_data\",\n\t\"temperature\":\t23.41,\n"
+    "\t\"moisture_compensated\":\t40.9,\n\t\"ts_ms\":\t1760000000123,\n\t\"air_temperature\":\t24.1,\n"
+    "\t\"air_humidity\":\t61.2,\n\t\"light_lux\":\t12850\n}";
+static const char BENCH_STATUS_PRETTY[] =
+    "{\n\t\"timestamp\":\t86400,\n\t\"system\":\t\"online\",\n\t\"uptime\":\t86400,\n\t\"free_heap\":\t142336,\n"
+    "\t\"gpio_status\":\tfalse,\n\t\"commands_processed\":\t42,\n\t\"command_errors\":\t1,\n\t\"water_count\":\t12,\n"
+    "\t\"water_last_ml\":\t198,\n\t\"water_total_ml\":\t2410,\n\t\"firmware_version\":\t\"1.0.0\",\n"
+    "\t\"ota_updates\":\t1,\n\t\"ota_success\":\t1,\n\t\"ota_state\":\t0,\n\t\"transport\":\t\"mqtt\",\n"
+    "\t\"first_send_ms\":\t2310,\n\t\"ts_ms\":\t1760000000456,\n\t\"time_synced\":\ttrue,\n"
+    "\t\"clock_drift_ppm\":\t3.2,\n\t\"mem_pressure\":\t\"normal\",\n\t\"pm\":\t{\n\t\t\"enabled\":\ttrue,\n"
+    "\t\t\"awake_pct\":\t6.4,\n\t\t\"lock_ms\":\t{\n\t\t\t\"adc\":\t51234,\n\t\t\t\"encode\":\t8123,\n"
+    "\t\t\t\"tls\":\t2211,\n\t\t\t\"ota\":\t0,\n\t\t\t\"flow\":\t18000\n\t\t},\n\t\t\"cmd_latency_avg_ms\":\t1.2,\n"
+    "\t\t\"cmd_latency_max_ms\":\t9.8\n\t},\n\t\"type\":\t\"system_status\"\n}";
+static const char BENCH_SOIL_COMPACT[] =
+    "{\"timestamp\":86460,\"voltage\":1.729,\"moisture\":41.7,\"raw_adc\":2147,\"gpio_status\":false,"
+    "\"type\":\"soil_data\",\"ts_ms\":1760000060123}";
+static const char BENCH_BACKFILL[] =
+    "{\"type\":\"soil_data_batch\",\"dropped\":0,\"readings\":["
+    "{\"seq\":101,\"timestamp\":80000,\"voltage\":1.71,\"moisture\":42.1,\"raw_adc\":2130,\"gpio_status\":false,\"ts_ms\":1759993600000},"
+    "{\"seq\":102,\"timestamp\":80060,\"voltage\":1.71,\"moisture\":42.0,\"raw_adc\":2131,\"gpio_status\":false,\"ts_ms\":1759993660000},"
+    "{\"seq\":103,\"timestamp\":80120,\"voltage\":1.72,\"moisture\":41.9,\"raw_adc\":2133,\"gpio_status\":false,\"ts_ms\":1759993720000},"
+    "{\"seq\":104,\"timestamp\":80180,\"voltage\":1.72,\"moisture\":41.9,\"raw_adc\":2134,\"gpio_status\":true,\"ts_ms\":1759993780000}]}";
+static const char BENCH_GATEWAY[] =
+    "{\"type\":\"gateway_batch\",\"gateway\":\"a1b2c3d4\",\"timestamp\":86400,\"ts_ms\":1759993605000,\"readings\":["
+    "{\"node\":\"0000beef\",\"seq\":77,\"uptime\":3600,\"ts_ms\":1759993600000,\"raw_adc\":2201,\"voltage\":1.77,\"moisture\":38.2,\"gpio_status\":false},"
+    "{\"node\":\"0000cafe\",\"seq\":12,\"uptime\":7200,\"raw_adc\":1999,\"voltage\":1.61,\"moisture\":50.4,\"gpio_status\":false},"
+    "{\"node\":\"0000f00d\",\"seq\":5,\"uptime\":900,\"raw_adc\":2400,\"voltage\":1.93,\"moisture\":26.1,\"gpio_status\":true}]}";
+static const char BENCH_ENVELOPE[] =
+    "{\"type\":\"envelope\",\"timestamp\":86400,\"records\":["
+    "{\"topic\":\"soilsensorcapture/esp/data\",\"qos\":0,\"retain\":false,\"seq\":205,\"payload\":"
+    "{\"timestamp\":86400,\"voltage\":1.73,\"moisture\":41.5,\"raw_adc\":2150,\"gpio_status\":false,\"type\":\"soil_data\"}},"
+    "{\"topic\":\"soilsensorcapture/esp/status\",\"qos\":2,\"retain\":true,\"payload\":"
+    "{\"type\":\"system_status\",\"compact\":true,\"system\":\"online\",\"uptime\":86400,\"free_heap\":40210,"
+    "\"gpio_status\":false,\"mem_pressure\":\"elevated\"}}]}";
+
+typedef struct {
+    const char *topic;
+    const char *payload;
+} bench_message_t;
+
+static int run_bench(uint64_t messages)
+{
+    const bench_message_t corpus[] = {
+        { "soilsensorcapture/esp/data", BENCH_SOIL_PRETTY },
+        { "soilsensorcapture/esp/status", BENCH_STATUS_PRETTY },
+        { "soilsensorcapture/esp/data", BENCH_SOIL_COMPACT },
+        { "soilsensorcapture/esp/data/backfill", BENCH_BACKFILL },
+        { "soilsensorcapture/gateway/batch", BENCH_GATEWAY },
+        { "soilsensorcapture/esp/envelope", BENCH_ENVELOPE },
+    };
+    const int corpus_size = COUNT_OF(corpus);
+    slice_t topics[COUNT_OF(corpus)];
+    size_t lengths[COUNT_OF(corpus)];
+    for (int i = 0; i < corpus_size; i++) {
+        topics[i] = (slice_t){ corpus[i].topic, (uint32_t)strlen(corpus[i].topic) };
+        lengths[i] = strlen(corpus[i].payload);
+    }
+
+    // 輸出到 /dev/null：計入 CSV 格式化成本，不受磁碟速度影響
+    for (int t = 0; t < COUNT_OF(tables); t++) {
+        if (!table_open(tables[t], NULL)) {
+            return 1;
+        }
+    }
+
+    double start = monotonic_s();
+    for (uint64_t i = 0; i < messages; i++) {
+        int m = (int)(i % (uint64_t)corpus_size);
+        ingest_message(topics[m], corpus[m].payload, lengths[m], 1760000000000LL);
+    }
+    double elapsed = monotonic_s() - start;
+
+    uint64_t rows = soil_table.rows + status_table.rows + gateway_table.rows;
+    printf("messages: %llu  rows: %llu  bytes: %.1f MB  errors: %llu  unknown_keys: %llu\n",
+           (unsigned long long)stats.messages, (unsigned long long)rows, stats.bytes / 1e6,
+           (unsigned long long)stats.parse_errors, (unsigned long long)stats.unknown_keys);
+    printf("elapsed: %.3f s  throughput: %.0f messages/s/core  %.0f rows/s/core  %.1f MB/s/core\n",
+           elapsed, stats.messages / elapsed, rows / elapsed, stats.bytes / 1e6 / elapsed);
+    return stats.parse_errors == 0 ? 0 : 1;
+}
+
+// ============================================================================
+// 主程式
+// ============================================================================
+int main(int argc, char **argv)
+{
+    const char *host = "127.0.0.1";
+    const char *port = "1883";
+    const char *topic = "soilsensorcapture/#";
+    const char *out_dir = "ingest_out";
+    bool bench = false, from_stdin = false;
+    uint64_t bench_messages = 2000000;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--host") == 0 && has_value) {
+            host = argv[++i];
+        } else if (strcmp(argv[i], "--port") == 0 && has_value) {
+            port = argv[++i];
+        } else if (strcmp(argv[i], "--topic") == 0 && has_value) {
+            topic = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && has_value) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "--messages") == 0 && has_value) {
+            bench_messages = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            bench = true;
+        } else if (strcmp(argv[i], "--stdin") == 0) {
+            from_stdin = true;
+        } else {
+            fprintf(stderr, "用法：%s [--host H] [--port P] [--topic T] [--out DIR] | --stdin | --bench [--messages N]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    for (int t = 0; t < COUNT_OF(tables); t++) {
+        table_build_index(tables[t]);
+    }
+
+    if (bench) {
+        return run_bench(bench_messages);
+    }
+
+    if (mkdir(out_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "❌ 無法建立輸出目錄 %s: %s\n", out_dir, strerror(errno));
+        return 1;
+    }
+    for (int t = 0; t < COUNT_OF(tables); t++) {
+        if (!table_open(tables[t], out_dir)) {
+            return 1;
+        }
+    }
+
+    int rc = from_stdin ? run_stdin() : run_mqtt(host, port, topic);
+
+    for (int t = 0; t < COUNT_OF(tables); t++) {
+        table_close(tables[t]);
+    }
+    fprintf(stderr, "✅ 共 %llu 則訊息：資料 %llu / 狀態 %llu / 閘道 %llu / OTA %llu / 預測 %llu / 即時 %llu 列，錯誤 %llu，略過 %llu，"
+            "QoS 2 重送 %llu，重連 %llu\n",
+            (unsigned long long)stats.messages, (unsigned long long)soil_table.rows,
+            (unsigned long long)status_table.rows, (unsigned long long)gateway_table.rows,
+            (unsigned long long)ota_record_table.rows, (unsigned long long)forecast_table.rows,
+            (unsigned long long)live_table.rows, (unsigned long long)stats.parse_errors,
+            (unsigned long long)stats.ignored, (unsigned long long)stats.qos2_duplicates,
+            (unsigned long long)stats.reconnects);
+    return rc;
+}
@@ -0,0 +1,91 @@
+# 本地 HTTP API 負載測試 - 對節點同時開啟 SSE 串流並輪詢其他端點
+# 用法：python tools/local_api_load.py <節點 IP> [--port 80] [--streams 3] [--pollers 4] [--duration 60]
+# - 串流：每個連線計算收到的事件數與 seq 缺漏 (超過上限的連線應收到 503)
+# - 輪詢：輪流請求 /api/latest、/api/history、/metrics，統計延遲與錯誤
+import argparse
+import http.client
+import threading
+import time
+
+
+def stream_worker(host, port, deadline, result):
+    conn = http.client.HTTPConnection(host, port, timeout=30)
+    try:
+        conn.request('GET', '/api/stream')
+        resp = conn.getresponse()
+        result['status'] = resp.status
+        if resp.status != 200:
+            return
+        last_seq = None
+        while time.time() < deadline:
+            line = resp.fp.readline()
+            if not line:
+                break
+            if line.startswith(b'id: '):
+                seq = int(line[4:])
+                if last_seq is not None and seq != last_seq + 1:
+                    result['gaps'] += seq - last_seq - 1
+                last_seq = seq
+                result['events'] += 1
+    except OSError as exc:
+        result['error'] = str(exc)
+    finally:
+        conn.close()
+
+
+def poll_worker(host, port, deadline, result):
+    paths = ['/api/latest', '/api/history?limit=64', '/metrics']
+    i = 0
+    while time.time() < deadline:
+        path = paths[i % len(paths)]
+        i += 1
+        start = time.perf_counter()
+        try:
+            conn = http.client.HTTPConnection(host, port, timeout=10)
+            conn.request('GET', path)
+            resp = conn.getresponse()
+            resp.read()
+            conn.close()
+            if resp.status in (200, 404):   # 404：尚無讀數
+                result['latencies'].append(time.perf_counter() - start)
+            else:
+                result['errors'] += 1
+        except OSError:
+            result['errors'] += 1
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('host')
+    parser.add_argument('--port', type=int, default=80)
+    parser.add_argument('--streams', type=int, default=3)
+    parser.add_argument('--pollers', type=int, default=4)
+    parser.add_argument('--duration', type=float, default=60.0)
+    args = parser.parse_args()
+
+    deadline = time.time() + args.duration
+    streams = [{'status': None, 'events': 0, 'gaps': 0, 'error': None} for _ in range(args.streams)]
+    polls = [{'latencies': [], 'errors': 0} for _ in range(args.pollers)]
+
+    threads = [threading.Thread(target=stream_worker, args=(args.host, args.port, deadline, r)) for r in streams]
+    threads += [threading.Thread(target=poll_worker, args=(args.host, args.port, deadline, r)) for r in polls]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    for n, r in enumerate(streams):
+        print(f"stream {n}: status={r['status']} events={r['events']} gaps={r['gaps']} error={r['error']}")
+
+    latencies = sorted(x for r in polls for x in r['latencies'])
+    errors = sum(r['errors'] for r in polls)
+    if latencies:
+        p50 = latencies[len(latencies) // 2] * 1000
+        p99 = latencies[min(len(latencies) - 1, int(len(latencies) * 0.99))] * 1000
+        print(f"polls: ok={len(latencies)} errors={errors} p50={p50:.1f}ms p99={p99:.1f}ms")
+    else:
+        print(f"polls: ok=0 errors={errors}")
+
+
+if __name__ == '__main__':
+    main()
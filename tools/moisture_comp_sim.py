@@ -0,0 +1,193 @@
+# 濕度溫度補償模擬 - 以與韌體相同的小時區段差分最小平方 (main/moisture_comp.c) 重播合成曲線，
+#                   檢查學習係數的收斂時間與誤差，以及補償前後日夜波動的殘餘量，用來決定預設補償模型
+# 用法：python tools/moisture_comp_sim.py [--runs 50] [--days 14] [--coeff-max 0.6] [--lag 1.0] [--damp 0.8]
+# - 合成曲線：指數乾燥 (乾燥速率隨日照 --et 調變) 加上每 2-5 天一次澆水步階；
+#   讀數 = 真實濕度 + k·(探頭溫度 - 參考溫度) + 白雜訊，量化到 0.1%
+# - 韌體量到的溫度 (晶片內建或外接 NTC) 與探頭實際溫度可有相位落後 --lag 與振幅比 --damp，
+#   模擬溫度感測器與土壤中探頭不在同一處的情況
+# - 日夜波動以「小時平均讀數 - 真實濕度」的標準差計算 (去除固定偏移)，只取最後 --eval-days 天
+# - 浮點運算以 Python double 取代韌體的 float，累積量在此範圍內差異可忽略
+import argparse
+import math
+import random
+import statistics
+
+BLOCK_S = 3600
+BLOCK_MIN_SAMPLES = 20
+FORGET_FACTOR = 0.98
+MAX_PAIR_GAP_S = 600
+MAX_STEP_X10 = 15
+MIN_BLOCKS = 24
+MIN_SXX = 10.0
+MAX_COEFF_X1000 = 2000
+
+
+class MoistureComp:
+    """與韌體相同的學習流程：小時區段平均、步階區段剔除、帶截距與遺忘因子的 Δm = c + k·ΔT"""
+
+    def __init__(self, coeff_x1000, ref_temp_x100):
+        self.coeff_x1000 = coeff_x1000
+        self.ref_temp_x100 = ref_temp_x100
+        self.learned = False
+        self.learned_at_s = None
+        self.n = self.sx = self.sy = self.sxx = self.sxy = 0.0
+        self.samples = 0
+        self.prev = None
+        self.block = None
+        self.prev_block = None
+
+    def process(self, moisture_x10, temp_x100, t_s):
+        self.learn_from_sample(moisture_x10, temp_x100, t_s)
+        delta = self.coeff_x1000 * (temp_x100 - self.ref_temp_x100)
+        # 韌體為 C 的整數除法 (向零截斷)
+        correction_x10 = int((delta + 5000 if delta >= 0 else delta - 5000) / 10000)
+        return min(max(moisture_x10 - correction_x10, 0), 1000)
+
+    def learn_from_sample(self, moisture_x10, temp_x100, t_s):
+        step = (self.prev is not None and t_s - self.prev[1] <= MAX_PAIR_GAP_S and
+                abs(moisture_x10 - self.prev[0]) > MAX_STEP_X10)
+        self.prev = (moisture_x10, t_s)
+
+        if self.block and t_s - self.block['start'] >= BLOCK_S:
+            b = self.block
+            if b['disturbed'] or b['count'] < BLOCK_MIN_SAMPLES:
+                self.prev_block = None
+            else:
+                self.learn_from_block(b['m'] / 10.0 / b['count'], b['t'] / 100.0 / b['count'], b['start'])
+            self.block = None
+
+        if self.block is None:
+            self.block = {'start': t_s, 'm': 0, 't': 0, 'count': 0, 'disturbed': False}
+        self.block['m'] += moisture_x10
+        self.block['t'] += temp_x100
+        self.block['count'] += 1
+        self.block['disturbed'] |= step
+
+    def learn_from_block(self, moisture, temp, start_s):
+        prev = self.prev_block
+        self.prev_block = (moisture, temp, start_s)
+        if prev is None or start_s - prev[2] > 2 * BLOCK_S:
+            return
+        dm, dt = moisture - prev[0], temp - prev[1]
+        lam = FORGET_FACTOR
+        self.n = lam * self.n + 1.0
+        self.sx = lam * self.sx + dt
+        self.sy = lam * self.sy + dm
+        self.sxx = lam * self.sxx + dt * dt
+        self.sxy = lam * self.sxy + dm * dt
+        self.samples += 1
+        sxx_centered = self.sxx - self.sx * self.sx / self.n
+        if self.samples >= MIN_BLOCKS and sxx_centered >= MIN_SXX:
+            sxy_centered = self.sxy - self.sx * self.sy / self.n
+            coeff = int(sxy_centered / sxx_centered * 1000.0)
+            self.coeff_x1000 = min(max(coeff, -MAX_COEFF_X1000), MAX_COEFF_X1000)
+            if not self.learned:
+                self.learned_at_s = start_s
+            self.learned = True
+
+
+def synth_run(rng, args):
+    """回傳 [(t_s, 真實濕度 %, 讀數 x10, 量測溫度 x100)] 與真實係數 (%/°C)"""
+    k_true = rng.uniform(-0.2, args.coeff_max)
+    amp = rng.uniform(args.amp_min, args.amp_max)
+    phase = rng.uniform(0, 2 * math.pi)
+    mean_t = rng.uniform(15, 30)
+    m_inf = rng.uniform(10, 20)
+    tau_h = rng.uniform(40, 160)
+    m = rng.uniform(35, 55)
+    next_water = rng.uniform(2, 5) * 86400
+    water_left = 0.0
+    weather = 0.0
+    omega = 2 * math.pi / 86400
+    series = []
+    for t in range(0, args.days * 86400, args.period):
+        # 天氣造成的日均溫慢速漂移 (隨機漫步，約 ±2°C / 天)
+        weather += rng.gauss(0, 2.0 * math.sqrt(args.period / 86400))
+        sun = math.sin(omega * t + phase)
+        measured = mean_t + weather + amp * sun
+        probe = mean_t + weather + args.damp * amp * math.sin(omega * (t - args.lag * 3600) + phase)
+
+        if t >= next_water:
+            water_left = rng.uniform(15, 25)
+            next_water = t + rng.uniform(2, 5) * 86400
+        if water_left > 0:
+            # 澆水在數分鐘內滲入，相鄰讀數的變化遠大於步階門檻
+            dose = min(water_left, 6.0)
+            m += dose
+            water_left -= dose
+        rate = (m - m_inf) / (tau_h * 3600) * max(1 + args.et * sun, 0)
+        m -= rate * args.period
+
+        reading = m + k_true * (probe - args.ref) + rng.gauss(0, args.noise)
+        series.append((t, m, min(max(round(reading * 10), 0), 1000), round(measured * 100)))
+    return series, k_true
+
+
+def diurnal_residual(pairs, start_s):
+    """小時平均 (讀數 - 真值) 的標準差 (%)"""
+    hours = {}
+    for t, err in pairs:
+        if t >= start_s:
+            hours.setdefault(t // 3600, []).append(err)
+    means = [sum(v) / len(v) for v in hours.values()]
+    return statistics.pstdev(means) if len(means) > 1 else 0.0
+
+
+def simulate(args):
+    rng = random.Random(args.seed)
+    coeff_err, learn_h, raw_res, comp_res, fixed_res = [], [], [], [], []
+    never = 0
+    for _ in range(args.runs):
+        series, k_true = synth_run(rng, args)
+        model = MoistureComp(args.initial * 1000, round(args.ref * 100))
+        raw_err, comp_err = [], []
+        for t, truth, m_x10, t_x100 in series:
+            comp_x10 = model.process(m_x10, t_x100, t)
+            raw_err.append((t, m_x10 / 10.0 - truth))
+            comp_err.append((t, comp_x10 / 10.0 - truth))
+        eval_start = (args.days - args.eval_days) * 86400
+        raw_res.append(diurnal_residual(raw_err, eval_start))
+        comp_res.append(diurnal_residual(comp_err, eval_start))
+        if model.learned:
+            coeff_err.append(abs(model.coeff_x1000 / 1000.0 - k_true))
+            learn_h.append(model.learned_at_s / 3600.0)
+        else:
+            never += 1
+            fixed_res.append(comp_res[-1])
+
+    print(f'{args.runs} 條曲線 × {args.days} 天，真實係數 -0.2 ~ {args.coeff_max}%/°C，'
+          f'日夜溫差振幅 {args.amp_min}-{args.amp_max}°C，探頭落後 {args.lag} h、振幅比 {args.damp}，'
+          f'日照調變 {args.et}，雜訊 σ={args.noise}%')
+    if learn_h:
+        print(f'學習生效 {len(learn_h)}/{args.runs} 條，生效時間中位數 {statistics.median(learn_h):.0f} h，'
+              f'最晚 {max(learn_h):.0f} h')
+        print(f'最終係數誤差中位數 {statistics.median(coeff_err):.3f}%/°C，'
+              f'90 百分位 {sorted(coeff_err)[int(len(coeff_err) * 0.9)]:.3f}%/°C')
+    if never:
+        print(f'{never} 條在 {args.days} 天內未生效 (沿用初值 {args.initial}%/°C)')
+    worse = sum(1 for r, c in zip(raw_res, comp_res) if c > r + 0.05)
+    print(f'最後 {args.eval_days} 天日夜波動 (小時平均殘差標準差)：補償前中位數 {statistics.median(raw_res):.2f}%，'
+          f'補償後 {statistics.median(comp_res):.2f}%；補償後反而增加 >0.05% 的曲線 {worse} 條')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='濕度溫度補償學習模擬')
+    parser.add_argument('--runs', type=int, default=50, help='合成曲線條數')
+    parser.add_argument('--days', type=int, default=14, help='每條曲線長度 (天)')
+    parser.add_argument('--eval-days', type=int, default=7, help='計算日夜波動的最後天數')
+    parser.add_argument('--period', type=int, default=60, help='採樣間隔 (秒)')
+    parser.add_argument('--coeff-max', type=float, default=0.6, help='真實溫度係數上限 (%%/°C)')
+    parser.add_argument('--amp-min', type=float, default=2.0, help='日夜溫差振幅下限 (°C)')
+    parser.add_argument('--amp-max', type=float, default=8.0, help='日夜溫差振幅上限 (°C)')
+    parser.add_argument('--lag', type=float, default=1.0, help='探頭溫度落後量測溫度的時間 (小時)')
+    parser.add_argument('--damp', type=float, default=0.8, help='探頭溫度振幅 / 量測溫度振幅')
+    parser.add_argument('--et', type=float, default=0.5, help='乾燥速率的日照調變比例')
+    parser.add_argument('--noise', type=float, default=0.4, help='讀數白雜訊標準差 (%%)')
+    parser.add_argument('--ref', type=float, default=25.0, help='補償參考溫度 (MOISTURE_COMP_REF_TEMP_X100 / 100)')
+    parser.add_argument('--initial', type=float, default=0.0, help='初始係數 (MOISTURE_COMP_COEFF_X1000 / 1000)')
+    parser.add_argument('--seed', type=int, default=1)
+    simulate(parser.parse_args())
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,593 @@
+// ============================================================================
+// net_impair.c - Socket 層網路劣化模擬 (LD_PRELOAD)
+// 功能：攔截 connect / send / recv 等呼叫，依目的地套用延遲、抖動、頻寬上限、
+//       封包遺失與連線中途斷線，讓主機端工具 (ingest_bridge 的 MQTT 重連、
+//       ota_range_bench.py 下載、local_api_load.py) 在單機上重現溫室等級的網路
+//       (韌體沒有 Linux 目標建置，無法以此方式在主機上執行)
+// 建置：cc -O2 -std=c11 -shared -fPIC -o net_impair.so tools/net_impair.c -ldl
+// 用法：NET_IMPAIR='<目的地> <參數>...; <目的地> <參數>...' LD_PRELOAD=./net_impair.so ./ingest_bridge ...
+//       例：NET_IMPAIR='*:1883 delay=150 jitter=40 loss=0.02 drop_after=65536; 192.168.1.5:8070 delay=300 kbps=256'
+//
+// 目的地：IPv4/IPv6 位址與埠，"*" 為萬用字元 ("*"、"*:1883"、"10.0.0.2:*")，第一條符合的規則生效
+// 參數：
+//   delay=ms          單程延遲；connect 與「送出後的第一次接收」等待一個來回 (2×delay)，
+//                     閒置後對方主動推送的資料等待單程延遲，同一段串流的後續資料不再加延遲
+//   jitter=ms         每次延遲額外加上 0 - jitter 的均勻亂數
+//   kbps=N            每條連線每個方向的頻寬上限 (0 = 不限)
+//   loss=p            每個 1460 bytes 區段的遺失機率；TCP 以重送逾時 max(200 ms, 2×delay)
+//                     計入延遲，UDP 直接丟棄資料包
+//   drop_after=bytes  每條連線收送累計超過此量後重設連線 (ECONNRESET)，用於重連與續傳測試
+//   connect_fail=p    connect 失敗機率 (等待 connect_timeout 後回傳 ETIMEDOUT)
+//   connect_timeout=ms  預設 3000
+// 環境變數：NET_IMPAIR_SEED (預設 1) 決定亂數序列；同一規則的第 N 條連線永遠得到相同的
+//           延遲、遺失與失敗序列。NET_IMPAIR_LOG=1 在 stderr 印出規則、事件與結束時的統計
+//
+// 模型說明：延遲在呼叫端執行緒中以 sleep 實現 (資料本身立即送達)，因此阻塞式與
+//           非阻塞式 socket 都能使用；非阻塞 recv 回傳 EAGAIN 時不加延遲
+// ============================================================================
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+// ============================================================================
+// 常數定義
+// ============================================================================
+#define MAX_RULES           16
+#define MAX_FDS             4096
+#define SEGMENT_BYTES       1460    // 遺失判定的區段大小 (乙太網路 MSS)
+#define MIN_RTO_MS          200     // TCP 最小重送逾時
+#define DEFAULT_CONNECT_TIMEOUT_MS 3000
+
+// ============================================================================
+// 規則與連線狀態
+// ============================================================================
+typedef struct {
+    char host[INET6_ADDRSTRLEN];    // 空字串 = 任意位址
+    int port;                       // 0 = 任意埠
+    uint32_t delay_ms;
+    uint32_t jitter_ms;
+    uint32_t kbps;
+    double loss;
+    uint64_t drop_after;
+    double connect_fail;
+    uint32_t connect_timeout_ms;
+
+    // 統計 (以 lock 保護)
+    uint32_t connections;
+    uint32_t connect_failures;
+    uint32_t resets;
+    uint32_t lost_segments;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t delay_total_ms;
+} rule_t;
+
+typedef struct {
+    rule_t *rule;
+    bool dgram;
+    bool reset;                     // 已被 drop_after 重設
+    bool sent_since_recv;           // 下一次接收等待來回延遲
+    int64_t last_rx_ns;             // 上一次接收完成的時間 (連續串流不重複計入延遲)
+    uint64_t rng;
+    uint64_t bytes;                 // 收送累計
+    int64_t tx_free_ns;             // 頻寬上限：下一段可送出的時間
+    int64_t rx_free_ns;
+} conn_t;
+
+// ============================================================================
+// 全域狀態
+// ============================================================================
+static rule_t rules[MAX_RULES];
+static int rule_count = 0;
+static uint64_t seed = 1;
+static bool log_enabled = false;
+static conn_t *conns[MAX_FDS];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int (*real_connect)(int, const struct sockaddr *, socklen_t);
+static ssize_t (*real_send)(int, const void *, size_t, int);
+static ssize_t (*real_sendto)(int, const void *, size_t, int, const struct sockaddr *, socklen_t);
+static ssize_t (*real_recv)(int, void *, size_t, int);
+static ssize_t (*real_recvfrom)(int, void *, size_t, int, struct sockaddr *, socklen_t *);
+static ssize_t (*real_read)(int, void *, size_t);
+static ssize_t (*real_write)(int, const void *, size_t);
+static int (*real_close)(int);
+
+// ============================================================================
+// 工具函數
+// ============================================================================
+static void log_event(const char *fmt, ...)
+{
+    if (!log_enabled) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "[net_impair] ");
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_ms(uint32_t ms)
+{
+    if (ms == 0) {
+        return;
+    }
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+static void sleep_until(int64_t deadline_ns)
+{
+    int64_t wait = deadline_ns - now_ns();
+    if (wait > 0) {
+        struct timespec ts = { .tv_sec = wait / 1000000000LL, .tv_nsec = wait % 1000000000LL };
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        }
+    }
+}
+
+// splitmix64：每條連線一個獨立序列，與執行緒排程無關
+static uint64_t next_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double random_unit(uint64_t *state)
+{
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint32_t jittered(conn_t *c, uint32_t base_ms)
+{
+    uint32_t jitter = c->rule->jitter_ms > 0 ? (uint32_t)(next_random(&c->rng) % (c->rule->jitter_ms + 1)) : 0;
+    return base_ms + jitter;
+}
+
+static conn_t *lookup(int fd)
+{
+    return fd >= 0 && fd < MAX_FDS ? conns[fd] : NULL;
+}
+
+// ============================================================================
+// 規則解析 (程式載入時執行)
+// ============================================================================
+static bool parse_destination(const char *token, rule_t *rule)
+{
+    char buf[INET6_ADDRSTRLEN + 16];
+    snprintf(buf, sizeof(buf), "%s", token);
+
+    // IPv6 以 [addr]:port 表示
+    char *host = buf;
+    char *port = NULL;
+    if (buf[0] == '[') {
+        char *close = strchr(buf, ']');
+        if (close == NULL) {
+            return false;
+        }
+        *close = '\0';
+        host = buf + 1;
+        port = close[1] == ':' ? close + 2 : NULL;
+    } else {
+        port = strrchr(buf, ':');
+        if (port != NULL) {
+            *port++ = '\0';
+        }
+    }
+
+    if (strlen(host) >= sizeof(rule->host)) {
+        return false;
+    }
+    strcpy(rule->host, strcmp(host, "*") == 0 ? "" : host);
+    rule->port = port == NULL || strcmp(port, "*") == 0 ? 0 : atoi(port);
+    return true;
+}
+
+static bool parse_param(const char *token, rule_t *rule)
+{
+    const char *eq = strchr(token, '=');
+    if (eq == NULL) {
+        return false;
+    }
+    size_t key_len = (size_t)(eq - token);
+    const char *value = eq + 1;
+
+#define KEY_IS(name) (key_len == sizeof(name) - 1 && strncmp(token, name, key_len) == 0)
+    if (KEY_IS("delay")) {
+        rule->delay_ms = (uint32_t)strtoul(value, NULL, 10);
+    } else if (KEY_IS("jitter")) {
+        rule->jitter_ms = (uint32_t)strtoul(value, NULL, 10);
+    } else if (KEY_IS("kbps")) {
+        rule->kbps = (uint32_t)strtoul(value, NULL, 10);
+    } else if (KEY_IS("loss")) {
+        rule->loss = strtod(value, NULL);
+    } else if (KEY_IS("drop_after")) {
+        rule->drop_after = strtoull(value, NULL, 10);
+    } else if (KEY_IS("connect_fail")) {
+        rule->connect_fail = strtod(value, NULL);
+    } else if (KEY_IS("connect_timeout")) {
+        rule->connect_timeout_ms = (uint32_t)strtoul(value, NULL, 10);
+    } else {
+        return false;
+    }
+#undef KEY_IS
+    return true;
+}
+
+static void parse_rules(const char *spec)
+{
+    char *copy = strdup(spec);
+    char *save_rule = NULL;
+    for (char *text = strtok_r(copy, ";", &save_rule); text != NULL && rule_count < MAX_RULES;
+         text = strtok_r(NULL, ";", &save_rule)) {
+        rule_t rule = { .connect_timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS };
+        char *save_token = NULL;
+        char *token = strtok_r(text, " \t,", &save_token);
+        if (token == NULL) {
+            continue;
+        }
+        if (!parse_destination(token, &rule)) {
+            fprintf(stderr, "[net_impair] 無效的目的地: %s\n", token);
+            continue;
+        }
+        while ((token = strtok_r(NULL, " \t,", &save_token)) != NULL) {
+            if (!parse_param(token, &rule)) {
+                fprintf(stderr, "[net_impair] 無效的參數: %s\n", token);
+            }
+        }
+        rules[rule_count++] = rule;
+        log_event("規則 %d: %s:%d delay=%u jitter=%u kbps=%u loss=%.3f drop_after=%llu connect_fail=%.3f",
+                  rule_count, rule.host[0] ? rule.host : "*", rule.port, rule.delay_ms, rule.jitter_ms,
+                  rule.kbps, rule.loss, (unsigned long long)rule.drop_after, rule.connect_fail);
+    }
+    free(copy);
+}
+
+__attribute__((constructor))
+static void net_impair_init(void)
+{
+    real_connect = dlsym(RTLD_NEXT, "connect");
+    real_send = dlsym(RTLD_NEXT, "send");
+    real_sendto = dlsym(RTLD_NEXT, "sendto");
+    real_recv = dlsym(RTLD_NEXT, "recv");
+    real_recvfrom = dlsym(RTLD_NEXT, "recvfrom");
+    real_read = dlsym(RTLD_NEXT, "read");
+    real_write = dlsym(RTLD_NEXT, "write");
+    real_close = dlsym(RTLD_NEXT, "close");
+
+    const char *env = getenv("NET_IMPAIR_LOG");
+    log_enabled = env != NULL && env[0] == '1';
+    env = getenv("NET_IMPAIR_SEED");
+    if (env != NULL) {
+        seed = strtoull(env, NULL, 10);
+    }
+    env = getenv("NET_IMPAIR");
+    if (env != NULL) {
+        parse_rules(env);
+    }
+}
+
+__attribute__((destructor))
+static void net_impair_report(void)
+{
+    for (int i = 0; i < rule_count; i++) {
+        rule_t *r = &rules[i];
+        if (r->connections == 0) {
+            continue;
+        }
+        log_event("規則 %d 統計: 連線 %u (失敗 %u，重設 %u)，送出 %llu / 接收 %llu bytes，遺失區段 %u，注入延遲 %llu ms",
+                  i + 1, r->connections, r->connect_failures, r->resets,
+                  (unsigned long long)r->bytes_sent, (unsigned long long)r->bytes_received,
+                  r->lost_segments, (unsigned long long)r->delay_total_ms);
+    }
+}
+
+// ============================================================================
+// 規則比對與連線建立
+// ============================================================================
+static rule_t *match_rule(const struct sockaddr *addr)
+{
+    char host[INET6_ADDRSTRLEN];
+    int port;
+    if (addr->sa_family == AF_INET) {
+        const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+        inet_ntop(AF_INET, &in->sin_addr, host, sizeof(host));
+        port = ntohs(in->sin_port);
+    } else if (addr->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)addr;
+        inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+        port = ntohs(in6->sin6_port);
+    } else {
+        return NULL;  // AF_UNIX 等不處理
+    }
+
+    for (int i = 0; i < rule_count; i++) {
+        if ((rules[i].host[0] == '\0' || strcmp(rules[i].host, host) == 0) &&
+            (rules[i].port == 0 || rules[i].port == port)) {
+            return &rules[i];
+        }
+    }
+    return NULL;
+}
+
+// 在 fd 上建立連線狀態；亂數種子由全域種子、規則與該規則的連線序號決定
+static conn_t *attach(int fd, rule_t *rule)
+{
+    if (fd < 0 || fd >= MAX_FDS) {
+        return NULL;
+    }
+    int type = SOCK_STREAM;
+    socklen_t len = sizeof(type);
+    getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len);
+
+    conn_t *c = calloc(1, sizeof(conn_t));
+    if (c == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&lock);
+    rule->connections++;
+    c->rule = rule;
+    c->dgram = type == SOCK_DGRAM;
+    c->rng = seed * 0x100000001B3ULL + (uint64_t)(rule - rules) * 0x10000 + rule->connections;
+    free(conns[fd]);
+    conns[fd] = c;
+    pthread_mutex_unlock(&lock);
+    return c;
+}
+
+int connect(int fd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    rule_t *rule = addr != NULL ? match_rule(addr) : NULL;
+    conn_t *c = rule != NULL ? attach(fd, rule) : NULL;
+    if (c == NULL) {
+        return real_connect(fd, addr, addrlen);
+    }
+
+    if (!c->dgram && rule->connect_fail > 0 && random_unit(&c->rng) < rule->connect_fail) {
+        sleep_ms(rule->connect_timeout_ms);
+        pthread_mutex_lock(&lock);
+        rule->connect_failures++;
+        pthread_mutex_unlock(&lock);
+        log_event("fd %d connect 失敗 (模擬逾時)", fd);
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    // TCP 三向交握：一個來回
+    if (!c->dgram) {
+        uint32_t rtt = jittered(c, 2 * rule->delay_ms);
+        sleep_ms(rtt);
+        pthread_mutex_lock(&lock);
+        rule->delay_total_ms += rtt;
+        pthread_mutex_unlock(&lock);
+    }
+    return real_connect(fd, addr, addrlen);
+}
+
+int close(int fd)
+{
+    if (fd >= 0 && fd < MAX_FDS && conns[fd] != NULL) {
+        pthread_mutex_lock(&lock);
+        free(conns[fd]);
+        conns[fd] = NULL;
+        pthread_mutex_unlock(&lock);
+    }
+    return real_close(fd);
+}
+
+// ============================================================================
+// 資料傳輸
+// ============================================================================
+
+// 累計收送量超過 drop_after 時重設連線；回傳 true 表示呼叫應以 ECONNRESET 失敗
+static bool check_reset(int fd, conn_t *c, size_t len)
+{
+    if (c->reset) {
+        return true;
+    }
+    if (c->dgram || c->rule->drop_after == 0 || c->bytes + len <= c->rule->drop_after) {
+        return false;
+    }
+    c->reset = true;
+    shutdown(fd, SHUT_RDWR);
+    pthread_mutex_lock(&lock);
+    c->rule->resets++;
+    pthread_mutex_unlock(&lock);
+    log_event("fd %d 在 %llu bytes 後重設連線", fd, (unsigned long long)c->bytes);
+    return true;
+}
+
+// 頻寬上限與區段遺失造成的延遲 (TCP)；UDP 回傳 true 表示此資料包被丟棄
+static bool shape(conn_t *c, size_t len, int64_t *free_ns)
+{
+    rule_t *rule = c->rule;
+    uint32_t penalty_ms = 0;
+    bool dropped = false;
+
+    if (rule->loss > 0) {
+        size_t segments = c->dgram ? 1 : (len + SEGMENT_BYTES - 1) / SEGMENT_BYTES;
+        for (size_t i = 0; i < segments; i++) {
+            if (random_unit(&c->rng) < rule->loss) {
+                pthread_mutex_lock(&lock);
+                rule->lost_segments++;
+                pthread_mutex_unlock(&lock);
+                if (c->dgram) {
+                    dropped = true;
+                } else {
+                    uint32_t rto = 2 * rule->delay_ms > MIN_RTO_MS ? 2 * rule->delay_ms : MIN_RTO_MS;
+                    penalty_ms += jittered(c, rto);
+                }
+            }
+        }
+    }
+
+    if (rule->kbps > 0) {
+        int64_t now = now_ns();
+        int64_t start = *free_ns > now ? *free_ns : now;
+        *free_ns = start + (int64_t)len * 8 * 1000000LL / rule->kbps;
+        sleep_until(*free_ns);
+    }
+    if (penalty_ms > 0) {
+        sleep_ms(penalty_ms);
+        pthread_mutex_lock(&lock);
+        rule->delay_total_ms += penalty_ms;
+        pthread_mutex_unlock(&lock);
+    }
+    return dropped;
+}
+
+static ssize_t impaired_send(int fd, conn_t *c, const void *buf, size_t len, int flags,
+                             const struct sockaddr *addr, socklen_t addrlen, bool use_write)
+{
+    if (check_reset(fd, c, len)) {
+        errno = ECONNRESET;
+        return -1;
+    }
+    if (shape(c, len, &c->tx_free_ns)) {
+        log_event("fd %d 丟棄送出的資料包 (%zu bytes)", fd, len);
+        return (ssize_t)len;  // UDP 遺失：呼叫端看起來已送出
+    }
+
+    ssize_t n;
+    if (use_write) {
+        n = real_write(fd, buf, len);
+    } else if (addr != NULL) {
+        n = real_sendto(fd, buf, len, flags, addr, addrlen);
+    } else {
+        n = real_send(fd, buf, len, flags);
+    }
+    if (n > 0) {
+        c->bytes += (uint64_t)n;
+        c->sent_since_recv = true;
+        pthread_mutex_lock(&lock);
+        c->rule->bytes_sent += (uint64_t)n;
+        pthread_mutex_unlock(&lock);
+    }
+    return n;
+}
+
+static ssize_t impaired_recv(int fd, conn_t *c, void *buf, size_t len, int flags,
+                             struct sockaddr *addr, socklen_t *addrlen, bool use_read)
+{
+    if (check_reset(fd, c, 0)) {
+        errno = ECONNRESET;
+        return -1;
+    }
+
+    while (1) {
+        ssize_t n;
+        if (use_read) {
+            n = real_read(fd, buf, len);
+        } else if (addr != NULL) {
+            n = real_recvfrom(fd, buf, len, flags, addr, addrlen);
+        } else {
+            n = real_recv(fd, buf, len, flags);
+        }
+        if (n <= 0 || (flags & MSG_PEEK)) {
+            return n;
+        }
+
+        // 回應等待一個來回；閒置後對方主動推送的資料等待單程延遲；
+        // 同一段串流的後續資料只受頻寬上限影響
+        uint32_t delay = 0;
+        if (c->sent_since_recv) {
+            delay = jittered(c, 2 * c->rule->delay_ms);
+        } else if (now_ns() - c->last_rx_ns > (int64_t)c->rule->delay_ms * 1000000LL) {
+            delay = jittered(c, c->rule->delay_ms);
+        }
+        c->sent_since_recv = false;
+        if (delay > 0) {
+            sleep_ms(delay);
+            pthread_mutex_lock(&lock);
+            c->rule->delay_total_ms += delay;
+            pthread_mutex_unlock(&lock);
+        }
+
+        if (shape(c, (size_t)n, &c->rx_free_ns)) {
+            log_event("fd %d 丟棄收到的資料包 (%zd bytes)", fd, n);
+            continue;  // UDP 遺失：等待下一個資料包 (非阻塞 socket 會回傳 EAGAIN)
+        }
+        if (check_reset(fd, c, (size_t)n)) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        c->bytes += (uint64_t)n;
+        c->last_rx_ns = now_ns();
+        pthread_mutex_lock(&lock);
+        c->rule->bytes_received += (uint64_t)n;
+        pthread_mutex_unlock(&lock);
+        return n;
+    }
+}
+
+// ============================================================================
+// 攔截的 libc 函數
+// ============================================================================
+ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+    conn_t *c = lookup(fd);
+    return c != NULL ? impaired_send(fd, c, buf, len, flags, NULL, 0, false) : real_send(fd, buf, len, flags);
+}
+
+ssize_t sendto(int fd, const void *buf, size_t len, int flags, const struct sockaddr *addr, socklen_t addrlen)
+{
+    conn_t *c = lookup(fd);
+    if (c == NULL && addr != NULL) {
+        rule_t *rule = match_rule(addr);  // 未 connect 的 UDP socket 以第一個目的地決定規則
+        c = rule != NULL ? attach(fd, rule) : NULL;
+    }
+    return c != NULL ? impaired_send(fd, c, buf, len, flags, addr, addrlen, false)
+                     : real_sendto(fd, buf, len, flags, addr, addrlen);
+}
+
+ssize_t write(int fd, const void *buf, size_t len)
+{
+    conn_t *c = lookup(fd);
+    return c != NULL ? impaired_send(fd, c, buf, len, 0, NULL, 0, true) : real_write(fd, buf, len);
+}
+
+ssize_t recv(int fd, void *buf, size_t len, int flags)
+{
+    conn_t *c = lookup(fd);
+    return c != NULL ? impaired_recv(fd, c, buf, len, flags, NULL, NULL, false) : real_recv(fd, buf, len, flags);
+}
+
+ssize_t recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *addr, socklen_t *addrlen)
+{
+    conn_t *c = lookup(fd);
+    return c != NULL ? impaired_recv(fd, c, buf, len, flags, addr, addrlen, false)
+                     : real_recvfrom(fd, buf, len, flags, addr, addrlen);
+}
+
+ssize_t read(int fd, void *buf, size_t len)
+{
+    conn_t *c = lookup(fd);
+    return c != NULL ? impaired_recv(fd, c, buf, len, 0, NULL, NULL, true) : real_read(fd, buf, len);
+}
@@ -0,0 +1,220 @@
+# OTA 多連線下載測試伺服器 - 注入延遲的 HTTP Range 伺服器，讓節點實測不同連線數的下載速率
+# 用法：python tools/ota_range_bench.py --serve build/soil_sensor.bin [--port 8070] [--rtt-ms 200] [--window-bytes 5760] [--link-kbps 0]
+#       python tools/ota_range_bench.py --bench [--size-kb 1024] [--rtt-ms 200] [--window-bytes 5760] [--link-kbps 0]
+# - 每個回應先延遲一個 RTT，之後每送出 window-bytes 就再等一個 RTT，模擬受 TCP 視窗限制的高延遲鏈路
+#   (預設 5760 = lwIP 預設接收視窗 CONFIG_LWIP_TCP_WND_DEFAULT)
+# - --link-kbps 為所有連線共用的鏈路頻寬上限 (0 = 不限制)，用來觀察連線數增加後的飽和點
+# - --serve：讓節點實測，例如送出 "OTA_UPDATE:http://<主機 IP>:8070/firmware.bin 3"，伺服器會印出每次下載的速率
+# - --bench：在本機以與韌體相同的區塊大小與重排緩衝區 (ota_range.h) 下載 1-4 條連線並驗證重組內容；
+#   下載端是 Python，印出的時間只反映這個主機模型，不代表韌體的速率 (韌體以 --serve 實測，看 OTA_STATUS)
+import argparse
+import hashlib
+import http.client
+import os
+import re
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+BLOCK_SIZE = 8192              # OTA_RANGE_BLOCK_SIZE
+SLOTS = 48 * 1024 // BLOCK_SIZE  # OTA_RANGE_RAM_BUDGET / OTA_RANGE_BLOCK_SIZE
+RANGE_RE = re.compile(r'bytes=(\d+)-(\d*)')
+
+
+class Link:
+    """所有連線共用的頻寬上限 (依序排定每段資料的送出時間)"""
+
+    def __init__(self, kbps):
+        self.bytes_per_s = kbps * 1000 / 8 if kbps > 0 else 0
+        self.lock = threading.Lock()
+        self.next_free = time.monotonic()
+
+    def send(self, nbytes):
+        if self.bytes_per_s == 0:
+            return
+        with self.lock:
+            start = max(self.next_free, time.monotonic())
+            self.next_free = start + nbytes / self.bytes_per_s
+            wait = self.next_free - time.monotonic()
+        if wait > 0:
+            time.sleep(wait)
+
+
+def make_handler(image, rtt, window, link, log_downloads):
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = 'HTTP/1.1'  # keep-alive：韌體每條連線重複使用同一個 TCP 連線
+
+        def log_message(self, fmt, *args):
+            pass
+
+        def do_GET(self):
+            start, end, status = 0, len(image) - 1, 200
+            match = RANGE_RE.fullmatch(self.headers.get('Range', ''))
+            if match:
+                start = int(match.group(1))
+                end = min(int(match.group(2)) if match.group(2) else len(image) - 1, len(image) - 1)
+                status = 206
+                if start > end:
+                    self.send_response(416)
+                    self.send_header('Content-Length', '0')
+                    self.end_headers()
+                    return
+
+            time.sleep(rtt)  # 請求 + 第一個回應封包
+            body = image[start:end + 1]
+            self.send_response(status)
+            self.send_header('Content-Type', 'application/octet-stream')
+            self.send_header('Content-Length', str(len(body)))
+            self.send_header('Accept-Ranges', 'bytes')
+            if status == 206:
+                self.send_header('Content-Range', f'bytes {start}-{end}/{len(image)}')
+            self.end_headers()
+
+            t0 = time.monotonic()
+            for pos in range(0, len(body), window):
+                if pos > 0:
+                    time.sleep(rtt)  # 等待前一個視窗的 ACK
+                chunk = body[pos:pos + window]
+                link.send(len(chunk))
+                self.wfile.write(chunk)
+            if log_downloads and status == 200:
+                elapsed = time.monotonic() - t0 + rtt
+                print(f'{self.client_address[0]} 完整下載 {len(body)} bytes，{len(body) / elapsed / 1024:.1f} KB/s')
+            elif log_downloads and end == len(image) - 1 and start > 0:
+                print(f'{self.client_address[0]} 最後一個區塊 ({start}-{end}) 已送出')
+
+    return Handler
+
+
+def start_server(image, port, rtt, window, link_kbps, log_downloads):
+    handler = make_handler(image, rtt, window, Link(link_kbps), log_downloads)
+    server = ThreadingHTTPServer(('0.0.0.0', port), handler)
+    server.daemon_threads = True
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    return server
+
+
+def download(port, size, connections):
+    """與 ota_range.c 相同的流程：先取槽再認領區塊，寫入端依序取出"""
+    blocks = (size + BLOCK_SIZE - 1) // BLOCK_SIZE
+    slots = [None] * SLOTS
+    free_slots = threading.Semaphore(SLOTS)
+    cond = threading.Condition()
+    state = {'next': 0, 'error': None}
+
+    def worker():
+        conn = http.client.HTTPConnection('127.0.0.1', port, timeout=30)
+        try:
+            while True:
+                free_slots.acquire()
+                with cond:
+                    if state['next'] >= blocks or state['error']:
+                        return
+                    block = state['next']
+                    state['next'] += 1
+                start = block * BLOCK_SIZE
+                end = min(start + BLOCK_SIZE, size) - 1
+                conn.request('GET', '/firmware.bin', headers={'Range': f'bytes={start}-{end}'})
+                resp = conn.getresponse()
+                data = resp.read()
+                if resp.status != 206 or len(data) != end - start + 1:
+                    raise OSError(f'區塊 {block}: HTTP {resp.status}, {len(data)} bytes')
+                with cond:
+                    slots[block % SLOTS] = (block, data)
+                    cond.notify_all()
+        except OSError as exc:
+            with cond:
+                state['error'] = str(exc)
+                cond.notify_all()
+        finally:
+            conn.close()
+
+    threads = [threading.Thread(target=worker, daemon=True) for _ in range(connections)]
+    t0 = time.monotonic()
+    for t in threads:
+        t.start()
+
+    sha = hashlib.sha256()
+    wait = 0.0
+    for block in range(blocks):
+        with cond:
+            w0 = time.monotonic()
+            while not state['error'] and (slots[block % SLOTS] is None or slots[block % SLOTS][0] != block):
+                cond.wait()
+            wait += time.monotonic() - w0
+            if state['error']:
+                raise RuntimeError(state['error'])
+            data = slots[block % SLOTS][1]
+            slots[block % SLOTS] = None
+        sha.update(data)  # 對應 esp_ota_write()
+        free_slots.release()
+    elapsed = time.monotonic() - t0
+
+    for _ in threads:
+        free_slots.release()
+    return elapsed, wait, sha.hexdigest()
+
+
+def download_single(port, size):
+    conn = http.client.HTTPConnection('127.0.0.1', port, timeout=60)
+    t0 = time.monotonic()
+    conn.request('GET', '/firmware.bin')
+    resp = conn.getresponse()
+    sha = hashlib.sha256()
+    while True:
+        data = resp.read(1024)  # OTA_BUFFER_SIZE
+        if not data:
+            break
+        sha.update(data)
+    conn.close()
+    return time.monotonic() - t0, 0.0, sha.hexdigest()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='OTA 多連線下載測試伺服器')
+    mode = parser.add_mutually_exclusive_group(required=True)
+    mode.add_argument('--serve', metavar='FIRMWARE')
+    mode.add_argument('--bench', action='store_true')
+    parser.add_argument('--port', type=int, default=8070)
+    parser.add_argument('--size-kb', type=int, default=1024)
+    parser.add_argument('--rtt-ms', type=float, default=200)
+    parser.add_argument('--window-bytes', type=int, default=5760)
+    parser.add_argument('--link-kbps', type=int, default=0)
+    args = parser.parse_args()
+
+    rtt = args.rtt_ms / 1000
+    window = args.window_bytes
+
+    if args.serve:
+        with open(args.serve, 'rb') as f:
+            image = f.read()
+        start_server(image, args.port, rtt, window, args.link_kbps, True)
+        print(f'提供 {args.serve} ({len(image)} bytes) 於 http://0.0.0.0:{args.port}/firmware.bin '
+              f'(RTT {args.rtt_ms:.0f} ms，視窗 {window} bytes)')
+        try:
+            while True:
+                time.sleep(1)
+        except KeyboardInterrupt:
+            return
+
+    image = os.urandom(args.size_kb * 1024)
+    expected = hashlib.sha256(image).hexdigest()
+    server = start_server(image, 0, rtt, window, args.link_kbps, False)
+    port = server.server_address[1]
+    print(f'映像 {len(image)} bytes，RTT {args.rtt_ms:.0f} ms，視窗 {window} bytes，'
+          f'鏈路 {"不限" if args.link_kbps == 0 else str(args.link_kbps) + " kbps"}，'
+          f'區塊 {BLOCK_SIZE} bytes × {SLOTS} 槽 (Python 下載端，時間不代表韌體)')
+    print(f'{"連線":>4} {"內容":>6} {"秒":>8} {"寫入等待":>9}')
+
+    for connections in range(1, 5):
+        if connections == 1:
+            elapsed, wait, digest = download_single(port, len(image))
+        else:
+            elapsed, wait, digest = download(port, len(image), connections)
+        result = '一致' if digest == expected else '不符'
+        print(f'{connections:>4} {result:>6} {elapsed:>8.2f} {wait:>8.2f}s')
+    server.shutdown()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,105 @@
+# OTA 飛行紀錄報告 - 從 ingest_bridge 輸出的 ota_record.csv 找出全場最慢的 OTA 階段
+# 用法：python tools/ota_record_report.py ingest_out/ota_record.csv [--version 1.0.1] [--slowest 5]
+# - 各階段耗時 = 相鄰已到達階段的時間差 (連線、標頭、第一個位元組、每 10%、下載收尾、驗證、設定啟動分區)
+# - 失敗與中斷的嘗試依「最後到達的階段」分組，看出卡在哪一步
+# - 同一筆紀錄可能因 OTA_HISTORY 指令重複上傳，以 (node, attempt) 去重
+import argparse
+import csv
+import statistics
+from collections import Counter, defaultdict
+
+STAGES = ['connect', 'headers', 'first_byte'] + [f'pct{p}' for p in range(10, 100, 10)] + \
+         ['download_end', 'verified', 'set_boot']
+
+
+def percentile(values, p):
+    values = sorted(values)
+    k = min(len(values) - 1, max(0, round(p / 100 * (len(values) - 1))))
+    return values[k]
+
+
+def load(path, version):
+    records = {}
+    with open(path, newline='') as f:
+        for row in csv.DictReader(f):
+            if version and row.get('target_version') != version:
+                continue
+            records[(row.get('node'), row.get('attempt'))] = row
+    return list(records.values())
+
+
+def stage_times(row):
+    times = []
+    for name in STAGES:
+        value = row.get(f'stages.{name}')
+        if value:
+            times.append((name, float(value)))
+    return times
+
+
+def main():
+    parser = argparse.ArgumentParser(description='OTA 飛行紀錄報告')
+    parser.add_argument('csv')
+    parser.add_argument('--version', help='只看指定目標版本')
+    parser.add_argument('--slowest', type=int, default=5, help='列出總耗時最長的嘗試數')
+    args = parser.parse_args()
+
+    rows = load(args.csv, args.version)
+    if not rows:
+        print('沒有符合的 OTA 紀錄')
+        return
+
+    results = Counter(r['result'] for r in rows)
+    print(f'{len(rows)} 次嘗試，{len({r["node"] for r in rows})} 個節點：' +
+          '，'.join(f'{k} {v}' for k, v in results.most_common()))
+
+    # 各階段耗時 (只計入兩端都到達的區間)
+    durations = defaultdict(list)
+    for row in rows:
+        prev_name, prev_ms = 'start', 0.0
+        for name, ms in stage_times(row):
+            durations[f'{prev_name}→{name}'].append(ms - prev_ms)
+            prev_name, prev_ms = name, ms
+
+    print(f'\n{"階段":<26} {"次數":>5} {"p50 ms":>9} {"p90 ms":>9} {"最大 ms":>9} {"總耗時占比":>9}')
+    total = sum(sum(v) for v in durations.values()) or 1
+    order = ['start'] + STAGES
+    for key in sorted(durations, key=lambda k: order.index(k.split('→')[1])):
+        values = durations[key]
+        print(f'{key:<26} {len(values):>5} {statistics.median(values):>9.0f} {percentile(values, 90):>9.0f} '
+              f'{max(values):>9.0f} {sum(values) / total * 100:>8.1f}%')
+
+    failed = [r for r in rows if r['result'] != 'success']
+    if failed:
+        print('\n失敗 / 中斷的嘗試 (依最後到達的階段)：')
+        groups = Counter()
+        for row in failed:
+            times = stage_times(row)
+            last = times[-1][0] if times else 'start'
+            groups[(row['result'], last, row.get('error', ''))] += 1
+        for (result, last, error), count in groups.most_common():
+            print(f'  {count:>4} × {result:<15} 停在 {last:<13} {error}')
+
+    speeds = [float(r['bytes_per_s']) for r in rows if r.get('bytes_per_s') and float(r['bytes_per_s']) > 0]
+    heap = [float(r['heap_floor']) for r in rows if r.get('heap_floor')]
+    if speeds:
+        print(f'\n下載速率：p10 {percentile(speeds, 10) / 1024:.1f} KB/s，中位數 {statistics.median(speeds) / 1024:.1f} KB/s')
+    if heap:
+        print(f'堆積下限：最低 {min(heap):.0f} bytes，中位數 {statistics.median(heap):.0f} bytes')
+
+    slowest = sorted((r for r in rows if r.get('end_ms')), key=lambda r: -float(r['end_ms']))[:args.slowest]
+    if slowest:
+        print('\n總耗時最長的嘗試：')
+        for row in slowest:
+            spans = []
+            prev_name, prev_ms = 'start', 0.0
+            for name, ms in stage_times(row):
+                spans.append((ms - prev_ms, f'{prev_name}→{name}'))
+                prev_name, prev_ms = name, ms
+            worst = max(spans)[1] if spans else '-'
+            print(f'  {row["node"]} #{row["attempt"]} {row["result"]:<15} {float(row["end_ms"]) / 1000:>7.1f} s  '
+                  f'{row.get("connections", "")} 條連線，重試 {row.get("retries", "")}，最慢區間 {worst}')
+
+
+if __name__ == '__main__':
+    main()
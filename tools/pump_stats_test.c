@@ -0,0 +1,157 @@
+// ============================================================================
+// pump_stats_test.c - 泵浦開啟統計 (main/pump_stats.h) 主機端測試
+// 功能：以與韌體相同的統計函數與分格上界，檢查直方圖分格邊界、計時關閉誤差的
+//       違規判定 (等於上限不算違規)、提前關閉不計誤差，以及誤差上下限與總和
+// 建置：cc -O2 -std=c11 -Wall -Wextra -I main -o pump_stats_test tools/pump_stats_test.c
+// 用法：./pump_stats_test   (全部通過時回傳 0，否則列出失敗項目並回傳 1)
+// ============================================================================
+
+#include <stdio.h>
+#include "pump_stats.h"
+
+// ============================================================================
+// 常數定義 (與 pump_control.c 相同的分格上界與違規門檻)
+// ============================================================================
+static const uint32_t jitter_le_us[PUMP_JITTER_BUCKETS] = PUMP_JITTER_BUCKET_LE_US;
+static const uint32_t on_time_le_ms[PUMP_ON_TIME_BUCKETS] = PUMP_ON_TIME_BUCKET_LE_MS;
+#define BOUND_US    2000    // main.c 的 PUMP_JITTER_BOUND_US
+#define START_US    1000000LL
+
+static int failures = 0;
+static int checks = 0;
+
+#define CHECK_EQ(label, actual, expected) do {                                              \
+        long long a_ = (long long)(actual), e_ = (long long)(expected);                     \
+        checks++;                                                                           \
+        if (a_ != e_) {                                                                     \
+            failures++;                                                                     \
+            printf("FAIL %s:%d %s: 得到 %lld，預期 %lld\n", __FILE__, __LINE__, label, a_, e_); \
+        }                                                                                   \
+    } while (0)
+
+// ============================================================================
+// 輔助函數
+// ============================================================================
+
+// 計時關閉：目標 target_ms，實際晚 jitter_us 關閉
+static void timer_off(pump_control_stats_t *stats, uint32_t target_ms, int32_t jitter_us)
+{
+    int64_t now_us = START_US + (int64_t)target_ms * 1000 + jitter_us;
+    pump_stats_record(stats, START_US, target_ms, now_us, true, BOUND_US, jitter_le_us, on_time_le_ms);
+}
+
+// 提前關閉：開啟 actual_us 後由任務關閉
+static void early_stop(pump_control_stats_t *stats, uint32_t target_ms, uint32_t actual_us)
+{
+    pump_stats_record(stats, START_US, target_ms, START_US + actual_us, false, BOUND_US,
+                      jitter_le_us, on_time_le_ms);
+}
+
+static int only_bucket(const uint32_t *hist, int buckets)
+{
+    int found = -1;
+    for (int b = 0; b < buckets; b++) {
+        if (hist[b] == 1 && found < 0) {
+            found = b;
+        } else if (hist[b] != 0) {
+            return -2;  // 多於一格有計數
+        }
+    }
+    return found;
+}
+
+// ============================================================================
+// 測試案例
+// ============================================================================
+
+// 誤差分格：上界包含在該格內 (|誤差| <= le)，超過最後一個有限上界落入 +Inf 格
+static void test_jitter_bucket_edges(void)
+{
+    static const struct { int32_t jitter_us; int bucket; } cases[] = {
+        { 0, 0 }, { 50, 0 }, { 51, 1 }, { -50, 0 }, { -51, 1 },
+        { 100, 1 }, { 101, 2 }, { 2500, 5 }, { 2501, 6 },
+        { 50000, 8 }, { 50001, 9 }, { -2000000, 9 },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        pump_control_stats_t stats;
+        pump_stats_reset(&stats);
+        timer_off(&stats, 5000, cases[i].jitter_us);
+        char label[64];
+        snprintf(label, sizeof(label), "jitter %ld us 的分格", (long)cases[i].jitter_us);
+        CHECK_EQ(label, only_bucket(stats.jitter_hist, PUMP_JITTER_BUCKETS), cases[i].bucket);
+    }
+}
+
+// 開啟時間分格以 ms 計 (截斷)：500.999 ms 仍在 <=500 格
+static void test_on_time_bucket_edges(void)
+{
+    static const struct { uint32_t actual_us; int bucket; } cases[] = {
+        { 0, 0 }, { 500000, 0 }, { 500999, 0 }, { 501000, 1 },
+        { 60000000, 6 }, { 60001000, 7 }, { 4000000000u, 7 },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        pump_control_stats_t stats;
+        pump_stats_reset(&stats);
+        early_stop(&stats, 60000, cases[i].actual_us);
+        char label[64];
+        snprintf(label, sizeof(label), "開啟 %lu us 的分格", (unsigned long)cases[i].actual_us);
+        CHECK_EQ(label, only_bucket(stats.on_time_hist, PUMP_ON_TIME_BUCKETS), cases[i].bucket);
+    }
+}
+
+// 違規：|誤差| 超過上限才計入，正負誤差都算
+static void test_bound_violations(void)
+{
+    pump_control_stats_t stats;
+    pump_stats_reset(&stats);
+    timer_off(&stats, 1500, BOUND_US);
+    CHECK_EQ("誤差等於上限", stats.bound_violations, 0);
+    timer_off(&stats, 1500, -BOUND_US);
+    CHECK_EQ("負誤差等於上限", stats.bound_violations, 0);
+    timer_off(&stats, 1500, BOUND_US + 1);
+    CHECK_EQ("誤差超過上限 1 us", stats.bound_violations, 1);
+    timer_off(&stats, 1500, -(BOUND_US + 1));
+    CHECK_EQ("負誤差超過上限 1 us", stats.bound_violations, 2);
+    CHECK_EQ("計時關閉次數", stats.timer_offs, 4);
+    CHECK_EQ("誤差下限", stats.jitter_min_us, -(BOUND_US + 1));
+    CHECK_EQ("誤差上限", stats.jitter_max_us, BOUND_US + 1);
+    CHECK_EQ("|誤差| 總和", stats.jitter_abs_sum_us, 4 * BOUND_US + 2);
+    CHECK_EQ("最近一次誤差", stats.last.jitter_us, -(BOUND_US + 1));
+}
+
+// 提前關閉：計入開啟次數與開啟時間直方圖，不計誤差、不算違規，上下限維持哨兵值
+static void test_early_stops(void)
+{
+    pump_control_stats_t stats;
+    pump_stats_reset(&stats);
+    early_stop(&stats, 60000, 3000000);     // 比目標短 57 秒，遠超過違規上限
+    CHECK_EQ("提前關閉次數", stats.early_stops, 1);
+    CHECK_EQ("開啟次數", stats.activations, 1);
+    CHECK_EQ("計時關閉次數", stats.timer_offs, 0);
+    CHECK_EQ("違規次數", stats.bound_violations, 0);
+    CHECK_EQ("|誤差| 總和", stats.jitter_abs_sum_us, 0);
+    CHECK_EQ("誤差下限 (哨兵)", stats.jitter_min_us, INT32_MAX);
+    CHECK_EQ("誤差上限 (哨兵)", stats.jitter_max_us, INT32_MIN);
+    CHECK_EQ("誤差直方圖", only_bucket(stats.jitter_hist, PUMP_JITTER_BUCKETS), -1);
+    CHECK_EQ("開啟時間分格", only_bucket(stats.on_time_hist, PUMP_ON_TIME_BUCKETS), 3);
+    CHECK_EQ("開啟時間總和", stats.on_time_sum_ms, 3000);
+    CHECK_EQ("最近一次為提前關閉", stats.last.timer_off, false);
+    CHECK_EQ("最近一次實際時間", stats.last.actual_us, 3000000);
+
+    timer_off(&stats, 1500, 120);
+    CHECK_EQ("混合後開啟次數", stats.activations, 2);
+    CHECK_EQ("混合後提前關閉次數", stats.early_stops, 1);
+    CHECK_EQ("混合後計時關閉次數", stats.timer_offs, 1);
+    CHECK_EQ("混合後誤差下限", stats.jitter_min_us, 120);
+}
+
+int main(void)
+{
+    test_jitter_bucket_edges();
+    test_on_time_bucket_edges();
+    test_bound_violations();
+    test_early_stops();
+
+    printf("%s: %d 項檢查，%d 項失敗\n", failures ? "FAIL" : "PASS", checks, failures);
+    return failures ? 1 : 0;
+}